@@ -0,0 +1,251 @@
+/*
+ * Throughput of the JSON command ingest path (json_command_process).
+ *
+ * Feeds a stream of data updates (synthetic uint16/int16/int32/uint32/float
+ * updates in LE/BE/SWAP order, or a recorded file with one command per
+ * line) through the command pipeline twice:
+ *   - in_process: straight calls, as the cost floor of parsing and applying
+ *   - stdin_pipe: written by a thread into a pipe that replaces stdin and
+ *     read back with platform_read_stdin() like the server loop does
+ * Each prints one JSON line with updates/s, ns/update and the cJSON
+ * allocations per update (counted through cJSON_InitHooks).
+ * Status lines the commands print go to /dev/null, results to the original
+ * stdout.
+ *
+ * Usage: json-ingest-bench [updates] [recorded.jsonl]
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // fdopen
+#endif
+#include "json/json_command.h"
+#include "utils/platform.h"
+#include "cJSON.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NB_REGISTERS 10000
+#define LINE_MAX_LENGTH 65536   // Server stdin buffer size
+
+typedef struct {
+    char *data;
+    size_t len;
+    int nb_lines;
+} Stream;
+
+static size_t nb_allocs;
+static size_t alloc_bytes;
+
+static void* counting_malloc(size_t size) {
+    nb_allocs++;
+    alloc_bytes += size;
+    return malloc(size);
+}
+
+static void append_line(Stream *s, size_t *cap, const char *line) {
+    size_t n = strlen(line);
+    if (s->len + n + 1 > *cap) {
+        *cap = (*cap + n + 1) * 2;
+        s->data = (char *)realloc(s->data, *cap);
+    }
+    memcpy(s->data + s->len, line, n);
+    s->len += n;
+    if (n == 0 || line[n - 1] != '\n') {
+        s->data[s->len++] = '\n';
+    }
+    s->nb_lines++;
+}
+
+// datatype NULL mixes all of them
+static void generate(Stream *s, int nb_updates, const char *datatype, unsigned int seed) {
+    static const char *datatypes[] = {"uint16", "int16", "uint32", "int32", "float", "uint64", "double"};
+    static const char *orders[] = {"LE", "BE", "SWAP", "BE_SWAP"};
+    size_t cap = 0;
+    char line[LINE_MAX_LENGTH];
+    
+    srand(seed);
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; i < nb_updates; i++) {
+        const char *type = datatype ? datatype : datatypes[rand() % 7];
+        const char *order = orders[rand() % 4];
+        int address = rand() % (NB_REGISTERS - 3);
+        if (strcmp(type, "float") == 0 || strcmp(type, "double") == 0) {
+            snprintf(line, sizeof(line),
+                     "{\"type\":\"holding\",\"address\":%d,\"datatype\":\"%s\",\"byte_order\":\"%s\",\"value\":%.4f}",
+                     address, type, order, (double)(rand() % 2000000) / 1000.0 - 1000.0);
+        } else {
+            long long value = strcmp(type, "int16") == 0 ? rand() % 65536 - 32768 :
+                              strcmp(type, "int32") == 0 ? (long long)(rand() % 2000000) - 1000000 :
+                              strcmp(type, "uint32") == 0 ? (long long)(rand() % 4000000) :
+                              strcmp(type, "uint64") == 0 ? (long long)rand() * 65536 : rand() % 65536;
+            snprintf(line, sizeof(line),
+                     "{\"type\":\"holding\",\"address\":%d,\"datatype\":\"%s\",\"byte_order\":\"%s\",\"value\":%lld}",
+                     address, type, order, value);
+        }
+        append_line(s, &cap, line);
+    }
+}
+
+static int load(Stream *s, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    size_t cap = 0;
+    char line[LINE_MAX_LENGTH];
+    memset(s, 0, sizeof(*s));
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] != '\n') {
+            append_line(s, &cap, line);
+        }
+    }
+    fclose(f);
+    return s->nb_lines > 0 ? 0 : -1;
+}
+
+static void report(FILE *out, const char *path, const char *stream, int nb_updates, uint64_t elapsed_us) {
+    double elapsed_s = (double)elapsed_us / 1e6;
+    fprintf(out, "{\"path\":\"%s\",\"stream\":\"%s\",\"updates\":%d,\"updates_per_s\":%.0f,"
+            "\"ns_per_update\":%.1f,\"allocs_per_update\":%.2f,\"alloc_bytes_per_update\":%.1f}\n",
+            path, stream, nb_updates, elapsed_s > 0 ? nb_updates / elapsed_s : 0.0,
+            (double)elapsed_us * 1000.0 / nb_updates,
+            (double)nb_allocs / nb_updates, (double)alloc_bytes / nb_updates);
+    fflush(out);
+}
+
+static void run_in_process(FILE *out, const char *name, const Stream *s, ModbusBackend *backend) {
+    ServerState state = STATE_RUNNING;
+    bool running = true;
+    char line[LINE_MAX_LENGTH];
+    
+    nb_allocs = alloc_bytes = 0;
+    uint64_t start = platform_monotonic_us();
+    const char *p = s->data;
+    const char *end = s->data + s->len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        size_t n = (size_t)(nl - p) + 1;
+        if (n >= sizeof(line)) n = sizeof(line) - 1;
+        memcpy(line, p, n);
+        line[n] = '\0';
+        json_command_process(line, backend, &state, &running);
+        p = nl + 1;
+    }
+    report(out, "in_process", name, s->nb_lines, platform_monotonic_us() - start);
+}
+
+typedef struct {
+    const Stream *stream;
+    int fd;
+} Writer;
+
+static void* writer_thread(void *arg) {
+    Writer *w = (Writer *)arg;
+    size_t off = 0;
+    while (off < w->stream->len) {
+        ssize_t n = write(w->fd, w->stream->data + off, w->stream->len - off);
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    close(w->fd);
+    return NULL;
+}
+
+static int run_stdin_pipe(FILE *out, const char *name, const Stream *s, ModbusBackend *backend) {
+    ServerState state = STATE_RUNNING;
+    bool running = true;
+    char buf[LINE_MAX_LENGTH];
+    int fds[2];
+    
+    if (pipe(fds) != 0 || dup2(fds[0], STDIN_FILENO) < 0) {
+        return -1;
+    }
+    close(fds[0]);
+    clearerr(stdin);
+    
+    Writer writer = {s, fds[1]};
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer_thread, &writer);
+    
+    // Same stdin handling as the server loop, minus the sockets
+    nb_allocs = alloc_bytes = 0;
+    int nb_updates = 0;
+    uint64_t start = platform_monotonic_us();
+    for (;;) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(STDIN_FILENO, &rfds);
+        struct timeval tv = {.tv_sec = 0, .tv_usec = 100000};
+        select(STDIN_FILENO + 1, &rfds, NULL, NULL, &tv);
+        
+        int n = platform_read_stdin(buf, sizeof(buf), 0);
+        if (n > 0) {
+            json_command_process(buf, backend, &state, &running);
+            nb_updates++;
+        } else if (feof(stdin)) {
+            break;
+        }
+    }
+    uint64_t elapsed = platform_monotonic_us() - start;
+    pthread_join(thread, NULL);
+    
+    report(out, "stdin_pipe", name, nb_updates, elapsed);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int nb_updates = (argc > 1) ? atoi(argv[1]) : 200000;
+    const char *recorded = (argc > 2) ? argv[2] : NULL;
+    if (nb_updates < 1) nb_updates = 1;
+    
+    static uint16_t registers[NB_REGISTERS];
+    static modbus_mapping_t mapping;
+    static ModbusBackend backend;
+    mapping.nb_registers = NB_REGISTERS;
+    mapping.tab_registers = registers;
+    backend.mapping = &mapping;
+    backend.tcp_listen_sock = -1;
+    backend.rtu_tcp_listen_sock = -1;
+    backend.udp_sock = -1;
+    backend.metrics_listen_sock = -1;
+    mapping_lock_init(&backend.mapping_lock);
+    
+    cJSON_Hooks hooks = {counting_malloc, free};
+    cJSON_InitHooks(&hooks);
+    
+    // Results on the real stdout, command replies discarded
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "Failed to redirect stdout\n");
+        return 1;
+    }
+    
+    static const char *streams[] = {"uint16", "int32", "float", "double", NULL};
+    static Stream stream;
+    int nb_streams = recorded ? 1 : (int)(sizeof(streams) / sizeof(streams[0]));
+    for (int i = 0; i < nb_streams; i++) {
+        const char *name = recorded ? recorded : (streams[i] ? streams[i] : "mixed");
+        if (recorded) {
+            if (load(&stream, recorded) != 0) {
+                fprintf(stderr, "Failed to read commands from %s\n", recorded);
+                return 1;
+            }
+        } else {
+            generate(&stream, nb_updates, streams[i], 1);
+        }
+        
+        run_in_process(out, name, &stream, &backend);
+        if (run_stdin_pipe(out, name, &stream, &backend) != 0) {
+            fprintf(stderr, "Failed to set up the stdin pipe\n");
+            return 1;
+        }
+        free(stream.data);
+    }
+    
+    mapping_lock_destroy(&backend.mapping_lock);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,542 @@
+/*
+ * Load generator for a running Modbus TCP server.
+ *
+ * Opens N connections, each driven by its own thread that keeps a fixed
+ * number of requests in flight (closed loop): every response received is
+ * replaced by a new request drawn from the function-code mix. Prints one
+ * JSON line with requests/s and latency percentiles from an HDR-style
+ * histogram (about 3% precision).
+ *
+ * With --scenarios it launches the given modbus-server binary on loopback
+ * with a generated config and runs a set of canned scenarios against it.
+ *
+ * Usage: modbus-bench [options]
+ *   -H host          Server address (127.0.0.1)
+ *   -p port          Server port (1502)
+ *   -c connections   Concurrent connections (8)
+ *   -d depth         Requests in flight per connection (1)
+ *   -t seconds       Measured duration (5)
+ *   -u unit          Unit id (1)
+ *   -m mix           Function-code weights, e.g. 3:70,4:10,16:10,23:10 (3:100)
+ *   -s min:max       Registers per request (10:10)
+ *   -r start:count   Holding register range to address (0:10000)
+ *   -i start:count   Input register range to address (0:10000)
+ *   --scenarios path Run canned scenarios against a launched server
+ *   --workers n      tcp_workers of the launched server (0)
+ */
+#define _GNU_SOURCE
+#include "utils/histogram.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define MAX_DEPTH 256
+#define MAX_MIX 4
+#define MBAP_HEADER_LENGTH 7
+#define MAX_ADU_LENGTH 260
+
+typedef struct {
+    int function;
+    int weight;
+} MixEntry;
+
+typedef struct {
+    char host[64];
+    int port;
+    int connections;
+    int depth;
+    int seconds;
+    int unit_id;
+    MixEntry mix[MAX_MIX];
+    int nb_mix;
+    int total_weight;
+    int min_count;
+    int max_count;
+    int holding_start;
+    int holding_count;
+    int input_start;
+    int input_count;
+} BenchConfig;
+
+typedef struct {
+    const BenchConfig *config;
+    atomic_bool *measuring;
+    atomic_bool *stop;
+    uint32_t seed;
+    uint64_t requests;
+    uint64_t errors;
+    bool failed;
+    Histogram latency;          // Nanoseconds
+} Client;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static int random_between(uint32_t *state, int min, int max) {
+    return min + (int)(next_random(state) % (uint32_t)(max - min + 1));
+}
+
+static int clamp_count(int count, int limit, int table_count) {
+    if (count > limit) count = limit;
+    if (count > table_count) count = table_count;
+    return count < 1 ? 1 : count;
+}
+
+static void put_u16(uint8_t *p, int value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+// Build one MBAP request, returns its length
+static int build_request(Client *c, uint16_t tid, uint8_t *out) {
+    const BenchConfig *cfg = c->config;
+    int pick = (int)(next_random(&c->seed) % (uint32_t)cfg->total_weight);
+    int function = cfg->mix[0].function;
+    for (int i = 0; i < cfg->nb_mix; i++) {
+        if (pick < cfg->mix[i].weight) {
+            function = cfg->mix[i].function;
+            break;
+        }
+        pick -= cfg->mix[i].weight;
+    }
+    
+    int size = random_between(&c->seed, cfg->min_count, cfg->max_count);
+    uint8_t *pdu = out + MBAP_HEADER_LENGTH;
+    int pdu_len;
+    pdu[0] = (uint8_t)function;
+    
+    switch (function) {
+    case 4: {
+        int count = clamp_count(size, 125, cfg->input_count);
+        put_u16(pdu + 1, cfg->input_start + random_between(&c->seed, 0, cfg->input_count - count));
+        put_u16(pdu + 3, count);
+        pdu_len = 5;
+        break;
+    }
+    case 16: {
+        int count = clamp_count(size, 123, cfg->holding_count);
+        put_u16(pdu + 1, cfg->holding_start + random_between(&c->seed, 0, cfg->holding_count - count));
+        put_u16(pdu + 3, count);
+        pdu[5] = (uint8_t)(count * 2);
+        for (int i = 0; i < count; i++) {
+            put_u16(pdu + 6 + 2 * i, (int)(next_random(&c->seed) & 0xFFFF));
+        }
+        pdu_len = 6 + count * 2;
+        break;
+    }
+    case 23: {
+        int nb_read = clamp_count(size, 125, cfg->holding_count);
+        int nb_write = clamp_count(size, 121, cfg->holding_count);
+        put_u16(pdu + 1, cfg->holding_start + random_between(&c->seed, 0, cfg->holding_count - nb_read));
+        put_u16(pdu + 3, nb_read);
+        put_u16(pdu + 5, cfg->holding_start + random_between(&c->seed, 0, cfg->holding_count - nb_write));
+        put_u16(pdu + 7, nb_write);
+        pdu[9] = (uint8_t)(nb_write * 2);
+        for (int i = 0; i < nb_write; i++) {
+            put_u16(pdu + 10 + 2 * i, (int)(next_random(&c->seed) & 0xFFFF));
+        }
+        pdu_len = 10 + nb_write * 2;
+        break;
+    }
+    default: {
+        int count = clamp_count(size, 125, cfg->holding_count);
+        pdu[0] = 3;
+        put_u16(pdu + 1, cfg->holding_start + random_between(&c->seed, 0, cfg->holding_count - count));
+        put_u16(pdu + 3, count);
+        pdu_len = 5;
+        break;
+    }
+    }
+    
+    put_u16(out, tid);
+    put_u16(out + 2, 0);
+    put_u16(out + 4, pdu_len + 1);
+    out[6] = (uint8_t)cfg->unit_id;
+    return MBAP_HEADER_LENGTH + pdu_len;
+}
+
+static int connect_to(const char *host, int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        return -1;
+    }
+    
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return sock;
+}
+
+static void* client_thread(void *arg) {
+    Client *c = (Client *)arg;
+    const BenchConfig *cfg = c->config;
+    uint64_t sent_ns[MAX_DEPTH];
+    uint8_t out[MAX_DEPTH * MAX_ADU_LENGTH];
+    uint8_t in[MAX_DEPTH * MAX_ADU_LENGTH];
+    int in_len = 0;
+    uint16_t tid = 0;
+    
+    int sock = connect_to(cfg->host, cfg->port);
+    if (sock < 0) {
+        c->failed = true;
+        return NULL;
+    }
+    
+    // Fill the window, then replace each response with a new request
+    int to_send = cfg->depth;
+    while (!atomic_load(c->stop)) {
+        int out_len = 0;
+        uint64_t now = now_ns();
+        for (int i = 0; i < to_send; i++, tid++) {
+            sent_ns[tid % MAX_DEPTH] = now;
+            out_len += build_request(c, tid, out + out_len);
+        }
+        if (out_len > 0 && send(sock, out, (size_t)out_len, MSG_NOSIGNAL) != out_len) {
+            c->failed = true;
+            break;
+        }
+        
+        ssize_t rc = recv(sock, in + in_len, sizeof(in) - (size_t)in_len, 0);
+        if (rc <= 0) {
+            c->failed = true;
+            break;
+        }
+        in_len += (int)rc;
+        now = now_ns();
+        bool measuring = atomic_load(c->measuring);
+        
+        int offset = 0;
+        to_send = 0;
+        while (in_len - offset >= MBAP_HEADER_LENGTH) {
+            const uint8_t *rsp = in + offset;
+            int length = (rsp[4] << 8) | rsp[5];
+            if (length < 2 || length > MAX_ADU_LENGTH - 6) {
+                c->failed = true;
+                break;
+            }
+            if (in_len - offset < 6 + length) {
+                break;
+            }
+            uint16_t rsp_tid = (uint16_t)((rsp[0] << 8) | rsp[1]);
+            if (measuring) {
+                c->requests++;
+                if (rsp[7] & 0x80) {
+                    c->errors++;
+                }
+                histogram_record(&c->latency, now - sent_ns[rsp_tid % MAX_DEPTH]);
+            }
+            offset += 6 + length;
+            to_send++;
+        }
+        if (c->failed) break;
+        memmove(in, in + offset, (size_t)(in_len - offset));
+        in_len -= offset;
+    }
+    
+    close(sock);
+    return NULL;
+}
+
+// Run one load pass and print its JSON line, -1 if no connection worked
+static int run(const BenchConfig *cfg, const char *scenario, const char *mix_text) {
+    Client *clients = (Client *)calloc((size_t)cfg->connections, sizeof(Client));
+    pthread_t *threads = (pthread_t *)calloc((size_t)cfg->connections, sizeof(pthread_t));
+    atomic_bool measuring = false;
+    atomic_bool stop = false;
+    if (!clients || !threads) {
+        free(clients);
+        free(threads);
+        return -1;
+    }
+    
+    for (int i = 0; i < cfg->connections; i++) {
+        clients[i].config = cfg;
+        clients[i].measuring = &measuring;
+        clients[i].stop = &stop;
+        clients[i].seed = 2463534242u + (uint32_t)i * 7919u;
+        histogram_init(&clients[i].latency);
+        pthread_create(&threads[i], NULL, client_thread, &clients[i]);
+    }
+    
+    // Warm up before measuring
+    usleep(300000);
+    atomic_store(&measuring, true);
+    uint64_t start = now_ns();
+    usleep((useconds_t)cfg->seconds * 1000000);
+    atomic_store(&measuring, false);
+    double elapsed_s = (double)(now_ns() - start) / 1e9;
+    atomic_store(&stop, true);
+    
+    static Histogram latency;
+    histogram_init(&latency);
+    uint64_t requests = 0, errors = 0;
+    int failed = 0;
+    for (int i = 0; i < cfg->connections; i++) {
+        pthread_join(threads[i], NULL);
+        histogram_merge(&latency, &clients[i].latency);
+        requests += clients[i].requests;
+        errors += clients[i].errors;
+        if (clients[i].failed) failed++;
+    }
+    free(clients);
+    free(threads);
+    
+    if (failed == cfg->connections) {
+        fprintf(stderr, "No connection to %s:%d succeeded\n", cfg->host, cfg->port);
+        return -1;
+    }
+    
+    printf("{\"scenario\":\"%s\",\"connections\":%d,\"depth\":%d,\"mix\":\"%s\","
+           "\"registers\":\"%d:%d\",\"seconds\":%.2f,\"requests\":%llu,\"exceptions\":%llu,"
+           "\"failed_connections\":%d,\"requests_per_s\":%.0f,"
+           "\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+           "\"p99.9\":%.1f,\"p99.99\":%.1f,\"max\":%.1f}}\n",
+           scenario, cfg->connections, cfg->depth, mix_text, cfg->min_count, cfg->max_count,
+           elapsed_s, (unsigned long long)requests, (unsigned long long)errors, failed,
+           (double)requests / elapsed_s,
+           latency.total ? (double)latency.min / 1e3 : 0.0, histogram_mean(&latency) / 1e3,
+           (double)histogram_percentile(&latency, 50.0) / 1e3,
+           (double)histogram_percentile(&latency, 90.0) / 1e3,
+           (double)histogram_percentile(&latency, 99.0) / 1e3,
+           (double)histogram_percentile(&latency, 99.9) / 1e3,
+           (double)histogram_percentile(&latency, 99.99) / 1e3,
+           (double)latency.max / 1e3);
+    fflush(stdout);
+    return 0;
+}
+
+static int parse_mix(BenchConfig *cfg, const char *text) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", text);
+    cfg->nb_mix = 0;
+    cfg->total_weight = 0;
+    
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int function, weight = 1;
+        if (sscanf(tok, "%d:%d", &function, &weight) < 1 || weight < 0 || cfg->nb_mix == MAX_MIX ||
+            (function != 3 && function != 4 && function != 16 && function != 23)) {
+            fprintf(stderr, "Invalid mix '%s' (FC 3, 4, 16, 23 with weights)\n", text);
+            return -1;
+        }
+        cfg->mix[cfg->nb_mix].function = function;
+        cfg->mix[cfg->nb_mix].weight = weight;
+        cfg->nb_mix++;
+        cfg->total_weight += weight;
+    }
+    return cfg->total_weight > 0 ? 0 : -1;
+}
+
+static int parse_pair(const char *text, int *a, int *b) {
+    return sscanf(text, "%d:%d", a, b) == 2 ? 0 : -1;
+}
+
+// Start modbus-server on loopback with a generated config, stdin kept as a pipe
+static pid_t launch_server(const char *path, int port, int workers, int *stdin_fd, char *config_path) {
+    strcpy(config_path, "/tmp/modbus-bench-XXXXXX");
+    int fd = mkstemp(config_path);
+    if (fd < 0) {
+        return -1;
+    }
+    FILE *f = fdopen(fd, "w");
+    fprintf(f, "{\"mode\":\"tcp\",\"tcp_port\":%d,\"tcp_workers\":%d,"
+            "\"coils\":{\"start_address\":0,\"count\":16},"
+            "\"input_bits\":{\"start_address\":0,\"count\":16},"
+            "\"holding_registers\":{\"start_address\":0,\"count\":10000},"
+            "\"input_registers\":{\"start_address\":0,\"count\":10000}}\n",
+            port, workers);
+    fclose(f);
+    
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        unlink(config_path);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(pipe_fds[0], STDIN_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        if (!freopen("/dev/null", "w", stdout)) {
+            _exit(127);
+        }
+        execl(path, path, config_path, (char *)NULL);
+        _exit(127);
+    }
+    close(pipe_fds[0]);
+    if (pid < 0) {
+        close(pipe_fds[1]);
+        unlink(config_path);
+        return -1;
+    }
+    *stdin_fd = pipe_fds[1];
+    
+    // Wait until it accepts connections
+    for (int i = 0; i < 100; i++) {
+        int sock = connect_to("127.0.0.1", port);
+        if (sock >= 0) {
+            close(sock);
+            return pid;
+        }
+        if (waitpid(pid, NULL, WNOHANG) == pid) {
+            break;
+        }
+        usleep(50000);
+    }
+    fprintf(stderr, "%s did not start listening on port %d\n", path, port);
+    close(*stdin_fd);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(config_path);
+    return -1;
+}
+
+typedef struct {
+    const char *name;
+    int connections;
+    int depth;
+    const char *mix;
+    int min_count;
+    int max_count;
+} Scenario;
+
+static const Scenario scenarios[] = {
+    {"read_latency",    1,  1, "3:100",               10,  10},
+    {"read_throughput", 16, 16, "3:100",              10,  10},
+    {"large_reads",     8,  4, "3:50,4:50",           125, 125},
+    {"mixed",           16, 8, "3:50,4:20,16:20,23:10", 1, 64},
+    {"write_heavy",     8,  8, "16:80,23:20",         1,   100},
+};
+
+static int run_scenarios(BenchConfig *base, const char *server, int workers) {
+    char config_path[64];
+    int stdin_fd;
+    pid_t pid = launch_server(server, base->port, workers, &stdin_fd, config_path);
+    if (pid < 0) {
+        return 1;
+    }
+    
+    int rc = 0;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]) && rc == 0; i++) {
+        const Scenario *s = &scenarios[i];
+        BenchConfig cfg = *base;
+        strcpy(cfg.host, "127.0.0.1");
+        cfg.connections = s->connections;
+        cfg.depth = s->depth;
+        cfg.min_count = s->min_count;
+        cfg.max_count = s->max_count;
+        cfg.holding_start = 0;
+        cfg.holding_count = 10000;
+        cfg.input_start = 0;
+        cfg.input_count = 10000;
+        parse_mix(&cfg, s->mix);
+        if (run(&cfg, s->name, s->mix) != 0) {
+            rc = 1;
+        }
+    }
+    
+    // EOF on stdin stops the server
+    close(stdin_fd);
+    waitpid(pid, NULL, 0);
+    unlink(config_path);
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    static BenchConfig cfg;
+    const char *mix_text = "3:100";
+    const char *server = NULL;
+    int workers = 0;
+    
+    strcpy(cfg.host, "127.0.0.1");
+    cfg.port = 1502;
+    cfg.connections = 8;
+    cfg.depth = 1;
+    cfg.seconds = 5;
+    cfg.unit_id = 1;
+    cfg.min_count = cfg.max_count = 10;
+    cfg.holding_start = cfg.input_start = 0;
+    cfg.holding_count = cfg.input_count = 10000;
+    
+    static const struct option long_options[] = {
+        {"scenarios", required_argument, NULL, 'S'},
+        {"workers", required_argument, NULL, 'W'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "H:p:c:d:t:u:m:s:r:i:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'H': snprintf(cfg.host, sizeof(cfg.host), "%s", optarg); break;
+        case 'p': cfg.port = atoi(optarg); break;
+        case 'c': cfg.connections = atoi(optarg); break;
+        case 'd': cfg.depth = atoi(optarg); break;
+        case 't': cfg.seconds = atoi(optarg); break;
+        case 'u': cfg.unit_id = atoi(optarg); break;
+        case 'm': mix_text = optarg; break;
+        case 's':
+            if (parse_pair(optarg, &cfg.min_count, &cfg.max_count) != 0) goto usage;
+            break;
+        case 'r':
+            if (parse_pair(optarg, &cfg.holding_start, &cfg.holding_count) != 0) goto usage;
+            break;
+        case 'i':
+            if (parse_pair(optarg, &cfg.input_start, &cfg.input_count) != 0) goto usage;
+            break;
+        case 'S': server = optarg; break;
+        case 'W': workers = atoi(optarg); break;
+        default: goto usage;
+        }
+    }
+    if (cfg.connections < 1 || cfg.depth < 1 || cfg.depth > MAX_DEPTH || cfg.seconds < 1 ||
+        cfg.min_count < 1 || cfg.max_count < cfg.min_count ||
+        cfg.holding_count < 1 || cfg.input_count < 1 || parse_mix(&cfg, mix_text) != 0) {
+        goto usage;
+    }
+    
+    if (server) {
+        return run_scenarios(&cfg, server, workers);
+    }
+    return run(&cfg, "custom", mix_text) == 0 ? 0 : 1;
+
+usage:
+    fprintf(stderr, "Usage: %s [-H host] [-p port] [-c connections] [-d depth (1-%d)] [-t seconds]\n"
+                    "          [-u unit] [-m 3:70,4:10,16:10,23:10] [-s min:max registers]\n"
+                    "          [-r holding start:count] [-i input start:count]\n"
+                    "          [--scenarios path/to/modbus-server [--workers n]]\n",
+            argv[0], MAX_DEPTH);
+    return 2;
+}
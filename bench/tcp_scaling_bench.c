@@ -0,0 +1,187 @@
+/*
+ * Requests/s of the SO_REUSEPORT TCP workers versus the number of workers,
+ * for the epoll backend and, when built with HAVE_LIBURING, io_uring.
+ *
+ * Starts a worker pool on a loopback port, drives it with blocking client
+ * threads (one connection each, pipelined FC3 reads) for a fixed time and
+ * prints one JSON line per backend and worker count. Clients share the
+ * machine with the workers, so give it more cores than workers for
+ * meaningful numbers.
+ *
+ * Usage: tcp-scaling-bench [max_workers] [connections] [pipeline] [seconds] [port]
+ */
+#define _GNU_SOURCE
+#include "adapters/tcp_worker.h"
+#include "utils/platform.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define NB_REGISTERS 1000
+#define READ_COUNT 10
+#define REQUEST_LENGTH 12
+#define RESPONSE_LENGTH (9 + 2 * READ_COUNT)
+
+typedef struct {
+    int port;
+    int pipeline;
+    volatile bool *stop;
+    uint64_t requests;
+    bool failed;
+} Client;
+
+static void* client_thread(void *arg) {
+    Client *c = (Client *)arg;
+    uint8_t req[REQUEST_LENGTH * 64];
+    uint8_t rsp[RESPONSE_LENGTH * 64];
+    int batch = REQUEST_LENGTH * c->pipeline;
+    int expected = RESPONSE_LENGTH * c->pipeline;
+    
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)c->port);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        c->failed = true;
+        if (sock >= 0) close(sock);
+        return NULL;
+    }
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    
+    for (int i = 0; i < c->pipeline; i++) {
+        uint8_t *r = req + i * REQUEST_LENGTH;
+        int address = (i * READ_COUNT) % (NB_REGISTERS - READ_COUNT);
+        r[0] = 0; r[1] = (uint8_t)i;                // Transaction id
+        r[2] = 0; r[3] = 0;                         // Protocol id
+        r[4] = 0; r[5] = 6;                         // Length
+        r[6] = 1;                                   // Unit id
+        r[7] = 3;
+        r[8] = (uint8_t)(address >> 8); r[9] = (uint8_t)address;
+        r[10] = 0; r[11] = READ_COUNT;
+    }
+    
+    while (!*c->stop) {
+        if (send(sock, req, (size_t)batch, MSG_NOSIGNAL) != batch) {
+            c->failed = true;
+            break;
+        }
+        int got = 0;
+        while (got < expected) {
+            ssize_t rc = recv(sock, rsp + got, (size_t)(expected - got), 0);
+            if (rc <= 0) {
+                c->failed = true;
+                break;
+            }
+            got += (int)rc;
+        }
+        if (c->failed) break;
+        c->requests += (uint64_t)c->pipeline;
+    }
+    
+    close(sock);
+    return NULL;
+}
+
+static double run(modbus_mapping_t *mapping, MappingLock *lock, TcpBackend backend, int workers,
+                  int connections, int pipeline, int seconds, int port) {
+    TcpWorkerPool *pool = tcp_worker_pool_create(mapping, lock, NULL, NULL, NULL, NULL, port, workers, backend);
+    if (!pool) {
+        return -1.0;
+    }
+    if (tcp_worker_pool_backend(pool) != backend) {
+        tcp_worker_pool_destroy(pool);
+        return -2.0;
+    }
+    
+    volatile bool stop = false;
+    Client *clients = (Client *)calloc((size_t)connections, sizeof(Client));
+    pthread_t *threads = (pthread_t *)calloc((size_t)connections, sizeof(pthread_t));
+    for (int i = 0; i < connections; i++) {
+        clients[i].port = port;
+        clients[i].pipeline = pipeline;
+        clients[i].stop = &stop;
+        pthread_create(&threads[i], NULL, client_thread, &clients[i]);
+    }
+    
+    // Let connections establish before measuring
+    platform_msleep(200);
+    uint64_t start_requests = tcp_worker_pool_requests(pool);
+    uint64_t start_us = platform_monotonic_us();
+    platform_msleep(seconds * 1000);
+    uint64_t requests = tcp_worker_pool_requests(pool) - start_requests;
+    uint64_t elapsed_us = platform_monotonic_us() - start_us;
+    
+    stop = true;
+    int failed = 0;
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        if (clients[i].failed) failed++;
+    }
+    tcp_worker_pool_destroy(pool);
+    free(clients);
+    free(threads);
+    
+    if (failed > 0) {
+        fprintf(stderr, "%d client connections failed\n", failed);
+    }
+    return (double)requests * 1e6 / (double)elapsed_us;
+}
+
+int main(int argc, char *argv[]) {
+    int max_workers = (argc > 1) ? atoi(argv[1]) : platform_get_nprocs();
+    int connections = (argc > 2) ? atoi(argv[2]) : 32;
+    int pipeline = (argc > 3) ? atoi(argv[3]) : 8;
+    int seconds = (argc > 4) ? atoi(argv[4]) : 3;
+    int port = (argc > 5) ? atoi(argv[5]) : 15502;
+    if (pipeline < 1) pipeline = 1;
+    if (pipeline > 64) pipeline = 64;
+    
+    static uint16_t registers[NB_REGISTERS];
+    static modbus_mapping_t mapping;
+    static MappingLock lock;
+    for (int i = 0; i < NB_REGISTERS; i++) {
+        registers[i] = (uint16_t)i;
+    }
+    mapping.nb_registers = NB_REGISTERS;
+    mapping.tab_registers = registers;
+    mapping_lock_init(&lock);
+    
+    static const TcpBackend backends[] = {TCP_BACKEND_EPOLL, TCP_BACKEND_IO_URING};
+    static const char *backend_names[] = {"epoll", "io_uring"};
+    double epoll_rate[32] = {0};
+    
+    for (int b = 0; b < 2; b++) {
+        double base = 0.0;
+        for (int workers = 1, step = 0; workers <= max_workers && step < 32; workers *= 2, step++) {
+            double rate = run(&mapping, &lock, backends[b], workers, connections, pipeline, seconds, port);
+            if (rate == -2.0) {
+                fprintf(stderr, "%s backend not available, skipping\n", backend_names[b]);
+                break;
+            }
+            if (rate < 0) {
+                fprintf(stderr, "Failed to start %d workers on port %d\n", workers, port);
+                return 1;
+            }
+            if (workers == 1) base = rate;
+            if (b == 0) epoll_rate[step] = rate;
+            printf("{\"backend\":\"%s\",\"workers\":%d,\"connections\":%d,\"pipeline\":%d,"
+                   "\"requests_per_s\":%.0f,\"speedup\":%.2f,\"vs_epoll\":%.2f}\n",
+                   backend_names[b], workers, connections, pipeline, rate,
+                   base > 0 ? rate / base : 0.0,
+                   epoll_rate[step] > 0 ? rate / epoll_rate[step] : 0.0);
+            fflush(stdout);
+        }
+    }
+    
+    mapping_lock_destroy(&lock);
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Write latency and throughput of the write-ahead log per durability level.
+ *
+ * Writer threads stand in for clients: each sends FC6 writes through the
+ * PDU engine one at a time and waits for its "response" (wal_wait) before
+ * the next, as a client waits for its answer. Levels:
+ *   - off: no log, the cost floor of the write path
+ *   - async: answered at once, synced by group commit in the background
+ *   - sync: answered once the commit holding the write is synced, for
+ *     each commit interval given
+ * Prints one JSON line per level with writes/s, latency percentiles and
+ * the average number of writes per fdatasync. Point the log directory at
+ * the storage that matters (the SD card on a Pi): sync cost is the point.
+ * One writer gives the sync-mode bound of the main-loop transports, which
+ * wait for each commit in place.
+ *
+ * Usage: wal-bench [writers] [seconds] [directory] [sync intervals ms, comma separated]
+ */
+#include "core/modbus_pdu.h"
+#include "core/wal.h"
+#include "utils/histogram.h"
+#include "utils/platform.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NB_REGISTERS 1000
+#define MAX_WRITERS 64
+#define MAX_LEVELS 16
+
+typedef struct {
+    modbus_mapping_t *mapping;
+    MappingLock *lock;
+    Wal *wal;
+    int id;
+    volatile bool *stop;
+    uint64_t writes;
+    Histogram latency;      // ns
+} Writer;
+
+typedef struct {
+    const char *name;
+    bool logged;
+    WalMode mode;
+    int interval_ms;
+} Level;
+
+static void* writer_thread(void *arg) {
+    Writer *w = (Writer *)arg;
+    uint8_t req[5] = {MODBUS_FC_WRITE_SINGLE_REGISTER, 0, 0, 0, 0};
+    uint8_t rsp[MODBUS_PDU_MAX_LENGTH];
+    int address = w->id % NB_REGISTERS;
+    
+    while (!*w->stop) {
+        req[1] = (uint8_t)(address >> 8);
+        req[2] = (uint8_t)address;
+        req[3] = (uint8_t)(w->writes >> 8);
+        req[4] = (uint8_t)w->writes;
+        uint64_t start_ns = platform_monotonic_ns();
+        uint64_t lsn;
+        modbus_pdu_process(w->mapping, w->lock, w->wal, &lsn, req, sizeof(req), rsp);
+        wal_wait(w->wal, lsn);
+        histogram_record(&w->latency, platform_monotonic_ns() - start_ns);
+        w->writes++;
+        address = (address + MAX_WRITERS) % NB_REGISTERS;
+    }
+    return NULL;
+}
+
+static int run(const Level *level, modbus_mapping_t *mapping, MappingLock *lock, int nb_writers,
+               int seconds, const char *path) {
+    Wal *wal = NULL;
+    if (level->logged) {
+        remove(path);
+        wal = wal_open(path, mapping, 0, level->mode, level->interval_ms, NULL);
+        if (!wal) {
+            return -1;
+        }
+    }
+    
+    static Writer writers[MAX_WRITERS];
+    pthread_t threads[MAX_WRITERS];
+    volatile bool stop = false;
+    for (int i = 0; i < nb_writers; i++) {
+        writers[i] = (Writer){.mapping = mapping, .lock = lock, .wal = wal, .id = i, .stop = &stop};
+        histogram_init(&writers[i].latency);
+    }
+    
+    uint64_t start_us = platform_monotonic_us();
+    for (int i = 0; i < nb_writers; i++) {
+        pthread_create(&threads[i], NULL, writer_thread, &writers[i]);
+    }
+    platform_msleep(seconds * 1000);
+    stop = true;
+    for (int i = 0; i < nb_writers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed_s = (platform_monotonic_us() - start_us) / 1e6;
+    
+    static Histogram total;
+    histogram_init(&total);
+    uint64_t writes = 0;
+    for (int i = 0; i < nb_writers; i++) {
+        histogram_merge(&total, &writers[i].latency);
+        writes += writers[i].writes;
+    }
+    
+    uint64_t commits = wal_commits(wal);
+    wal_close(wal);
+    remove(path);
+    
+    printf("{\"level\":\"%s\",\"commit_interval_ms\":%d,\"writers\":%d,\"writes\":%llu,\"writes_per_s\":%.0f,"
+           "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f},"
+           "\"writes_per_sync\":%.1f}\n",
+           level->name, level->logged ? level->interval_ms : 0, nb_writers, (unsigned long long)writes,
+           writes / elapsed_s, histogram_mean(&total) / 1e3, histogram_percentile(&total, 50.0) / 1e3,
+           histogram_percentile(&total, 99.0) / 1e3, histogram_percentile(&total, 99.9) / 1e3,
+           total.max / 1e3, commits > 0 ? (double)writes / commits : 0.0);
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int nb_writers = (argc > 1) ? atoi(argv[1]) : 8;
+    int seconds = (argc > 2) ? atoi(argv[2]) : 3;
+    const char *dir = (argc > 3) ? argv[3] : ".";
+    const char *intervals = (argc > 4) ? argv[4] : "0,2,10";
+    if (nb_writers < 1) nb_writers = 1;
+    if (nb_writers > MAX_WRITERS) nb_writers = MAX_WRITERS;
+    
+    char path[512];
+    snprintf(path, sizeof(path), "%s/wal-bench.log", dir);
+    
+    static uint16_t registers[NB_REGISTERS];
+    static modbus_mapping_t mapping;
+    static MappingLock lock;
+    mapping.nb_registers = NB_REGISTERS;
+    mapping.tab_registers = registers;
+    mapping_lock_init(&lock);
+    
+    Level levels[MAX_LEVELS] = {
+        {"off", false, WAL_MODE_ASYNC, 0},
+        {"async", true, WAL_MODE_ASYNC, 10},
+    };
+    int nb_levels = 2;
+    char list[256];
+    snprintf(list, sizeof(list), "%s", intervals);
+    for (char *tok = strtok(list, ","); tok && nb_levels < MAX_LEVELS; tok = strtok(NULL, ",")) {
+        levels[nb_levels++] = (Level){"sync", true, WAL_MODE_SYNC, atoi(tok)};
+    }
+    
+    for (int i = 0; i < nb_levels; i++) {
+        if (run(&levels[i], &mapping, &lock, nb_writers, seconds, path) != 0) {
+            fprintf(stderr, "Failed to open a write-ahead log at %s\n", path);
+            return 1;
+        }
+    }
+    
+    mapping_lock_destroy(&lock);
+    return 0;
+}
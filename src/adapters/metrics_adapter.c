@@ -0,0 +1,223 @@
+#include "metrics_adapter.h"
+#include "../core/handoff.h"
+#include "../core/metrics.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+    #include <ws2tcpip.h>
+#else
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static int open_listener(int port) {
+    int sock = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        log_error("Metrics socket failed: %s", strerror(errno));
+        return -1;
+    }
+    
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, MAX_METRICS_CLIENTS) != 0) {
+        log_error("Metrics listen on port %d failed: %s", port, strerror(errno));
+        platform_close_fd(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int metrics_adapter_init(ModbusBackend *backend, const ModbusConfig *config) {
+    // Inherited from systemd or the server being upgraded, else bound here
+    int sock = handoff_take_listener(SOCK_STREAM, config->metrics_port);
+    if (sock < 0 && (sock = open_listener(config->metrics_port)) < 0) {
+        return -1;
+    }
+    platform_set_nonblocking(sock);
+    
+    backend->metrics_listen_sock = sock;
+    for (int i = 0; i < MAX_METRICS_CLIENTS; i++) {
+        backend->metrics_conns[i].sock = -1;
+        backend->metrics_conns[i].out = NULL;
+    }
+    
+    log_debug("Metrics endpoint listening on port %d", config->metrics_port);
+    return 0;
+}
+
+static void close_client(ModbusBackend *backend, int client_index) {
+    MetricsConn *conn = &backend->metrics_conns[client_index];
+    platform_close_fd(conn->sock);
+    free(conn->out);
+    conn->sock = -1;
+    conn->out = NULL;
+}
+
+int metrics_adapter_accept_client(ModbusBackend *backend) {
+    int new_conn = (int)accept(backend->metrics_listen_sock, NULL, NULL);
+    if (new_conn < 0) {
+        return -1;
+    }
+    
+    // A stalled scraper must not lock the endpoint: reuse the oldest slot
+    int slot = 0;
+    for (int i = 0; i < MAX_METRICS_CLIENTS; i++) {
+        if (backend->metrics_conns[i].sock == -1) {
+            slot = i;
+            break;
+        }
+        if (backend->metrics_conns[i].opened_us < backend->metrics_conns[slot].opened_us) {
+            slot = i;
+        }
+    }
+    if (backend->metrics_conns[slot].sock != -1) {
+        log_debug("Metrics clients exhausted, dropping the oldest (slot %d)", slot);
+        close_client(backend, slot);
+    }
+    platform_set_nonblocking(new_conn);
+    
+    MetricsConn *conn = &backend->metrics_conns[slot];
+    conn->sock = new_conn;
+    conn->len = 0;
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    conn->opened_us = platform_monotonic_us();
+    return slot;
+}
+
+static int respond(MetricsConn *conn, const char *status, const char *body, size_t body_len, bool head) {
+    char header[256];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %s\r\n"
+                     "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n",
+                     status, body_len);
+    if (head) {
+        body_len = 0;
+    }
+    
+    conn->out = (char *)malloc((size_t)n + body_len);
+    if (!conn->out) {
+        return -1;
+    }
+    memcpy(conn->out, header, (size_t)n);
+    memcpy(conn->out + n, body, body_len);
+    conn->out_len = (size_t)n + body_len;
+    conn->out_sent = 0;
+    return 0;
+}
+
+// Parse the request line once the headers are complete; 1 when a response is ready
+static int process_request(MetricsConn *conn, ModbusBackend *backend, const ModbusConfig *config) {
+    conn->buf[conn->len] = '\0';
+    if (!strstr(conn->buf, "\r\n\r\n") && !strstr(conn->buf, "\n\n")) {
+        if (conn->len < (int)sizeof(conn->buf) - 1) {
+            return 0;
+        }
+        static const char too_large[] = "Request too large\n";
+        return respond(conn, "431 Request Header Fields Too Large", too_large, sizeof(too_large) - 1, false) == 0 ? 1 : -1;
+    }
+    
+    char method[8] = {0};
+    char path[256] = {0};
+    sscanf(conn->buf, "%7s %255s", method, path);
+    char *query = strchr(path, '?');
+    if (query) *query = '\0';
+    
+    bool head = strcmp(method, "HEAD") == 0;
+    if (!head && strcmp(method, "GET") != 0) {
+        static const char not_allowed[] = "Method not allowed\n";
+        return respond(conn, "405 Method Not Allowed", not_allowed, sizeof(not_allowed) - 1, false) == 0 ? 1 : -1;
+    }
+    if (strcmp(path, "/metrics") != 0) {
+        static const char not_found[] = "Not found, try /metrics\n";
+        return respond(conn, "404 Not Found", not_found, sizeof(not_found) - 1, head) == 0 ? 1 : -1;
+    }
+    
+    size_t len = 0;
+    char *body = metrics_render(backend, config, &len);
+    if (!body) {
+        log_warn("Failed to render metrics");
+        return -1;
+    }
+    int rc = respond(conn, "200 OK", body, len, head);
+    free(body);
+    return rc == 0 ? 1 : -1;
+}
+
+int metrics_adapter_handle_client(ModbusBackend *backend, int client_index, const ModbusConfig *config) {
+    if (client_index < 0 || client_index >= MAX_METRICS_CLIENTS) {
+        return -1;
+    }
+    
+    MetricsConn *conn = &backend->metrics_conns[client_index];
+    if (conn->sock == -1) {
+        return -1;
+    }
+    
+    if (!conn->out) {
+        int rc = (int)recv(conn->sock, conn->buf + conn->len, sizeof(conn->buf) - 1 - (size_t)conn->len, 0);
+        if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            close_client(backend, client_index);
+            return -1;
+        }
+        if (rc < 0) {
+            return 0;
+        }
+        conn->len += rc;
+        
+        rc = process_request(conn, backend, config);
+        if (rc < 0) {
+            close_client(backend, client_index);
+            return -1;
+        }
+        if (rc == 0) {
+            return 0;
+        }
+    }
+    
+    // Most scrapes fit in the socket buffer; the rest goes out as the socket drains
+    while (conn->out_sent < conn->out_len) {
+        int rc = (int)send(conn->sock, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return 0;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        conn->out_sent += (size_t)rc;
+    }
+    close_client(backend, client_index);
+    return -1;
+}
+
+void metrics_adapter_cleanup(ModbusBackend *backend) {
+    if (!backend) return;
+    
+    for (int i = 0; i < MAX_METRICS_CLIENTS; i++) {
+        if (backend->metrics_conns[i].sock != -1) {
+            close_client(backend, i);
+        }
+    }
+    
+    if (backend->metrics_listen_sock != -1) {
+        platform_close_fd(backend->metrics_listen_sock);
+        backend->metrics_listen_sock = -1;
+    }
+}
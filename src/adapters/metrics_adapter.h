@@ -0,0 +1,40 @@
+#ifndef METRICS_ADAPTER_H
+#define METRICS_ADAPTER_H
+
+#include "../config/config.h"
+#include "modbus_backend.h"
+
+/**
+ * Initialize the HTTP listener serving GET /metrics (Prometheus text format).
+ * It runs in the main loop; metrics are only gathered when scraped.
+ * @param backend Pointer to ModbusBackend
+ * @param config Pointer to ModbusConfig
+ * @return 0 on success, -1 on failure
+ */
+int metrics_adapter_init(ModbusBackend *backend, const ModbusConfig *config);
+
+/**
+ * Accept a pending scrape connection. When all slots are taken the oldest
+ * connection is dropped.
+ * @param backend Pointer to ModbusBackend
+ * @return Slot index on success, -1 on failure
+ */
+int metrics_adapter_accept_client(ModbusBackend *backend);
+
+/**
+ * Read the request of a scrape connection, or send more of its response.
+ * The connection is closed once the response is sent.
+ * @param backend Pointer to ModbusBackend
+ * @param client_index Index of client in metrics_conns array
+ * @param config Pointer to ModbusConfig
+ * @return 0 while the connection stays open, -1 once closed
+ */
+int metrics_adapter_handle_client(ModbusBackend *backend, int client_index, const ModbusConfig *config);
+
+/**
+ * Cleanup metrics listener resources
+ * @param backend Pointer to ModbusBackend
+ */
+void metrics_adapter_cleanup(ModbusBackend *backend);
+
+#endif // METRICS_ADAPTER_H
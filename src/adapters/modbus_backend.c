@@ -15,10 +15,56 @@ ModbusBackend* modbus_backend_create(void) {
     backend->mapping = NULL;
     backend->tcp_listen_sock = -1;
     backend->tcp_conn_count = 0;
+    backend->unit_id = 1;
+    backend->rtu_tcp_listen_sock = -1;
+    backend->rtu_tcp_conn_count = 0;
+    backend->udp_sock = -1;
+    backend->udp_batch = NULL;
+    backend->tcp_workers = NULL;
+    backend->poller = NULL;
+    backend->snapshotter = NULL;
+    backend->wal = NULL;
+    backend->image = NULL;
+    backend->watch = NULL;
+    backend->tags = NULL;
+    backend->scales = NULL;
+    backend->reload_requested = false;
+    backend->upgrade_requested = false;
+    backend->metrics_listen_sock = -1;
     
-    // Initialize TCP client array
+    if (mapping_lock_init(&backend->mapping_lock) != 0) {
+        log_error("Failed to initialize mapping lock");
+        free(backend);
+        return NULL;
+    }
+    
+    if (stats_init(&backend->stats) != 0) {
+        log_error("Failed to initialize stats");
+        mapping_lock_destroy(&backend->mapping_lock);
+        free(backend);
+        return NULL;
+    }
+    backend->stats_shard = stats_shard_create(&backend->stats);
+    
+    // Rings are sized and created once the config is known
+    if (trace_init(&backend->trace) != 0) {
+        log_error("Failed to initialize trace");
+        stats_destroy(&backend->stats);
+        mapping_lock_destroy(&backend->mapping_lock);
+        free(backend);
+        return NULL;
+    }
+    backend->trace_ring = NULL;
+    
+    // Initialize TCP client arrays
     for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
         backend->tcp_conn_socks[i] = -1;
+        backend->rtu_tcp_conns[i].sock = -1;
+        backend->rtu_tcp_conns[i].len = 0;
+    }
+    for (int i = 0; i < MAX_METRICS_CLIENTS; i++) {
+        backend->metrics_conns[i].sock = -1;
+        backend->metrics_conns[i].out = NULL;
     }
     
     log_debug("ModbusBackend created successfully");
@@ -29,6 +75,9 @@ void modbus_backend_destroy(ModbusBackend *backend) {
     if (!backend) return;
     
     // Cleanup will be done by adapters
+    mapping_lock_destroy(&backend->mapping_lock);
+    stats_destroy(&backend->stats);
+    trace_destroy(&backend->trace);
     free(backend);
     log_debug("ModbusBackend destroyed");
 }
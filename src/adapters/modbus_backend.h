@@ -1,21 +1,98 @@
 #ifndef MODBUS_BACKEND_H
 #define MODBUS_BACKEND_H
 
+#include "../core/mapping_lock.h"
+#include "../core/stats.h"
+#include "../core/trace.h"
 #include <modbus/modbus.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+// Connection speaking RTU framing over raw TCP
+typedef struct {
+    int sock;
+    int len;                                    // Bytes buffered in buf
+    uint8_t buf[MODBUS_RTU_MAX_ADU_LENGTH];
+} RtuTcpConn;
+
+// HTTP connection to the metrics endpoint
+typedef struct {
+    int sock;
+    int len;                                    // Request bytes buffered in buf
+    char buf[1024];
+    char *out;                                  // Response being sent, NULL while reading the request
+    size_t out_len;
+    size_t out_sent;
+    uint64_t opened_us;
+} MetricsConn;
+
 typedef struct {
     modbus_t *ctx_tcp;
     modbus_t *ctx_rtu;
     modbus_mapping_t *mapping;
     
+    // Serialises writers to the mapping; readers go lock-free
+    MappingLock mapping_lock;
+    
+    // Request counters and latency, one shard per serving thread
+    Stats stats;
+    StatsShard *stats_shard;                    // Main loop's shard
+    
+    // Wire trace of recent ADUs, one ring per serving thread
+    Trace trace;
+    TraceRing *trace_ring;                      // Main loop's ring, NULL when unavailable
+    
     int tcp_listen_sock;
     
     // TCP client management
     #define MAX_TCP_CLIENTS 10
     int tcp_conn_socks[MAX_TCP_CLIENTS];
     int tcp_conn_count;
+    
+    // SO_REUSEPORT worker threads serving tcp_port instead (optional)
+    struct TcpWorkerPool *tcp_workers;
+    
+    // Unit id answered by the listeners framed outside libmodbus
+    int unit_id;
+    
+    // RTU-over-TCP listener (optional)
+    int rtu_tcp_listen_sock;
+    RtuTcpConn rtu_tcp_conns[MAX_TCP_CLIENTS];
+    int rtu_tcp_conn_count;
+    
+    // Modbus/UDP listener (optional)
+    int udp_sock;
+    struct UdpBatch *udp_batch;
+    
+    // Downstream poller feeding the mapping (optional)
+    struct Poller *poller;
+    
+    // Periodic snapshots of the mapping (optional)
+    struct Snapshotter *snapshotter;
+    
+    // Write-ahead log of client writes, replayed over the snapshot (optional)
+    struct Wal *wal;
+    
+    // Memory-mapped file holding the tables (optional, owns mapping when set)
+    struct RegisterImage *image;
+    
+    // Client writes to ranges watched from the control channel (optional)
+    struct Watch *watch;
+    
+    // Named points of the config, resolved against the mapping (optional)
+    struct TagMap *tags;
+    
+    // Register ranges updated and read in engineering units (optional)
+    struct ScaleMap *scales;
+    
+    // Set by the reload and upgrade commands, acted on by the main loop
+    bool reload_requested;
+    bool upgrade_requested;
+    
+    // Prometheus scrape endpoint (optional)
+    #define MAX_METRICS_CLIENTS 4
+    int metrics_listen_sock;
+    MetricsConn metrics_conns[MAX_METRICS_CLIENTS];
 } ModbusBackend;
 
 /**
@@ -1,4 +1,6 @@
 #include "rtu_adapter.h"
+#include "../core/modbus_pdu.h"
+#include "../core/watch.h"
 #include "../utils/logging.h"
 #include "../utils/platform.h"
 #include <errno.h>
@@ -44,6 +46,60 @@ int rtu_adapter_init(ModbusBackend *backend, const ModbusConfig *config) {
     return 0;
 }
 
+/*
+ * libmodbus sends the response itself: rebuild it for the trace while the
+ * write lock taken for the reply is still held. Broadcasts get no response.
+ */
+static void trace_exchange(ModbusBackend *backend, const uint8_t *query, int req_len, int rsp_len) {
+    trace_record(backend->trace_ring, TRACE_RTU, TRACE_REQUEST, 0, query, req_len);
+    if (rsp_len == 0) {
+        return;
+    }
+    
+    uint8_t rsp[MODBUS_RTU_MAX_ADU_LENGTH];
+    int pdu_len = modbus_pdu_replay(backend->mapping, query + 1, req_len - 3, rsp + 1);
+    // Functions the PDU engine does not implement (report slave id) keep only their request
+    if (pdu_len + 3 != rsp_len) {
+        return;
+    }
+    rsp[0] = query[0];
+    uint16_t crc = modbus_pdu_crc16(rsp, pdu_len + 1);
+    rsp[pdu_len + 1] = (uint8_t)(crc & 0xFF);
+    rsp[pdu_len + 2] = (uint8_t)(crc >> 8);
+    trace_record(backend->trace_ring, TRACE_RTU, TRACE_RESPONSE, 0, rsp, rsp_len);
+}
+
+/*
+ * With a write-ahead log, writes are answered by the PDU engine instead of
+ * libmodbus, which would send the response before the log is synced;
+ * libmodbus still frames it. Broadcasts get no response.
+ * Returns the response length (0 for a broadcast), -1 if sending failed.
+ */
+static int reply_logged(ModbusBackend *backend, const uint8_t *query, int req_len) {
+    uint8_t rsp[MODBUS_RTU_MAX_ADU_LENGTH];
+    uint64_t lsn;
+    int pdu_len = modbus_pdu_process(backend->mapping, &backend->mapping_lock, backend->wal, &lsn,
+                                     query + 1, req_len - 3, rsp + 1);
+    bool traced = trace_active(backend->trace_ring);
+    if (traced) {
+        trace_record(backend->trace_ring, TRACE_RTU, TRACE_REQUEST, 0, query, req_len);
+    }
+    if (query[0] == MODBUS_BROADCAST_ADDRESS) {
+        return 0;
+    }
+    
+    rsp[0] = query[0];
+    if (traced) {
+        uint16_t crc = modbus_pdu_crc16(rsp, pdu_len + 1);
+        rsp[pdu_len + 1] = (uint8_t)(crc & 0xFF);
+        rsp[pdu_len + 2] = (uint8_t)(crc >> 8);
+        trace_record(backend->trace_ring, TRACE_RTU, TRACE_RESPONSE, 0, rsp, pdu_len + 3);
+    }
+    wal_wait(backend->wal, lsn);
+    // Adds the CRC and goes through the serial settings of the context
+    return modbus_send_raw_request(backend->ctx_rtu, rsp, pdu_len + 1);
+}
+
 int rtu_adapter_handle(ModbusBackend *backend, uint8_t *query) {
     if (!backend || !backend->ctx_rtu) {
         return -1;
@@ -51,12 +107,34 @@ int rtu_adapter_handle(ModbusBackend *backend, uint8_t *query) {
     
     int rc = modbus_receive(backend->ctx_rtu, query);
     if (rc > 0) {
-        if (modbus_reply(backend->ctx_rtu, query, rc, backend->mapping) == -1) {
+        uint64_t recv_ns = platform_monotonic_ns();
+        int req_len = rc;
+        int header = modbus_get_header_length(backend->ctx_rtu);
+        if (backend->wal && wal_logs_function(query[header])) {
+            rc = reply_logged(backend, query, req_len);
+        } else {
+            mapping_write_begin(&backend->mapping_lock);
+            rc = modbus_reply(backend->ctx_rtu, query, rc, backend->mapping);
+            if (rc >= 0 && trace_active(backend->trace_ring)) {
+                trace_exchange(backend, query, req_len, rc);
+            }
+            mapping_write_end(&backend->mapping_lock);
+        }
+        if (rc == -1) {
             log_debug("RTU reply failed: %s", modbus_strerror(errno));
             return -1;
         }
+        // An exception is the only 2-byte PDU (plus CRC); broadcasts are not answered
+        if (rc != header + 4) {
+            watch_note_write(backend->watch, query + header, req_len - header - 2);
+        }
+        stats_record(backend->stats_shard, query[0], query[header], req_len, rc,
+                     rc == header + 4, platform_monotonic_ns() - recv_ns);
         return 1;
     } else if (rc == -1) {
+        if (errno == EMBBADCRC) {
+            stats_event(backend->stats_shard, STATS_CRC_ERRORS);
+        }
         if (errno != EAGAIN && errno != EWOULDBLOCK) {
             log_debug("RTU error: %s", modbus_strerror(errno));
             return -1;
@@ -107,6 +185,7 @@ int rtu_adapter_reconnect(ModbusBackend *backend, const ModbusConfig *config) {
         return -1;
     }
     
+    stats_event(backend->stats_shard, STATS_RTU_RECONNECTS);
     log_debug("RTU reconnected successfully on %s", config->serial_device);
     return 0;
 }
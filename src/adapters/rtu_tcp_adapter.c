@@ -0,0 +1,250 @@
+#include "rtu_tcp_adapter.h"
+#include "../core/handoff.h"
+#include "../core/modbus_pdu.h"
+#include "../core/watch.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+    #include <ws2tcpip.h>
+#else
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/*
+ * RTU frames carry no length field, so the request length is derived from
+ * the function code. Returns the frame length, 0 if more bytes are needed
+ * to tell, -1 if the function code cannot be framed.
+ */
+static int request_length(const uint8_t *buf, int len) {
+    if (len < 2) {
+        return 0;
+    }
+    switch (buf[1]) {
+    case MODBUS_FC_READ_COILS:
+    case MODBUS_FC_READ_DISCRETE_INPUTS:
+    case MODBUS_FC_READ_HOLDING_REGISTERS:
+    case MODBUS_FC_READ_INPUT_REGISTERS:
+    case MODBUS_FC_WRITE_SINGLE_COIL:
+    case MODBUS_FC_WRITE_SINGLE_REGISTER:
+        return 8;
+    case MODBUS_FC_READ_EXCEPTION_STATUS:
+    case MODBUS_FC_REPORT_SLAVE_ID:
+        return 4;
+    case MODBUS_FC_WRITE_MULTIPLE_COILS:
+    case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+        return (len < 7) ? 0 : 9 + buf[6];
+    case MODBUS_FC_MASK_WRITE_REGISTER:
+        return 10;
+    case MODBUS_FC_WRITE_AND_READ_REGISTERS:
+        return (len < 11) ? 0 : 13 + buf[10];
+    default:
+        return -1;
+    }
+}
+
+static int open_listener(int port) {
+    int sock = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        log_error("RTU-over-TCP socket failed: %s", strerror(errno));
+        return -1;
+    }
+    
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 5) != 0) {
+        log_error("RTU-over-TCP listen on port %d failed: %s", port, strerror(errno));
+        platform_close_fd(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int rtu_tcp_adapter_init(ModbusBackend *backend, const ModbusConfig *config) {
+    // Inherited from systemd or the server being upgraded, else bound here
+    int sock = handoff_take_listener(SOCK_STREAM, config->rtu_tcp_port);
+    if (sock < 0 && (sock = open_listener(config->rtu_tcp_port)) < 0) {
+        return -1;
+    }
+    
+    backend->rtu_tcp_listen_sock = sock;
+    backend->unit_id = config->unit_id;
+    for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
+        backend->rtu_tcp_conns[i].sock = -1;
+        backend->rtu_tcp_conns[i].len = 0;
+    }
+    backend->rtu_tcp_conn_count = 0;
+    
+    log_debug("RTU-over-TCP Server listening on port %d", config->rtu_tcp_port);
+    return 0;
+}
+
+int rtu_tcp_adapter_accept_client(ModbusBackend *backend) {
+    int new_conn = (int)accept(backend->rtu_tcp_listen_sock, NULL, NULL);
+    if (new_conn < 0) {
+        return -1;
+    }
+    
+    int slot = -1;
+    for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
+        if (backend->rtu_tcp_conns[i].sock == -1) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == -1) {
+        log_warn("Max RTU-over-TCP clients reached (%d), rejecting connection", MAX_TCP_CLIENTS);
+        platform_close_fd(new_conn);
+        return -1;
+    }
+    
+    int yes = 1;
+    setsockopt(new_conn, IPPROTO_TCP, TCP_NODELAY, (const char *)&yes, sizeof(yes));
+    platform_set_nonblocking(new_conn);
+    
+    backend->rtu_tcp_conns[slot].sock = new_conn;
+    backend->rtu_tcp_conns[slot].len = 0;
+    backend->rtu_tcp_conn_count++;
+    log_debug("RTU-over-TCP client connected (slot %d, fd %d), total clients: %d",
+              slot, new_conn, backend->rtu_tcp_conn_count);
+    return slot;
+}
+
+static void close_client(ModbusBackend *backend, int client_index) {
+    RtuTcpConn *conn = &backend->rtu_tcp_conns[client_index];
+    log_debug("RTU-over-TCP client disconnect (slot %d)", client_index);
+    platform_close_fd(conn->sock);
+    conn->sock = -1;
+    conn->len = 0;
+    backend->rtu_tcp_conn_count--;
+}
+
+int rtu_tcp_adapter_handle_client(ModbusBackend *backend, int client_index) {
+    if (client_index < 0 || client_index >= MAX_TCP_CLIENTS) {
+        return -1;
+    }
+    
+    RtuTcpConn *conn = &backend->rtu_tcp_conns[client_index];
+    if (conn->sock == -1) {
+        return -1;
+    }
+    
+    int rc = (int)recv(conn->sock, (char *)conn->buf + conn->len, sizeof(conn->buf) - conn->len, 0);
+    if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        close_client(backend, client_index);
+        return -1;
+    }
+    if (rc < 0) {
+        return 0;
+    }
+    conn->len += rc;
+    uint64_t recv_ns = platform_monotonic_ns();
+    
+    // A stream read may hold several pipelined frames, or only part of one
+    int processed = 0;
+    int offset = 0;
+    while (offset < conn->len) {
+        uint8_t *frame = conn->buf + offset;
+        int avail = conn->len - offset;
+        int frame_len = request_length(frame, avail);
+        
+        if (frame_len < 0 || frame_len > (int)sizeof(conn->buf)) {
+            // Cannot resynchronise a stream without lengths: drop what we have
+            log_debug("RTU-over-TCP unsupported function 0x%02X, flushing", frame[1]);
+            offset = conn->len;
+            break;
+        }
+        if (frame_len == 0 || avail < frame_len) {
+            break;
+        }
+        offset += frame_len;
+        
+        uint16_t crc = modbus_pdu_crc16(frame, frame_len - 2);
+        if (frame[frame_len - 2] != (crc & 0xFF) || frame[frame_len - 1] != (crc >> 8)) {
+            log_debug("RTU-over-TCP CRC error (slot %d), flushing", client_index);
+            stats_event(backend->stats_shard, STATS_CRC_ERRORS);
+            offset = conn->len;
+            break;
+        }
+        bool traced = trace_active(backend->trace_ring);
+        if (traced) {
+            trace_record(backend->trace_ring, TRACE_RTU_TCP, TRACE_REQUEST, (uint32_t)conn->sock, frame, frame_len);
+        }
+        
+        // Unit filter as on a serial line: broadcasts are executed but not answered
+        int unit = frame[0];
+        if (unit != backend->unit_id && unit != MODBUS_BROADCAST_ADDRESS) {
+            continue;
+        }
+        
+        uint8_t rsp[MODBUS_RTU_MAX_ADU_LENGTH];
+        uint64_t lsn;
+        int pdu_len = modbus_pdu_process(backend->mapping, &backend->mapping_lock, backend->wal, &lsn,
+                                         frame + 1, frame_len - 3, rsp + 1);
+        processed++;
+        bool exception = (rsp[1] & 0x80) != 0;
+        if (!exception) {
+            watch_note_write(backend->watch, frame + 1, frame_len - 3);
+        }
+        if (unit == MODBUS_BROADCAST_ADDRESS) {
+            stats_record(backend->stats_shard, (uint8_t)unit, frame[1], frame_len, 0, exception,
+                         platform_monotonic_ns() - recv_ns);
+            continue;
+        }
+        
+        wal_wait(backend->wal, lsn);
+        rsp[0] = (uint8_t)unit;
+        crc = modbus_pdu_crc16(rsp, pdu_len + 1);
+        rsp[pdu_len + 1] = (uint8_t)(crc & 0xFF);
+        rsp[pdu_len + 2] = (uint8_t)(crc >> 8);
+        if (traced) {
+            trace_record(backend->trace_ring, TRACE_RTU_TCP, TRACE_RESPONSE, (uint32_t)conn->sock, rsp, pdu_len + 3);
+        }
+        if (send(conn->sock, (const char *)rsp, pdu_len + 3, MSG_NOSIGNAL) != pdu_len + 3) {
+            close_client(backend, client_index);
+            return -1;
+        }
+        stats_record(backend->stats_shard, (uint8_t)unit, frame[1], frame_len, pdu_len + 3, exception,
+                     platform_monotonic_ns() - recv_ns);
+    }
+    
+    // Keep the partial frame at the start of the buffer
+    if (offset > 0) {
+        memmove(conn->buf, conn->buf + offset, conn->len - offset);
+        conn->len -= offset;
+    }
+    return processed;
+}
+
+void rtu_tcp_adapter_cleanup(ModbusBackend *backend) {
+    if (!backend) return;
+    
+    for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
+        if (backend->rtu_tcp_conns[i].sock != -1) {
+            platform_close_fd(backend->rtu_tcp_conns[i].sock);
+            backend->rtu_tcp_conns[i].sock = -1;
+            backend->rtu_tcp_conns[i].len = 0;
+        }
+    }
+    backend->rtu_tcp_conn_count = 0;
+    
+    if (backend->rtu_tcp_listen_sock != -1) {
+        platform_close_fd(backend->rtu_tcp_listen_sock);
+        backend->rtu_tcp_listen_sock = -1;
+    }
+}
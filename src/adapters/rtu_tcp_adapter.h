@@ -0,0 +1,37 @@
+#ifndef RTU_TCP_ADAPTER_H
+#define RTU_TCP_ADAPTER_H
+
+#include "../config/config.h"
+#include "modbus_backend.h"
+#include <modbus/modbus.h>
+
+/**
+ * Initialize the RTU-over-TCP listener (RTU framing with CRC on a raw TCP stream)
+ * @param backend Pointer to ModbusBackend
+ * @param config Pointer to ModbusConfig
+ * @return 0 on success, -1 on failure
+ */
+int rtu_tcp_adapter_init(ModbusBackend *backend, const ModbusConfig *config);
+
+/**
+ * Accept a pending RTU-over-TCP connection
+ * @param backend Pointer to ModbusBackend
+ * @return Slot index on success, -1 on failure
+ */
+int rtu_tcp_adapter_accept_client(ModbusBackend *backend);
+
+/**
+ * Read from an RTU-over-TCP connection and answer every complete frame
+ * @param backend Pointer to ModbusBackend
+ * @param client_index Index of client in rtu_tcp_conns array
+ * @return Number of frames processed, -1 if client disconnected
+ */
+int rtu_tcp_adapter_handle_client(ModbusBackend *backend, int client_index);
+
+/**
+ * Cleanup RTU-over-TCP resources
+ * @param backend Pointer to ModbusBackend
+ */
+void rtu_tcp_adapter_cleanup(ModbusBackend *backend);
+
+#endif // RTU_TCP_ADAPTER_H
@@ -1,9 +1,23 @@
 #include "tcp_adapter.h"
+#include "../core/handoff.h"
+#include "../core/modbus_pdu.h"
+#include "../core/watch.h"
 #include "../utils/logging.h"
 #include "../utils/platform.h"
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+#else
+    #include <sys/socket.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 int tcp_adapter_init(ModbusBackend *backend, const ModbusConfig *config) {
     backend->ctx_tcp = modbus_new_tcp(NULL, config->tcp_port);
     if (!backend->ctx_tcp) {
@@ -14,7 +28,11 @@ int tcp_adapter_init(ModbusBackend *backend, const ModbusConfig *config) {
     modbus_set_slave(backend->ctx_tcp, config->unit_id);
     modbus_set_debug(backend->ctx_tcp, FALSE);
     
-    backend->tcp_listen_sock = modbus_tcp_listen(backend->ctx_tcp, 1);
+    // A socket inherited from systemd or the server being upgraded keeps its queued connections
+    backend->tcp_listen_sock = handoff_take_listener(SOCK_STREAM, config->tcp_port);
+    if (backend->tcp_listen_sock == -1) {
+        backend->tcp_listen_sock = modbus_tcp_listen(backend->ctx_tcp, 1);
+    }
     if (backend->tcp_listen_sock == -1) {
         log_error("TCP listen failed");
         modbus_free(backend->ctx_tcp);
@@ -26,7 +44,10 @@ int tcp_adapter_init(ModbusBackend *backend, const ModbusConfig *config) {
     for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
         backend->tcp_conn_socks[i] = -1;
     }
-    backend->tcp_conn_count = 0;
+    backend->tcp_conn_count = handoff_take_clients(config->tcp_port, backend->tcp_conn_socks, MAX_TCP_CLIENTS);
+    if (backend->tcp_conn_count > 0) {
+        log_info("TCP server took over %d client connections", backend->tcp_conn_count);
+    }
     
     log_debug("TCP Server listening on port %d", config->tcp_port);
     return 0;
@@ -62,6 +83,55 @@ int tcp_adapter_accept_client(ModbusBackend *backend) {
     return slot;
 }
 
+/*
+ * libmodbus sends the response itself: rebuild it for the trace while the
+ * write lock taken for the reply is still held.
+ */
+static void trace_exchange(ModbusBackend *backend, int sock, const uint8_t *query, int req_len, int rsp_len) {
+    trace_record(backend->trace_ring, TRACE_TCP, TRACE_REQUEST, (uint32_t)sock, query, req_len);
+    
+    uint8_t rsp[MODBUS_TCP_MAX_ADU_LENGTH];
+    int header = modbus_get_header_length(backend->ctx_tcp);
+    int pdu_len = modbus_pdu_replay(backend->mapping, query + header, req_len - header, rsp + header);
+    // Functions the PDU engine does not implement (report slave id) keep only their request
+    if (header + pdu_len != rsp_len) {
+        return;
+    }
+    memcpy(rsp, query, 4);
+    rsp[4] = (uint8_t)((pdu_len + 1) >> 8);
+    rsp[5] = (uint8_t)(pdu_len + 1);
+    rsp[6] = query[6];
+    trace_record(backend->trace_ring, TRACE_TCP, TRACE_RESPONSE, (uint32_t)sock, rsp, rsp_len);
+}
+
+/*
+ * With a write-ahead log, writes are answered by the PDU engine instead of
+ * libmodbus, which would send the response before the log is synced.
+ * Returns the response length, -1 if sending failed.
+ */
+static int reply_logged(ModbusBackend *backend, int sock, const uint8_t *query, int req_len) {
+    uint8_t rsp[MODBUS_TCP_MAX_ADU_LENGTH];
+    int header = modbus_get_header_length(backend->ctx_tcp);
+    uint64_t lsn;
+    int pdu_len = modbus_pdu_process(backend->mapping, &backend->mapping_lock, backend->wal, &lsn,
+                                     query + header, req_len - header, rsp + header);
+    memcpy(rsp, query, 4);
+    rsp[4] = (uint8_t)((pdu_len + 1) >> 8);
+    rsp[5] = (uint8_t)(pdu_len + 1);
+    rsp[6] = query[6];
+    int rsp_len = header + pdu_len;
+    if (trace_active(backend->trace_ring)) {
+        trace_record(backend->trace_ring, TRACE_TCP, TRACE_REQUEST, (uint32_t)sock, query, req_len);
+        trace_record(backend->trace_ring, TRACE_TCP, TRACE_RESPONSE, (uint32_t)sock, rsp, rsp_len);
+    }
+    
+    wal_wait(backend->wal, lsn);
+    if (send(sock, (const char *)rsp, rsp_len, MSG_NOSIGNAL) != rsp_len) {
+        return -1;
+    }
+    return rsp_len;
+}
+
 int tcp_adapter_handle_client(ModbusBackend *backend, int client_index, uint8_t *query) {
     if (client_index < 0 || client_index >= MAX_TCP_CLIENTS) {
         return -1;
@@ -76,10 +146,29 @@ int tcp_adapter_handle_client(ModbusBackend *backend, int client_index, uint8_t
     int rc = modbus_receive(backend->ctx_tcp, query);
     
     if (rc > 0) {
-        if (modbus_reply(backend->ctx_tcp, query, rc, backend->mapping) == -1) {
+        uint64_t recv_ns = platform_monotonic_ns();
+        int req_len = rc;
+        int header = modbus_get_header_length(backend->ctx_tcp);
+        if (backend->wal && wal_logs_function(query[header])) {
+            rc = reply_logged(backend, sock, query, req_len);
+        } else {
+            mapping_write_begin(&backend->mapping_lock);
+            rc = modbus_reply(backend->ctx_tcp, query, rc, backend->mapping);
+            if (rc > 0 && trace_active(backend->trace_ring)) {
+                trace_exchange(backend, sock, query, req_len, rc);
+            }
+            mapping_write_end(&backend->mapping_lock);
+        }
+        if (rc == -1) {
             log_debug("TCP reply failed for client %d: %s", client_index, modbus_strerror(errno));
             return -1;
         }
+        // libmodbus does not expose the response: an exception is the only 2-byte PDU
+        if (rc != header + 2) {
+            watch_note_write(backend->watch, query + header, req_len - header);
+        }
+        stats_record(backend->stats_shard, query[header - 1], query[header], req_len, rc,
+                     rc == header + 2, platform_monotonic_ns() - recv_ns);
         return 1;
     } else if (rc == -1) {
         log_debug("TCP client disconnect (slot %d)", client_index);
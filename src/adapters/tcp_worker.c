@@ -0,0 +1,1340 @@
+#ifdef __linux__
+#define _GNU_SOURCE     // accept4
+#endif
+
+#include "tcp_worker.h"
+#include "../core/handoff.h"
+#include "../core/modbus_pdu.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#define TCP_WORKER_MAX_CONNS 256
+#define TCP_WORKER_MAX_EVENTS 64
+#define TCP_WORKER_RX_BUFFER 4096
+#define TCP_WORKER_TX_BUFFER 8192
+#define LISTEN_TAG UINT32_MAX
+#define COMMIT_TAG (UINT32_MAX - 1)
+
+#define MBAP_HEADER_LENGTH 7
+
+#ifdef HAVE_LIBURING
+// io_uring sizing, per worker
+#define URING_ENTRIES 1024
+#define URING_BUF_ENTRIES 512               // Provided receive buffers
+#define URING_BUF_SIZE 2048
+#define URING_BUF_GROUP 0
+#define URING_TX_CHUNKS 1024                // Response chunks shared by all connections
+#define URING_TX_CHUNKS_PER_CONN 64         // Unread responses before a client is paused
+#define URING_HELD_BUFFERS 16               // Received buffers a paused client may hold
+
+// Low bits of the completion user data; send completions carry the chunk pointer
+#define URING_OP_SEND 0
+#define URING_OP_RECV 1
+#define URING_OP_ACCEPT 2
+#define URING_OP_IGNORE 3
+#define URING_OP_MASK 3
+#define URING_COMMIT_TAG (4 | URING_OP_IGNORE)      // Poll of the commit event
+
+typedef struct TxChunk {
+    struct TxChunk *next;
+    int slot;                   // Connection the chunk belongs to
+    uint32_t generation;        // ... and its generation when queued
+    int len;
+    uint64_t recv_ns;           // When its first request was picked up
+    StatsBatch stats;           // Requests answered in it, timed on send completion
+    uint8_t data[4096 - 64];
+} TxChunk;
+
+// Received data not yet moved into the connection buffer
+typedef struct {
+    int bid;
+    int len;
+    int offset;
+} HeldBuffer;
+#endif
+
+typedef struct {
+    int sock;
+    int len;                            // Bytes buffered in buf
+    uint8_t buf[TCP_WORKER_RX_BUFFER];
+    uint64_t wait_lsn;                  // Write the responses queued wait for (sync WAL mode)
+    
+    // epoll: responses parked until their writes are durable, input not read meanwhile
+    uint8_t *parked;                    // TCP_WORKER_TX_BUFFER bytes once needed
+    int parked_len;
+    uint64_t parked_ns;                 // When their first request was picked up
+    StatsBatch parked_stats;
+#ifdef HAVE_LIBURING
+    uint32_t generation;                // Bumped on close to spot stale completions
+    TxChunk *tx_head;                   // Responses waiting or in flight, in order
+    TxChunk *tx_tail;
+    int tx_queued;
+    int tx_inflight;                    // Chunks of the linked send chain in flight
+    HeldBuffer held[URING_HELD_BUFFERS];
+    int nb_held;
+    bool recv_armed;
+    bool recv_paused;                   // Send queue full, receive cancelled
+    bool recv_starved;                  // Receive ended for lack of provided buffers
+#endif
+} WorkerConn;
+
+typedef struct {
+    struct TcpWorkerPool *pool;
+    int id;
+    int listen_sock;
+    bool listen_inherited;              // Also held by systemd or another server: never shut down
+    int epfd;
+    pthread_t thread;
+    bool thread_started;
+    
+    WorkerConn conns[TCP_WORKER_MAX_CONNS];
+    int nb_conns;
+    
+    uint8_t tx[TCP_WORKER_TX_BUFFER];
+    atomic_uint_fast64_t requests;
+    StatsShard *stats;
+    TraceRing *trace;
+    uint64_t wal_lsn;                   // Last write logged, responses wait for it in sync mode
+    int commit_fd;                      // Event the log signals after each group commit
+    int nb_parked;
+    
+    // Published once per loop iteration for the metrics endpoint
+    atomic_int open_conns;
+    atomic_int queued_chunks;
+    
+    // Pool epoch seen at the top of the loop, where no mapping or watch is held
+    atomic_uint_fast64_t quiescent_epoch;
+
+#ifdef HAVE_LIBURING
+    bool uring_ready;
+    struct io_uring ring;
+    struct io_uring_buf_ring *buf_ring;
+    uint8_t *bufs;
+    TxChunk *chunks;
+    TxChunk *free_chunks;
+    int nb_chunks_used;
+    int nb_paused;
+    int nb_starved;
+#endif
+} TcpWorker;
+
+struct TcpWorkerPool {
+    modbus_mapping_t *mapping;          // Until a mapping is published on the lock
+    MappingLock *lock;
+    Wal *wal;                           // Changed only while paused, see tcp_worker_pool_set_wal()
+    Watch *_Atomic watch;
+    atomic_uint_fast64_t epoch;         // Bumped by tcp_worker_pool_synchronize()
+    TcpWorker *workers;
+    int nb_workers;
+    TcpBackend backend;
+    atomic_bool stop;
+    atomic_bool paused;
+    bool disowned;                      // Sockets handed to a new process: closed, never shut down
+};
+
+static void publish_gauges(TcpWorker *w, int queued_chunks) {
+    atomic_store_explicit(&w->open_conns, w->nb_conns, memory_order_relaxed);
+    atomic_store_explicit(&w->queued_chunks, queued_chunks, memory_order_relaxed);
+}
+
+static int open_listen_socket(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) != 0) {
+        close(sock);
+        return -1;
+    }
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 128) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int find_free_slot(TcpWorker *w) {
+    for (int i = 0; i < TCP_WORKER_MAX_CONNS; i++) {
+        if (w->conns[i].sock == -1) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Answer the complete requests at the start of in, appending the responses
+ * to out until it cannot hold one more. Each request is counted in batch,
+ * to be timed once its response is sent, and traced under conn. Logged
+ * writes move w->wal_lsn, which the responses must wait for.
+ * Returns the number of bytes consumed, -1 on a framing error.
+ */
+static int serve_requests(TcpWorker *w, StatsBatch *batch, uint32_t conn, const uint8_t *in, int in_len,
+                          uint8_t *out, int out_cap, int *out_len, uint64_t *answered) {
+    bool traced = trace_active(w->trace);
+    int offset = 0;
+    while (in_len - offset >= MBAP_HEADER_LENGTH &&
+           out_cap - *out_len >= MODBUS_TCP_MAX_ADU_LENGTH) {
+        const uint8_t *req = in + offset;
+        int mbap_len = (req[4] << 8) | req[5];
+        int frame_len = 6 + mbap_len;
+        if (req[2] != 0 || req[3] != 0 || mbap_len < 2 || frame_len > MODBUS_TCP_MAX_ADU_LENGTH) {
+            return -1;
+        }
+        if (in_len - offset < frame_len) {
+            break;
+        }
+        
+        uint8_t *rsp = out + *out_len;
+        uint64_t lsn;
+        int pdu_len = modbus_pdu_process(mapping_current(w->pool->lock, w->pool->mapping), w->pool->lock,
+                                         w->pool->wal, &lsn,
+                                         req + MBAP_HEADER_LENGTH, frame_len - MBAP_HEADER_LENGTH,
+                                         rsp + MBAP_HEADER_LENGTH);
+        if (lsn > 0) {
+            w->wal_lsn = lsn;
+        }
+        if ((rsp[MBAP_HEADER_LENGTH] & 0x80) == 0) {
+            watch_note_write(atomic_load_explicit(&w->pool->watch, memory_order_acquire),
+                             req + MBAP_HEADER_LENGTH, frame_len - MBAP_HEADER_LENGTH);
+        }
+        memcpy(rsp, req, 4);
+        rsp[4] = (uint8_t)((pdu_len + 1) >> 8);
+        rsp[5] = (uint8_t)(pdu_len + 1);
+        rsp[6] = req[6];
+        *out_len += MBAP_HEADER_LENGTH + pdu_len;
+        stats_count(w->stats, batch, req[6], req[7], frame_len, MBAP_HEADER_LENGTH + pdu_len,
+                    (rsp[MBAP_HEADER_LENGTH] & 0x80) != 0);
+        if (traced) {
+            trace_record(w->trace, TRACE_TCP, TRACE_REQUEST, conn, req, frame_len);
+            trace_record(w->trace, TRACE_TCP, TRACE_RESPONSE, conn, rsp, MBAP_HEADER_LENGTH + pdu_len);
+        }
+        offset += frame_len;
+        (*answered)++;
+    }
+    return offset;
+}
+
+// Nothing from before this point is used any more: report it to the pool
+static void quiescent(TcpWorker *w) {
+    atomic_store_explicit(&w->quiescent_epoch, atomic_load_explicit(&w->pool->epoch, memory_order_acquire),
+                          memory_order_release);
+}
+
+/* epoll backend */
+
+static void close_conn(TcpWorker *w, int slot) {
+    WorkerConn *conn = &w->conns[slot];
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, conn->sock, NULL);
+    close(conn->sock);
+    conn->sock = -1;
+    conn->len = 0;
+    if (conn->parked_len > 0) {
+        conn->parked_len = 0;
+        w->nb_parked--;
+    }
+    w->nb_conns--;
+}
+
+static void accept_conns(TcpWorker *w) {
+    for (;;) {
+        int sock = accept4(w->listen_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock < 0) {
+            return;
+        }
+        
+        int slot = find_free_slot(w);
+        if (slot == -1) {
+            log_warn("TCP worker %d: max clients reached (%d), rejecting connection",
+                     w->id, TCP_WORKER_MAX_CONNS);
+            close(sock);
+            continue;
+        }
+        
+        int yes = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        
+        struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (uint32_t)slot};
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, sock, &ev) != 0) {
+            close(sock);
+            continue;
+        }
+        w->conns[slot].sock = sock;
+        w->conns[slot].len = 0;
+        w->nb_conns++;
+    }
+}
+
+// Responses are small and the peer is waiting for them: wait briefly if the socket is full
+static int send_all(int sock, const uint8_t *buf, int len) {
+    while (len > 0) {
+        ssize_t rc = send(sock, buf, (size_t)len, MSG_NOSIGNAL);
+        if (rc > 0) {
+            buf += rc;
+            len -= (int)rc;
+            continue;
+        }
+        if (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return -1;
+        }
+        struct pollfd pfd = {.fd = sock, .events = POLLOUT};
+        if (poll(&pfd, 1, 1000) <= 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Keep the responses in w->tx with the connection until the log has synced
+ * the writes among them, and stop reading it meanwhile so later responses
+ * cannot overtake them. Returns -1 if they could not be kept.
+ */
+static int park_conn(TcpWorker *w, int slot, int tx_len, StatsBatch *batch, uint64_t recv_ns) {
+    WorkerConn *conn = &w->conns[slot];
+    if (!conn->parked && !(conn->parked = (uint8_t *)malloc(TCP_WORKER_TX_BUFFER))) {
+        return -1;
+    }
+    struct epoll_event ev = {.events = 0, .data.u32 = (uint32_t)slot};
+    if (epoll_ctl(w->epfd, EPOLL_CTL_MOD, conn->sock, &ev) != 0) {
+        return -1;
+    }
+    memcpy(conn->parked, w->tx, (size_t)tx_len);
+    conn->parked_len = tx_len;
+    conn->parked_ns = recv_ns;
+    conn->parked_stats = *batch;
+    memset(batch, 0, sizeof(*batch));
+    conn->wait_lsn = w->wal_lsn;
+    w->nb_parked++;
+    return 0;
+}
+
+/*
+ * Answer every complete pipelined request buffered on a connection,
+ * sending the responses together. In sync WAL mode responses that wait for
+ * a commit are parked instead, and the rest of the input with them.
+ */
+static void serve_conn(TcpWorker *w, int slot, uint64_t recv_ns) {
+    WorkerConn *conn = &w->conns[slot];
+    int offset = 0;
+    uint64_t answered = 0;
+    StatsBatch batch = {{0}};
+    for (;;) {
+        int tx_len = 0;
+        int consumed = serve_requests(w, &batch, (uint32_t)conn->sock, conn->buf + offset, conn->len - offset,
+                                      w->tx, sizeof(w->tx), &tx_len, &answered);
+        if (consumed < 0) {
+            close_conn(w, slot);
+            return;
+        }
+        if (tx_len > 0 && !wal_durable(w->pool->wal, w->wal_lsn)) {
+            if (park_conn(w, slot, tx_len, &batch, recv_ns) == 0) {
+                offset += consumed;
+                break;
+            }
+            wal_wait(w->pool->wal, w->wal_lsn);
+        }
+        if (tx_len > 0 && send_all(conn->sock, w->tx, tx_len) != 0) {
+            close_conn(w, slot);
+            return;
+        }
+        if (tx_len > 0) {
+            stats_complete(w->stats, &batch, platform_monotonic_ns() - recv_ns);
+        }
+        if (consumed == 0) {
+            break;
+        }
+        offset += consumed;
+    }
+    
+    if (offset > 0) {
+        memmove(conn->buf, conn->buf + offset, conn->len - offset);
+        conn->len -= offset;
+    }
+    atomic_fetch_add_explicit(&w->requests, answered, memory_order_relaxed);
+}
+
+static void handle_conn(TcpWorker *w, int slot) {
+    WorkerConn *conn = &w->conns[slot];
+    
+    ssize_t rc = recv(conn->sock, conn->buf + conn->len, sizeof(conn->buf) - conn->len, 0);
+    if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        close_conn(w, slot);
+        return;
+    }
+    if (rc < 0) {
+        return;
+    }
+    conn->len += (int)rc;
+    serve_conn(w, slot, platform_monotonic_ns());
+}
+
+// A group commit went through: send the parked responses it made durable
+static void release_parked(TcpWorker *w) {
+    uint64_t commits;
+    if (read(w->commit_fd, &commits, sizeof(commits)) < 0) {
+        // Already drained
+    }
+    for (int i = 0; i < TCP_WORKER_MAX_CONNS && w->nb_parked > 0; i++) {
+        WorkerConn *conn = &w->conns[i];
+        if (conn->sock == -1 || conn->parked_len == 0 || !wal_durable(w->pool->wal, conn->wait_lsn)) {
+            continue;
+        }
+        int len = conn->parked_len;
+        conn->parked_len = 0;
+        w->nb_parked--;
+        struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (uint32_t)i};
+        if (send_all(conn->sock, conn->parked, len) != 0 || epoll_ctl(w->epfd, EPOLL_CTL_MOD, conn->sock, &ev) != 0) {
+            close_conn(w, i);
+            continue;
+        }
+        stats_complete(w->stats, &conn->parked_stats, platform_monotonic_ns() - conn->parked_ns);
+        // Requests that came with the parked ones
+        serve_conn(w, i, platform_monotonic_ns());
+    }
+}
+
+static void* epoll_worker_thread(void *arg) {
+    TcpWorker *w = (TcpWorker *)arg;
+    struct TcpWorkerPool *pool = w->pool;
+    struct epoll_event events[TCP_WORKER_MAX_EVENTS];
+    
+    while (!atomic_load_explicit(&pool->stop, memory_order_relaxed)) {
+        quiescent(w);
+        if (atomic_load_explicit(&pool->paused, memory_order_relaxed)) {
+            usleep(100000);
+            continue;
+        }
+        
+        int n = epoll_wait(w->epfd, events, TCP_WORKER_MAX_EVENTS, 100);
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+            if (tag == LISTEN_TAG) {
+                accept_conns(w);
+            } else if (tag == COMMIT_TAG) {
+                release_parked(w);
+            } else if (w->conns[tag].sock != -1) {
+                handle_conn(w, (int)tag);
+            }
+        }
+        // Responses are sent before the next wait unless parked for the log
+        publish_gauges(w, w->nb_parked);
+    }
+    // Nothing held any more: never keep a synchronize waiting
+    atomic_store_explicit(&w->quiescent_epoch, UINT64_MAX, memory_order_release);
+    return NULL;
+}
+
+static int epoll_setup(TcpWorker *w) {
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = LISTEN_TAG};
+    struct epoll_event commit_ev = {.events = EPOLLIN, .data.u32 = COMMIT_TAG};
+    if (w->epfd < 0 || epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listen_sock, &ev) != 0 ||
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->commit_fd, &commit_ev) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef HAVE_LIBURING
+
+/*
+ * io_uring backend: one multishot accept, one multishot recv per connection
+ * drawing from a provided buffer ring, and responses queued in chunks sent
+ * as one linked chain per connection (at most one chain in flight keeps the
+ * byte stream ordered). A busy worker makes a single io_uring_enter() per
+ * loop for all its connections.
+ *
+ * A client that does not read its responses is paused: its recv is
+ * cancelled and input waits in the held buffers until its sends drain.
+ */
+
+static struct io_uring_sqe* uring_sqe(TcpWorker *w) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&w->ring);
+    if (!sqe) {
+        // Submission queue full: flush it and retry
+        io_uring_submit(&w->ring);
+        sqe = io_uring_get_sqe(&w->ring);
+    }
+    return sqe;
+}
+
+static uint64_t recv_tag(int slot, uint32_t generation) {
+    return ((uint64_t)generation << 32) | ((uint64_t)slot << 2) | URING_OP_RECV;
+}
+
+static void uring_arm_accept(TcpWorker *w) {
+    struct io_uring_sqe *sqe = uring_sqe(w);
+    if (!sqe) return;
+    io_uring_prep_multishot_accept(sqe, w->listen_sock, NULL, NULL, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, URING_OP_ACCEPT);
+}
+
+static void uring_arm_recv(TcpWorker *w, int slot) {
+    WorkerConn *conn = &w->conns[slot];
+    struct io_uring_sqe *sqe = uring_sqe(w);
+    if (!sqe) return;
+    io_uring_prep_recv_multishot(sqe, conn->sock, NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    io_uring_sqe_set_data64(sqe, recv_tag(slot, conn->generation));
+    conn->recv_armed = true;
+    conn->recv_starved = false;
+}
+
+static void uring_recycle_buffer(TcpWorker *w, int bid) {
+    io_uring_buf_ring_add(w->buf_ring, w->bufs + (size_t)bid * URING_BUF_SIZE, URING_BUF_SIZE,
+                          (unsigned short)bid, io_uring_buf_ring_mask(URING_BUF_ENTRIES), 0);
+    io_uring_buf_ring_advance(w->buf_ring, 1);
+    
+    // Receives that ran out of buffers can go again
+    if (w->nb_starved > 0) {
+        w->nb_starved = 0;
+        for (int i = 0; i < TCP_WORKER_MAX_CONNS; i++) {
+            WorkerConn *conn = &w->conns[i];
+            if (conn->sock != -1 && conn->recv_starved && !conn->recv_paused && !conn->recv_armed) {
+                uring_arm_recv(w, i);
+            }
+        }
+    }
+}
+
+static void uring_free_chunk(TcpWorker *w, TxChunk *chunk) {
+    chunk->next = w->free_chunks;
+    w->free_chunks = chunk;
+    w->nb_chunks_used--;
+}
+
+static void uring_close_conn(TcpWorker *w, int slot) {
+    WorkerConn *conn = &w->conns[slot];
+    
+    struct io_uring_sqe *sqe = uring_sqe(w);
+    if (sqe) {
+        io_uring_prep_cancel_fd(sqe, conn->sock, IORING_ASYNC_CANCEL_ALL);
+        io_uring_sqe_set_data64(sqe, URING_OP_IGNORE);
+    }
+    shutdown(conn->sock, SHUT_RDWR);
+    close(conn->sock);
+    
+    // Chunks still in flight come back through their (cancelled) completions
+    TxChunk *chunk = conn->tx_head;
+    for (int i = 0; chunk; i++) {
+        TxChunk *next = chunk->next;
+        if (i >= conn->tx_inflight) {
+            uring_free_chunk(w, chunk);
+        }
+        chunk = next;
+    }
+    conn->tx_head = conn->tx_tail = NULL;
+    conn->tx_queued = 0;
+    conn->tx_inflight = 0;
+    conn->sock = -1;
+    conn->len = 0;
+    conn->generation++;
+    conn->recv_armed = false;
+    conn->recv_paused = false;
+    conn->recv_starved = false;
+    w->nb_conns--;
+    
+    int nb_held = conn->nb_held;
+    conn->nb_held = 0;
+    for (int i = 0; i < nb_held; i++) {
+        uring_recycle_buffer(w, conn->held[i].bid);
+    }
+}
+
+/*
+ * Submit every queued chunk as one linked send chain, once the writes they
+ * answer are durable (the commit event flushes them otherwise)
+ */
+static void uring_flush(TcpWorker *w, int slot) {
+    WorkerConn *conn = &w->conns[slot];
+    if (conn->tx_inflight > 0 || conn->tx_queued == 0 || !wal_durable(w->pool->wal, conn->wait_lsn)) {
+        return;
+    }
+    
+    TxChunk *chunk = conn->tx_head;
+    for (int i = 0; i < conn->tx_queued; i++, chunk = chunk->next) {
+        struct io_uring_sqe *sqe = uring_sqe(w);
+        if (!sqe) {
+            uring_close_conn(w, slot);
+            return;
+        }
+        io_uring_prep_send(sqe, conn->sock, chunk->data, (size_t)chunk->len, MSG_NOSIGNAL | MSG_WAITALL);
+        io_uring_sqe_set_data(sqe, chunk);
+        if (i < conn->tx_queued - 1) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+    }
+    conn->tx_inflight = conn->tx_queued;
+}
+
+/*
+ * Answer the requests buffered on a connection into its send queue.
+ * Returns 0 when all complete requests are answered, 1 when the send queue
+ * is full (the rest waits), -1 if the connection was closed.
+ */
+static int uring_serve(TcpWorker *w, int slot) {
+    WorkerConn *conn = &w->conns[slot];
+    int offset = 0;
+    int rc = 0;
+    uint64_t answered = 0;
+    uint64_t now = platform_monotonic_ns();
+    
+    for (;;) {
+        // Append to the last queued chunk unless it is already being sent
+        TxChunk *chunk = conn->tx_tail;
+        if (!chunk || conn->tx_queued == conn->tx_inflight ||
+            (int)sizeof(chunk->data) - chunk->len < MODBUS_TCP_MAX_ADU_LENGTH) {
+            if (!w->free_chunks || conn->tx_queued >= URING_TX_CHUNKS_PER_CONN) {
+                rc = 1;
+                break;
+            }
+            chunk = w->free_chunks;
+            w->free_chunks = chunk->next;
+            w->nb_chunks_used++;
+            chunk->next = NULL;
+            chunk->slot = slot;
+            chunk->generation = conn->generation;
+            chunk->len = 0;
+            chunk->recv_ns = now;
+            memset(&chunk->stats, 0, sizeof(chunk->stats));
+            if (conn->tx_tail) {
+                conn->tx_tail->next = chunk;
+            } else {
+                conn->tx_head = chunk;
+            }
+            conn->tx_tail = chunk;
+            conn->tx_queued++;
+        }
+        
+        int consumed = serve_requests(w, &chunk->stats, (uint32_t)conn->sock, conn->buf + offset,
+                                      conn->len - offset, chunk->data, sizeof(chunk->data), &chunk->len, &answered);
+        if (consumed < 0) {
+            uring_close_conn(w, slot);
+            return -1;
+        }
+        if (consumed == 0) {
+            break;
+        }
+        offset += consumed;
+    }
+    
+    if (offset > 0) {
+        memmove(conn->buf, conn->buf + offset, conn->len - offset);
+        conn->len -= offset;
+    }
+    
+    // A fresh chunk may have stayed empty
+    if (conn->tx_tail && conn->tx_tail->len == 0 && conn->tx_queued > conn->tx_inflight) {
+        TxChunk *empty = conn->tx_tail;
+        TxChunk *prev = NULL;
+        for (TxChunk *c = conn->tx_head; c != empty; c = c->next) prev = c;
+        if (prev) prev->next = NULL; else conn->tx_head = NULL;
+        conn->tx_tail = prev;
+        conn->tx_queued--;
+        uring_free_chunk(w, empty);
+    }
+    
+    atomic_fetch_add_explicit(&w->requests, answered, memory_order_relaxed);
+    return rc;
+}
+
+// Feed held receive buffers through the connection and send the answers
+static void uring_pump(TcpWorker *w, int slot) {
+    WorkerConn *conn = &w->conns[slot];
+    
+    for (;;) {
+        int rc = uring_serve(w, slot);
+        if (rc < 0) {
+            return;
+        }
+        if (rc > 0) {
+            // Client is not keeping up with its responses: stop receiving
+            if (!conn->recv_paused) {
+                conn->recv_paused = true;
+                w->nb_paused++;
+                if (conn->recv_armed) {
+                    struct io_uring_sqe *sqe = uring_sqe(w);
+                    if (sqe) {
+                        io_uring_prep_cancel64(sqe, recv_tag(slot, conn->generation), 0);
+                        io_uring_sqe_set_data64(sqe, URING_OP_IGNORE);
+                    }
+                }
+            }
+            break;
+        }
+        if (conn->nb_held == 0) {
+            if (conn->recv_paused) {
+                conn->recv_paused = false;
+                w->nb_paused--;
+            }
+            if (!conn->recv_armed) {
+                uring_arm_recv(w, slot);
+            }
+            break;
+        }
+        
+        HeldBuffer *held = &conn->held[0];
+        int n = held->len - held->offset;
+        int room = (int)sizeof(conn->buf) - conn->len;
+        if (n > room) n = room;
+        memcpy(conn->buf + conn->len, w->bufs + (size_t)held->bid * URING_BUF_SIZE + held->offset, (size_t)n);
+        conn->len += n;
+        held->offset += n;
+        if (held->offset == held->len) {
+            int bid = held->bid;
+            conn->nb_held--;
+            memmove(&conn->held[0], &conn->held[1], (size_t)conn->nb_held * sizeof(HeldBuffer));
+            uring_recycle_buffer(w, bid);
+        }
+    }
+    // The queued responses go out once every write answered so far is durable
+    conn->wait_lsn = w->wal_lsn;
+    uring_flush(w, slot);
+}
+
+static void uring_arm_commit(TcpWorker *w) {
+    struct io_uring_sqe *sqe = uring_sqe(w);
+    if (!sqe) return;
+    io_uring_prep_poll_multishot(sqe, w->commit_fd, POLLIN);
+    io_uring_sqe_set_data64(sqe, URING_COMMIT_TAG);
+}
+
+// A group commit went through: send the responses that waited for it
+static void uring_on_commit(TcpWorker *w, struct io_uring_cqe *cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        uring_arm_commit(w);
+    }
+    uint64_t commits;
+    if (read(w->commit_fd, &commits, sizeof(commits)) < 0) {
+        // Already drained
+    }
+    for (int i = 0; i < TCP_WORKER_MAX_CONNS; i++) {
+        WorkerConn *conn = &w->conns[i];
+        if (conn->sock != -1 && conn->tx_inflight == 0 && conn->tx_queued > 0) {
+            uring_flush(w, i);
+        }
+    }
+}
+
+static void uring_on_accept(TcpWorker *w, struct io_uring_cqe *cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        uring_arm_accept(w);
+    }
+    if (cqe->res < 0) {
+        return;
+    }
+    
+    int sock = cqe->res;
+    int slot = find_free_slot(w);
+    if (slot == -1) {
+        log_warn("TCP worker %d: max clients reached (%d), rejecting connection",
+                 w->id, TCP_WORKER_MAX_CONNS);
+        close(sock);
+        return;
+    }
+    
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    w->conns[slot].sock = sock;
+    w->conns[slot].len = 0;
+    w->nb_conns++;
+    uring_arm_recv(w, slot);
+}
+
+static void uring_on_recv(TcpWorker *w, struct io_uring_cqe *cqe) {
+    uint64_t tag = io_uring_cqe_get_data64(cqe);
+    int slot = (int)((tag & 0xFFFFFFFFu) >> 2);
+    uint32_t generation = (uint32_t)(tag >> 32);
+    WorkerConn *conn = &w->conns[slot];
+    bool current = (conn->sock != -1 && conn->generation == generation);
+    
+    if (current && !(cqe->flags & IORING_CQE_F_MORE)) {
+        conn->recv_armed = false;
+    }
+    
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        int bid = (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (!current || cqe->res <= 0) {
+            uring_recycle_buffer(w, bid);
+        } else if (conn->nb_held == URING_HELD_BUFFERS) {
+            uring_recycle_buffer(w, bid);
+            log_warn("TCP worker %d: client flooding requests, dropping it", w->id);
+            uring_close_conn(w, slot);
+            return;
+        } else {
+            HeldBuffer *held = &conn->held[conn->nb_held++];
+            held->bid = bid;
+            held->len = cqe->res;
+            held->offset = 0;
+        }
+    }
+    if (!current) {
+        return;
+    }
+    
+    if (cqe->res == -ENOBUFS) {
+        // Re-armed once a buffer is recycled
+        conn->recv_starved = true;
+        w->nb_starved++;
+        return;
+    }
+    if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ECANCELED)) {
+        uring_close_conn(w, slot);
+        return;
+    }
+    if (!conn->recv_paused) {
+        uring_pump(w, slot);
+    }
+}
+
+static void uring_on_send(TcpWorker *w, struct io_uring_cqe *cqe) {
+    TxChunk *chunk = (TxChunk *)io_uring_cqe_get_data(cqe);
+    WorkerConn *conn = &w->conns[chunk->slot];
+    
+    if (conn->sock == -1 || conn->generation != chunk->generation) {
+        uring_free_chunk(w, chunk);
+        return;
+    }
+    
+    int slot = chunk->slot;
+    bool complete = (cqe->res == chunk->len);
+    if (complete) {
+        stats_complete(w->stats, &chunk->stats, platform_monotonic_ns() - chunk->recv_ns);
+    }
+    conn->tx_head = chunk->next;
+    if (!conn->tx_head) conn->tx_tail = NULL;
+    conn->tx_queued--;
+    conn->tx_inflight--;
+    uring_free_chunk(w, chunk);
+    
+    if (!complete) {
+        uring_close_conn(w, slot);
+        return;
+    }
+    if (conn->tx_inflight > 0) {
+        return;
+    }
+    
+    if (conn->recv_paused) {
+        uring_pump(w, slot);
+    } else {
+        uring_flush(w, slot);
+    }
+    
+    // Connections paused only because the shared chunks ran out get another go
+    if (w->nb_paused > 0) {
+        for (int i = 0; i < TCP_WORKER_MAX_CONNS && w->free_chunks; i++) {
+            WorkerConn *other = &w->conns[i];
+            if (i != slot && other->sock != -1 && other->recv_paused && other->tx_inflight == 0) {
+                uring_pump(w, i);
+            }
+        }
+    }
+}
+
+static void* uring_worker_thread(void *arg) {
+    TcpWorker *w = (TcpWorker *)arg;
+    struct TcpWorkerPool *pool = w->pool;
+    
+    uring_arm_accept(w);
+    uring_arm_commit(w);
+    while (!atomic_load_explicit(&pool->stop, memory_order_relaxed)) {
+        quiescent(w);
+        if (atomic_load_explicit(&pool->paused, memory_order_relaxed)) {
+            usleep(100000);
+            continue;
+        }
+        
+        // Submit everything queued and wait for completions in one syscall
+        struct io_uring_cqe *cqe;
+        struct __kernel_timespec ts = {.tv_sec = 0, .tv_nsec = 100000000};
+        int rc = io_uring_submit_and_wait_timeout(&w->ring, &cqe, 1, &ts, NULL);
+        if (rc < 0 && rc != -ETIME && rc != -EINTR) {
+            log_error("TCP worker %d: io_uring wait failed: %s", w->id, strerror(-rc));
+            break;
+        }
+        
+        unsigned head;
+        unsigned seen = 0;
+        io_uring_for_each_cqe(&w->ring, head, cqe) {
+            seen++;
+            switch (io_uring_cqe_get_data64(cqe) & URING_OP_MASK) {
+            case URING_OP_SEND:
+                uring_on_send(w, cqe);
+                break;
+            case URING_OP_RECV:
+                uring_on_recv(w, cqe);
+                break;
+            case URING_OP_ACCEPT:
+                uring_on_accept(w, cqe);
+                break;
+            default:
+                if (io_uring_cqe_get_data64(cqe) == URING_COMMIT_TAG) {
+                    uring_on_commit(w, cqe);
+                }
+                break;
+            }
+        }
+        io_uring_cq_advance(&w->ring, seen);
+        publish_gauges(w, w->nb_chunks_used);
+    }
+    // Nothing held any more: never keep a synchronize waiting
+    atomic_store_explicit(&w->quiescent_epoch, UINT64_MAX, memory_order_release);
+    return NULL;
+}
+
+static void uring_teardown(TcpWorker *w) {
+    if (!w->uring_ready) return;
+    
+    if (w->buf_ring) {
+        io_uring_free_buf_ring(&w->ring, w->buf_ring, URING_BUF_ENTRIES, URING_BUF_GROUP);
+        w->buf_ring = NULL;
+    }
+    io_uring_queue_exit(&w->ring);
+    free(w->bufs);
+    free(w->chunks);
+    w->bufs = NULL;
+    w->chunks = NULL;
+    w->free_chunks = NULL;
+    w->uring_ready = false;
+}
+
+static int uring_setup(TcpWorker *w) {
+    int rc = io_uring_queue_init(URING_ENTRIES, &w->ring, 0);
+    if (rc < 0) {
+        log_warn("TCP worker %d: io_uring unavailable: %s", w->id, strerror(-rc));
+        return -1;
+    }
+    w->uring_ready = true;
+    
+    w->bufs = (uint8_t *)malloc((size_t)URING_BUF_ENTRIES * URING_BUF_SIZE);
+    w->chunks = (TxChunk *)calloc(URING_TX_CHUNKS, sizeof(TxChunk));
+    if (!w->bufs || !w->chunks) {
+        uring_teardown(w);
+        return -1;
+    }
+    
+    // Provided buffer rings need Linux 5.19, multishot recv 6.0
+    w->buf_ring = io_uring_setup_buf_ring(&w->ring, URING_BUF_ENTRIES, URING_BUF_GROUP, 0, &rc);
+    if (!w->buf_ring) {
+        log_warn("TCP worker %d: io_uring buffer ring unavailable: %s", w->id, strerror(-rc));
+        uring_teardown(w);
+        return -1;
+    }
+    for (int i = 0; i < URING_BUF_ENTRIES; i++) {
+        io_uring_buf_ring_add(w->buf_ring, w->bufs + (size_t)i * URING_BUF_SIZE, URING_BUF_SIZE,
+                              (unsigned short)i, io_uring_buf_ring_mask(URING_BUF_ENTRIES), i);
+    }
+    io_uring_buf_ring_advance(w->buf_ring, URING_BUF_ENTRIES);
+    
+    for (int i = URING_TX_CHUNKS - 1; i >= 0; i--) {
+        uring_free_chunk(w, &w->chunks[i]);
+    }
+    w->nb_chunks_used = 0;
+    return 0;
+}
+
+#endif // HAVE_LIBURING
+
+// Commit thread of the log: wake the worker to send what it parked
+static void wake_worker(void *arg) {
+    TcpWorker *w = (TcpWorker *)arg;
+    uint64_t one = 1;
+    if (write(w->commit_fd, &one, sizeof(one)) < 0) {
+        // Counter already at its limit: the worker wakes anyway
+    }
+}
+
+/*
+ * Serve a connection accepted by another process, before the worker's
+ * thread starts. Not adopted, it is closed.
+ */
+static void adopt_conn(TcpWorker *w, int sock) {
+    int slot = find_free_slot(w);
+    if (slot == -1) {
+        close(sock);
+        return;
+    }
+    platform_set_nonblocking(sock);
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    
+    if (w->pool->backend == TCP_BACKEND_EPOLL) {
+        struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (uint32_t)slot};
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, sock, &ev) != 0) {
+            close(sock);
+            return;
+        }
+    }
+    w->conns[slot].sock = sock;
+    w->conns[slot].len = 0;
+    w->nb_conns++;
+#ifdef HAVE_LIBURING
+    if (w->pool->backend == TCP_BACKEND_IO_URING) {
+        uring_arm_recv(w, slot);
+    }
+#endif
+}
+
+TcpWorkerPool* tcp_worker_pool_create(modbus_mapping_t *mapping, MappingLock *lock, Wal *wal, Watch *watch,
+                                      Stats *stats, Trace *trace, int port, int nb_workers, TcpBackend backend) {
+    if (nb_workers < 1) {
+        return NULL;
+    }
+    
+    TcpWorkerPool *pool = (TcpWorkerPool *)calloc(1, sizeof(TcpWorkerPool));
+    TcpWorker *workers = (TcpWorker *)calloc((size_t)nb_workers, sizeof(TcpWorker));
+    if (!pool || !workers) {
+        log_error("Failed to allocate TCP workers");
+        free(pool);
+        free(workers);
+        return NULL;
+    }
+    pool->mapping = mapping;
+    pool->lock = lock;
+    pool->wal = wal;
+    atomic_init(&pool->watch, watch);
+    atomic_init(&pool->epoch, 0);
+    pool->workers = workers;
+    pool->nb_workers = nb_workers;
+    pool->backend = TCP_BACKEND_EPOLL;
+    atomic_init(&pool->stop, false);
+    atomic_init(&pool->paused, false);
+    
+    for (int i = 0; i < nb_workers; i++) {
+        TcpWorker *w = &workers[i];
+        w->pool = pool;
+        w->id = i;
+        w->listen_sock = -1;
+        w->epfd = -1;
+        w->commit_fd = -1;
+        atomic_init(&w->requests, 0);
+        atomic_init(&w->open_conns, 0);
+        atomic_init(&w->queued_chunks, 0);
+        atomic_init(&w->quiescent_epoch, 0);
+        w->stats = stats_shard_create(stats);
+        w->trace = trace_ring_create(trace);
+        for (int c = 0; c < TCP_WORKER_MAX_CONNS; c++) {
+            w->conns[c].sock = -1;
+        }
+    }
+    
+    // In sync WAL mode the log wakes the workers holding responses for a commit
+    for (int i = 0; i < nb_workers; i++) {
+        TcpWorker *w = &workers[i];
+        w->commit_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (w->commit_fd < 0 || (wal && wal_subscribe(wal, wake_worker, w) != 0)) {
+            log_error("TCP worker %d: commit event setup failed: %s", i, strerror(errno));
+            tcp_worker_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    
+    // Inherited sockets first; one without SO_REUSEPORT is shared by the workers that cannot bind
+    for (int i = 0; i < nb_workers; i++) {
+        TcpWorker *w = &workers[i];
+        w->listen_sock = handoff_take_listener(SOCK_STREAM, port);
+        w->listen_inherited = w->listen_sock >= 0;
+        if (w->listen_sock < 0) {
+            w->listen_sock = open_listen_socket(port);
+        }
+        if (w->listen_sock < 0 && (w->listen_sock = handoff_share_listener(port)) >= 0) {
+            w->listen_inherited = true;
+        }
+        if (w->listen_sock < 0) {
+            log_error("TCP worker %d: listen on port %d failed: %s", i, port, strerror(errno));
+            tcp_worker_pool_destroy(pool);
+            return NULL;
+        }
+        if (w->listen_inherited) {
+            platform_set_nonblocking(w->listen_sock);
+        }
+    }
+    
+    // io_uring needs every worker ready, otherwise the whole pool uses epoll
+    if (backend == TCP_BACKEND_IO_URING) {
+#ifdef HAVE_LIBURING
+        pool->backend = TCP_BACKEND_IO_URING;
+        for (int i = 0; i < nb_workers; i++) {
+            if (uring_setup(&workers[i]) != 0) {
+                for (int j = 0; j <= i; j++) {
+                    uring_teardown(&workers[j]);
+                }
+                pool->backend = TCP_BACKEND_EPOLL;
+                log_warn("Falling back to the epoll TCP backend");
+                break;
+            }
+        }
+#else
+        log_warn("Built without io_uring support, using the epoll TCP backend");
+#endif
+    }
+    
+    // Clients of the server being upgraded, dealt out to the workers
+    int *adopted = (int *)malloc((size_t)nb_workers * TCP_WORKER_MAX_CONNS * sizeof(int));
+    int nb_adopted = adopted ? handoff_take_clients(port, adopted, nb_workers * TCP_WORKER_MAX_CONNS) : 0;
+    
+    for (int i = 0; i < nb_workers; i++) {
+        TcpWorker *w = &workers[i];
+        void *(*thread_fn)(void *) = epoll_worker_thread;
+#ifdef HAVE_LIBURING
+        if (pool->backend == TCP_BACKEND_IO_URING) {
+            thread_fn = uring_worker_thread;
+        }
+#endif
+        if (pool->backend == TCP_BACKEND_EPOLL && epoll_setup(w) != 0) {
+            log_error("TCP worker %d: epoll setup failed: %s", i, strerror(errno));
+            tcp_worker_pool_destroy(pool);
+            free(adopted);
+            return NULL;
+        }
+        for (int c = i; c < nb_adopted; c += nb_workers) {
+            adopt_conn(w, adopted[c]);
+        }
+        
+        if (pthread_create(&w->thread, NULL, thread_fn, w) != 0) {
+            log_error("TCP worker %d: failed to start thread", i);
+            tcp_worker_pool_destroy(pool);
+            free(adopted);
+            return NULL;
+        }
+        w->thread_started = true;
+    }
+    free(adopted);
+    if (nb_adopted > 0) {
+        log_info("TCP workers took over %d client connections", nb_adopted);
+    }
+    
+    log_debug("TCP Server listening on port %d with %d %s workers", port, nb_workers,
+              pool->backend == TCP_BACKEND_IO_URING ? "io_uring" : "epoll");
+    return pool;
+}
+
+TcpBackend tcp_worker_pool_backend(TcpWorkerPool *pool) {
+    return pool ? pool->backend : TCP_BACKEND_EPOLL;
+}
+
+void tcp_worker_pool_pause(TcpWorkerPool *pool, bool paused) {
+    if (!pool) return;
+    atomic_store_explicit(&pool->paused, paused, memory_order_relaxed);
+}
+
+void tcp_worker_pool_synchronize(TcpWorkerPool *pool, Watch *watch) {
+    if (!pool) return;
+    
+    atomic_store_explicit(&pool->watch, watch, memory_order_release);
+    uint64_t epoch = atomic_fetch_add_explicit(&pool->epoch, 1, memory_order_acq_rel) + 1;
+    for (int i = 0; i < pool->nb_workers; i++) {
+        TcpWorker *w = &pool->workers[i];
+        while (w->thread_started && atomic_load_explicit(&w->quiescent_epoch, memory_order_acquire) < epoch) {
+            usleep(1000);
+        }
+    }
+}
+
+int tcp_worker_pool_sockets(TcpWorkerPool *pool, int *socks, int max) {
+    if (!pool) return 0;
+    
+    int n = 0;
+    for (int i = 0; i < pool->nb_workers; i++) {
+        TcpWorker *w = &pool->workers[i];
+        if (w->listen_sock >= 0) {
+            if (n < max) socks[n] = w->listen_sock;
+            n++;
+        }
+        // A partial request would be lost, and io_uring may have received more than the buffers show
+        for (int c = 0; c < TCP_WORKER_MAX_CONNS && pool->backend == TCP_BACKEND_EPOLL; c++) {
+            if (w->conns[c].sock != -1 && w->conns[c].len == 0 && w->conns[c].parked_len == 0) {
+                if (n < max) socks[n] = w->conns[c].sock;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+void tcp_worker_pool_disown(TcpWorkerPool *pool) {
+    if (!pool) return;
+    pool->disowned = true;
+}
+
+void tcp_worker_pool_set_wal(TcpWorkerPool *pool, Wal *wal) {
+    if (!pool) return;
+    
+    for (int i = 0; i < pool->nb_workers; i++) {
+        TcpWorker *w = &pool->workers[i];
+        wal_unsubscribe(pool->wal, w);
+        if (wal && wal_subscribe(wal, wake_worker, w) != 0) {
+            log_warn("TCP worker %d: responses wait for the log in place", i);
+        }
+    }
+    pool->wal = wal;
+    // Published with the epoch the workers load (acquire) at the top of their loop
+    atomic_fetch_add_explicit(&pool->epoch, 1, memory_order_release);
+}
+
+uint64_t tcp_worker_pool_requests(TcpWorkerPool *pool) {
+    if (!pool) return 0;
+    
+    uint64_t total = 0;
+    for (int i = 0; i < pool->nb_workers; i++) {
+        total += atomic_load_explicit(&pool->workers[i].requests, memory_order_relaxed);
+    }
+    return total;
+}
+
+int tcp_worker_pool_connections(TcpWorkerPool *pool) {
+    if (!pool) return 0;
+    
+    int total = 0;
+    for (int i = 0; i < pool->nb_workers; i++) {
+        total += atomic_load_explicit(&pool->workers[i].open_conns, memory_order_relaxed);
+    }
+    return total;
+}
+
+int tcp_worker_pool_queued(TcpWorkerPool *pool) {
+    if (!pool) return 0;
+    
+    int total = 0;
+    for (int i = 0; i < pool->nb_workers; i++) {
+        total += atomic_load_explicit(&pool->workers[i].queued_chunks, memory_order_relaxed);
+    }
+    return total;
+}
+
+void tcp_worker_pool_destroy(TcpWorkerPool *pool) {
+    if (!pool) return;
+    
+    atomic_store(&pool->stop, true);
+    for (int i = 0; i < pool->nb_workers; i++) {
+        TcpWorker *w = &pool->workers[i];
+        wal_unsubscribe(pool->wal, w);
+        if (w->thread_started) {
+            pthread_join(w->thread, NULL);
+        }
+        // Requests still queued in io_uring hold the sockets open until the
+        // ring is gone: shut them down so they leave the SO_REUSEPORT group now,
+        // unless another process goes on with them
+        if (w->listen_sock >= 0 && !w->listen_inherited && !pool->disowned) {
+            shutdown(w->listen_sock, SHUT_RDWR);
+        }
+        for (int c = 0; c < TCP_WORKER_MAX_CONNS; c++) {
+            if (w->conns[c].sock != -1) {
+                if (!pool->disowned) shutdown(w->conns[c].sock, SHUT_RDWR);
+                close(w->conns[c].sock);
+            }
+        }
+#ifdef HAVE_LIBURING
+        uring_teardown(w);
+#endif
+        for (int c = 0; c < TCP_WORKER_MAX_CONNS; c++) {
+            free(w->conns[c].parked);
+        }
+        if (w->listen_sock >= 0) close(w->listen_sock);
+        if (w->epfd >= 0) close(w->epfd);
+        if (w->commit_fd >= 0) close(w->commit_fd);
+    }
+    
+    free(pool->workers);
+    free(pool);
+}
+
+#else // !__linux__
+
+TcpWorkerPool* tcp_worker_pool_create(modbus_mapping_t *mapping, MappingLock *lock, Wal *wal, Watch *watch,
+                                      Stats *stats, Trace *trace, int port, int nb_workers, TcpBackend backend) {
+    (void)mapping;
+    (void)lock;
+    (void)wal;
+    (void)watch;
+    (void)stats;
+    (void)trace;
+    (void)port;
+    (void)nb_workers;
+    (void)backend;
+    log_warn("TCP workers need SO_REUSEPORT and epoll (Linux), using the main loop");
+    return NULL;
+}
+
+TcpBackend tcp_worker_pool_backend(TcpWorkerPool *pool) {
+    (void)pool;
+    return TCP_BACKEND_EPOLL;
+}
+
+void tcp_worker_pool_pause(TcpWorkerPool *pool, bool paused) {
+    (void)pool;
+    (void)paused;
+}
+
+void tcp_worker_pool_synchronize(TcpWorkerPool *pool, Watch *watch) {
+    (void)pool;
+    (void)watch;
+}
+
+int tcp_worker_pool_sockets(TcpWorkerPool *pool, int *socks, int max) {
+    (void)pool;
+    (void)socks;
+    (void)max;
+    return 0;
+}
+
+void tcp_worker_pool_disown(TcpWorkerPool *pool) {
+    (void)pool;
+}
+
+void tcp_worker_pool_set_wal(TcpWorkerPool *pool, Wal *wal) {
+    (void)pool;
+    (void)wal;
+}
+
+uint64_t tcp_worker_pool_requests(TcpWorkerPool *pool) {
+    (void)pool;
+    return 0;
+}
+
+int tcp_worker_pool_connections(TcpWorkerPool *pool) {
+    (void)pool;
+    return 0;
+}
+
+int tcp_worker_pool_queued(TcpWorkerPool *pool) {
+    (void)pool;
+    return 0;
+}
+
+void tcp_worker_pool_destroy(TcpWorkerPool *pool) {
+    (void)pool;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef TCP_WORKER_H
+#define TCP_WORKER_H
+
+#include "../config/config.h"
+#include "../core/mapping_lock.h"
+#include "../core/stats.h"
+#include "../core/trace.h"
+#include "../core/wal.h"
+#include "../core/watch.h"
+#include <modbus/modbus.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct TcpWorkerPool TcpWorkerPool;
+
+/**
+ * Start worker threads serving Modbus TCP on a shared port.
+ * Each worker owns a listening socket bound with SO_REUSEPORT (the kernel
+ * spreads new connections over them), an epoll reactor and a connection
+ * table. Sockets inherited from systemd or an upgraded server are used
+ * first, and inherited client connections are dealt out to the workers.
+ * Requests are answered by the PDU engine: reads use the lock-free
+ * seqlock path, writes serialise on the mapping lock. In sync WAL mode a
+ * connection's responses are parked until the writes among them are
+ * durable, and the log's commit event wakes the worker to send them; other
+ * connections are served meanwhile.
+ * The io_uring backend (built with HAVE_LIBURING) falls back to epoll when
+ * the kernel lacks the needed features.
+ * Linux only; returns NULL elsewhere so the caller can fall back to the
+ * single-threaded TCP adapter.
+ * @param mapping Register mapping shared by all workers
+ * @param lock Mapping lock shared with every other writer
+ * @param wal Write-ahead log of client writes, NULL for none
+ * @param watch Change watch told about client writes, NULL for none
+ * @param stats Registry each worker adds its stats shard to, NULL for none
+ * @param trace Registry each worker adds its trace ring to, NULL for none
+ * @param port TCP port
+ * @param nb_workers Number of worker threads
+ * @param backend Requested I/O backend
+ * @return Pointer to TcpWorkerPool, or NULL on failure
+ */
+TcpWorkerPool* tcp_worker_pool_create(modbus_mapping_t *mapping, MappingLock *lock, Wal *wal, Watch *watch,
+                                      Stats *stats, Trace *trace, int port, int nb_workers, TcpBackend backend);
+
+/**
+ * I/O backend actually in use (after any fallback)
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ * @return Backend
+ */
+TcpBackend tcp_worker_pool_backend(TcpWorkerPool *pool);
+
+/**
+ * Pause or resume serving (connections are kept, requests wait)
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ * @param paused true to pause
+ */
+void tcp_worker_pool_pause(TcpWorkerPool *pool, bool paused);
+
+/**
+ * Point the workers at a new watch, then wait until each has finished what
+ * it was serving, so none still uses the previous watch or a mapping
+ * replaced on the lock before the call (RCU grace period). Paused workers
+ * count too; the wait lasts at most one turn of their loop (~100 ms).
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ * @param watch Watch to note client writes in from now on
+ */
+void tcp_worker_pool_synchronize(TcpWorkerPool *pool, Watch *watch);
+
+/**
+ * Sockets to hand to a new process on upgrade: the listening sockets and
+ * the connections with no partial request buffered and no response parked
+ * (epoll backend only; io_uring may hold received data the buffers do not
+ * show yet). Call with the pool paused and synchronized.
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ * @param socks Filled with up to max sockets, still owned by the pool
+ * @param max Size of socks
+ * @return Number of sockets, which may exceed max
+ */
+int tcp_worker_pool_sockets(TcpWorkerPool *pool, int *socks, int max);
+
+/**
+ * Mark the sockets as handed over: the pool then closes them without
+ * shutting them down, which would cut them for the new process too
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ */
+void tcp_worker_pool_disown(TcpWorkerPool *pool);
+
+/**
+ * Point the workers at another write-ahead log, or none, as when the log is
+ * closed and reopened around an upgrade. Call with the pool paused and
+ * synchronized, and before closing the previous log.
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ * @param wal Write-ahead log of client writes, NULL for none
+ */
+void tcp_worker_pool_set_wal(TcpWorkerPool *pool, Wal *wal);
+
+/**
+ * Number of requests answered so far by all workers
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ * @return Request count
+ */
+uint64_t tcp_worker_pool_requests(TcpWorkerPool *pool);
+
+/**
+ * Connections open on all workers, as of their last loop iteration
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ * @return Connection count
+ */
+int tcp_worker_pool_connections(TcpWorkerPool *pool);
+
+/**
+ * Response chunks queued or in flight on all workers (io_uring backend;
+ * the epoll backend sends before waiting again and only reports the
+ * connections parked for the write-ahead log)
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ * @return Chunk count
+ */
+int tcp_worker_pool_queued(TcpWorkerPool *pool);
+
+/**
+ * Stop the workers and close all their sockets
+ * @param pool Pointer to TcpWorkerPool (may be NULL)
+ */
+void tcp_worker_pool_destroy(TcpWorkerPool *pool);
+
+#endif // TCP_WORKER_H
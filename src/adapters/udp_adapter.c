@@ -0,0 +1,242 @@
+#ifdef __linux__
+#define _GNU_SOURCE     // recvmmsg / sendmmsg
+#endif
+#include "udp_adapter.h"
+#include "../core/handoff.h"
+#include "../core/modbus_pdu.h"
+#include "../core/watch.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+    #include <ws2tcpip.h>
+#else
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+#endif
+
+// Datagrams moved per syscall, and batches drained per wakeup
+#define UDP_BATCH_SIZE 32
+#define UDP_MAX_BATCHES 8
+
+#define MBAP_HEADER_LENGTH 7
+
+struct UdpBatch {
+    uint8_t req[UDP_BATCH_SIZE][MODBUS_TCP_MAX_ADU_LENGTH];
+    uint8_t rsp[UDP_BATCH_SIZE][MODBUS_TCP_MAX_ADU_LENGTH];
+    struct sockaddr_storage addr[UDP_BATCH_SIZE];
+#ifdef __linux__
+    struct iovec req_iov[UDP_BATCH_SIZE];
+    struct iovec rsp_iov[UDP_BATCH_SIZE];
+    struct mmsghdr req_msg[UDP_BATCH_SIZE];
+    struct mmsghdr rsp_msg[UDP_BATCH_SIZE];
+#endif
+};
+
+/*
+ * Answer one MBAP-framed request into rsp and count it in batch. A logged
+ * write sets *wal_lsn, which the response must wait for.
+ * Returns the response length, 0 if the datagram is not a valid request.
+ */
+static int process_request(ModbusBackend *backend, StatsBatch *batch, const uint8_t *req, int len,
+                           uint8_t *rsp, const struct sockaddr_storage *addr, uint64_t *wal_lsn) {
+    if (len < MBAP_HEADER_LENGTH + 1) {
+        return 0;
+    }
+    // Protocol id must be 0 and the length field must match the datagram
+    int mbap_len = (req[4] << 8) | req[5];
+    if (req[2] != 0 || req[3] != 0 || mbap_len != len - 6) {
+        return 0;
+    }
+    
+    // Unit id is not filtered, as for the libmodbus TCP listener
+    uint64_t lsn;
+    int pdu_len = modbus_pdu_process(backend->mapping, &backend->mapping_lock, backend->wal, &lsn,
+                                     req + MBAP_HEADER_LENGTH, len - MBAP_HEADER_LENGTH, rsp + MBAP_HEADER_LENGTH);
+    if (lsn > 0) {
+        *wal_lsn = lsn;
+    }
+    if ((rsp[MBAP_HEADER_LENGTH] & 0x80) == 0) {
+        watch_note_write(backend->watch, req + MBAP_HEADER_LENGTH, len - MBAP_HEADER_LENGTH);
+    }
+    memcpy(rsp, req, 4);
+    rsp[4] = (uint8_t)((pdu_len + 1) >> 8);
+    rsp[5] = (uint8_t)(pdu_len + 1);
+    rsp[6] = req[6];
+    stats_count(backend->stats_shard, batch, req[6], req[7], len, MBAP_HEADER_LENGTH + pdu_len,
+                (rsp[MBAP_HEADER_LENGTH] & 0x80) != 0);
+    if (trace_active(backend->trace_ring)) {
+        // Datagrams have no connection: the peer port tells clients apart
+        uint32_t peer = addr->ss_family == AF_INET ? ntohs(((const struct sockaddr_in *)addr)->sin_port) : 0;
+        trace_record(backend->trace_ring, TRACE_UDP, TRACE_REQUEST, peer, req, len);
+        trace_record(backend->trace_ring, TRACE_UDP, TRACE_RESPONSE, peer, rsp, MBAP_HEADER_LENGTH + pdu_len);
+    }
+    return MBAP_HEADER_LENGTH + pdu_len;
+}
+
+static int open_socket(int port) {
+    int sock = (int)socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        log_error("UDP socket failed: %s", strerror(errno));
+        return -1;
+    }
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        log_error("UDP bind on port %d failed: %s", port, strerror(errno));
+        platform_close_fd(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int udp_adapter_init(ModbusBackend *backend, const ModbusConfig *config) {
+    struct UdpBatch *batch = (struct UdpBatch *)calloc(1, sizeof(struct UdpBatch));
+    if (!batch) {
+        log_error("Failed to allocate UDP batch buffers");
+        return -1;
+    }
+    
+    // Inherited from systemd or the server being upgraded, else bound here
+    int sock = handoff_take_listener(SOCK_DGRAM, config->udp_port);
+    if (sock < 0 && (sock = open_socket(config->udp_port)) < 0) {
+        free(batch);
+        return -1;
+    }
+    platform_set_nonblocking(sock);
+
+#ifdef __linux__
+    // The iovecs and message headers never move, only lengths change per batch
+    for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+        batch->req_iov[i].iov_base = batch->req[i];
+        batch->req_iov[i].iov_len = sizeof(batch->req[i]);
+        batch->req_msg[i].msg_hdr.msg_iov = &batch->req_iov[i];
+        batch->req_msg[i].msg_hdr.msg_iovlen = 1;
+        batch->rsp_iov[i].iov_base = batch->rsp[i];
+        batch->rsp_msg[i].msg_hdr.msg_iov = &batch->rsp_iov[i];
+        batch->rsp_msg[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+    
+    backend->udp_sock = sock;
+    backend->udp_batch = batch;
+    backend->unit_id = config->unit_id;
+    
+    log_debug("UDP Server listening on port %d", config->udp_port);
+    return 0;
+}
+
+#ifdef __linux__
+static int handle_batch(ModbusBackend *backend) {
+    struct UdpBatch *batch = backend->udp_batch;
+    
+    for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+        batch->req_msg[i].msg_hdr.msg_name = &batch->addr[i];
+        batch->req_msg[i].msg_hdr.msg_namelen = sizeof(batch->addr[i]);
+    }
+    
+    int n = recvmmsg(backend->udp_sock, batch->req_msg, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (n <= 0) {
+        return (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) ? -1 : 0;
+    }
+    uint64_t recv_ns = platform_monotonic_ns();
+    
+    int nb_rsp = 0;
+    uint64_t wal_lsn = 0;
+    StatsBatch stats = {{0}};
+    for (int i = 0; i < n; i++) {
+        int len = process_request(backend, &stats, batch->req[i], (int)batch->req_msg[i].msg_len,
+                                  batch->rsp[nb_rsp], &batch->addr[i], &wal_lsn);
+        if (len == 0) {
+            continue;
+        }
+        batch->rsp_iov[nb_rsp].iov_base = batch->rsp[nb_rsp];
+        batch->rsp_iov[nb_rsp].iov_len = len;
+        batch->rsp_msg[nb_rsp].msg_hdr.msg_name = &batch->addr[i];
+        batch->rsp_msg[nb_rsp].msg_hdr.msg_namelen = batch->req_msg[i].msg_hdr.msg_namelen;
+        nb_rsp++;
+    }
+    
+    // One wait covers every write of the batch
+    wal_wait(backend->wal, wal_lsn);
+    
+    // A full socket buffer drops responses, like a lost datagram would
+    int sent = 0;
+    while (sent < nb_rsp) {
+        int rc = sendmmsg(backend->udp_sock, batch->rsp_msg + sent, nb_rsp - sent, MSG_DONTWAIT);
+        if (rc <= 0) {
+            log_debug("UDP sendmmsg dropped %d responses: %s", nb_rsp - sent, strerror(errno));
+            break;
+        }
+        sent += rc;
+    }
+    stats_complete(backend->stats_shard, &stats, platform_monotonic_ns() - recv_ns);
+    return n;
+}
+#else
+static int handle_batch(ModbusBackend *backend) {
+    struct UdpBatch *batch = backend->udp_batch;
+    int n = 0;
+    
+    for (; n < UDP_BATCH_SIZE; n++) {
+        socklen_t addr_len = sizeof(batch->addr[0]);
+        int len = (int)recvfrom(backend->udp_sock, (char *)batch->req[0], sizeof(batch->req[0]), 0,
+                                (struct sockaddr *)&batch->addr[0], &addr_len);
+        if (len < 0) {
+            break;
+        }
+        uint64_t recv_ns = platform_monotonic_ns();
+        uint64_t wal_lsn = 0;
+        StatsBatch stats = {{0}};
+        int rsp_len = process_request(backend, &stats, batch->req[0], len, batch->rsp[0], &batch->addr[0],
+                                      &wal_lsn);
+        if (rsp_len > 0) {
+            wal_wait(backend->wal, wal_lsn);
+            sendto(backend->udp_sock, (const char *)batch->rsp[0], rsp_len, 0,
+                   (struct sockaddr *)&batch->addr[0], addr_len);
+            stats_complete(backend->stats_shard, &stats, platform_monotonic_ns() - recv_ns);
+        }
+    }
+    return n;
+}
+#endif
+
+int udp_adapter_handle(ModbusBackend *backend) {
+    if (!backend || backend->udp_sock == -1) {
+        return -1;
+    }
+    
+    // Bounded so a flood cannot starve the other listeners of the loop
+    int total = 0;
+    for (int i = 0; i < UDP_MAX_BATCHES; i++) {
+        int n = handle_batch(backend);
+        if (n < 0) {
+            log_debug("UDP receive failed: %s", strerror(errno));
+            return -1;
+        }
+        total += n;
+        if (n < UDP_BATCH_SIZE) {
+            break;
+        }
+    }
+    return total;
+}
+
+void udp_adapter_cleanup(ModbusBackend *backend) {
+    if (!backend) return;
+    
+    if (backend->udp_sock != -1) {
+        platform_close_fd(backend->udp_sock);
+        backend->udp_sock = -1;
+    }
+    free(backend->udp_batch);
+    backend->udp_batch = NULL;
+}
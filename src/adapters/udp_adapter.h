@@ -0,0 +1,30 @@
+#ifndef UDP_ADAPTER_H
+#define UDP_ADAPTER_H
+
+#include "../config/config.h"
+#include "modbus_backend.h"
+#include <modbus/modbus.h>
+
+/**
+ * Initialize the Modbus/UDP listener (MBAP header, one ADU per datagram)
+ * @param backend Pointer to ModbusBackend
+ * @param config Pointer to ModbusConfig
+ * @return 0 on success, -1 on failure
+ */
+int udp_adapter_init(ModbusBackend *backend, const ModbusConfig *config);
+
+/**
+ * Drain pending datagrams and answer them. On Linux requests and responses
+ * are moved in batches with recvmmsg()/sendmmsg().
+ * @param backend Pointer to ModbusBackend
+ * @return Number of requests processed, -1 on error
+ */
+int udp_adapter_handle(ModbusBackend *backend);
+
+/**
+ * Cleanup UDP resources
+ * @param backend Pointer to ModbusBackend
+ */
+void udp_adapter_cleanup(ModbusBackend *backend);
+
+#endif // UDP_ADAPTER_H
@@ -4,6 +4,88 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// Downstream polling limits
+#define MAX_POLL_DEVICES 16
+#define MAX_POLL_BLOCKS 128
+
+typedef enum {
+    POLL_TARGET_INPUT_REGISTERS,
+    POLL_TARGET_HOLDING_REGISTERS
+} PollTarget;
+
+typedef enum {
+    TCP_BACKEND_EPOLL,
+    TCP_BACKEND_IO_URING
+} TcpBackend;
+
+typedef enum {
+    WAL_MODE_ASYNC,         // Answer at once, log synced within the commit interval
+    WAL_MODE_SYNC           // Answer writes once their log record is synced
+} WalMode;
+
+typedef struct {
+    int function;           // 3 = read holding, 4 = read input registers
+    int address;            // Remote start address
+    int count;              // Number of registers
+    int local_address;      // Destination address in the local mapping
+    PollTarget target;      // Destination table in the local mapping
+    int period_ms;          // Poll period, 0 = device period
+} PollBlockConfig;
+
+typedef struct {
+    char name[32];
+    bool is_rtu;
+    
+    // TCP device settings
+    char host[64];
+    int port;
+    
+    // RTU device settings
+    char serial_device[64];
+    int baudrate;
+    char parity;
+    int data_bits;
+    int stop_bits;
+    
+    int unit_id;
+    int period_ms;
+    int timeout_ms;
+    int max_gap;            // Unused registers a merged read may span
+    
+    PollBlockConfig blocks[MAX_POLL_BLOCKS];
+    int nb_blocks;
+} PollDeviceConfig;
+
+// Linear conversion of engineering values: register value = (value - offset) / scale
+typedef struct {
+    double scale;
+    double offset;
+    double min;             // Values clamped to [min, max] before conversion
+    double max;
+    char round[12];         // Rounding to integer registers, "nearest" by default
+} ScalingConfig;
+
+// Named point written by {"tag": name, "value": v} instead of by address
+typedef struct {
+    char name[64];
+    char table[24];         // Table name, as updates take it ("holding", "coils"...)
+    int address;
+    char datatype[8];       // Update datatype, "uint16" by default
+    char byte_order[8];     // Update byte order, "LE" by default
+    ScalingConfig scaling;
+    int length;             // Registers of a string tag, 0 = as long as the value
+} TagConfig;
+
+// Register range whose updates and reads by address are in engineering units
+typedef struct {
+    char table[24];
+    int address;
+    int count;              // Registers in the range
+    ScalingConfig scaling;
+} ScaleRangeConfig;
+
+// Settings of a config file, cached as laid out here: new fields of it and of
+// the records it holds are listed in the layout digest of config_cache.c
 typedef struct {
     // Mode settings
     bool enable_tcp;
@@ -11,6 +93,38 @@ typedef struct {
     
     // TCP settings
     int tcp_port;
+    int tcp_workers;        // SO_REUSEPORT worker threads, 0 = serve in the main loop
+    TcpBackend tcp_backend; // I/O backend of the worker threads
+    
+    // Extra listeners on the same mapping, 0 = disabled
+    int rtu_tcp_port;       // RTU framing over raw TCP
+    int udp_port;           // Modbus/UDP
+    
+    // Prometheus scrape endpoint (HTTP /metrics), 0 = disabled
+    int metrics_port;
+    
+    // Lowest log level written (LOG_LEVEL_* of logging.h)
+    int log_level;
+    
+    // Wire trace: ADUs kept per serving thread (0 = no trace), recording from startup
+    int trace_records;
+    bool trace_enabled;
+    
+    // Register snapshots restored at startup ("" = disabled)
+    char snapshot_file[256];
+    int snapshot_interval_ms;
+    
+    // Write-ahead log of client writes, replayed over the snapshot ("" = disabled)
+    char wal_file[256];
+    WalMode wal_mode;
+    int wal_commit_interval_ms;     // Group commit: records gathered per fdatasync
+    
+    // Tables kept in a memory-mapped file instead of the heap ("" = disabled)
+    char image_file[256];
+    int image_sync_interval_ms;     // 0 = left to the kernel until exit
+    
+    // Change events for client writes to subscribed ranges: gathered this long
+    int watch_interval_ms;
     
     // RTU settings
     char serial_device[64];
@@ -34,6 +148,21 @@ typedef struct {
     
     int input_regs_start;
     int nb_input_regs;
+    
+    // Downstream devices mirrored into the local mapping
+    PollDeviceConfig poll_devices[MAX_POLL_DEVICES];
+    int nb_poll_devices;
+    
+    // Named points, allocated by config_load()
+    TagConfig *tags;
+    int nb_tags;
+    
+    // Scaled register ranges, allocated by config_load()
+    ScaleRangeConfig *scale_ranges;
+    int nb_scale_ranges;
+    
+    // Mapped cache holding tags and scale_ranges when loaded from one, NULL otherwise
+    struct ConfigCache *cache;
 } ModbusConfig;
 
 /**
@@ -44,4 +173,10 @@ typedef struct {
  */
 int config_load(const char *filename, ModbusConfig *config);
 
+/**
+ * Free what config_load() or config_cache_load() allocated
+ * @param config Pointer to ModbusConfig structure
+ */
+void config_free(ModbusConfig *config);
+
 #endif // CONFIG_H
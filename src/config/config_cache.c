@@ -0,0 +1,289 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // fileno
+#endif
+#include "config_cache.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bump the version byte whenever the header changes
+#define CACHE_MAGIC "MBCFG\0\0\2"
+#define CACHE_BYTE_ORDER 0x01020304u
+
+// Bump whenever config_load() resolves a file differently
+#define CACHE_LOADER_VERSION 2u
+
+/*
+ * File layout, host byte order (the records are used in place):
+ *   header: magic[8], byte order mark, loader version, sizes of
+ *   ModbusConfig, TagConfig and ScaleRangeConfig, tag and scaled range
+ *   counts, zero (8 x u32), layout digest, length and modification time in
+ *   ns of the JSON file (3 x u64), payload length and checksum (2 x u64);
+ *   payload: the ModbusConfig, pointers cleared, then the tags and the
+ *   scaled ranges. Every record size is a multiple of 8, so all of them
+ *   stay aligned in the mapping.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t loader_version;
+    uint32_t record_sizes[3];
+    uint32_t nb_tags;
+    uint32_t nb_scale_ranges;
+    uint32_t reserved;
+    uint64_t layout;
+    uint64_t source_size;
+    uint64_t source_mtime_ns;
+    uint64_t payload_length;
+    uint64_t checksum;
+} CacheHeader;
+
+struct ConfigCache {
+    PlatformFileMap map;
+};
+
+// FNV-1a over 64-bit words, then over the bytes left
+static uint64_t checksum(const uint8_t *buf, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, buf + i, sizeof(word));
+        h = (h ^ word) * 1099511628211ULL;
+    }
+    for (; i < len; i++) {
+        h = (h ^ buf[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static void record_sizes(uint32_t *sizes) {
+    sizes[0] = (uint32_t)sizeof(ModbusConfig);
+    sizes[1] = (uint32_t)sizeof(TagConfig);
+    sizes[2] = (uint32_t)sizeof(ScaleRangeConfig);
+}
+
+/*
+ * Offset and size of every field of the records, nested ones included. Their
+ * digest in the header refuses a cache laid out by another build even when
+ * the record sizes happen to match. A field added to config.h goes here too.
+ */
+#define FIELD(type, field) {(uint32_t)offsetof(type, field), (uint32_t)sizeof(((type *)0)->field)}
+
+static const uint32_t LAYOUT[][2] = {
+    // ModbusConfig
+    FIELD(ModbusConfig, enable_tcp), FIELD(ModbusConfig, enable_rtu), FIELD(ModbusConfig, tcp_port),
+    FIELD(ModbusConfig, tcp_workers), FIELD(ModbusConfig, tcp_backend),
+    FIELD(ModbusConfig, rtu_tcp_port), FIELD(ModbusConfig, udp_port),
+    FIELD(ModbusConfig, metrics_port), FIELD(ModbusConfig, log_level),
+    FIELD(ModbusConfig, trace_records), FIELD(ModbusConfig, trace_enabled),
+    FIELD(ModbusConfig, snapshot_file), FIELD(ModbusConfig, snapshot_interval_ms),
+    FIELD(ModbusConfig, wal_file), FIELD(ModbusConfig, wal_mode),
+    FIELD(ModbusConfig, wal_commit_interval_ms), FIELD(ModbusConfig, image_file),
+    FIELD(ModbusConfig, image_sync_interval_ms), FIELD(ModbusConfig, watch_interval_ms),
+    FIELD(ModbusConfig, serial_device), FIELD(ModbusConfig, baudrate), FIELD(ModbusConfig, parity),
+    FIELD(ModbusConfig, data_bits), FIELD(ModbusConfig, stop_bits), FIELD(ModbusConfig, unit_id),
+    FIELD(ModbusConfig, coils_start), FIELD(ModbusConfig, nb_coils),
+    FIELD(ModbusConfig, input_bits_start), FIELD(ModbusConfig, nb_input_bits),
+    FIELD(ModbusConfig, holding_regs_start), FIELD(ModbusConfig, nb_holding_regs),
+    FIELD(ModbusConfig, input_regs_start), FIELD(ModbusConfig, nb_input_regs),
+    FIELD(ModbusConfig, poll_devices), FIELD(ModbusConfig, nb_poll_devices),
+    FIELD(ModbusConfig, tags), FIELD(ModbusConfig, nb_tags), FIELD(ModbusConfig, scale_ranges),
+    FIELD(ModbusConfig, nb_scale_ranges), FIELD(ModbusConfig, cache),
+    // PollDeviceConfig
+    FIELD(PollDeviceConfig, name), FIELD(PollDeviceConfig, is_rtu), FIELD(PollDeviceConfig, host),
+    FIELD(PollDeviceConfig, port), FIELD(PollDeviceConfig, serial_device),
+    FIELD(PollDeviceConfig, baudrate), FIELD(PollDeviceConfig, parity),
+    FIELD(PollDeviceConfig, data_bits), FIELD(PollDeviceConfig, stop_bits),
+    FIELD(PollDeviceConfig, unit_id), FIELD(PollDeviceConfig, period_ms),
+    FIELD(PollDeviceConfig, timeout_ms), FIELD(PollDeviceConfig, max_gap),
+    FIELD(PollDeviceConfig, blocks), FIELD(PollDeviceConfig, nb_blocks),
+    // PollBlockConfig
+    FIELD(PollBlockConfig, function), FIELD(PollBlockConfig, address),
+    FIELD(PollBlockConfig, count), FIELD(PollBlockConfig, local_address),
+    FIELD(PollBlockConfig, target), FIELD(PollBlockConfig, period_ms),
+    // TagConfig
+    FIELD(TagConfig, name), FIELD(TagConfig, table), FIELD(TagConfig, address),
+    FIELD(TagConfig, datatype), FIELD(TagConfig, byte_order), FIELD(TagConfig, scaling),
+    FIELD(TagConfig, length),
+    // ScaleRangeConfig
+    FIELD(ScaleRangeConfig, table), FIELD(ScaleRangeConfig, address),
+    FIELD(ScaleRangeConfig, count), FIELD(ScaleRangeConfig, scaling),
+    // ScalingConfig
+    FIELD(ScalingConfig, scale), FIELD(ScalingConfig, offset), FIELD(ScalingConfig, min),
+    FIELD(ScalingConfig, max), FIELD(ScalingConfig, round),
+};
+
+static uint64_t layout_digest(void) {
+    return checksum((const uint8_t *)LAYOUT, sizeof(LAYOUT));
+}
+
+int config_cache_path(const char *filename, char *path, size_t size) {
+    int len = snprintf(path, size, "%s%s", filename, CONFIG_CACHE_SUFFIX);
+    return len >= 0 && (size_t)len < size ? 0 : -1;
+}
+
+/*
+ * Write the cache of a config loaded from a JSON file of the given length and
+ * modification time, taken before the file was read: a file changed while it
+ * was read then reads as changed at the next start.
+ */
+static int write_cache(const char *path, const ModbusConfig *config, uint64_t source_size,
+                       uint64_t source_mtime_ns) {
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.source_size = source_size;
+    header.source_mtime_ns = source_mtime_ns;
+    memcpy(header.magic, CACHE_MAGIC, 8);
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.loader_version = CACHE_LOADER_VERSION;
+    record_sizes(header.record_sizes);
+    header.layout = layout_digest();
+    header.nb_tags = (uint32_t)config->nb_tags;
+    header.nb_scale_ranges = (uint32_t)config->nb_scale_ranges;
+    
+    size_t tags_len = (size_t)config->nb_tags * sizeof(TagConfig);
+    size_t ranges_len = (size_t)config->nb_scale_ranges * sizeof(ScaleRangeConfig);
+    header.payload_length = sizeof(ModbusConfig) + tags_len + ranges_len;
+    uint8_t *payload = (uint8_t *)calloc(1, (size_t)header.payload_length);
+    if (!payload) {
+        log_error("Failed to allocate %llu bytes of config cache", (unsigned long long)header.payload_length);
+        return -1;
+    }
+    
+    // Pointers mean nothing in the file: the loader points them into the mapping
+    ModbusConfig *copy = (ModbusConfig *)payload;
+    *copy = *config;
+    copy->tags = NULL;
+    copy->scale_ranges = NULL;
+    copy->cache = NULL;
+    if (tags_len) {
+        memcpy(payload + sizeof(ModbusConfig), config->tags, tags_len);
+    }
+    if (ranges_len) {
+        memcpy(payload + sizeof(ModbusConfig) + tags_len, config->scale_ranges, ranges_len);
+    }
+    header.checksum = checksum(payload, (size_t)header.payload_length);
+    
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    bool ok = fp && fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(payload, 1, (size_t)header.payload_length, fp) == (size_t)header.payload_length &&
+              fflush(fp) == 0 && platform_sync_fd(fileno(fp)) == 0;
+    if (fp) {
+        ok = fclose(fp) == 0 && ok;
+    }
+    free(payload);
+    if (!ok || platform_replace_file(tmp_path, path) != 0) {
+        log_error("Failed to write config cache %s", path);
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int config_cache_load(const char *path, const char *source, ModbusConfig *config) {
+    uint64_t source_size, source_mtime_ns;
+    if (platform_file_stamp(source, &source_size, &source_mtime_ns) != 0) {
+        return -1;
+    }
+    ConfigCache *cache = (ConfigCache *)calloc(1, sizeof(ConfigCache));
+    if (!cache) {
+        return -1;
+    }
+    if (platform_map_file_readonly(path, &cache->map) != 0) {
+        free(cache);
+        return -1;
+    }
+    
+    // Checked in order of cost: the checksum reads every page in
+    const CacheHeader *h = (const CacheHeader *)cache->map.addr;
+    const uint8_t *payload = (const uint8_t *)cache->map.addr + sizeof(CacheHeader);
+    uint32_t sizes[3];
+    record_sizes(sizes);
+    const char *problem = NULL;
+    if (cache->map.size < sizeof(CacheHeader)) {
+        problem = "is damaged";
+    } else if (memcmp(h->magic, CACHE_MAGIC, 8) != 0 || h->byte_order != CACHE_BYTE_ORDER ||
+               memcmp(h->record_sizes, sizes, sizeof(sizes)) != 0 || h->layout != layout_digest()) {
+        problem = "was written by another build";
+    } else if (h->loader_version != CACHE_LOADER_VERSION) {
+        problem = "was compiled by another version of the loader";
+    } else if (h->source_size != source_size || h->source_mtime_ns != source_mtime_ns) {
+        problem = "is out of date";
+    } else if (h->nb_tags > INT32_MAX || h->nb_scale_ranges > INT32_MAX ||
+               h->payload_length != sizeof(ModbusConfig) + (uint64_t)h->nb_tags * sizeof(TagConfig) +
+                                    (uint64_t)h->nb_scale_ranges * sizeof(ScaleRangeConfig) ||
+               cache->map.size - sizeof(CacheHeader) != h->payload_length ||
+               checksum(payload, (size_t)h->payload_length) != h->checksum) {
+        problem = "is damaged";
+    }
+    if (problem) {
+        log_info("Config cache %s %s, loading %s", path, problem, source);
+        config_cache_close(cache);
+        return -1;
+    }
+    
+    memcpy(config, payload, sizeof(ModbusConfig));
+    config->nb_tags = (int)h->nb_tags;
+    config->nb_scale_ranges = (int)h->nb_scale_ranges;
+    config->tags = config->nb_tags > 0 ? (TagConfig *)(payload + sizeof(ModbusConfig)) : NULL;
+    config->scale_ranges = config->nb_scale_ranges > 0 ?
+                           (ScaleRangeConfig *)(payload + sizeof(ModbusConfig) +
+                                                (size_t)config->nb_tags * sizeof(TagConfig)) : NULL;
+    config->cache = cache;
+    return 0;
+}
+
+void config_cache_close(ConfigCache *cache) {
+    if (!cache) return;
+    
+    platform_unmap_file(&cache->map);
+    free(cache);
+}
+
+int config_cache_compile(const char *filename, const char *path) {
+    uint64_t size, mtime_ns;
+    if (platform_file_stamp(filename, &size, &mtime_ns) != 0) {
+        log_error("Cannot compile %s: the file is missing", filename);
+        return -1;
+    }
+    ModbusConfig config;
+    if (config_load(filename, &config) != 0) {
+        config_free(&config);
+        return -1;
+    }
+    int rc = write_cache(path, &config, size, mtime_ns);
+    if (rc == 0) {
+        log_info("Compiled %s into %s: %d tags, %d scaled ranges", filename, path, config.nb_tags,
+                 config.nb_scale_ranges);
+    }
+    config_free(&config);
+    return rc;
+}
+
+int config_load_cached(const char *filename, ModbusConfig *config) {
+    char path[512];
+    uint64_t size, mtime_ns;
+    if (config_cache_path(filename, path, sizeof(path)) != 0 || platform_file_stamp(path, &size, &mtime_ns) != 0) {
+        return config_load(filename, config);
+    }
+    if (config_cache_load(path, filename, config) == 0) {
+        log_info("Config loaded from cache %s", path);
+        return 0;
+    }
+    
+    // Stale or damaged: compiled again, unless the JSON file is gone too
+    bool have_source = platform_file_stamp(filename, &size, &mtime_ns) == 0;
+    if (config_load(filename, config) != 0) {
+        return -1;
+    }
+    if (have_source && write_cache(path, config, size, mtime_ns) == 0) {
+        log_info("Config cache %s compiled again", path);
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef CONFIG_CACHE_H
+#define CONFIG_CACHE_H
+
+#include "config.h"
+#include <stddef.h>
+
+// Suffix of the cache next to a JSON config file
+#define CONFIG_CACHE_SUFFIX ".cache"
+
+typedef struct ConfigCache ConfigCache;
+
+/**
+ * Path of the cache of a JSON config file: the same path plus CONFIG_CACHE_SUFFIX
+ * @param filename JSON config file
+ * @param path Filled with the cache path
+ * @param size Size of path
+ * @return 0 on success, -1 if the path does not fit
+ */
+int config_cache_path(const char *filename, char *path, size_t size);
+
+/**
+ * Compile a JSON config into its binary cache: every setting, then the tags
+ * and scaled ranges, laid out as this build holds them in memory and
+ * stamped with the length and modification time of the JSON file. The
+ * cache is written aside and renamed over the previous one.
+ * @param filename JSON config file
+ * @param path Cache file
+ * @return 0 on success, -1 on failure
+ */
+int config_cache_compile(const char *filename, const char *path);
+
+/**
+ * Load a config from its cache. The cache is mapped and used in place: the
+ * tags and scaled ranges of the config point into it until config_free().
+ * It is refused when the JSON file changed since it was compiled, when its
+ * checksum does not match, or when another build wrote it.
+ * @param path Cache file
+ * @param source JSON file the cache was compiled from
+ * @param config Filled on success
+ * @return 0 on success, -1 if there is no usable cache
+ */
+int config_cache_load(const char *path, const char *source, ModbusConfig *config);
+
+/**
+ * Unmap a cache once its config is no longer used (called by config_free())
+ * @param cache Pointer to ConfigCache
+ */
+void config_cache_close(ConfigCache *cache);
+
+/**
+ * Load a config from its cache when the cache is current, else from the
+ * JSON file. A cache found stale is compiled again; none is created where
+ * there was none, `--compile-config` does that.
+ * @param filename JSON config file
+ * @param config Pointer to ModbusConfig structure to fill
+ * @return 0 on success, -1 on failure
+ */
+int config_load_cached(const char *filename, ModbusConfig *config);
+
+#endif // CONFIG_CACHE_H
@@ -1,49 +1,448 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // strnlen
+#endif
 #include "config.h"
+#include "config_cache.h"
 #include "../utils/logging.h"
+#include "../utils/platform.h"
+#include "../utils/text_buffer.h"
 #include "cJSON.h"
+#include <float.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>      // strcasecmp
 #include <stdlib.h>
 
-int config_load(const char *filename, ModbusConfig *config) {
-    // Set defaults
-    config->enable_tcp = true;
-    config->enable_rtu = false;
-    config->tcp_port = 1502;
-    config->unit_id = 1;
-    config->coils_start = 0;
-    config->nb_coils = 0;
-    config->input_bits_start = 0;
-    config->nb_input_bits = 0;
-    config->holding_regs_start = 0;
-    config->nb_holding_regs = 0;
-    config->input_regs_start = 0;
-    config->nb_input_regs = 0;
-    strcpy(config->serial_device, "/dev/ttyUSB0");
-    config->baudrate = 9600;
-    config->parity = 'N';
-    config->data_bits = 8;
-    config->stop_bits = 1;
+static void parse_serial(cJSON *j, char *device, size_t device_size,
+                         int *baudrate, char *parity, int *data_bits, int *stop_bits) {
+    cJSON *d;
+    if ((d = cJSON_GetObjectItem(j, "device")) && cJSON_IsString(d)) {
+        strncpy(device, d->valuestring, device_size - 1);
+        device[device_size - 1] = '\0';
+    }
+    if ((d = cJSON_GetObjectItem(j, "baudrate")) && cJSON_IsNumber(d)) {
+        *baudrate = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "parity")) && cJSON_IsString(d)) {
+        *parity = d->valuestring[0];
+    }
+    if ((d = cJSON_GetObjectItem(j, "data_bits")) && cJSON_IsNumber(d)) {
+        *data_bits = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "stop_bits")) && cJSON_IsNumber(d)) {
+        *stop_bits = d->valueint;
+    }
+}
+
+static void parse_poll_block(cJSON *j, PollBlockConfig *block) {
+    cJSON *d;
+    block->function = 4;
+    block->address = 0;
+    block->count = 0;
+    block->local_address = 0;
+    block->target = POLL_TARGET_INPUT_REGISTERS;
+    block->period_ms = 0;
     
-    // Read file
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        log_warn("Config file not found: %s, using defaults", filename);
-        return 0; // Return 0 to allow running with defaults
+    if ((d = cJSON_GetObjectItem(j, "function")) && cJSON_IsNumber(d)) {
+        block->function = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "address")) && cJSON_IsNumber(d)) {
+        block->address = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "count")) && cJSON_IsNumber(d)) {
+        block->count = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "local_address")) && cJSON_IsNumber(d)) {
+        block->local_address = d->valueint;
+    } else {
+        block->local_address = block->address;
+    }
+    if ((d = cJSON_GetObjectItem(j, "target")) && cJSON_IsString(d) &&
+        strcmp(d->valuestring, "holding_registers") == 0) {
+        block->target = POLL_TARGET_HOLDING_REGISTERS;
     }
+    if ((d = cJSON_GetObjectItem(j, "period_ms")) && cJSON_IsNumber(d) && d->valueint > 0) {
+        block->period_ms = d->valueint;
+    }
+}
+
+static int parse_poll_device(cJSON *j, PollDeviceConfig *dev, int index) {
+    cJSON *d;
+    memset(dev, 0, sizeof(*dev));
+    snprintf(dev->name, sizeof(dev->name), "device%d", index);
+    dev->port = 502;
+    strcpy(dev->serial_device, "/dev/ttyUSB1");
+    dev->baudrate = 9600;
+    dev->parity = 'N';
+    dev->data_bits = 8;
+    dev->stop_bits = 1;
+    dev->unit_id = 1;
+    dev->period_ms = 1000;
+    dev->timeout_ms = 500;
     
-    char buf[2048];
-    size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
-    fclose(fp);
-    buf[len] = '\0';
+    if ((d = cJSON_GetObjectItem(j, "name")) && cJSON_IsString(d)) {
+        strncpy(dev->name, d->valuestring, sizeof(dev->name) - 1);
+    }
+    if ((d = cJSON_GetObjectItem(j, "type")) && cJSON_IsString(d)) {
+        dev->is_rtu = (strcmp(d->valuestring, "rtu") == 0);
+    }
+    if ((d = cJSON_GetObjectItem(j, "host")) && cJSON_IsString(d)) {
+        strncpy(dev->host, d->valuestring, sizeof(dev->host) - 1);
+    }
+    if ((d = cJSON_GetObjectItem(j, "port")) && cJSON_IsNumber(d)) {
+        dev->port = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "serial")) && cJSON_IsObject(d)) {
+        parse_serial(d, dev->serial_device, sizeof(dev->serial_device),
+                     &dev->baudrate, &dev->parity, &dev->data_bits, &dev->stop_bits);
+    }
+    if ((d = cJSON_GetObjectItem(j, "unit_id")) && cJSON_IsNumber(d)) {
+        dev->unit_id = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "period_ms")) && cJSON_IsNumber(d) && d->valueint > 0) {
+        dev->period_ms = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "timeout_ms")) && cJSON_IsNumber(d) && d->valueint > 0) {
+        dev->timeout_ms = d->valueint;
+    }
+    if ((d = cJSON_GetObjectItem(j, "max_gap")) && cJSON_IsNumber(d) && d->valueint >= 0) {
+        dev->max_gap = d->valueint;
+    }
     
-    // Parse JSON
-    cJSON *root = cJSON_Parse(buf);
-    if (!root) {
-        log_error("Failed to parse JSON config");
+    if (!dev->is_rtu && dev->host[0] == '\0') {
+        log_error("Poll device '%s' has no host", dev->name);
+        return -1;
+    }
+    
+    // "tags" is accepted as an alias of "blocks"
+    cJSON *blocks = cJSON_GetObjectItem(j, "blocks");
+    if (!blocks) {
+        blocks = cJSON_GetObjectItem(j, "tags");
+    }
+    cJSON *b;
+    cJSON_ArrayForEach(b, blocks) {
+        if (dev->nb_blocks >= MAX_POLL_BLOCKS) {
+            log_warn("Poll device '%s': more than %d blocks, ignoring the rest",
+                     dev->name, MAX_POLL_BLOCKS);
+            break;
+        }
+        PollBlockConfig *block = &dev->blocks[dev->nb_blocks];
+        parse_poll_block(b, block);
+        if ((block->function != 3 && block->function != 4) || block->count <= 0) {
+            log_warn("Poll device '%s': ignoring invalid block at address %d",
+                     dev->name, block->address);
+            continue;
+        }
+        dev->nb_blocks++;
+    }
+    return 0;
+}
+
+// String value cut to the size of its field
+static void copy_value(char *dst, size_t size, const char *src) {
+    size_t len = strnlen(src, size - 1);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/*
+ * Keys of tags and scaled ranges, matched regardless of case like every
+ * other key; the scaling keys are shared by both
+ */
+#define SCALING_KEYS "scale", "offset", "min", "max", "round"
+
+static const char *const TAG_KEYS[] = {"table", "address", "datatype", "byte_order", "length", SCALING_KEYS};
+static const char *const SCALE_RANGE_KEYS[] = {"table", "address", "count", SCALING_KEYS};
+
+// First of the keys from item on that is none of keys, NULL if all are known
+static cJSON *unknown_key(cJSON *item, const char *const *keys, size_t nb_keys) {
+    for (; item; item = item->next) {
+        size_t k = 0;
+        while (k < nb_keys && strcasecmp(item->string, keys[k]) != 0) {
+            k++;
+        }
+        if (k == nb_keys) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Scaling keys of a tag or scaled range: scale, offset, min, max, round.
+ * Returns -1 on a zero scale or an empty clamp range.
+ */
+static int parse_scaling(cJSON *j, ScalingConfig *s) {
+    cJSON *d;
+    s->scale = 1.0;
+    s->offset = 0.0;
+    s->min = -DBL_MAX;
+    s->max = DBL_MAX;
+    strcpy(s->round, "nearest");
+    
+    if ((d = cJSON_GetObjectItem(j, "scale")) && cJSON_IsNumber(d)) {
+        s->scale = d->valuedouble;
+    }
+    if ((d = cJSON_GetObjectItem(j, "offset")) && cJSON_IsNumber(d)) {
+        s->offset = d->valuedouble;
+    }
+    if ((d = cJSON_GetObjectItem(j, "min")) && cJSON_IsNumber(d)) {
+        s->min = d->valuedouble;
+    }
+    if ((d = cJSON_GetObjectItem(j, "max")) && cJSON_IsNumber(d)) {
+        s->max = d->valuedouble;
+    }
+    if ((d = cJSON_GetObjectItem(j, "round")) && cJSON_IsString(d)) {
+        copy_value(s->round, sizeof(s->round), d->valuestring);
+    }
+    return s->scale != 0 && s->min <= s->max ? 0 : -1;
+}
+
+// One entry of "tags": the key is the tag name
+static int parse_tag(cJSON *j, TagConfig *tag) {
+    cJSON *d;
+    memset(tag, 0, sizeof(*tag));
+    strcpy(tag->table, "holding");
+    strcpy(tag->datatype, "uint16");
+    strcpy(tag->byte_order, "LE");
+    
+    if (!j->string || j->string[0] == '\0' || strlen(j->string) >= sizeof(tag->name) || !cJSON_IsObject(j)) {
+        log_warn("Ignoring invalid tag '%s'", j->string ? j->string : "");
+        return -1;
+    }
+    strcpy(tag->name, j->string);
+    size_t nb_keys = sizeof(TAG_KEYS) / sizeof(TAG_KEYS[0]);
+    for (d = unknown_key(j->child, TAG_KEYS, nb_keys); d; d = unknown_key(d->next, TAG_KEYS, nb_keys)) {
+        log_warn("Tag '%s': unknown key '%s', ignoring it", tag->name, d->string);
+    }
+    if ((d = cJSON_GetObjectItem(j, "table")) && cJSON_IsString(d)) {
+        copy_value(tag->table, sizeof(tag->table), d->valuestring);
+    }
+    if ((d = cJSON_GetObjectItem(j, "address")) && cJSON_IsNumber(d)) {
+        tag->address = d->valueint;
+    } else {
+        log_warn("Tag '%s' has no address, ignoring it", tag->name);
         return -1;
     }
+    if ((d = cJSON_GetObjectItem(j, "datatype")) && cJSON_IsString(d)) {
+        copy_value(tag->datatype, sizeof(tag->datatype), d->valuestring);
+    }
+    if ((d = cJSON_GetObjectItem(j, "byte_order")) && cJSON_IsString(d)) {
+        copy_value(tag->byte_order, sizeof(tag->byte_order), d->valuestring);
+    }
+    if ((d = cJSON_GetObjectItem(j, "length")) && cJSON_IsNumber(d) && d->valueint > 0) {
+        tag->length = d->valueint;
+    }
+    if (parse_scaling(j, &tag->scaling) != 0) {
+        log_warn("Tag '%s' has a zero scale or min above max, ignoring it", tag->name);
+        return -1;
+    }
+    return 0;
+}
+
+// One entry of "scaling"
+static int parse_scale_range(cJSON *j, ScaleRangeConfig *range) {
+    cJSON *d;
+    memset(range, 0, sizeof(*range));
+    strcpy(range->table, "holding");
+    range->count = 1;
+    
+    if (!cJSON_IsObject(j)) {
+        log_warn("Ignoring invalid scaling entry");
+        return -1;
+    }
+    if ((d = cJSON_GetObjectItem(j, "table")) && cJSON_IsString(d)) {
+        copy_value(range->table, sizeof(range->table), d->valuestring);
+    }
+    if ((d = cJSON_GetObjectItem(j, "address")) && cJSON_IsNumber(d)) {
+        range->address = d->valueint;
+    } else {
+        log_warn("Scaling entry has no address, ignoring it");
+        return -1;
+    }
+    if ((d = cJSON_GetObjectItem(j, "count")) && cJSON_IsNumber(d)) {
+        range->count = d->valueint;
+    }
+    size_t nb_keys = sizeof(SCALE_RANGE_KEYS) / sizeof(SCALE_RANGE_KEYS[0]);
+    for (d = unknown_key(j->child, SCALE_RANGE_KEYS, nb_keys); d; d = unknown_key(d->next, SCALE_RANGE_KEYS, nb_keys)) {
+        log_warn("Scaling at address %d: unknown key '%s', ignoring it", range->address, d->string);
+    }
+    if (range->count < 1 || parse_scaling(j, &range->scaling) != 0) {
+        log_warn("Scaling at address %d has no registers, a zero scale or min above max, ignoring it",
+                 range->address);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Whole content of a file, NUL-terminated. Sized from the file up front and
+ * grown if it is longer by the time it is read. Returns 1 when the file
+ * cannot be opened.
+ */
+static int read_file(const char *filename, TextBuffer *text) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return 1;
+    }
+    long size = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    rewind(fp);
     
+    // A read that fills the buffer may have stopped short of the end
+    size_t more = size > 0 ? (size_t)size + 1 : 4096;
+    do {
+        if (text_buffer_reserve(text, more) != 0) {
+            fclose(fp);
+            return -1;
+        }
+        text->len += fread(text->data + text->len, 1, text->cap - text->len, fp);
+        more = text->cap;
+    } while (text->len == text->cap && !ferror(fp));
+    int failed = ferror(fp);
+    fclose(fp);
+    if (failed) {
+        return -1;
+    }
+    text->data[text->len] = '\0';
+    return 0;
+}
+
+// Line and column (from 1) of where parsing stopped, and the text leading there
+static void report_syntax_error(const char *filename, const char *text, size_t len, const char *at) {
+    if (!at || at < text || at > text + len) {
+        at = text + len;
+    }
+    int line = 1;
+    const char *line_start = text;
+    for (const char *nl; (nl = memchr(line_start, '\n', (size_t)(at - line_start))); line_start = nl + 1) {
+        line++;
+    }
+    const char *from = at - line_start > 20 ? at - 20 : line_start;
+    const char *to = at;
+    while (to < text + len && to < at + 4 && *to != '\n' && *to != '\r') {
+        to++;
+    }
+    while (from < to && (*from == ' ' || *from == '\t')) {
+        from++;
+    }
+    if (from == to) {
+        log_error("%s:%d:%d: invalid JSON, unexpected end of file", filename, line, (int)(at - line_start) + 1);
+    } else {
+        log_error("%s:%d:%d: invalid JSON %s '%.*s'", filename, line, (int)(at - line_start) + 1,
+                  at == text + len ? "at the end of the file, after" : "near", (int)(to - from), from);
+    }
+}
+
+/*
+ * Allocator of the cJSON tree while parsing a config: nodes and strings are
+ * carved out of large blocks and all released together once the config is
+ * applied, instead of a malloc and a free per value. The hooks are global to
+ * cJSON and only set for the parse, which runs on the main loop, the one
+ * other user of cJSON.
+ */
+#define PARSE_BLOCK_SIZE (1u << 20)
+
+typedef struct ParseBlock {
+    struct ParseBlock *next;
+    size_t used;
+    size_t size;
+    max_align_t data[];
+} ParseBlock;
+
+static ParseBlock *parse_blocks;
+
+static void *parse_alloc(size_t size) {
+    size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    ParseBlock *b = parse_blocks;
+    if (!b || b->size - b->used < size) {
+        size_t block_size = size > PARSE_BLOCK_SIZE ? size : PARSE_BLOCK_SIZE;
+        if (!(b = malloc(sizeof(ParseBlock) + block_size))) {
+            return NULL;
+        }
+        b->used = 0;
+        b->size = block_size;
+        b->next = parse_blocks;
+        parse_blocks = b;
+    }
+    void *p = (char *)b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+static void parse_free(void *p) {
+    (void)p;
+}
+
+static void parse_release(void) {
+    while (parse_blocks) {
+        ParseBlock *next = parse_blocks->next;
+        free(parse_blocks);
+        parse_blocks = next;
+    }
+}
+
+// Top-level keys and the JSON types each takes
+typedef struct {
+    const char *name;
+    int types;
+    const char *expected;
+} ConfigKey;
+
+#define NUMBER_KEY(name) {name, cJSON_Number, "a number"}
+#define STRING_KEY(name) {name, cJSON_String, "a string"}
+#define RANGE_KEY(name) {name, cJSON_Object | cJSON_Array, "an object or an array"}
+
+static const ConfigKey CONFIG_KEYS[] = {
+    STRING_KEY("mode"),
+    NUMBER_KEY("tcp_port"),
+    {"tcp_workers", cJSON_Number | cJSON_String, "a number or \"auto\""},
+    STRING_KEY("tcp_backend"),
+    NUMBER_KEY("rtu_tcp_port"),
+    NUMBER_KEY("udp_port"),
+    NUMBER_KEY("metrics_port"),
+    STRING_KEY("log_level"),
+    NUMBER_KEY("trace_records"),
+    {"trace_enabled", cJSON_True | cJSON_False, "a boolean"},
+    STRING_KEY("snapshot_file"),
+    NUMBER_KEY("snapshot_interval_ms"),
+    STRING_KEY("wal_file"),
+    STRING_KEY("wal_mode"),
+    NUMBER_KEY("wal_commit_interval_ms"),
+    STRING_KEY("image_file"),
+    NUMBER_KEY("image_sync_interval_ms"),
+    NUMBER_KEY("watch_interval_ms"),
+    NUMBER_KEY("unit_id"),
+    {"serial", cJSON_Object, "an object"},
+    RANGE_KEY("coils"),
+    RANGE_KEY("input_bits"),
+    RANGE_KEY("holding_registers"),
+    RANGE_KEY("input_registers"),
+    {"poll_devices", cJSON_Array, "an array"},
+    {"tags", cJSON_Object, "an object"},
+    {"scaling", cJSON_Array, "an array"},
+};
+
+// Unknown top-level keys, and known ones of the wrong type, are ignored with a warning
+static void check_keys(const char *filename, cJSON *root) {
+    cJSON *j;
+    cJSON_ArrayForEach(j, root) {
+        const ConfigKey *key = NULL;
+        for (size_t k = 0; k < sizeof(CONFIG_KEYS) / sizeof(CONFIG_KEYS[0]) && !key; k++) {
+            if (strcasecmp(j->string, CONFIG_KEYS[k].name) == 0) {
+                key = &CONFIG_KEYS[k];
+            }
+        }
+        if (!key) {
+            log_warn("%s: unknown key '%s', ignoring it", filename, j->string);
+        } else if (!(j->type & key->types)) {
+            log_warn("%s: '%s' should be %s, ignoring it", filename, j->string, key->expected);
+        }
+    }
+}
+
+// Settings of a parsed config over the defaults
+static int apply_config(cJSON *root, ModbusConfig *config) {
     cJSON *j;
     
     // Parse mode
@@ -56,6 +455,75 @@ int config_load(const char *filename, ModbusConfig *config) {
     if ((j = cJSON_GetObjectItem(root, "tcp_port")) && cJSON_IsNumber(j)) {
         config->tcp_port = j->valueint;
     }
+    if ((j = cJSON_GetObjectItem(root, "tcp_workers"))) {
+        if (cJSON_IsNumber(j) && j->valueint >= 0) {
+            config->tcp_workers = j->valueint;
+        } else if (cJSON_IsString(j) && strcmp(j->valuestring, "auto") == 0) {
+            config->tcp_workers = platform_get_nprocs();
+        }
+    }
+    if ((j = cJSON_GetObjectItem(root, "tcp_backend")) && cJSON_IsString(j)) {
+        if (strcmp(j->valuestring, "io_uring") == 0) {
+            config->tcp_backend = TCP_BACKEND_IO_URING;
+        } else if (strcmp(j->valuestring, "epoll") == 0) {
+            config->tcp_backend = TCP_BACKEND_EPOLL;
+        } else {
+            log_warn("Unknown tcp_backend '%s', keeping default", j->valuestring);
+        }
+    }
+    if ((j = cJSON_GetObjectItem(root, "rtu_tcp_port")) && cJSON_IsNumber(j)) {
+        config->rtu_tcp_port = j->valueint;
+    }
+    if ((j = cJSON_GetObjectItem(root, "udp_port")) && cJSON_IsNumber(j)) {
+        config->udp_port = j->valueint;
+    }
+    if ((j = cJSON_GetObjectItem(root, "metrics_port")) && cJSON_IsNumber(j)) {
+        config->metrics_port = j->valueint;
+    }
+    if ((j = cJSON_GetObjectItem(root, "log_level")) && cJSON_IsString(j)) {
+        int level = log_level_from_string(j->valuestring);
+        if (level >= 0) {
+            config->log_level = level;
+        } else {
+            log_warn("Unknown log_level '%s', keeping default", j->valuestring);
+        }
+    }
+    if ((j = cJSON_GetObjectItem(root, "trace_records")) && cJSON_IsNumber(j) && j->valueint >= 0) {
+        config->trace_records = j->valueint;
+    }
+    if ((j = cJSON_GetObjectItem(root, "trace_enabled")) && cJSON_IsBool(j)) {
+        config->trace_enabled = cJSON_IsTrue(j);
+    }
+    if ((j = cJSON_GetObjectItem(root, "snapshot_file")) && cJSON_IsString(j)) {
+        strncpy(config->snapshot_file, j->valuestring, sizeof(config->snapshot_file) - 1);
+    }
+    if ((j = cJSON_GetObjectItem(root, "snapshot_interval_ms")) && cJSON_IsNumber(j) && j->valueint > 0) {
+        config->snapshot_interval_ms = j->valueint;
+    }
+    if ((j = cJSON_GetObjectItem(root, "wal_file")) && cJSON_IsString(j)) {
+        strncpy(config->wal_file, j->valuestring, sizeof(config->wal_file) - 1);
+    }
+    if ((j = cJSON_GetObjectItem(root, "wal_mode")) && cJSON_IsString(j)) {
+        if (strcmp(j->valuestring, "async") == 0) {
+            config->wal_mode = WAL_MODE_ASYNC;
+        } else if (strcmp(j->valuestring, "sync") == 0) {
+            config->wal_mode = WAL_MODE_SYNC;
+        } else {
+            log_warn("Unknown wal_mode '%s', keeping default", j->valuestring);
+        }
+    }
+    if ((j = cJSON_GetObjectItem(root, "wal_commit_interval_ms")) && cJSON_IsNumber(j) && j->valueint >= 0) {
+        config->wal_commit_interval_ms = j->valueint;
+    }
+    if ((j = cJSON_GetObjectItem(root, "image_file")) && cJSON_IsString(j)) {
+        strncpy(config->image_file, j->valuestring, sizeof(config->image_file) - 1);
+    }
+    if ((j = cJSON_GetObjectItem(root, "image_sync_interval_ms")) && cJSON_IsNumber(j) && j->valueint >= 0) {
+        config->image_sync_interval_ms = j->valueint;
+    }
+    if ((j = cJSON_GetObjectItem(root, "watch_interval_ms")) && cJSON_IsNumber(j) && j->valueint >= 0) {
+        config->watch_interval_ms = j->valueint;
+    }
     
     // Parse Modbus settings
     if ((j = cJSON_GetObjectItem(root, "unit_id")) && cJSON_IsNumber(j)) {
@@ -64,22 +532,9 @@ int config_load(const char *filename, ModbusConfig *config) {
     
     // Parse RTU settings
     if ((j = cJSON_GetObjectItem(root, "serial")) && cJSON_IsObject(j)) {
-        cJSON *d;
-        if ((d = cJSON_GetObjectItem(j, "device")) && cJSON_IsString(d)) {
-            strncpy(config->serial_device, d->valuestring, sizeof(config->serial_device) - 1);
-        }
-        if ((d = cJSON_GetObjectItem(j, "baudrate")) && cJSON_IsNumber(d)) {
-            config->baudrate = d->valueint;
-        }
-        if ((d = cJSON_GetObjectItem(j, "parity")) && cJSON_IsString(d)) {
-            config->parity = d->valuestring[0];
-        }
-        if ((d = cJSON_GetObjectItem(j, "data_bits")) && cJSON_IsNumber(d)) {
-            config->data_bits = d->valueint;
-        }
-        if ((d = cJSON_GetObjectItem(j, "stop_bits")) && cJSON_IsNumber(d)) {
-            config->stop_bits = d->valueint;
-        }
+        parse_serial(j, config->serial_device, sizeof(config->serial_device),
+                     &config->baudrate, &config->parity,
+                     &config->data_bits, &config->stop_bits);
     }
     
     // Helper macro for parsing register configs
@@ -103,7 +558,152 @@ int config_load(const char *filename, ModbusConfig *config) {
     PARSE_REG_CONFIG("holding_registers", config->holding_regs_start, config->nb_holding_regs);
     PARSE_REG_CONFIG("input_registers", config->input_regs_start, config->nb_input_regs);
     
-    cJSON_Delete(root);
-    log_debug("Config loaded successfully");
+    // Parse downstream poll devices
+    if ((j = cJSON_GetObjectItem(root, "poll_devices")) && cJSON_IsArray(j)) {
+        cJSON *d;
+        cJSON_ArrayForEach(d, j) {
+            if (config->nb_poll_devices >= MAX_POLL_DEVICES) {
+                log_warn("More than %d poll devices, ignoring the rest", MAX_POLL_DEVICES);
+                break;
+            }
+            if (parse_poll_device(d, &config->poll_devices[config->nb_poll_devices],
+                                  config->nb_poll_devices) == 0) {
+                config->nb_poll_devices++;
+            }
+        }
+    }
+    
+    // Parse named points
+    if ((j = cJSON_GetObjectItem(root, "tags")) && cJSON_IsObject(j)) {
+        int nb_entries = cJSON_GetArraySize(j);
+        config->tags = nb_entries > 0 ? (TagConfig *)calloc((size_t)nb_entries, sizeof(TagConfig)) : NULL;
+        if (nb_entries > 0 && !config->tags) {
+            log_error("Failed to allocate %d tags", nb_entries);
+            return -1;
+        }
+        cJSON *t;
+        cJSON_ArrayForEach(t, j) {
+            if (parse_tag(t, &config->tags[config->nb_tags]) == 0) {
+                config->nb_tags++;
+            }
+        }
+    }
+    
+    // Parse scaled register ranges
+    if ((j = cJSON_GetObjectItem(root, "scaling")) && cJSON_IsArray(j)) {
+        int nb_entries = cJSON_GetArraySize(j);
+        config->scale_ranges = nb_entries > 0 ?
+                               (ScaleRangeConfig *)calloc((size_t)nb_entries, sizeof(ScaleRangeConfig)) : NULL;
+        if (nb_entries > 0 && !config->scale_ranges) {
+            log_error("Failed to allocate %d scaling entries", nb_entries);
+            config_free(config);
+            return -1;
+        }
+        cJSON *r;
+        cJSON_ArrayForEach(r, j) {
+            if (parse_scale_range(r, &config->scale_ranges[config->nb_scale_ranges]) == 0) {
+                config->nb_scale_ranges++;
+            }
+        }
+    }
+    
     return 0;
 }
+
+int config_load(const char *filename, ModbusConfig *config) {
+    // Set defaults
+    config->enable_tcp = true;
+    config->enable_rtu = false;
+    config->tcp_port = 1502;
+    config->tcp_workers = 0;
+#ifdef HAVE_LIBURING
+    config->tcp_backend = TCP_BACKEND_IO_URING;
+#else
+    config->tcp_backend = TCP_BACKEND_EPOLL;
+#endif
+    config->rtu_tcp_port = 0;
+    config->udp_port = 0;
+    config->metrics_port = 0;
+    config->log_level = LOG_LEVEL_INFO;
+    config->trace_records = 1024;
+    config->trace_enabled = false;
+    config->snapshot_file[0] = '\0';
+    config->snapshot_interval_ms = 10000;
+    config->wal_file[0] = '\0';
+    config->wal_mode = WAL_MODE_ASYNC;
+    config->wal_commit_interval_ms = 10;
+    config->image_file[0] = '\0';
+    config->image_sync_interval_ms = 0;
+    config->watch_interval_ms = 100;
+    config->unit_id = 1;
+    config->coils_start = 0;
+    config->nb_coils = 0;
+    config->input_bits_start = 0;
+    config->nb_input_bits = 0;
+    config->holding_regs_start = 0;
+    config->nb_holding_regs = 0;
+    config->input_regs_start = 0;
+    config->nb_input_regs = 0;
+    strcpy(config->serial_device, "/dev/ttyUSB0");
+    config->baudrate = 9600;
+    config->parity = 'N';
+    config->data_bits = 8;
+    config->stop_bits = 1;
+    config->nb_poll_devices = 0;
+    config->tags = NULL;
+    config->nb_tags = 0;
+    config->scale_ranges = NULL;
+    config->nb_scale_ranges = 0;
+    config->cache = NULL;
+    
+    // Read file
+    TextBuffer text = {0};
+    int rc = read_file(filename, &text);
+    if (rc > 0) {
+        log_warn("Config file not found: %s, using defaults", filename);
+        return 0; // Return 0 to allow running with defaults
+    }
+    if (rc < 0) {
+        log_error("Failed to read config file %s", filename);
+        text_buffer_free(&text);
+        return -1;
+    }
+    
+    // Parse JSON, nothing but whitespace allowed after the root
+    const char *end = NULL;
+    cJSON_Hooks hooks = {parse_alloc, parse_free};
+    cJSON_InitHooks(&hooks);
+    cJSON *root = cJSON_ParseWithLengthOpts(text.data, text.len + 1, &end, true);
+    cJSON_InitHooks(NULL);
+    if (!root) {
+        report_syntax_error(filename, text.data, text.len, end);
+        rc = -1;
+    } else if (!cJSON_IsObject(root)) {
+        log_error("%s: the config must be a JSON object", filename);
+        rc = -1;
+    } else {
+        check_keys(filename, root);
+        rc = apply_config(root, config);
+    }
+    parse_release();
+    text_buffer_free(&text);
+    if (rc == 0) {
+        log_debug("Config loaded successfully");
+    }
+    return rc;
+}
+
+void config_free(ModbusConfig *config) {
+    // Tags and ranges of a cached config are in the cache file
+    if (config->cache) {
+        config_cache_close(config->cache);
+        config->cache = NULL;
+    } else {
+        free(config->tags);
+        free(config->scale_ranges);
+    }
+    config->tags = NULL;
+    config->nb_tags = 0;
+    config->scale_ranges = NULL;
+    config->nb_scale_ranges = 0;
+}
@@ -0,0 +1,606 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // F_DUPFD_CLOEXEC, strdup, unsetenv, kill
+#endif
+#include "handoff.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define HANDOFF_MAGIC "MBHOFF\0\1"
+#define HANDOFF_TIMEOUT_MS 30000            // Longest silence of the other process
+#define HANDOFF_FDS_PER_MESSAGE 64
+#define LISTEN_FDS_START 3                  // First descriptor passed by systemd
+
+extern char **environ;
+
+/*
+ * Stream layout, host byte order (both ends run on the same machine): the
+ * header, the holding and input registers, the coils and discrete inputs (a
+ * byte each), then the sockets in batches, each carried as SCM_RIGHTS by one
+ * byte holding the batch size.
+ */
+typedef struct {
+    char magic[8];
+    int32_t layout[8];          // Start and count of coils, discrete inputs, holding and input registers
+    uint32_t nb_socks;
+    uint32_t reserved;
+} HandoffHeader;
+
+struct Handoff {
+    int channel;
+    int pid;                    // New process, -1 on its own side
+    modbus_mapping_t mapping;   // Tables received, pointing into tables
+    uint8_t *tables;
+};
+
+typedef struct {
+    int fd;
+    bool taken;
+} InheritedSocket;
+
+static InheritedSocket *inherited;
+static int nb_inherited;
+static int inherited_capacity;
+
+static void adopt(int fd) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (nb_inherited == inherited_capacity) {
+        int capacity = inherited_capacity ? inherited_capacity * 2 : 16;
+        InheritedSocket *grown = (InheritedSocket *)realloc(inherited, (size_t)capacity * sizeof(InheritedSocket));
+        if (!grown) {
+            log_error("Failed to allocate inherited sockets, closing fd %d", fd);
+            close(fd);
+            return;
+        }
+        inherited = grown;
+        inherited_capacity = capacity;
+    }
+    inherited[nb_inherited].fd = fd;
+    inherited[nb_inherited].taken = false;
+    nb_inherited++;
+}
+
+int handoff_inherit(void) {
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    long n = 0;
+    if (pid && fds && strtol(pid, NULL, 10) == (long)getpid()) {
+        n = strtol(fds, NULL, 10);
+        n = n < 0 || n > 4096 ? 0 : n;
+        for (long i = 0; i < n; i++) {
+            adopt(LISTEN_FDS_START + (int)i);
+        }
+        if (n > 0) {
+            log_info("Inherited %ld sockets from systemd", n);
+        }
+    }
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return (int)n;
+}
+
+// Local port of an IP socket, with its type and whether it listens; -1 for other sockets
+static int socket_port(int fd, int *type, bool *listening) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    socklen_t len = sizeof(*type);
+    if (getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0 ||
+        getsockopt(fd, SOL_SOCKET, SO_TYPE, type, &len) != 0) {
+        return -1;
+    }
+    int accepting = 0;
+    len = sizeof(accepting);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) != 0) {
+        accepting = 0;
+    }
+    *listening = accepting != 0;
+    if (addr.ss_family == AF_INET) {
+        return ntohs(((struct sockaddr_in *)&addr)->sin_port);
+    }
+    if (addr.ss_family == AF_INET6) {
+        return ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+    }
+    return -1;
+}
+
+static int find_socket(int type, int port, bool listening, bool taken) {
+    for (int i = 0; i < nb_inherited; i++) {
+        int t;
+        bool l;
+        if (inherited[i].taken == taken && socket_port(inherited[i].fd, &t, &l) == port && t == type &&
+            l == listening) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int handoff_take_listener(int type, int port) {
+    int i = find_socket(type, port, type == SOCK_STREAM, false);
+    if (i < 0) {
+        return -1;
+    }
+    inherited[i].taken = true;
+    log_debug("Listening on inherited fd %d for port %d", inherited[i].fd, port);
+    return inherited[i].fd;
+}
+
+int handoff_share_listener(int port) {
+    int i = find_socket(SOCK_STREAM, port, true, true);
+    return i < 0 ? -1 : fcntl(inherited[i].fd, F_DUPFD_CLOEXEC, 0);
+}
+
+int handoff_take_clients(int port, int *socks, int max) {
+    int n = 0;
+    for (int i = 0; i < nb_inherited && n < max; i++) {
+        int type;
+        bool listening;
+        if (!inherited[i].taken && socket_port(inherited[i].fd, &type, &listening) == port &&
+            type == SOCK_STREAM && !listening) {
+            inherited[i].taken = true;
+            socks[n++] = inherited[i].fd;
+        }
+    }
+    return n;
+}
+
+void handoff_close_unused(void) {
+    int closed = 0;
+    for (int i = 0; i < nb_inherited; i++) {
+        if (!inherited[i].taken) {
+            close(inherited[i].fd);
+            closed++;
+        }
+    }
+    if (closed > 0) {
+        log_warn("Closed %d inherited sockets no listener took", closed);
+    }
+    free(inherited);
+    inherited = NULL;
+    nb_inherited = inherited_capacity = 0;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        int rc = poll(&pfd, 1, HANDOFF_TIMEOUT_MS);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) return -1;
+        
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_status(int fd, char status) {
+    return write_full(fd, &status, 1);
+}
+
+static int wait_status(int fd, char expected) {
+    char status;
+    return read_full(fd, &status, 1) == 0 && status == expected ? 0 : -1;
+}
+
+static int send_sockets(int fd, const int *socks, int nb_socks) {
+    for (int i = 0; i < nb_socks; i += HANDOFF_FDS_PER_MESSAGE) {
+        int n = nb_socks - i < HANDOFF_FDS_PER_MESSAGE ? nb_socks - i : HANDOFF_FDS_PER_MESSAGE;
+        uint8_t count = (uint8_t)n;
+        struct iovec iov = {.iov_base = &count, .iov_len = 1};
+        union {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(HANDOFF_FDS_PER_MESSAGE * sizeof(int))];
+        } control;
+        memset(&control, 0, sizeof(control));
+        
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE((size_t)n * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN((size_t)n * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), socks + i, (size_t)n * sizeof(int));
+        
+        ssize_t rc;
+        do {
+            rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        } while (rc < 0 && errno == EINTR);
+        if (rc != 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// The sockets received join the inherited ones
+static int receive_sockets(int fd, uint32_t nb_socks) {
+    uint32_t received = 0;
+    while (received < nb_socks) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        int rc = poll(&pfd, 1, HANDOFF_TIMEOUT_MS);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) return -1;
+        
+        uint8_t count = 0;
+        struct iovec iov = {.iov_base = &count, .iov_len = 1};
+        union {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(HANDOFF_FDS_PER_MESSAGE * sizeof(int))];
+        } control;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        ssize_t n = recvmsg(fd, &msg, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n != 1) return -1;
+        
+        int got = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            int k = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (int j = 0; j < k; j++) {
+                int sock;
+                memcpy(&sock, CMSG_DATA(cmsg) + (size_t)j * sizeof(int), sizeof(int));
+                adopt(sock);
+                got++;
+            }
+        }
+        if ((msg.msg_flags & MSG_CTRUNC) || got != count) {
+            return -1;
+        }
+        received += (uint32_t)got;
+    }
+    return 0;
+}
+
+// Looked up as execvp() would, before fork(): the child only calls execve()
+static char* find_program(const char *name) {
+    if (strchr(name, '/')) {
+        return strdup(name);
+    }
+    const char *path = getenv("PATH");
+    for (path = path ? path : "/usr/bin:/bin"; ; ) {
+        const char *end = strchr(path, ':');
+        int dir_len = end ? (int)(end - path) : (int)strlen(path);
+        size_t size = (size_t)dir_len + strlen(name) + 3;
+        char *candidate = (char *)malloc(size);
+        if (!candidate) {
+            return NULL;
+        }
+        // An empty entry is the working directory
+        snprintf(candidate, size, "%.*s/%s", dir_len ? dir_len : 1, dir_len ? path : ".", name);
+        if (access(candidate, X_OK) == 0) {
+            return candidate;
+        }
+        free(candidate);
+        if (!end) {
+            return NULL;
+        }
+        path = end + 1;
+    }
+}
+
+// This process's environment, naming the channel instead of any earlier one
+static char** child_environment(char *entry, size_t size, int channel) {
+    size_t n = 0;
+    while (environ[n]) n++;
+    char **envp = (char **)malloc((n + 2) * sizeof(char *));
+    if (!envp) {
+        return NULL;
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (strncmp(environ[i], HANDOFF_ENV "=", sizeof(HANDOFF_ENV)) != 0) {
+            envp[k++] = environ[i];
+        }
+    }
+    snprintf(entry, size, "%s=%d", HANDOFF_ENV, channel);
+    envp[k++] = entry;
+    envp[k] = NULL;
+    return envp;
+}
+
+Handoff* handoff_start(char *const argv[]) {
+    char *program = find_program(argv[0]);
+    if (!program) {
+        log_error("Upgrade: %s not found", argv[0]);
+        return NULL;
+    }
+    
+    int sv[2] = {-1, -1};
+    char entry[64];
+    char **envp = NULL;
+    Handoff *handoff = (Handoff *)calloc(1, sizeof(Handoff));
+    if (!handoff || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0 ||
+        !(envp = child_environment(entry, sizeof(entry), sv[1]))) {
+        log_error("Upgrade: failed to set up the channel: %s", strerror(errno));
+        if (sv[0] >= 0) close(sv[0]);
+        if (sv[1] >= 0) close(sv[1]);
+        free(handoff);
+        free(program);
+        return NULL;
+    }
+    // Only the new process's end stays open across exec
+    fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        execve(program, argv, envp);
+        _exit(127);
+    }
+    close(sv[1]);
+    free(envp);
+    if (pid < 0) {
+        log_error("Upgrade: fork failed: %s", strerror(errno));
+        close(sv[0]);
+        free(handoff);
+        free(program);
+        return NULL;
+    }
+    handoff->channel = sv[0];
+    handoff->pid = (int)pid;
+    log_info("Upgrade: started %s (pid %d)", program, (int)pid);
+    free(program);
+    
+    if (wait_status(handoff->channel, 'R') != 0) {
+        log_error("Upgrade: the new process failed before loading its config");
+        handoff_abort(handoff);
+        return NULL;
+    }
+    return handoff;
+}
+
+int handoff_send(Handoff *handoff, const modbus_mapping_t *mapping, const int *socks, int nb_socks) {
+    HandoffHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HANDOFF_MAGIC, 8);
+    header.layout[0] = mapping->start_bits;
+    header.layout[1] = mapping->nb_bits;
+    header.layout[2] = mapping->start_input_bits;
+    header.layout[3] = mapping->nb_input_bits;
+    header.layout[4] = mapping->start_registers;
+    header.layout[5] = mapping->nb_registers;
+    header.layout[6] = mapping->start_input_registers;
+    header.layout[7] = mapping->nb_input_registers;
+    header.nb_socks = (uint32_t)nb_socks;
+    
+    int fd = handoff->channel;
+    if (write_full(fd, &header, sizeof(header)) != 0 ||
+        write_full(fd, mapping->tab_registers, (size_t)mapping->nb_registers * sizeof(uint16_t)) != 0 ||
+        write_full(fd, mapping->tab_input_registers, (size_t)mapping->nb_input_registers * sizeof(uint16_t)) != 0 ||
+        write_full(fd, mapping->tab_bits, (size_t)mapping->nb_bits) != 0 ||
+        write_full(fd, mapping->tab_input_bits, (size_t)mapping->nb_input_bits) != 0 ||
+        send_sockets(fd, socks, nb_socks) != 0 || wait_status(fd, 'T') != 0) {
+        log_error("Upgrade: the new process failed to take the sockets and tables");
+        return -1;
+    }
+    return 0;
+}
+
+void handoff_abort(Handoff *handoff) {
+    if (!handoff) return;
+    
+    kill((pid_t)handoff->pid, SIGTERM);
+    waitpid((pid_t)handoff->pid, NULL, 0);
+    handoff_free(handoff);
+}
+
+int handoff_release(Handoff *handoff) {
+    int pid = handoff->pid;
+    if (send_status(handoff->channel, 'G') != 0 || wait_status(handoff->channel, 'S') != 0) {
+        // Killed: its shutdown would cut the client connections both processes hold
+        log_error("Upgrade: the new process (pid %d) did not start serving, stopping it", pid);
+        kill((pid_t)pid, SIGKILL);
+        waitpid((pid_t)pid, NULL, 0);
+        pid = -1;
+    }
+    handoff_free(handoff);
+    return pid;
+}
+
+static bool valid_layout(const int32_t *layout) {
+    for (int i = 0; i < 8; i += 2) {
+        if (layout[i] < 0 || layout[i + 1] < 0 || layout[i + 1] > 0x10000) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int handoff_receive(Handoff **out) {
+    *out = NULL;
+    const char *env = getenv(HANDOFF_ENV);
+    if (!env) {
+        return 0;
+    }
+    int channel = (int)strtol(env, NULL, 10);
+    unsetenv(HANDOFF_ENV);
+    fcntl(channel, F_SETFD, FD_CLOEXEC);
+    
+    Handoff *handoff = (Handoff *)calloc(1, sizeof(Handoff));
+    if (!handoff) {
+        close(channel);
+        return -1;
+    }
+    handoff->channel = channel;
+    handoff->pid = -1;
+    
+    HandoffHeader header;
+    if (send_status(channel, 'R') != 0 || read_full(channel, &header, sizeof(header)) != 0 ||
+        memcmp(header.magic, HANDOFF_MAGIC, 8) != 0 || !valid_layout(header.layout)) {
+        log_error("Upgrade: no state received from the previous process");
+        handoff_free(handoff);
+        return -1;
+    }
+    
+    modbus_mapping_t *m = &handoff->mapping;
+    m->start_bits = header.layout[0];
+    m->nb_bits = header.layout[1];
+    m->start_input_bits = header.layout[2];
+    m->nb_input_bits = header.layout[3];
+    m->start_registers = header.layout[4];
+    m->nb_registers = header.layout[5];
+    m->start_input_registers = header.layout[6];
+    m->nb_input_registers = header.layout[7];
+    size_t regs_len = ((size_t)m->nb_registers + (size_t)m->nb_input_registers) * sizeof(uint16_t);
+    size_t bits_len = (size_t)m->nb_bits + (size_t)m->nb_input_bits;
+    handoff->tables = (uint8_t *)malloc(regs_len + bits_len + 1);
+    if (!handoff->tables) {
+        log_error("Upgrade: failed to allocate the tables received");
+        handoff_free(handoff);
+        return -1;
+    }
+    m->tab_registers = (uint16_t *)handoff->tables;
+    m->tab_input_registers = m->tab_registers + m->nb_registers;
+    m->tab_bits = handoff->tables + regs_len;
+    m->tab_input_bits = m->tab_bits + m->nb_bits;
+    
+    if (read_full(channel, handoff->tables, regs_len + bits_len) != 0 ||
+        receive_sockets(channel, header.nb_socks) != 0 || send_status(channel, 'T') != 0) {
+        log_error("Upgrade: failed to receive the state of the previous process");
+        handoff_free(handoff);
+        return -1;
+    }
+    if (wait_status(channel, 'G') != 0) {
+        log_error("Upgrade: the previous process did not release its files");
+        handoff_free(handoff);
+        return -1;
+    }
+    log_info("Upgrade: took over %u sockets and the register tables", header.nb_socks);
+    *out = handoff;
+    return 0;
+}
+
+const modbus_mapping_t* handoff_mapping(const Handoff *handoff) {
+    return &handoff->mapping;
+}
+
+void handoff_complete(Handoff *handoff) {
+    if (!handoff) return;
+    
+    send_status(handoff->channel, 'S');
+    handoff_free(handoff);
+}
+
+void handoff_free(Handoff *handoff) {
+    if (!handoff) return;
+    
+    if (handoff->channel >= 0) close(handoff->channel);
+    free(handoff->tables);
+    free(handoff);
+}
+
+#else // _WIN32
+
+struct Handoff {
+    modbus_mapping_t mapping;
+};
+
+int handoff_inherit(void) {
+    return 0;
+}
+
+int handoff_take_listener(int type, int port) {
+    (void)type;
+    (void)port;
+    return -1;
+}
+
+int handoff_share_listener(int port) {
+    (void)port;
+    return -1;
+}
+
+int handoff_take_clients(int port, int *socks, int max) {
+    (void)port;
+    (void)socks;
+    (void)max;
+    return 0;
+}
+
+void handoff_close_unused(void) {
+}
+
+Handoff* handoff_start(char *const argv[]) {
+    (void)argv;
+    log_warn("Upgrades need descriptor passing (POSIX), restart the server instead");
+    return NULL;
+}
+
+int handoff_send(Handoff *handoff, const modbus_mapping_t *mapping, const int *socks, int nb_socks) {
+    (void)handoff;
+    (void)mapping;
+    (void)socks;
+    (void)nb_socks;
+    return -1;
+}
+
+void handoff_abort(Handoff *handoff) {
+    (void)handoff;
+}
+
+int handoff_release(Handoff *handoff) {
+    (void)handoff;
+    return -1;
+}
+
+int handoff_receive(Handoff **handoff) {
+    *handoff = NULL;
+    return 0;
+}
+
+const modbus_mapping_t* handoff_mapping(const Handoff *handoff) {
+    return &handoff->mapping;
+}
+
+void handoff_complete(Handoff *handoff) {
+    (void)handoff;
+}
+
+void handoff_free(Handoff *handoff) {
+    (void)handoff;
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <modbus/modbus.h>
+
+// Environment variable naming the channel of a process started by an upgrade
+#define HANDOFF_ENV "MODBUS_UPGRADE_FD"
+
+typedef struct Handoff Handoff;
+
+/*
+ * Sockets inherited at start, from systemd socket activation or from the
+ * server being upgraded. Listeners take them by port before binding their
+ * own; whatever no listener took is closed once all of them are up.
+ */
+
+/**
+ * Adopt the sockets passed by systemd socket activation: LISTEN_FDS
+ * descriptors from 3, when LISTEN_PID names this process. The variables
+ * are removed so child processes do not see them. Call once at start.
+ * @return Number of sockets adopted
+ */
+int handoff_inherit(void);
+
+/**
+ * Take an inherited socket bound to a port: a listening one for
+ * SOCK_STREAM, the socket itself for SOCK_DGRAM
+ * @param type SOCK_STREAM or SOCK_DGRAM
+ * @param port Local port
+ * @return Socket, now owned by the caller, or -1 if none was inherited
+ */
+int handoff_take_listener(int type, int port);
+
+/**
+ * Duplicate a listening socket already taken for a port, for TCP workers
+ * when the inherited socket lacks SO_REUSEPORT and no worker can bind its own
+ * @param port Local port
+ * @return New descriptor, or -1 if no listener of that port was inherited
+ */
+int handoff_share_listener(int port);
+
+/**
+ * Take the inherited client connections accepted on a port
+ * @param port Local port
+ * @param socks Filled with the sockets, now owned by the caller
+ * @param max Size of socks
+ * @return Number of sockets taken
+ */
+int handoff_take_clients(int port, int *socks, int max);
+
+/**
+ * Close the inherited sockets no listener took, once every listener is up:
+ * a listening socket left open would queue connections nobody accepts
+ */
+void handoff_close_unused(void);
+
+/*
+ * Upgrade: the running server starts the new binary with a channel to it
+ * and, once the new process has loaded its config, hands it the listening
+ * sockets, the idle client connections and the register tables, then closes
+ * its persistence files and exits. Clients see a pause, not a reconnect.
+ *
+ *   new: 'R' ready          old: pauses, sends tables and sockets
+ *   new: 'T' taken          old: closes persistence, serial line, poller
+ *   old: 'G' go on          new: opens them, starts serving
+ *   new: 'S' serving        old: exits
+ *
+ * Up to 'T' a failure leaves the old process as it was; after it, the old
+ * process reopens what it closed and goes on serving.
+ */
+
+/**
+ * Start the new binary (argv[0] looked up in PATH when it has no slash)
+ * with the same arguments and wait until it has loaded its config
+ * @param argv Command line of the running server
+ * @return Handoff to the new process, or NULL if it did not start
+ */
+Handoff* handoff_start(char *const argv[]);
+
+/**
+ * Send the register tables and sockets to the new process and wait until
+ * it has taken them. Nothing may change the tables meanwhile.
+ * @param handoff Handoff from handoff_start()
+ * @param mapping Register tables
+ * @param socks Listening sockets and client connections
+ * @param nb_socks Number of sockets
+ * @return 0 once taken, -1 if the new process failed (see handoff_abort())
+ */
+int handoff_send(Handoff *handoff, const modbus_mapping_t *mapping, const int *socks, int nb_socks);
+
+/**
+ * Stop a new process that failed before taking over, and free the handoff
+ * @param handoff Handoff from handoff_start()
+ */
+void handoff_abort(Handoff *handoff);
+
+/**
+ * Tell the new process the files and devices are released, wait until it
+ * serves, and free the handoff. A new process that does not report serving
+ * is killed and reaped, so the files are free to be taken back.
+ * @param handoff Handoff from handoff_start()
+ * @return Process id of the new server, -1 if it did not report serving
+ */
+int handoff_release(Handoff *handoff);
+
+/**
+ * In a process started by an upgrade: report the config loaded, receive
+ * the tables and sockets (the sockets join the inherited ones) and wait
+ * until the previous process has released its files
+ * @param handoff Set to the received state, NULL when not started by an upgrade
+ * @return 0 on success, -1 if the handoff failed
+ */
+int handoff_receive(Handoff **handoff);
+
+/**
+ * Register tables received from the previous process
+ * @param handoff Handoff from handoff_receive()
+ * @return Mapping holding the tables, valid until the handoff is freed
+ */
+const modbus_mapping_t* handoff_mapping(const Handoff *handoff);
+
+/**
+ * Tell the previous process this one serves, and free the handoff
+ * @param handoff Handoff from handoff_receive() (may be NULL)
+ */
+void handoff_complete(Handoff *handoff);
+
+/**
+ * Free a handoff without reporting anything: the other process sees the
+ * channel close
+ * @param handoff Pointer to Handoff (may be NULL)
+ */
+void handoff_free(Handoff *handoff);
+
+#endif // HANDOFF_H
@@ -0,0 +1,209 @@
+#include "image.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_MAGIC "MBIMG\0\0\1"
+#define IMAGE_BYTE_ORDER 0x01020304u
+#define IMAGE_ALIGN 4096            // Header and every table start on a page of their own
+#define IMAGE_TICK_MS 100
+
+/*
+ * File layout, host byte order (the tables are used in place):
+ *   header page: magic[8], byte order mark (u32), start and size of coils,
+ *   discrete inputs, holding and input registers (8 x u32), last
+ *   write-ahead log LSN synced (u64);
+ *   then coils and discrete inputs, one byte per bit as libmodbus keeps
+ *   them, holding and input registers as u16, each table page aligned.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t layout[8];
+    uint64_t wal_lsn;
+} ImageHeader;
+
+struct RegisterImage {
+    char path[256];
+    PlatformFileMap map;
+    ImageHeader *header;
+    modbus_mapping_t mapping;
+    size_t tables_offset;
+    
+    MappingLock *lock;
+    Wal *wal;
+    unsigned synced_seq;        // Mapping lock sequence at the last sync
+    bool synced;
+    int interval_ms;
+    
+    pthread_mutex_t sync_lock;  // Thread and final sync never overlap
+    pthread_t thread;
+    bool thread_started;
+    atomic_bool stop;
+};
+
+static size_t align_up(size_t n) {
+    return (n + IMAGE_ALIGN - 1) / IMAGE_ALIGN * IMAGE_ALIGN;
+}
+
+RegisterImage* image_open(const char *path, const ModbusConfig *config) {
+    RegisterImage *image = (RegisterImage *)calloc(1, sizeof(RegisterImage));
+    if (!image) {
+        return NULL;
+    }
+    snprintf(image->path, sizeof(image->path), "%s", path);
+    atomic_init(&image->stop, false);
+    pthread_mutex_init(&image->sync_lock, NULL);
+    
+    const uint32_t layout[8] = {
+        (uint32_t)config->coils_start, (uint32_t)config->nb_coils,
+        (uint32_t)config->input_bits_start, (uint32_t)config->nb_input_bits,
+        (uint32_t)config->holding_regs_start, (uint32_t)config->nb_holding_regs,
+        (uint32_t)config->input_regs_start, (uint32_t)config->nb_input_regs
+    };
+    size_t sizes[4] = {
+        align_up((size_t)config->nb_coils), align_up((size_t)config->nb_input_bits),
+        align_up((size_t)config->nb_holding_regs * 2), align_up((size_t)config->nb_input_regs * 2)
+    };
+    image->tables_offset = IMAGE_ALIGN;
+    size_t total = image->tables_offset + sizes[0] + sizes[1] + sizes[2] + sizes[3];
+    
+    if (platform_map_file(path, total, &image->map) != 0) {
+        log_error("Failed to map register image %s", path);
+        pthread_mutex_destroy(&image->sync_lock);
+        free(image);
+        return NULL;
+    }
+    uint8_t *base = (uint8_t *)image->map.addr;
+    image->header = (ImageHeader *)base;
+    
+    // Another layout or byte order means the values are meaningless here
+    ImageHeader *h = image->header;
+    bool fresh = memcmp(h->magic, IMAGE_MAGIC, 8) != 0;
+    if (fresh || h->byte_order != IMAGE_BYTE_ORDER || memcmp(h->layout, layout, sizeof(layout)) != 0) {
+        if (!fresh) {
+            log_warn("Register image %s does not match the configured tables, clearing it", path);
+        }
+        memset(base + image->tables_offset, 0, total - image->tables_offset);
+        memset(h, 0, sizeof(*h));
+        h->byte_order = IMAGE_BYTE_ORDER;
+        memcpy(h->layout, layout, sizeof(layout));
+        memcpy(h->magic, IMAGE_MAGIC, 8);
+        if (platform_flush_map(&image->map, 0, total) != 0) {
+            log_warn("Failed to sync new register image %s", path);
+        }
+    } else {
+        log_info("Mapped register image %s", path);
+    }
+    
+    modbus_mapping_t *m = &image->mapping;
+    uint8_t *p = base + image->tables_offset;
+    m->start_bits = config->coils_start;
+    m->nb_bits = config->nb_coils;
+    m->tab_bits = config->nb_coils > 0 ? p : NULL;
+    p += sizes[0];
+    m->start_input_bits = config->input_bits_start;
+    m->nb_input_bits = config->nb_input_bits;
+    m->tab_input_bits = config->nb_input_bits > 0 ? p : NULL;
+    p += sizes[1];
+    m->start_registers = config->holding_regs_start;
+    m->nb_registers = config->nb_holding_regs;
+    m->tab_registers = config->nb_holding_regs > 0 ? (uint16_t *)p : NULL;
+    p += sizes[2];
+    m->start_input_registers = config->input_regs_start;
+    m->nb_input_registers = config->nb_input_regs;
+    m->tab_input_registers = config->nb_input_regs > 0 ? (uint16_t *)p : NULL;
+    
+    log_debug("Register image %s: %zu bytes", path, total);
+    return image;
+}
+
+modbus_mapping_t* image_mapping(RegisterImage *image) {
+    return &image->mapping;
+}
+
+uint64_t image_wal_lsn(RegisterImage *image) {
+    return image->header->wal_lsn;
+}
+
+int image_sync(RegisterImage *image) {
+    pthread_mutex_lock(&image->sync_lock);
+    
+    unsigned seq = image->lock ? atomic_load_explicit(&image->lock->seq, memory_order_acquire) : 0;
+    if (image->synced && image->lock && seq == image->synced_seq) {
+        pthread_mutex_unlock(&image->sync_lock);
+        return 0;
+    }
+    
+    // Every write up to this LSN is in the tables; later ones may be too, replay redoes them
+    mapping_write_begin(image->lock);
+    uint64_t lsn = wal_last_lsn(image->wal);
+    seq = image->lock ? atomic_load_explicit(&image->lock->seq, memory_order_relaxed) + 1 : 0;
+    mapping_write_end(image->lock);
+    
+    uint64_t start_us = platform_monotonic_us();
+    int rc = platform_flush_map(&image->map, image->tables_offset, image->map.size - image->tables_offset);
+    if (rc == 0 && lsn != image->header->wal_lsn) {
+        image->header->wal_lsn = lsn;
+        rc = platform_flush_map(&image->map, 0, sizeof(ImageHeader));
+        if (rc == 0) {
+            wal_checkpoint(image->wal, lsn);
+        }
+    }
+    if (rc != 0) {
+        log_warn("Failed to sync register image %s", image->path);
+    } else {
+        image->synced = true;
+        image->synced_seq = seq;
+        log_debug("Register image synced in %.1f ms", (platform_monotonic_us() - start_us) / 1e3);
+    }
+    pthread_mutex_unlock(&image->sync_lock);
+    return rc;
+}
+
+static void* image_thread(void *arg) {
+    RegisterImage *image = (RegisterImage *)arg;
+    uint64_t next_us = platform_monotonic_us() + (uint64_t)image->interval_ms * 1000;
+    while (!atomic_load_explicit(&image->stop, memory_order_relaxed)) {
+        if (platform_monotonic_us() >= next_us) {
+            image_sync(image);
+            next_us = platform_monotonic_us() + (uint64_t)image->interval_ms * 1000;
+        }
+        platform_msleep(IMAGE_TICK_MS);
+    }
+    return NULL;
+}
+
+int image_start(RegisterImage *image, MappingLock *lock, Wal *wal, int interval_ms) {
+    image->lock = lock;
+    image->wal = wal;
+    image->interval_ms = interval_ms;
+    if (interval_ms <= 0) {
+        return 0;
+    }
+    if (pthread_create(&image->thread, NULL, image_thread, image) != 0) {
+        log_error("Failed to start register image thread");
+        return -1;
+    }
+    image->thread_started = true;
+    return 0;
+}
+
+void image_close(RegisterImage *image) {
+    if (!image) return;
+    
+    atomic_store(&image->stop, true);
+    if (image->thread_started) {
+        pthread_join(image->thread, NULL);
+    }
+    if (image_sync(image) == 0) {
+        log_info("Register image %s synced", image->path);
+    }
+    platform_unmap_file(&image->map);
+    pthread_mutex_destroy(&image->sync_lock);
+    free(image);
+}
@@ -0,0 +1,67 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "mapping_lock.h"
+#include "wal.h"
+#include "../config/config.h"
+#include <modbus/modbus.h>
+#include <stdint.h>
+
+typedef struct RegisterImage RegisterImage;
+
+/**
+ * Map a register image file and lay the tables out in it.
+ * The tables of image_mapping() are the file itself: values survive a
+ * restart with no load step, and pages are read in as they are touched.
+ * An image made for other table starts or sizes, or on a machine of
+ * another byte order, is cleared with a warning.
+ * @param path Image file, created if missing
+ * @param config Table starts and sizes
+ * @return Pointer to RegisterImage, or NULL on failure
+ */
+RegisterImage* image_open(const char *path, const ModbusConfig *config);
+
+/**
+ * Mapping whose table pointers point into the image. It belongs to the
+ * image: never pass it to modbus_mapping_free().
+ * @param image Pointer to RegisterImage
+ * @return Mapping
+ */
+modbus_mapping_t* image_mapping(RegisterImage *image);
+
+/**
+ * Last write-ahead log LSN known to be in the image file
+ * @param image Pointer to RegisterImage
+ * @return LSN, 0 if none
+ */
+uint64_t image_wal_lsn(RegisterImage *image);
+
+/**
+ * Start a thread writing the modified pages back every interval.
+ * Without it the kernel writes them back on its own schedule and
+ * image_close() syncs the rest.
+ * @param image Pointer to RegisterImage
+ * @param lock Mapping lock shared with every writer
+ * @param wal Write-ahead log to checkpoint after each sync, NULL for none
+ * @param interval_ms Time between syncs, 0 for no thread
+ * @return 0 on success, -1 on failure
+ */
+int image_start(RegisterImage *image, MappingLock *lock, Wal *wal, int interval_ms);
+
+/**
+ * Write the modified pages back and wait for them, then record the log
+ * LSN they include and checkpoint the log. Does nothing if no writer
+ * touched the mapping since the last sync.
+ * @param image Pointer to RegisterImage
+ * @return 0 on success (or nothing to do), -1 on failure
+ */
+int image_sync(RegisterImage *image);
+
+/**
+ * Stop the thread, sync the image and unmap it.
+ * Call once every writer of the mapping has stopped.
+ * @param image Pointer to RegisterImage (may be NULL)
+ */
+void image_close(RegisterImage *image);
+
+#endif // IMAGE_H
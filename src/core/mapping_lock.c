@@ -0,0 +1,11 @@
+#include "mapping_lock.h"
+
+int mapping_lock_init(MappingLock *lock) {
+    atomic_init(&lock->seq, 0u);
+    atomic_init(&lock->mapping, NULL);
+    return pthread_mutex_init(&lock->write_mutex, NULL) == 0 ? 0 : -1;
+}
+
+void mapping_lock_destroy(MappingLock *lock) {
+    pthread_mutex_destroy(&lock->write_mutex);
+}
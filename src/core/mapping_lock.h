@@ -0,0 +1,89 @@
+#ifndef MAPPING_LOCK_H
+#define MAPPING_LOCK_H
+
+#include <modbus/modbus.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/*
+ * Seqlock guarding the register mapping once several threads serve it.
+ * Writers serialise on a mutex and make the sequence odd while they modify
+ * the tables. Readers never block: they copy what they need and retry if
+ * the sequence moved meanwhile. All helpers accept NULL (no locking).
+ *
+ * A configuration reload replaces the whole mapping RCU-style: the new one
+ * is published on the lock, threads pick it up on their next request, and
+ * the old one is freed once every thread has moved past it.
+ */
+typedef struct {
+    atomic_uint seq;
+    pthread_mutex_t write_mutex;
+    modbus_mapping_t *_Atomic mapping;  // Mapping in service, NULL until published
+} MappingLock;
+
+/**
+ * Initialize a mapping lock
+ * @param lock Pointer to MappingLock
+ * @return 0 on success, -1 on failure
+ */
+int mapping_lock_init(MappingLock *lock);
+
+/**
+ * Release a mapping lock
+ * @param lock Pointer to MappingLock
+ */
+void mapping_lock_destroy(MappingLock *lock);
+
+/**
+ * Publish the mapping in service. Writers take it once they hold the lock,
+ * so a replacement published between mapping_write_begin() and
+ * mapping_write_end() misses no write.
+ * @param lock Pointer to MappingLock
+ * @param mapping Register mapping
+ */
+static inline void mapping_publish(MappingLock *lock, modbus_mapping_t *mapping) {
+    if (!lock) return;
+    atomic_store_explicit(&lock->mapping, mapping, memory_order_release);
+}
+
+/**
+ * Mapping in service
+ * @param lock Pointer to MappingLock
+ * @param fallback Mapping to use while none is published
+ * @return Published mapping, or fallback
+ */
+static inline modbus_mapping_t* mapping_current(MappingLock *lock, modbus_mapping_t *fallback) {
+    modbus_mapping_t *mapping = lock ? atomic_load_explicit(&lock->mapping, memory_order_acquire) : NULL;
+    return mapping ? mapping : fallback;
+}
+
+static inline unsigned mapping_read_begin(MappingLock *lock) {
+    if (!lock) return 0;
+    unsigned seq;
+    while ((seq = atomic_load_explicit(&lock->seq, memory_order_acquire)) & 1u) {
+        // Writer in progress
+    }
+    return seq;
+}
+
+static inline bool mapping_read_retry(MappingLock *lock, unsigned seq) {
+    if (!lock) return false;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&lock->seq, memory_order_relaxed) != seq;
+}
+
+static inline void mapping_write_begin(MappingLock *lock) {
+    if (!lock) return;
+    pthread_mutex_lock(&lock->write_mutex);
+    atomic_fetch_add_explicit(&lock->seq, 1u, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void mapping_write_end(MappingLock *lock) {
+    if (!lock) return;
+    atomic_fetch_add_explicit(&lock->seq, 1u, memory_order_release);
+    pthread_mutex_unlock(&lock->write_mutex);
+}
+
+#endif // MAPPING_LOCK_H
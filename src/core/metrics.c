@@ -0,0 +1,240 @@
+#include "metrics.h"
+#include "stats.h"
+#include "../adapters/tcp_worker.h"
+#include "../poller/poller.h"
+#include "../utils/platform.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Upper bounds of the exported latency buckets, in nanoseconds
+static const uint64_t latency_bounds_ns[] = {
+    50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000,
+    1000000000
+};
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} Text;
+
+static void text_printf(Text *t, const char *fmt, ...) {
+    while (!t->failed) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(t->data + t->len, t->cap - t->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            t->failed = true;
+        } else if ((size_t)n < t->cap - t->len) {
+            t->len += (size_t)n;
+            return;
+        } else {
+            size_t cap = t->cap * 2 + (size_t)n;
+            char *data = (char *)realloc(t->data, cap);
+            if (!data) {
+                t->failed = true;
+            } else {
+                t->data = data;
+                t->cap = cap;
+            }
+        }
+    }
+}
+
+static void family(Text *t, const char *name, const char *type, const char *help) {
+    text_printf(t, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void function_label(char *buf, size_t size, int slot) {
+    int function = stats_slot_function(slot);
+    if (function > 0) {
+        snprintf(buf, size, "%d", function);
+    } else {
+        snprintf(buf, size, "other");
+    }
+}
+
+// Label values escape backslash, double quote and newline
+static void escape_label(char *dst, size_t size, const char *src) {
+    size_t n = 0;
+    for (; *src && n + 2 < size; src++) {
+        if (*src == '\\' || *src == '"') {
+            dst[n++] = '\\';
+            dst[n++] = *src;
+        } else if (*src == '\n') {
+            dst[n++] = '\\';
+            dst[n++] = 'n';
+        } else {
+            dst[n++] = *src;
+        }
+    }
+    dst[n] = '\0';
+}
+
+static void render_functions(Text *t, const StatsShard *total) {
+    char label[8];
+    
+    family(t, "modbus_requests_total", "counter", "Requests answered, by function code.");
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        if (total->functions[f].requests == 0) continue;
+        function_label(label, sizeof(label), f);
+        text_printf(t, "modbus_requests_total{function=\"%s\"} %llu\n",
+                    label, (unsigned long long)total->functions[f].requests);
+    }
+    family(t, "modbus_exceptions_total", "counter", "Requests answered with an exception, by function code.");
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        if (total->functions[f].requests == 0) continue;
+        function_label(label, sizeof(label), f);
+        text_printf(t, "modbus_exceptions_total{function=\"%s\"} %llu\n",
+                    label, (unsigned long long)total->functions[f].exceptions);
+    }
+    family(t, "modbus_received_bytes_total", "counter", "Request ADU bytes, by function code.");
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        if (total->functions[f].requests == 0) continue;
+        function_label(label, sizeof(label), f);
+        text_printf(t, "modbus_received_bytes_total{function=\"%s\"} %llu\n",
+                    label, (unsigned long long)total->functions[f].bytes_in);
+    }
+    family(t, "modbus_sent_bytes_total", "counter", "Response ADU bytes, by function code.");
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        if (total->functions[f].requests == 0) continue;
+        function_label(label, sizeof(label), f);
+        text_printf(t, "modbus_sent_bytes_total{function=\"%s\"} %llu\n",
+                    label, (unsigned long long)total->functions[f].bytes_out);
+    }
+    
+    family(t, "modbus_request_duration_seconds", "histogram",
+           "Time from receiving a request to sending its response, by function code.");
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        const Histogram *h = &total->latency[f];
+        if (h->total == 0) continue;
+        function_label(label, sizeof(label), f);
+        for (size_t b = 0; b < sizeof(latency_bounds_ns) / sizeof(latency_bounds_ns[0]); b++) {
+            text_printf(t, "modbus_request_duration_seconds_bucket{function=\"%s\",le=\"%g\"} %llu\n",
+                        label, (double)latency_bounds_ns[b] / 1e9,
+                        (unsigned long long)histogram_count_le(h, latency_bounds_ns[b]));
+        }
+        text_printf(t, "modbus_request_duration_seconds_bucket{function=\"%s\",le=\"+Inf\"} %llu\n",
+                    label, (unsigned long long)h->total);
+        text_printf(t, "modbus_request_duration_seconds_sum{function=\"%s\"} %.9f\n",
+                    label, (double)h->sum / 1e9);
+        text_printf(t, "modbus_request_duration_seconds_count{function=\"%s\"} %llu\n",
+                    label, (unsigned long long)h->total);
+    }
+}
+
+static void render_units(Text *t, const StatsShard *total) {
+    family(t, "modbus_unit_requests_total", "counter", "Requests answered, by unit id.");
+    for (int u = 0; u < 256; u++) {
+        if (total->units[u].requests == 0) continue;
+        text_printf(t, "modbus_unit_requests_total{unit=\"%d\"} %llu\n",
+                    u, (unsigned long long)total->units[u].requests);
+    }
+    family(t, "modbus_unit_exceptions_total", "counter", "Requests answered with an exception, by unit id.");
+    for (int u = 0; u < 256; u++) {
+        if (total->units[u].requests == 0) continue;
+        text_printf(t, "modbus_unit_exceptions_total{unit=\"%d\"} %llu\n",
+                    u, (unsigned long long)total->units[u].exceptions);
+    }
+}
+
+static void render_poller(Text *t, Poller *poller) {
+    PollDeviceStats devices[MAX_POLL_DEVICES];
+    char name[64];
+    int n = poller_device_stats(poller, devices, MAX_POLL_DEVICES);
+    if (n == 0) {
+        return;
+    }
+    
+    family(t, "modbus_poll_device_up", "gauge", "Whether the downstream device is connected.");
+    for (int d = 0; d < n; d++) {
+        escape_label(name, sizeof(name), devices[d].name);
+        text_printf(t, "modbus_poll_device_up{device=\"%s\"} %d\n", name, devices[d].connected ? 1 : 0);
+    }
+    family(t, "modbus_poll_reads_total", "counter", "Reads sent to the downstream device, by result.");
+    for (int d = 0; d < n; d++) {
+        escape_label(name, sizeof(name), devices[d].name);
+        text_printf(t, "modbus_poll_reads_total{device=\"%s\",result=\"ok\"} %llu\n",
+                    name, (unsigned long long)devices[d].polls_ok);
+        text_printf(t, "modbus_poll_reads_total{device=\"%s\",result=\"error\"} %llu\n",
+                    name, (unsigned long long)devices[d].polls_failed);
+    }
+    family(t, "modbus_poll_connects_total", "counter", "Connections (re)established to the downstream device.");
+    for (int d = 0; d < n; d++) {
+        escape_label(name, sizeof(name), devices[d].name);
+        text_printf(t, "modbus_poll_connects_total{device=\"%s\"} %llu\n",
+                    name, (unsigned long long)devices[d].connects);
+    }
+    family(t, "modbus_poll_last_duration_seconds", "gauge", "Duration of the last read of the downstream device.");
+    for (int d = 0; d < n; d++) {
+        escape_label(name, sizeof(name), devices[d].name);
+        text_printf(t, "modbus_poll_last_duration_seconds{device=\"%s\"} %.6f\n",
+                    name, devices[d].last_ms / 1e3);
+    }
+}
+
+char* metrics_render(ModbusBackend *backend, const ModbusConfig *config, size_t *len) {
+    Text t = {(char *)malloc(16384), 0, 16384, false};
+    StatsShard *total = (StatsShard *)malloc(sizeof(StatsShard));
+    if (!t.data || !total) {
+        free(t.data);
+        free(total);
+        return NULL;
+    }
+    stats_snapshot(&backend->stats, total);
+    
+    family(&t, "modbus_uptime_seconds", "gauge", "Time since the server started.");
+    text_printf(&t, "modbus_uptime_seconds %.1f\n",
+                (double)(platform_monotonic_us() - backend->stats.start_us) / 1e6);
+    
+    render_functions(&t, total);
+    render_units(&t, total);
+    
+    family(&t, "modbus_connections", "gauge", "Open client connections, by listener.");
+    if (config->enable_tcp) {
+        text_printf(&t, "modbus_connections{listener=\"tcp\"} %d\n",
+                    backend->tcp_conn_count + tcp_worker_pool_connections(backend->tcp_workers));
+    }
+    if (config->rtu_tcp_port > 0) {
+        text_printf(&t, "modbus_connections{listener=\"rtu_tcp\"} %d\n", backend->rtu_tcp_conn_count);
+    }
+    if (config->enable_rtu) {
+        family(&t, "modbus_rtu_up", "gauge", "Whether the serial port is open.");
+        text_printf(&t, "modbus_rtu_up %d\n", backend->ctx_rtu ? 1 : 0);
+    }
+    
+    family(&t, "modbus_crc_errors_total", "counter", "RTU and RTU-over-TCP frames dropped for a bad CRC.");
+    text_printf(&t, "modbus_crc_errors_total %llu\n", (unsigned long long)total->events[STATS_CRC_ERRORS]);
+    family(&t, "modbus_rtu_reconnects_total", "counter", "Serial port reopened after a failure.");
+    text_printf(&t, "modbus_rtu_reconnects_total %llu\n", (unsigned long long)total->events[STATS_RTU_RECONNECTS]);
+    family(&t, "modbus_commands_total", "counter", "JSON commands read from stdin.");
+    text_printf(&t, "modbus_commands_total %llu\n", (unsigned long long)total->events[STATS_COMMANDS]);
+    
+    // Queue depths
+    int pending = platform_stdin_pending();
+    if (pending >= 0) {
+        family(&t, "modbus_command_backlog_bytes", "gauge", "JSON command bytes waiting on stdin.");
+        text_printf(&t, "modbus_command_backlog_bytes %d\n", pending);
+    }
+    if (backend->tcp_workers) {
+        family(&t, "modbus_tcp_queued_responses", "gauge",
+               "Response chunks queued or in flight on the TCP workers (io_uring backend).");
+        text_printf(&t, "modbus_tcp_queued_responses %d\n", tcp_worker_pool_queued(backend->tcp_workers));
+    }
+    
+    render_poller(&t, backend->poller);
+    free(total);
+    
+    if (t.failed) {
+        free(t.data);
+        return NULL;
+    }
+    *len = t.len;
+    return t.data;
+}
@@ -0,0 +1,21 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "../adapters/modbus_backend.h"
+#include "../config/config.h"
+#include <stddef.h>
+
+/**
+ * Render the server metrics in the Prometheus text exposition format (0.0.4):
+ * request, exception and byte counters per function code and unit, latency
+ * histograms per function code, connection gauges, CRC errors, reconnects,
+ * JSON command counts, queue depths and downstream poll statistics.
+ * Only reads counters the serving paths maintain anyway.
+ * @param backend Pointer to ModbusBackend
+ * @param config Pointer to ModbusConfig
+ * @param len Receives the text length
+ * @return Text to free(), NULL on allocation failure
+ */
+char* metrics_render(ModbusBackend *backend, const ModbusConfig *config, size_t *len);
+
+#endif // METRICS_H
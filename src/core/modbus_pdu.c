@@ -0,0 +1,257 @@
+#include "modbus_pdu.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define GET_U16(p) ((uint16_t)(((p)[0] << 8) | (p)[1]))
+#define PUT_U16(p, v) do { (p)[0] = (uint8_t)((v) >> 8); (p)[1] = (uint8_t)(v); } while (0)
+
+static int exception(uint8_t function, uint8_t code, uint8_t *rsp) {
+    rsp[0] = function | 0x80;
+    rsp[1] = code;
+    return 2;
+}
+
+// Index of [address, address + nb) inside a table, -1 if out of range
+static int table_index(int address, int nb, int start, int size) {
+    int idx = address - start;
+    if (idx < 0 || nb > size || idx > size - nb) {
+        return -1;
+    }
+    return idx;
+}
+
+static int read_bits(const uint8_t *tab, int start, int size, const uint8_t *req, int req_len,
+                     uint8_t *rsp) {
+    if (req_len < 5) {
+        return exception(req[0], MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+    }
+    int address = GET_U16(req + 1);
+    int nb = GET_U16(req + 3);
+    if (nb < 1 || nb > MODBUS_MAX_READ_BITS) {
+        return exception(req[0], MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+    }
+    int idx = table_index(address, nb, start, size);
+    if (idx < 0) {
+        return exception(req[0], MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
+    }
+    
+    int nb_bytes = (nb + 7) / 8;
+    rsp[0] = req[0];
+    rsp[1] = (uint8_t)nb_bytes;
+    memset(rsp + 2, 0, nb_bytes);
+    for (int i = 0; i < nb; i++) {
+        if (tab[idx + i]) {
+            rsp[2 + i / 8] |= (uint8_t)(1 << (i % 8));
+        }
+    }
+    return 2 + nb_bytes;
+}
+
+static int read_registers(const uint16_t *tab, int start, int size, int function,
+                          int address, int nb, uint8_t *rsp) {
+    if (nb < 1 || nb > MODBUS_MAX_READ_REGISTERS) {
+        return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+    }
+    int idx = table_index(address, nb, start, size);
+    if (idx < 0) {
+        return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
+    }
+    
+    rsp[0] = (uint8_t)function;
+    rsp[1] = (uint8_t)(nb * 2);
+    for (int i = 0; i < nb; i++) {
+        PUT_U16(rsp + 2 + 2 * i, tab[idx + i]);
+    }
+    return 2 + nb * 2;
+}
+
+/*
+ * Build the response of a request. With apply false, writes are validated
+ * and answered but leave the tables alone.
+ */
+static int execute(modbus_mapping_t *mapping, const uint8_t *req, int req_len, uint8_t *rsp, bool apply) {
+    uint8_t function = req[0];
+    modbus_mapping_t *m = mapping;
+    
+    switch (function) {
+    case MODBUS_FC_READ_COILS:
+        return read_bits(m->tab_bits, m->start_bits, m->nb_bits, req, req_len, rsp);
+    
+    case MODBUS_FC_READ_DISCRETE_INPUTS:
+        return read_bits(m->tab_input_bits, m->start_input_bits, m->nb_input_bits, req, req_len, rsp);
+    
+    case MODBUS_FC_READ_HOLDING_REGISTERS:
+        if (req_len < 5) break;
+        return read_registers(m->tab_registers, m->start_registers, m->nb_registers,
+                              function, GET_U16(req + 1), GET_U16(req + 3), rsp);
+    
+    case MODBUS_FC_READ_INPUT_REGISTERS:
+        if (req_len < 5) break;
+        return read_registers(m->tab_input_registers, m->start_input_registers,
+                              m->nb_input_registers, function, GET_U16(req + 1), GET_U16(req + 3), rsp);
+    
+    case MODBUS_FC_WRITE_SINGLE_COIL: {
+        if (req_len < 5) break;
+        uint16_t value = GET_U16(req + 3);
+        if (value != 0xFF00 && value != 0x0000) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+        }
+        int idx = table_index(GET_U16(req + 1), 1, m->start_bits, m->nb_bits);
+        if (idx < 0) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
+        }
+        if (apply) m->tab_bits[idx] = value ? 1 : 0;
+        memcpy(rsp, req, 5);
+        return 5;
+    }
+    
+    case MODBUS_FC_WRITE_SINGLE_REGISTER: {
+        if (req_len < 5) break;
+        int idx = table_index(GET_U16(req + 1), 1, m->start_registers, m->nb_registers);
+        if (idx < 0) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
+        }
+        if (apply) m->tab_registers[idx] = GET_U16(req + 3);
+        memcpy(rsp, req, 5);
+        return 5;
+    }
+    
+    case MODBUS_FC_WRITE_MULTIPLE_COILS: {
+        if (req_len < 6) break;
+        int nb = GET_U16(req + 3);
+        int nb_bytes = req[5];
+        if (nb < 1 || nb > MODBUS_MAX_WRITE_BITS || nb_bytes != (nb + 7) / 8 || req_len < 6 + nb_bytes) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+        }
+        int idx = table_index(GET_U16(req + 1), nb, m->start_bits, m->nb_bits);
+        if (idx < 0) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
+        }
+        for (int i = 0; apply && i < nb; i++) {
+            m->tab_bits[idx + i] = (req[6 + i / 8] >> (i % 8)) & 1;
+        }
+        memcpy(rsp, req, 5);
+        return 5;
+    }
+    
+    case MODBUS_FC_WRITE_MULTIPLE_REGISTERS: {
+        if (req_len < 6) break;
+        int nb = GET_U16(req + 3);
+        int nb_bytes = req[5];
+        if (nb < 1 || nb > MODBUS_MAX_WRITE_REGISTERS || nb_bytes != nb * 2 || req_len < 6 + nb_bytes) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+        }
+        int idx = table_index(GET_U16(req + 1), nb, m->start_registers, m->nb_registers);
+        if (idx < 0) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
+        }
+        for (int i = 0; apply && i < nb; i++) {
+            m->tab_registers[idx + i] = GET_U16(req + 6 + 2 * i);
+        }
+        memcpy(rsp, req, 5);
+        return 5;
+    }
+    
+    case MODBUS_FC_MASK_WRITE_REGISTER: {
+        if (req_len < 7) break;
+        int idx = table_index(GET_U16(req + 1), 1, m->start_registers, m->nb_registers);
+        if (idx < 0) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
+        }
+        uint16_t and_mask = GET_U16(req + 3);
+        uint16_t or_mask = GET_U16(req + 5);
+        if (apply) {
+            m->tab_registers[idx] = (m->tab_registers[idx] & and_mask) | (or_mask & ~and_mask);
+        }
+        memcpy(rsp, req, 7);
+        return 7;
+    }
+    
+    case MODBUS_FC_WRITE_AND_READ_REGISTERS: {
+        if (req_len < 10) break;
+        int nb_read = GET_U16(req + 3);
+        int nb_write = GET_U16(req + 7);
+        int nb_bytes = req[9];
+        if (nb_read < 1 || nb_read > MODBUS_MAX_WR_READ_REGISTERS ||
+            nb_write < 1 || nb_write > MODBUS_MAX_WR_WRITE_REGISTERS ||
+            nb_bytes != nb_write * 2 || req_len < 10 + nb_bytes) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+        }
+        int read_idx = table_index(GET_U16(req + 1), nb_read, m->start_registers, m->nb_registers);
+        int write_idx = table_index(GET_U16(req + 5), nb_write, m->start_registers, m->nb_registers);
+        if (read_idx < 0 || write_idx < 0) {
+            return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS, rsp);
+        }
+        // Write happens before the read
+        for (int i = 0; apply && i < nb_write; i++) {
+            m->tab_registers[write_idx + i] = GET_U16(req + 10 + 2 * i);
+        }
+        return read_registers(m->tab_registers, m->start_registers, m->nb_registers,
+                              function, GET_U16(req + 1), nb_read, rsp);
+    }
+    
+    default:
+        return exception(function, MODBUS_EXCEPTION_ILLEGAL_FUNCTION, rsp);
+    }
+    
+    // Truncated request
+    return exception(function, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE, rsp);
+}
+
+int modbus_pdu_process(modbus_mapping_t *mapping, MappingLock *lock, Wal *wal, uint64_t *lsn,
+                       const uint8_t *req, int req_len, uint8_t *rsp) {
+    if (lsn) {
+        *lsn = 0;
+    }
+    if (req_len < 1) {
+        return exception(0, MODBUS_EXCEPTION_ILLEGAL_FUNCTION, rsp);
+    }
+    
+    int rsp_len;
+    switch (req[0]) {
+    case MODBUS_FC_READ_COILS:
+    case MODBUS_FC_READ_DISCRETE_INPUTS:
+    case MODBUS_FC_READ_HOLDING_REGISTERS:
+    case MODBUS_FC_READ_INPUT_REGISTERS: {
+        // Lock-free: rebuild the response if a writer got in the way
+        unsigned seq;
+        do {
+            seq = mapping_read_begin(lock);
+            rsp_len = execute(mapping, req, req_len, rsp, true);
+        } while (mapping_read_retry(lock, seq));
+        break;
+    }
+    default:
+        mapping_write_begin(lock);
+        // A reload may have replaced the mapping since the caller took it
+        rsp_len = execute(mapping_current(lock, mapping), req, req_len, rsp, true);
+        // Logged in the order writes took effect; a rejected request changed nothing
+        if (wal && (rsp[0] & 0x80) == 0 && wal_logs_function(req[0])) {
+            uint64_t logged = wal_append(wal, req, req_len);
+            if (lsn) {
+                *lsn = logged;
+            }
+        }
+        mapping_write_end(lock);
+        break;
+    }
+    return rsp_len;
+}
+
+int modbus_pdu_replay(modbus_mapping_t *mapping, const uint8_t *req, int req_len, uint8_t *rsp) {
+    if (req_len < 1) {
+        return exception(0, MODBUS_EXCEPTION_ILLEGAL_FUNCTION, rsp);
+    }
+    return execute(mapping, req, req_len, rsp, false);
+}
+
+uint16_t modbus_pdu_crc16(const uint8_t *buf, int len) {
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 1) ? (uint16_t)((crc >> 1) ^ 0xA001) : (uint16_t)(crc >> 1);
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,55 @@
+#ifndef MODBUS_PDU_H
+#define MODBUS_PDU_H
+
+#include "mapping_lock.h"
+#include "wal.h"
+#include <modbus/modbus.h>
+#include <stdint.h>
+
+// Largest PDU (function code + data) allowed by the protocol
+#define MODBUS_PDU_MAX_LENGTH 253
+
+/**
+ * Execute a request PDU against the mapping and build the response PDU.
+ * Used by the listeners libmodbus cannot frame (RTU over TCP, UDP), and
+ * for writes on the libmodbus listeners while a write-ahead log is on.
+ * Supports FC 1, 2, 3, 4, 5, 6, 15, 16, 22 and 23; anything else gets an
+ * illegal function exception.
+ * Reads go through the lock-free seqlock path, writes take the write lock
+ * and apply to the mapping published on it, if any.
+ * Accepted writes are queued to the write-ahead log under that lock; the
+ * caller passes the LSN to wal_wait() before sending the response.
+ * @param mapping Register mapping
+ * @param lock Mapping lock, NULL when a single thread owns the mapping
+ * @param wal Write-ahead log, NULL for none
+ * @param lsn Receives the LSN of the logged write, 0 if nothing was logged (may be NULL)
+ * @param req Request PDU (function code first)
+ * @param req_len Request PDU length
+ * @param rsp Response buffer of at least MODBUS_PDU_MAX_LENGTH bytes
+ * @return Response PDU length
+ */
+int modbus_pdu_process(modbus_mapping_t *mapping, MappingLock *lock, Wal *wal, uint64_t *lsn,
+                       const uint8_t *req, int req_len, uint8_t *rsp);
+
+/**
+ * Rebuild the response a request already got, without executing it again.
+ * Lets the listeners answered by libmodbus trace their responses: called
+ * under the same write lock as the reply, reads see the same values and
+ * writes are only validated.
+ * @param mapping Register mapping the request was executed against
+ * @param req Request PDU (function code first)
+ * @param req_len Request PDU length
+ * @param rsp Response buffer of at least MODBUS_PDU_MAX_LENGTH bytes
+ * @return Response PDU length
+ */
+int modbus_pdu_replay(modbus_mapping_t *mapping, const uint8_t *req, int req_len, uint8_t *rsp);
+
+/**
+ * CRC of an RTU frame (sent low byte first)
+ * @param buf Frame without its CRC
+ * @param len Length of buf
+ * @return CRC-16/MODBUS
+ */
+uint16_t modbus_pdu_crc16(const uint8_t *buf, int len);
+
+#endif // MODBUS_PDU_H
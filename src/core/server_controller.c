@@ -1,97 +1,817 @@
-#include "rtu_adapter.h"
+#include "server_controller.h"
+#include "handoff.h"
+#include "image.h"
+#include "snapshot.h"
+#include "wal.h"
+#include "watch.h"
+#include "../adapters/tcp_adapter.h"
+#include "../adapters/tcp_worker.h"
+#include "../adapters/rtu_adapter.h"
+#include "../adapters/rtu_tcp_adapter.h"
+#include "../adapters/udp_adapter.h"
+#include "../adapters/metrics_adapter.h"
+#include "../config/config_cache.h"
+#include "../json/scale_map.h"
+#include "../json/tag_map.h"
+#include "../poller/poller.h"
 #include "../utils/logging.h"
 #include "../utils/platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
 #include <errno.h>
 
-static void set_nonblocking(int fd) {
-    if (platform_set_nonblocking(fd) != 0) {
-        log_warn("Failed to set non-blocking mode on fd %d", fd);
+// Longest command line, room for a batch of tag updates
+#define MAX_JSON_BUFFER 65536
+
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t reload_requested = 0;
+static volatile sig_atomic_t upgrade_requested = 0;
+
+static void signal_handler(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+#ifdef SIGHUP
+static void reload_handler(int sig) {
+    (void)sig;
+    reload_requested = 1;
+}
+#endif
+
+#ifdef SIGUSR2
+static void upgrade_handler(int sig) {
+    (void)sig;
+    upgrade_requested = 1;
+}
+#endif
+
+// Copy the entries of the addresses both tables hold
+static void carry_table(const void *from, int from_start, int from_nb, void *to, int to_start, int to_nb,
+                        size_t size) {
+    int lo = from_start > to_start ? from_start : to_start;
+    int hi = from_start + from_nb < to_start + to_nb ? from_start + from_nb : to_start + to_nb;
+    if (hi > lo) {
+        memcpy((uint8_t *)to + (size_t)(lo - to_start) * size,
+               (const uint8_t *)from + (size_t)(lo - from_start) * size, (size_t)(hi - lo) * size);
     }
 }
 
-int rtu_adapter_init(ModbusBackend *backend, const ModbusConfig *config) {
-    backend->ctx_rtu = modbus_new_rtu(
-        config->serial_device,
-        config->baudrate,
-        config->parity,
-        config->data_bits,
-        config->stop_bits
-    );
+static void carry_mapping(const modbus_mapping_t *from, modbus_mapping_t *to) {
+    carry_table(from->tab_bits, from->start_bits, from->nb_bits,
+                to->tab_bits, to->start_bits, to->nb_bits, sizeof(uint8_t));
+    carry_table(from->tab_input_bits, from->start_input_bits, from->nb_input_bits,
+                to->tab_input_bits, to->start_input_bits, to->nb_input_bits, sizeof(uint8_t));
+    carry_table(from->tab_registers, from->start_registers, from->nb_registers,
+                to->tab_registers, to->start_registers, to->nb_registers, sizeof(uint16_t));
+    carry_table(from->tab_input_registers, from->start_input_registers, from->nb_input_registers,
+                to->tab_input_registers, to->start_input_registers, to->nb_input_registers, sizeof(uint16_t));
+}
+
+ServerController* server_controller_create(const char *config_file) {
+    ServerController *controller = (ServerController *)calloc(1, sizeof(ServerController));
+    if (!controller) {
+        log_error("Failed to allocate ServerController");
+        return NULL;
+    }
     
-    if (!backend->ctx_rtu) {
-        log_error("Failed to create RTU context");
-        return -1;
+    snprintf(controller->config_file, sizeof(controller->config_file), "%s", config_file);
+    if (config_load_cached(config_file, &controller->config) != 0) {
+        log_error("Failed to load config: %s", config_file);
+        free(controller);
+        return NULL;
     }
+    log_set_level(controller->config.log_level);
     
-    modbus_set_slave(backend->ctx_rtu, config->unit_id);
-    modbus_set_debug(backend->ctx_rtu, FALSE);
+    // Started by an upgrade: wait here, the config known good, until the previous server lets go
+    if (handoff_receive(&controller->handoff) != 0) {
+        config_free(&controller->config);
+        free(controller);
+        return NULL;
+    }
     
-    // Set non-blocking and timeout
-    int rtu_fd = modbus_get_socket(backend->ctx_rtu);
-    if (rtu_fd != -1) {
-        set_nonblocking(rtu_fd);
-        modbus_set_response_timeout(backend->ctx_rtu, 0, 100000); // 100ms
+    controller->backend = modbus_backend_create();
+    if (!controller->backend) {
+        handoff_free(controller->handoff);
+        config_free(&controller->config);
+        free(controller);
+        return NULL;
     }
     
-    if (modbus_connect(backend->ctx_rtu) == -1) {
-        log_error("RTU connect failed: %s", modbus_strerror(errno));
-        modbus_free(backend->ctx_rtu);
-        backend->ctx_rtu = NULL;
-        return -1;
+    const ModbusConfig *config = &controller->config;
+    
+    // Shared memory mapping (used by both TCP and RTU), in the image file when there is one
+    if (config->image_file[0]) {
+        controller->backend->image = image_open(config->image_file, config);
+        if (!controller->backend->image) {
+            server_controller_destroy(controller);
+            return NULL;
+        }
+        controller->backend->mapping = image_mapping(controller->backend->image);
+    } else {
+        controller->backend->mapping = modbus_mapping_new_start_address(
+            config->coils_start, config->nb_coils,
+            config->input_bits_start, config->nb_input_bits,
+            config->holding_regs_start, config->nb_holding_regs,
+            config->input_regs_start, config->nb_input_regs);
+    }
+    if (!controller->backend->mapping) {
+        log_error("Mapping alloc failed: %s", modbus_strerror(errno));
+        server_controller_destroy(controller);
+        return NULL;
+    }
+    mapping_publish(&controller->backend->mapping_lock, controller->backend->mapping);
+    
+    // Last saved register values, before any client or feeder can see the tables:
+    // the snapshot (the image already holds its own), then the logged writes not included yet
+    bool restored = false;
+    uint64_t snapshot_lsn = 0;
+    bool snapshots = config->snapshot_file[0] != '\0';
+    if (snapshots && controller->backend->image) {
+        log_warn("snapshot_file is ignored with image_file set");
+        snapshots = false;
+    }
+    if (controller->backend->image) {
+        snapshot_lsn = image_wal_lsn(controller->backend->image);
+    } else if (snapshots) {
+        restored = snapshot_restore(config->snapshot_file, controller->backend->mapping, &snapshot_lsn) == 1;
+    }
+    if (config->wal_file[0]) {
+        int replayed = 0;
+        controller->backend->wal = wal_open(config->wal_file, controller->backend->mapping, snapshot_lsn,
+                                            config->wal_mode, config->wal_commit_interval_ms, &replayed);
+        if (!controller->backend->wal) {
+            server_controller_destroy(controller);
+            return NULL;
+        }
+        restored = restored && replayed == 0;
+    }
+    // The tables the upgraded server held last, for the addresses both layouts have
+    if (controller->handoff) {
+        carry_mapping(handoff_mapping(controller->handoff), controller->backend->mapping);
+    }
+    if (controller->backend->image &&
+        image_start(controller->backend->image, &controller->backend->mapping_lock, controller->backend->wal,
+                    config->image_sync_interval_ms) != 0) {
+        server_controller_destroy(controller);
+        return NULL;
+    }
+    if (snapshots) {
+        controller->backend->snapshotter = snapshot_start(config->snapshot_file, controller->backend->mapping,
+                                                          &controller->backend->mapping_lock,
+                                                          controller->backend->wal,
+                                                          config->snapshot_interval_ms, restored);
+        if (!controller->backend->snapshotter) {
+            server_controller_destroy(controller);
+            return NULL;
+        }
+    }
+    
+    // Before any listener starts, as every client write is noted in it
+    controller->backend->watch = watch_create(controller->backend->mapping, config->watch_interval_ms);
+    if (!controller->backend->watch) {
+        server_controller_destroy(controller);
+        return NULL;
+    }
+    
+    if (config->nb_tags > 0) {
+        controller->backend->tags = tag_map_create(config->tags, config->nb_tags, controller->backend->mapping);
+        if (!controller->backend->tags) {
+            server_controller_destroy(controller);
+            return NULL;
+        }
+    }
+    
+    if (config->nb_scale_ranges > 0) {
+        controller->backend->scales = scale_map_create(config->scale_ranges, config->nb_scale_ranges);
+        if (!controller->backend->scales) {
+            server_controller_destroy(controller);
+            return NULL;
+        }
+    }
+    
+    // Before any listener starts, so every serving thread gets a ring
+    trace_configure(&controller->backend->trace, config->trace_records, config->trace_enabled);
+    controller->backend->trace_ring = trace_ring_create(&controller->backend->trace);
+    
+    // Sharded TCP workers when asked for, the main loop otherwise (or if unsupported)
+    // io_uring only drives worker threads, so asking for it implies at least one
+    int nb_workers = config->tcp_workers;
+    if (nb_workers == 0 && config->tcp_backend == TCP_BACKEND_IO_URING) {
+        nb_workers = 1;
+    }
+    if (config->enable_tcp && nb_workers > 0) {
+        controller->backend->tcp_workers = tcp_worker_pool_create(
+            controller->backend->mapping, &controller->backend->mapping_lock, controller->backend->wal,
+            controller->backend->watch, &controller->backend->stats, &controller->backend->trace,
+            config->tcp_port, nb_workers, config->tcp_backend);
+    }
+    if (config->enable_tcp && !controller->backend->tcp_workers &&
+        tcp_adapter_init(controller->backend, config) != 0) {
+        server_controller_destroy(controller);
+        return NULL;
+    }
+    
+    if (config->rtu_tcp_port > 0 && rtu_tcp_adapter_init(controller->backend, config) != 0) {
+        server_controller_destroy(controller);
+        return NULL;
+    }
+    
+    if (config->udp_port > 0 && udp_adapter_init(controller->backend, config) != 0) {
+        server_controller_destroy(controller);
+        return NULL;
+    }
+    
+    if (config->metrics_port > 0 && metrics_adapter_init(controller->backend, config) != 0) {
+        server_controller_destroy(controller);
+        return NULL;
+    }
+    handoff_close_unused();
+    
+    // A missing serial device is not fatal: the main loop keeps reconnecting
+    if (config->enable_rtu && rtu_adapter_init(controller->backend, config) != 0) {
+        log_warn("RTU not available yet, will retry in main loop");
+    }
+    
+    if (config->nb_poll_devices > 0) {
+        controller->backend->poller = poller_create(config);
+        if (!controller->backend->poller || poller_start(controller->backend->poller) != 0) {
+            log_error("Failed to start downstream poller");
+            server_controller_destroy(controller);
+            return NULL;
+        }
+    }
+    
+    controller->state = STATE_STOPPED;
+    controller->running = true;
+    handoff_complete(controller->handoff);
+    controller->handoff = NULL;
+    
+    log_debug("ServerController created");
+    return controller;
+}
+
+void server_controller_destroy(ServerController *controller) {
+    if (!controller) return;
+    
+    ModbusBackend *backend = controller->backend;
+    if (backend) {
+        poller_destroy(backend->poller);
+        backend->poller = NULL;
+        tcp_worker_pool_destroy(backend->tcp_workers);
+        backend->tcp_workers = NULL;
+        tcp_adapter_cleanup(backend);
+        rtu_tcp_adapter_cleanup(backend);
+        udp_adapter_cleanup(backend);
+        metrics_adapter_cleanup(backend);
+        rtu_adapter_cleanup(backend);
+        watch_destroy(backend->watch);
+        backend->watch = NULL;
+        tag_map_destroy(backend->tags);
+        backend->tags = NULL;
+        scale_map_destroy(backend->scales);
+        backend->scales = NULL;
+        // Every writer is gone: the final snapshot is the last state clients saw
+        snapshot_stop(backend->snapshotter);
+        backend->snapshotter = NULL;
+        if (backend->image) {
+            // The image owns the mapping
+            image_close(backend->image);
+            backend->image = NULL;
+            backend->mapping = NULL;
+        }
+        wal_close(backend->wal);
+        backend->wal = NULL;
+        if (backend->mapping) {
+            modbus_mapping_free(backend->mapping);
+            backend->mapping = NULL;
+        }
+        modbus_backend_destroy(backend);
     }
     
-    log_debug("RTU connected on %s", config->serial_device);
+    handoff_free(controller->handoff);
+    config_free(&controller->config);
+    free(controller);
+    log_debug("ServerController destroyed");
+}
+
+/*
+ * Settings only a restart applies: next keeps the running values. Returns
+ * true if the file asked for others.
+ */
+static bool keep_restart_settings(const ModbusConfig *config, ModbusConfig *next) {
+    bool changed = false;
+    #define KEEP(field) do { \
+        changed |= memcmp(&next->field, &config->field, sizeof(config->field)) != 0; \
+        memcpy(&next->field, &config->field, sizeof(config->field)); \
+    } while (0)
+    KEEP(enable_tcp);
+    KEEP(enable_rtu);
+    KEEP(tcp_port);
+    KEEP(tcp_workers);
+    KEEP(tcp_backend);
+    KEEP(rtu_tcp_port);
+    KEEP(udp_port);
+    KEEP(metrics_port);
+    KEEP(trace_records);
+    KEEP(snapshot_file);
+    KEEP(snapshot_interval_ms);
+    KEEP(wal_file);
+    KEEP(wal_mode);
+    KEEP(wal_commit_interval_ms);
+    KEEP(image_file);
+    KEEP(image_sync_interval_ms);
+    KEEP(serial_device);
+    KEEP(baudrate);
+    KEEP(parity);
+    KEEP(data_bits);
+    KEEP(stop_bits);
+    KEEP(poll_devices);
+    KEEP(nb_poll_devices);
+    #undef KEEP
+    next->trace_enabled = config->trace_enabled;
+    return changed;
+}
+
+static bool same_layout(const ModbusConfig *a, const ModbusConfig *b) {
+    return a->coils_start == b->coils_start && a->nb_coils == b->nb_coils &&
+           a->input_bits_start == b->input_bits_start && a->nb_input_bits == b->nb_input_bits &&
+           a->holding_regs_start == b->holding_regs_start && a->nb_holding_regs == b->nb_holding_regs &&
+           a->input_regs_start == b->input_regs_start && a->nb_input_regs == b->nb_input_regs;
+}
+
+static void keep_layout(const ModbusConfig *config, ModbusConfig *next) {
+    next->coils_start = config->coils_start;
+    next->nb_coils = config->nb_coils;
+    next->input_bits_start = config->input_bits_start;
+    next->nb_input_bits = config->nb_input_bits;
+    next->holding_regs_start = config->holding_regs_start;
+    next->nb_holding_regs = config->nb_holding_regs;
+    next->input_regs_start = config->input_regs_start;
+    next->nb_input_regs = config->nb_input_regs;
+}
+
+/*
+ * Put a new mapping and its watch in service. Values are carried over
+ * under the write lock, so no write falls between the copy and the swap;
+ * the old tables are freed once no worker can still be reading them.
+ */
+static void swap_mapping(ModbusBackend *backend, const ModbusConfig *config, modbus_mapping_t *mapping,
+                         Watch *watch) {
+    modbus_mapping_t *old = backend->mapping;
+    Watch *old_watch = backend->watch;
+    watch_carry(watch, old_watch);
+
+    // Snapshots follow the live tables: they start over on the new ones
+    snapshot_stop(backend->snapshotter);
+    backend->snapshotter = NULL;
+
+    mapping_write_begin(&backend->mapping_lock);
+    carry_mapping(old, mapping);
+    mapping_publish(&backend->mapping_lock, mapping);
+    backend->mapping = mapping;
+    backend->watch = watch;
+    mapping_write_end(&backend->mapping_lock);
+
+    tcp_worker_pool_synchronize(backend->tcp_workers, watch);
+    watch_destroy(old_watch);
+    modbus_mapping_free(old);
+
+    if (config->snapshot_file[0]) {
+        backend->snapshotter = snapshot_start(config->snapshot_file, mapping, &backend->mapping_lock, backend->wal,
+                                              config->snapshot_interval_ms, false);
+        if (!backend->snapshotter) {
+            log_error("Reload: failed to restart snapshots");
+        }
+    }
+}
+
+int server_controller_reload(ServerController *controller) {
+    ModbusBackend *backend = controller->backend;
+    ModbusConfig *config = &controller->config;
+
+    // A missing file would mean defaults: keep what runs instead
+    ModbusConfig next;
+    memset(&next, 0, sizeof(next));
+    FILE *fp = fopen(controller->config_file, "r");
+    if (!fp) {
+        log_error("Reload: cannot open %s: %s", controller->config_file, strerror(errno));
+        printf("{\"error\":\"reload_failed\"}\n");
+        return -1;
+    }
+    fclose(fp);
+    if (config_load_cached(controller->config_file, &next) != 0) {
+        log_error("Reload: failed to load %s, keeping the running configuration", controller->config_file);
+        config_free(&next);
+        printf("{\"error\":\"reload_failed\"}\n");
+        return -1;
+    }
+
+    if (keep_restart_settings(config, &next)) {
+        log_warn("Reload: listener, serial, persistence and polling changes need a restart");
+    }
+    bool new_layout = !same_layout(config, &next);
+    if (new_layout && (backend->image || backend->wal)) {
+        log_warn("Reload: register ranges need a restart with image_file or wal_file set");
+        keep_layout(config, &next);
+        new_layout = false;
+    }
+
+    // Everything is built before anything changes, so a failure leaves the server as it was
+    modbus_mapping_t *mapping = backend->mapping;
+    Watch *watch = NULL;
+    if (new_layout) {
+        mapping = modbus_mapping_new_start_address(
+            next.coils_start, next.nb_coils,
+            next.input_bits_start, next.nb_input_bits,
+            next.holding_regs_start, next.nb_holding_regs,
+            next.input_regs_start, next.nb_input_regs);
+        watch = mapping ? watch_create(mapping, next.watch_interval_ms) : NULL;
+    }
+    TagMap *tags = next.nb_tags > 0 && mapping ? tag_map_create(next.tags, next.nb_tags, mapping) : NULL;
+    ScaleMap *scales = next.nb_scale_ranges > 0 ? scale_map_create(next.scale_ranges, next.nb_scale_ranges) : NULL;
+    if (!mapping || (new_layout && !watch) || (next.nb_tags > 0 && !tags) ||
+        (next.nb_scale_ranges > 0 && !scales)) {
+        log_error("Reload: out of memory, keeping the running configuration");
+        scale_map_destroy(scales);
+        tag_map_destroy(tags);
+        watch_destroy(watch);
+        if (new_layout && mapping) {
+            modbus_mapping_free(mapping);
+        }
+        config_free(&next);
+        printf("{\"error\":\"reload_failed\"}\n");
+        return -1;
+    }
+
+    if (new_layout) {
+        swap_mapping(backend, &next, mapping, watch);
+    }
+    watch_set_interval(backend->watch, next.watch_interval_ms);
+    tag_map_destroy(backend->tags);
+    backend->tags = tags;
+    scale_map_destroy(backend->scales);
+    backend->scales = scales;
+
+    if (next.unit_id != config->unit_id) {
+        backend->unit_id = next.unit_id;
+        if (backend->ctx_tcp) modbus_set_slave(backend->ctx_tcp, next.unit_id);
+        if (backend->ctx_rtu) modbus_set_slave(backend->ctx_rtu, next.unit_id);
+    }
+    log_set_level(next.log_level);
+
+    config_free(config);
+    *config = next;
+    log_info("Configuration reloaded from %s", controller->config_file);
+    printf("{\"status\":\"reloaded\",\"layout\":\"%s\",\"tags\":%d,\"scale_ranges\":%d,\"unit_id\":%d}\n",
+           new_layout ? "changed" : "kept", tag_map_count(tags), next.nb_scale_ranges, next.unit_id);
     return 0;
 }
 
-int rtu_adapter_handle(ModbusBackend *backend, uint8_t *query) {
-    if (!backend || !backend->ctx_rtu) {
+/*
+ * Sockets the new process goes on with: every listener and the client
+ * connections between requests. Returns their number, -1 if out of memory.
+ */
+static int collect_sockets(ModbusBackend *backend, int **socks) {
+    int max = 4 + MAX_TCP_CLIENTS + tcp_worker_pool_sockets(backend->tcp_workers, NULL, 0);
+    int *s = (int *)malloc((size_t)max * sizeof(int));
+    if (!s) {
         return -1;
     }
-    
-    int rc = modbus_receive(backend->ctx_rtu, query);
-    if (rc > 0) {
-        if (modbus_reply(backend->ctx_rtu, query, rc, backend->mapping) == -1) {
-            log_debug("RTU reply failed: %s", modbus_strerror(errno));
+    int n = tcp_worker_pool_sockets(backend->tcp_workers, s, max);
+    if (backend->tcp_listen_sock != -1) s[n++] = backend->tcp_listen_sock;
+    for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
+        if (backend->tcp_conn_socks[i] != -1) s[n++] = backend->tcp_conn_socks[i];
+    }
+    if (backend->rtu_tcp_listen_sock != -1) s[n++] = backend->rtu_tcp_listen_sock;
+    if (backend->udp_sock != -1) s[n++] = backend->udp_sock;
+    if (backend->metrics_listen_sock != -1) s[n++] = backend->metrics_listen_sock;
+    *socks = s;
+    return n;
+}
+
+/*
+ * Take back what an upgrade released, once the new process was stopped.
+ * The files are read again, as that process may have written to them
+ * before it failed; the serial line is left to the main loop's reconnects.
+ * Returns 0 on success, -1 if the image or the log cannot be reopened.
+ */
+static int resume_after_upgrade(ServerController *controller, uint64_t lsn) {
+    ModbusBackend *backend = controller->backend;
+    const ModbusConfig *config = &controller->config;
+
+    if (config->image_file[0]) {
+        backend->image = image_open(config->image_file, config);
+        if (!backend->image) {
             return -1;
         }
-        return 1;
-    } else if (rc == -1) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            log_debug("RTU error: %s", modbus_strerror(errno));
-            // RTU lỗi thật sự: đóng context và để vòng lặp chính auto-reconnect
-            rtu_adapter_cleanup(backend);
+        modbus_mapping_t *mapping = image_mapping(backend->image);
+        mapping_write_begin(&backend->mapping_lock);
+        mapping_publish(&backend->mapping_lock, mapping);
+        backend->mapping = mapping;
+        mapping_write_end(&backend->mapping_lock);
+        tcp_worker_pool_synchronize(backend->tcp_workers, backend->watch);
+        lsn = image_wal_lsn(backend->image);
+
+        // Tags point into the tables: built again on the new ones
+        tag_map_destroy(backend->tags);
+        backend->tags = config->nb_tags > 0 ? tag_map_create(config->tags, config->nb_tags, mapping) : NULL;
+        if (config->nb_tags > 0 && !backend->tags) {
+            log_error("Upgrade: out of memory, tags unavailable");
+        }
+    }
+    if (config->wal_file[0]) {
+        int replayed = 0;
+        backend->wal = wal_open(config->wal_file, backend->mapping, lsn, config->wal_mode,
+                                config->wal_commit_interval_ms, &replayed);
+        if (!backend->wal) {
             return -1;
         }
+        tcp_worker_pool_set_wal(backend->tcp_workers, backend->wal);
+    }
+    if (backend->image &&
+        image_start(backend->image, &backend->mapping_lock, backend->wal, config->image_sync_interval_ms) != 0) {
+        return -1;
+    }
+    if (config->snapshot_file[0] && !backend->image) {
+        backend->snapshotter = snapshot_start(config->snapshot_file, backend->mapping, &backend->mapping_lock,
+                                              backend->wal, config->snapshot_interval_ms, false);
+        if (!backend->snapshotter) {
+            log_error("Upgrade: failed to restart snapshots");
+        }
+    }
+    if (config->nb_poll_devices > 0) {
+        backend->poller = poller_create(config);
+        if (!backend->poller || poller_start(backend->poller) != 0) {
+            log_error("Upgrade: failed to restart the downstream poller");
+            poller_destroy(backend->poller);
+            backend->poller = NULL;
+        }
     }
-    
     return 0;
 }
 
-int rtu_adapter_reconnect(ModbusBackend *backend, const ModbusConfig *config) {
-    if (!backend) return -1;
-    
-    // Cleanup old connection first (if any)
+int server_controller_upgrade(ServerController *controller) {
+    ModbusBackend *backend = controller->backend;
+    Handoff *handoff = controller->argv ? handoff_start(controller->argv) : NULL;
+    if (!handoff) {
+        printf("{\"error\":\"upgrade_failed\"}\n");
+        return -1;
+    }
+
+    // The tables stop changing: the workers park between requests, the main loop is here
+    tcp_worker_pool_pause(backend->tcp_workers, true);
+    tcp_worker_pool_synchronize(backend->tcp_workers, backend->watch);
+    poller_apply(backend->poller, backend->mapping, &backend->mapping_lock);
+
+    int *socks = NULL;
+    int nb_socks = collect_sockets(backend, &socks);
+    if (nb_socks < 0 || handoff_send(handoff, backend->mapping, socks, nb_socks) != 0) {
+        free(socks);
+        handoff_abort(handoff);
+        tcp_worker_pool_pause(backend->tcp_workers, controller->state != STATE_RUNNING);
+        printf("{\"error\":\"upgrade_failed\"}\n");
+        return -1;
+    }
+    free(socks);
+
+    // The new process holds everything now: release what it opens next, as a shutdown would
+    uint64_t lsn = wal_last_lsn(backend->wal);
+    poller_destroy(backend->poller);
+    backend->poller = NULL;
     rtu_adapter_cleanup(backend);
-    
-    log_debug("Attempting to reconnect RTU on %s", config->serial_device);
-    
-    int rc = rtu_adapter_init(backend, config);
-    if (rc == 0) {
-        log_debug("RTU reconnected successfully on %s", config->serial_device);
-    } else {
-        log_debug("RTU reconnect failed on %s", config->serial_device);
+    snapshot_stop(backend->snapshotter);
+    backend->snapshotter = NULL;
+    if (backend->image) {
+        image_close(backend->image);
+        backend->image = NULL;
+        backend->mapping = NULL;
     }
-    
-    return rc;
+    tcp_worker_pool_set_wal(backend->tcp_workers, NULL);
+    wal_close(backend->wal);
+    backend->wal = NULL;
+
+    int pid = handoff_release(handoff);
+    if (pid < 0) {
+        if (resume_after_upgrade(controller, lsn) != 0) {
+            log_error("Upgrade: cannot reopen the persistence files, exiting");
+            controller->running = false;
+            return 0;
+        }
+        log_warn("Upgrade: the new process failed, serving on");
+        tcp_worker_pool_pause(backend->tcp_workers, controller->state != STATE_RUNNING);
+        printf("{\"error\":\"upgrade_failed\"}\n");
+        return -1;
+    }
+    tcp_worker_pool_disown(backend->tcp_workers);
+    log_info("Upgrade: pid %d serves now, exiting", pid);
+    printf("{\"status\":\"upgraded\",\"pid\":%d}\n", pid);
+    controller->running = false;
+    return 0;
 }
 
-void rtu_adapter_cleanup(ModbusBackend *backend) {
-    if (!backend || !backend->ctx_rtu) {
-        return;
+int server_controller_run(ServerController *controller) {
+    if (!controller || !controller->backend) {
+        return -1;
+    }
+
+    ModbusBackend *backend = controller->backend;
+    const ModbusConfig *config = &controller->config;
+    uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+    char buf[MAX_JSON_BUFFER];
+    uint64_t last_rtu_attempt_us = 0;
+
+    signal(SIGTERM, signal_handler);
+    signal(SIGINT, signal_handler);
+    #ifdef SIGHUP
+    signal(SIGHUP, reload_handler);
+    #endif
+    #ifdef SIGUSR2
+    signal(SIGUSR2, upgrade_handler);
+    #endif
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    printf("{\"status\":\"server_ready\",\"tcp\":%s,\"rtu\":%s,\"rtu_tcp\":%s,\"udp\":%s,\"metrics\":%s,\"tcp_workers\":%d,\"tcp_backend\":\"%s\",\"unit_id\":%d}\n",
+           config->enable_tcp ? "true" : "false",
+           config->enable_rtu ? "true" : "false",
+           config->rtu_tcp_port > 0 ? "true" : "false",
+           config->udp_port > 0 ? "true" : "false",
+           config->metrics_port > 0 ? "true" : "false",
+           backend->tcp_workers ? (config->tcp_workers > 0 ? config->tcp_workers : 1) : 0,
+           tcp_worker_pool_backend(backend->tcp_workers) == TCP_BACKEND_IO_URING ? "io_uring" : "epoll",
+           config->unit_id);
+
+    while (controller->running && !stop_requested) {
+        fd_set fds;
+        fd_set wfds;
+        FD_ZERO(&fds);
+        FD_ZERO(&wfds);
+        int maxfd = -1;
+        
+        #if PLATFORM_LINUX
+        FD_SET(STDIN_FILENO, &fds);
+        maxfd = STDIN_FILENO;
+        #endif
+        
+        // Metrics stay available while stopped
+        if (backend->metrics_listen_sock != -1) {
+            FD_SET(backend->metrics_listen_sock, &fds);
+            if (backend->metrics_listen_sock > maxfd) maxfd = backend->metrics_listen_sock;
+        }
+        for (int i = 0; i < MAX_METRICS_CLIENTS; i++) {
+            const MetricsConn *conn = &backend->metrics_conns[i];
+            if (conn->sock != -1) {
+                FD_SET(conn->sock, conn->out ? &wfds : &fds);
+                if (conn->sock > maxfd) maxfd = conn->sock;
+            }
+        }
+        
+        if (controller->state == STATE_RUNNING) {
+            if (backend->tcp_listen_sock != -1) {
+                FD_SET(backend->tcp_listen_sock, &fds);
+                if (backend->tcp_listen_sock > maxfd) maxfd = backend->tcp_listen_sock;
+            }
+            for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
+                int sock = backend->tcp_conn_socks[i];
+                if (sock != -1) {
+                    FD_SET(sock, &fds);
+                    if (sock > maxfd) maxfd = sock;
+                }
+            }
+            if (backend->rtu_tcp_listen_sock != -1) {
+                FD_SET(backend->rtu_tcp_listen_sock, &fds);
+                if (backend->rtu_tcp_listen_sock > maxfd) maxfd = backend->rtu_tcp_listen_sock;
+            }
+            for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
+                int sock = backend->rtu_tcp_conns[i].sock;
+                if (sock != -1) {
+                    FD_SET(sock, &fds);
+                    if (sock > maxfd) maxfd = sock;
+                }
+            }
+            if (backend->udp_sock != -1) {
+                FD_SET(backend->udp_sock, &fds);
+                if (backend->udp_sock > maxfd) maxfd = backend->udp_sock;
+            }
+            if (backend->ctx_rtu) {
+                int rtu_fd = modbus_get_socket(backend->ctx_rtu);
+                if (rtu_fd != -1) {
+                    FD_SET(rtu_fd, &fds);
+                    if (rtu_fd > maxfd) maxfd = rtu_fd;
+                }
+            }
+        }
+        
+        int ret = 0;
+        if (maxfd >= 0) {
+            struct timeval tv = {.tv_sec = 0, .tv_usec = 100000};
+            ret = select(maxfd + 1, &fds, &wfds, NULL, &tv);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                log_error("select failed: %s", strerror(errno));
+                break;
+            }
+        } else {
+            platform_msleep(100);
+        }
+        
+        // Process stdin commands
+        int n = platform_read_stdin(buf, sizeof(buf), 0);
+        if (n > 0) {
+            json_command_process(buf, backend, &controller->state, &controller->running);
+            stats_event(backend->stats_shard, STATS_COMMANDS);
+        } else if (feof(stdin)) {
+            // EOF on stdin -> treat as stop
+            controller->running = false;
+            controller->state = STATE_STOPPED;
+        }
+        
+        // SIGHUP or the reload command; clients stay connected throughout
+        if (reload_requested || backend->reload_requested) {
+            reload_requested = 0;
+            backend->reload_requested = false;
+            server_controller_reload(controller);
+        }
+        
+        // SIGUSR2 or the upgrade command; this process exits once the new one serves
+        if (upgrade_requested || backend->upgrade_requested) {
+            upgrade_requested = 0;
+            backend->upgrade_requested = false;
+            if (server_controller_upgrade(controller) == 0) {
+                break;
+            }
+        }
+        
+        // Mirror freshly polled downstream values
+        poller_apply(backend->poller, backend->mapping, &backend->mapping_lock);
+        
+        // Client writes to subscribed ranges since the last event
+        watch_flush(backend->watch, backend->mapping, &backend->mapping_lock, stdout);
+        
+        tcp_worker_pool_pause(backend->tcp_workers, controller->state != STATE_RUNNING);
+        
+        if (ret > 0) {
+            if (backend->metrics_listen_sock != -1 && FD_ISSET(backend->metrics_listen_sock, &fds)) {
+                metrics_adapter_accept_client(backend);
+            }
+            for (int i = 0; i < MAX_METRICS_CLIENTS; i++) {
+                int sock = backend->metrics_conns[i].sock;
+                if (sock != -1 && (FD_ISSET(sock, &fds) || FD_ISSET(sock, &wfds))) {
+                    metrics_adapter_handle_client(backend, i, config);
+                }
+            }
+        }
+        
+        if (controller->state == STATE_RUNNING && ret > 0) {
+            // Accept new TCP connections
+            if (backend->tcp_listen_sock != -1 && FD_ISSET(backend->tcp_listen_sock, &fds)) {
+                tcp_adapter_accept_client(backend);
+            }
+            
+            // Handle data from all TCP clients
+            for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
+                int sock = backend->tcp_conn_socks[i];
+                if (sock != -1 && FD_ISSET(sock, &fds)) {
+                    tcp_adapter_handle_client(backend, i, query);
+                }
+            }
+            
+            // RTU framing over raw TCP
+            if (backend->rtu_tcp_listen_sock != -1 && FD_ISSET(backend->rtu_tcp_listen_sock, &fds)) {
+                rtu_tcp_adapter_accept_client(backend);
+            }
+            for (int i = 0; i < MAX_TCP_CLIENTS; i++) {
+                int sock = backend->rtu_tcp_conns[i].sock;
+                if (sock != -1 && FD_ISSET(sock, &fds)) {
+                    rtu_tcp_adapter_handle_client(backend, i);
+                }
+            }
+            
+            // Modbus/UDP datagrams
+            if (backend->udp_sock != -1 && FD_ISSET(backend->udp_sock, &fds)) {
+                udp_adapter_handle(backend);
+            }
+            
+            // Handle RTU
+            if (backend->ctx_rtu) {
+                int rtu_fd = modbus_get_socket(backend->ctx_rtu);
+                if (rtu_fd != -1 && FD_ISSET(rtu_fd, &fds)) {
+                    rtu_adapter_handle(backend, query);
+                }
+            }
+        }
+        
+        // Auto-reconnect RTU while running, at most once per second
+        if (config->enable_rtu && !backend->ctx_rtu && controller->state == STATE_RUNNING) {
+            uint64_t now = platform_monotonic_us();
+            if (now - last_rtu_attempt_us >= 1000000ULL) {
+                last_rtu_attempt_us = now;
+                rtu_adapter_reconnect(backend, config);
+            }
+        }
     }
-    
-    modbus_close(backend->ctx_rtu);
-    modbus_free(backend->ctx_rtu);
-    backend->ctx_rtu = NULL;
+
+    printf("{\"status\":\"exited\"}\n");
+    return 0;
 }
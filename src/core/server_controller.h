@@ -6,10 +6,13 @@
 #include "../json/json_command.h"
 
 typedef struct {
+    char config_file[256];
     ModbusConfig config;
     ModbusBackend *backend;
     ServerState state;
     bool running;
+    char **argv;                    // Command line, run again by an upgrade (NULL: no upgrades)
+    struct Handoff *handoff;        // State of the upgraded server, until this one serves
 } ServerController;
 
 /**
@@ -25,6 +28,33 @@ ServerController* server_controller_create(const char *config_file);
  */
 void server_controller_destroy(ServerController *controller);
 
+/**
+ * Reread the config file and apply it without dropping any client: new
+ * register ranges get a new mapping, filled with the values of the
+ * addresses both layouts hold and swapped in RCU-style; tags, scaling,
+ * unit id, log level and watch interval are replaced. Listener, serial,
+ * persistence and polling settings keep their running values until a
+ * restart, as do the register ranges with image_file or wal_file set.
+ * Called by the main loop, outside the mapping lock. Prints the outcome.
+ * @param controller Pointer to ServerController
+ * @return 0 on success, -1 if the running configuration was kept
+ */
+int server_controller_reload(ServerController *controller);
+
+/**
+ * Hand the server over to a new process running the binary now installed:
+ * the new process loads its config, then receives the register tables, the
+ * listening sockets and the idle client connections; this one closes its
+ * persistence files, serial line and poller for it to open. Clients see a
+ * pause instead of a refused or dropped connection. If the new process
+ * fails once they are closed, it is stopped and this one reopens them.
+ * Called by the main loop on SIGUSR2 or the upgrade command. Prints the outcome.
+ * @param controller Pointer to ServerController (argv set)
+ * @return 0 once handed over, or if the files could not be reopened (the
+ *         process must exit), -1 if this one keeps serving
+ */
+int server_controller_upgrade(ServerController *controller);
+
 /**
  * Run the main server loop
  * @param controller Pointer to ServerController
@@ -0,0 +1,357 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // fileno
+#endif
+#include "snapshot.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_MAGIC "MBSNAP\0\2"
+#define SNAPSHOT_HEADER_LENGTH 64
+#define SNAPSHOT_TABLES 4
+#define SNAPSHOT_READ_RETRIES 4     // Lock-free copies before blocking writers
+#define SNAPSHOT_TICK_MS 100
+
+#define PUT_U32(p, v) do { (p)[0] = (uint8_t)(v); (p)[1] = (uint8_t)((v) >> 8); \
+                           (p)[2] = (uint8_t)((v) >> 16); (p)[3] = (uint8_t)((v) >> 24); } while (0)
+#define GET_U32(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+/*
+ * File layout, little endian:
+ *   magic[8], then start and size of coils, discrete inputs, holding and
+ *   input registers (8 x u32), payload CRC-32 (u32), payload length (u32),
+ *   wall clock time of the snapshot in us (u64), last write-ahead log LSN
+ *   included (u64, 0 without a log);
+ *   payload: coils and discrete inputs packed 8 per byte (LSB first),
+ *   then the registers as u16.
+ */
+
+typedef struct {
+    uint8_t *live;              // Table inside the mapping
+    uint8_t *shadow;            // Contents at the last snapshot
+    size_t bytes;
+    int start;
+    int nb;
+    bool bits;                  // One byte per bit, packed in the file
+} SnapshotTable;
+
+struct Snapshotter {
+    char path[256];
+    char tmp_path[264];
+    MappingLock *lock;
+    SnapshotTable tables[SNAPSHOT_TABLES];
+    unsigned saved_seq;         // Mapping lock sequence at the last comparison
+    Wal *wal;
+    uint64_t lsn;               // Last logged write in the shadow tables
+    uint64_t saved_lsn;         // ... and in the file
+    bool current;               // The file holds the shadow tables
+    int interval_ms;
+
+    uint8_t *file;              // Serialized snapshot
+    size_t file_len;
+
+    pthread_mutex_t save_lock;  // Thread and final save never overlap
+    pthread_t thread;
+    bool thread_started;
+    atomic_bool stop;
+};
+
+static uint32_t crc32(const uint8_t *buf, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static void describe_tables(modbus_mapping_t *m, SnapshotTable *tables) {
+    tables[0] = (SnapshotTable){m->tab_bits, NULL, (size_t)m->nb_bits, m->start_bits, m->nb_bits, true};
+    tables[1] = (SnapshotTable){m->tab_input_bits, NULL, (size_t)m->nb_input_bits,
+                                m->start_input_bits, m->nb_input_bits, true};
+    tables[2] = (SnapshotTable){(uint8_t *)m->tab_registers, NULL, (size_t)m->nb_registers * 2,
+                                m->start_registers, m->nb_registers, false};
+    tables[3] = (SnapshotTable){(uint8_t *)m->tab_input_registers, NULL, (size_t)m->nb_input_registers * 2,
+                                m->start_input_registers, m->nb_input_registers, false};
+}
+
+static size_t payload_length(const SnapshotTable *tables) {
+    size_t len = 0;
+    for (int t = 0; t < SNAPSHOT_TABLES; t++) {
+        len += tables[t].bits ? ((size_t)tables[t].nb + 7) / 8 : (size_t)tables[t].nb * 2;
+    }
+    return len;
+}
+
+int snapshot_restore(const char *path, modbus_mapping_t *mapping, uint64_t *wal_lsn) {
+    *wal_lsn = 0;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        log_info("No snapshot at %s, starting from empty tables", path);
+        return 0;
+    }
+
+    SnapshotTable tables[SNAPSHOT_TABLES];
+    describe_tables(mapping, tables);
+    size_t expected = payload_length(tables);
+    uint8_t header[SNAPSHOT_HEADER_LENGTH];
+    uint8_t *payload = (uint8_t *)malloc(expected ? expected : 1);
+    bool ok = payload && fread(header, 1, sizeof(header), fp) == sizeof(header) &&
+              memcmp(header, SNAPSHOT_MAGIC, 8) == 0;
+
+    // Another table layout means another configuration: its contents are meaningless here
+    for (int t = 0; ok && t < SNAPSHOT_TABLES; t++) {
+        ok = GET_U32(header + 8 + 8 * t) == (uint32_t)tables[t].start &&
+             GET_U32(header + 12 + 8 * t) == (uint32_t)tables[t].nb;
+    }
+    ok = ok && GET_U32(header + 44) == (uint32_t)expected &&
+         fread(payload, 1, expected, fp) == expected && crc32(payload, expected) == GET_U32(header + 40);
+    fclose(fp);
+    if (!ok) {
+        log_warn("Snapshot %s is damaged or does not match the configured tables, ignoring it", path);
+        free(payload);
+        return 0;
+    }
+
+    const uint8_t *p = payload;
+    for (int t = 0; t < SNAPSHOT_TABLES; t++) {
+        SnapshotTable *table = &tables[t];
+        if (table->bits) {
+            for (int i = 0; i < table->nb; i++) {
+                table->live[i] = (p[i / 8] >> (i % 8)) & 1;
+            }
+            p += (table->nb + 7) / 8;
+        } else {
+            uint16_t *regs = (uint16_t *)table->live;
+            for (int i = 0; i < table->nb; i++) {
+                regs[i] = (uint16_t)(p[2 * i] | p[2 * i + 1] << 8);
+            }
+            p += table->nb * 2;
+        }
+    }
+    free(payload);
+    *wal_lsn = GET_U32(header + 56) | (uint64_t)GET_U32(header + 60) << 32;
+    log_info("Restored registers from snapshot %s", path);
+    return 1;
+}
+
+/*
+ * Bring the shadow tables up to date, page by page. Runs as a seqlock
+ * reader: a pass that overlapped a write is repeated, and the last pass
+ * holds the write lock so the tables always come from one instant.
+ * Returns the number of pages copied.
+ */
+static int capture(Snapshotter *snap) {
+    int copied = 0;
+    for (int attempt = 0; attempt <= SNAPSHOT_READ_RETRIES; attempt++) {
+        bool locked = attempt == SNAPSHOT_READ_RETRIES;
+        unsigned seq = 0;
+        if (locked) {
+            mapping_write_begin(snap->lock);
+        } else {
+            seq = mapping_read_begin(snap->lock);
+        }
+        uint64_t lsn = wal_last_lsn(snap->wal);
+        
+        for (int t = 0; t < SNAPSHOT_TABLES; t++) {
+            SnapshotTable *table = &snap->tables[t];
+            for (size_t off = 0; off < table->bytes; off += SNAPSHOT_PAGE_BYTES) {
+                size_t len = table->bytes - off < SNAPSHOT_PAGE_BYTES ? table->bytes - off : SNAPSHOT_PAGE_BYTES;
+                if (memcmp(table->shadow + off, table->live + off, len) != 0) {
+                    memcpy(table->shadow + off, table->live + off, len);
+                    copied++;
+                }
+            }
+        }
+        
+        if (locked) {
+            snap->saved_seq = snap->lock ? atomic_load_explicit(&snap->lock->seq, memory_order_relaxed) + 1 : 0;
+            snap->lsn = lsn;
+            mapping_write_end(snap->lock);
+            break;
+        }
+        if (!mapping_read_retry(snap->lock, seq)) {
+            snap->saved_seq = seq;
+            snap->lsn = lsn;
+            break;
+        }
+    }
+    return copied;
+}
+
+static void serialize(Snapshotter *snap) {
+    uint8_t *header = snap->file;
+    uint8_t *payload = snap->file + SNAPSHOT_HEADER_LENGTH;
+    size_t payload_len = snap->file_len - SNAPSHOT_HEADER_LENGTH;
+
+    uint8_t *p = payload;
+    for (int t = 0; t < SNAPSHOT_TABLES; t++) {
+        SnapshotTable *table = &snap->tables[t];
+        if (table->bits) {
+            memset(p, 0, ((size_t)table->nb + 7) / 8);
+            for (int i = 0; i < table->nb; i++) {
+                p[i / 8] |= (uint8_t)((table->shadow[i] ? 1 : 0) << (i % 8));
+            }
+            p += (table->nb + 7) / 8;
+        } else {
+            const uint16_t *regs = (const uint16_t *)table->shadow;
+            for (int i = 0; i < table->nb; i++) {
+                p[2 * i] = (uint8_t)regs[i];
+                p[2 * i + 1] = (uint8_t)(regs[i] >> 8);
+            }
+            p += table->nb * 2;
+        }
+    }
+
+    memcpy(header, SNAPSHOT_MAGIC, 8);
+    for (int t = 0; t < SNAPSHOT_TABLES; t++) {
+        PUT_U32(header + 8 + 8 * t, (uint32_t)snap->tables[t].start);
+        PUT_U32(header + 12 + 8 * t, (uint32_t)snap->tables[t].nb);
+    }
+    PUT_U32(header + 40, crc32(payload, payload_len));
+    PUT_U32(header + 44, (uint32_t)payload_len);
+    uint64_t now_us = platform_realtime_us();
+    PUT_U32(header + 48, (uint32_t)now_us);
+    PUT_U32(header + 52, (uint32_t)(now_us >> 32));
+    PUT_U32(header + 56, (uint32_t)snap->lsn);
+    PUT_U32(header + 60, (uint32_t)(snap->lsn >> 32));
+}
+
+static int write_file(Snapshotter *snap) {
+    FILE *fp = fopen(snap->tmp_path, "wb");
+    if (!fp) {
+        return -1;
+    }
+    bool ok = fwrite(snap->file, 1, snap->file_len, fp) == snap->file_len && fflush(fp) == 0 &&
+              platform_sync_fd(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || platform_replace_file(snap->tmp_path, snap->path) != 0) {
+        remove(snap->tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int snapshot_save(Snapshotter *snap) {
+    pthread_mutex_lock(&snap->save_lock);
+
+    // No writer since the last comparison: nothing to look at
+    unsigned seq = snap->lock ? atomic_load_explicit(&snap->lock->seq, memory_order_acquire) : 1;
+    if (snap->current && snap->lock && seq == snap->saved_seq) {
+        pthread_mutex_unlock(&snap->save_lock);
+        return 0;
+    }
+
+    uint64_t start_us = platform_monotonic_us();
+    int copied = capture(snap);
+    // Writes of unchanged values still move the LSN: saving it lets the log be trimmed
+    if (copied == 0 && snap->current && snap->lsn == snap->saved_lsn) {
+        pthread_mutex_unlock(&snap->save_lock);
+        return 0;
+    }
+
+    serialize(snap);
+    int rc = write_file(snap);
+    if (rc != 0) {
+        log_warn("Failed to write snapshot %s", snap->path);
+        snap->current = false;
+    } else {
+        snap->current = true;
+        snap->saved_lsn = snap->lsn;
+        wal_checkpoint(snap->wal, snap->lsn);
+        log_debug("Snapshot written: %d pages changed, %zu bytes, %.1f ms", copied, snap->file_len,
+                  (platform_monotonic_us() - start_us) / 1e3);
+    }
+    pthread_mutex_unlock(&snap->save_lock);
+    return rc == 0 ? copied : -1;
+}
+
+static void* snapshot_thread(void *arg) {
+    Snapshotter *snap = (Snapshotter *)arg;
+    uint64_t next_us = platform_monotonic_us() + (uint64_t)snap->interval_ms * 1000;
+    while (!atomic_load_explicit(&snap->stop, memory_order_relaxed)) {
+        if (platform_monotonic_us() >= next_us) {
+            snapshot_save(snap);
+            next_us = platform_monotonic_us() + (uint64_t)snap->interval_ms * 1000;
+        }
+        platform_msleep(SNAPSHOT_TICK_MS);
+    }
+    return NULL;
+}
+
+static void snapshot_free(Snapshotter *snap) {
+    for (int t = 0; t < SNAPSHOT_TABLES; t++) {
+        free(snap->tables[t].shadow);
+    }
+    free(snap->file);
+    pthread_mutex_destroy(&snap->save_lock);
+    free(snap);
+}
+
+Snapshotter* snapshot_start(const char *path, modbus_mapping_t *mapping, MappingLock *lock, Wal *wal,
+                            int interval_ms, bool restored) {
+    Snapshotter *snap = (Snapshotter *)calloc(1, sizeof(Snapshotter));
+    if (!snap) {
+        return NULL;
+    }
+    snprintf(snap->path, sizeof(snap->path), "%s", path);
+    snprintf(snap->tmp_path, sizeof(snap->tmp_path), "%s.tmp", path);
+    snap->lock = lock;
+    snap->wal = wal;
+    snap->interval_ms = interval_ms > 0 ? interval_ms : 1000;
+    atomic_init(&snap->stop, false);
+    pthread_mutex_init(&snap->save_lock, NULL);
+
+    describe_tables(mapping, snap->tables);
+    bool ok = true;
+    for (int t = 0; t < SNAPSHOT_TABLES; t++) {
+        snap->tables[t].shadow = (uint8_t *)malloc(snap->tables[t].bytes ? snap->tables[t].bytes : 1);
+        ok = ok && snap->tables[t].shadow;
+    }
+    snap->file_len = SNAPSHOT_HEADER_LENGTH + payload_length(snap->tables);
+    snap->file = (uint8_t *)malloc(snap->file_len);
+    if (!ok || !snap->file) {
+        log_error("Failed to allocate snapshot buffers");
+        snapshot_free(snap);
+        return NULL;
+    }
+
+    // Start from the mapping as it is; a restored mapping is already on disk
+    for (int t = 0; t < SNAPSHOT_TABLES; t++) {
+        if (snap->tables[t].bytes > 0) {
+            memcpy(snap->tables[t].shadow, snap->tables[t].live, snap->tables[t].bytes);
+        }
+    }
+    snap->saved_seq = lock ? atomic_load(&lock->seq) : 0;
+    snap->lsn = wal_last_lsn(wal);
+    snap->saved_lsn = snap->lsn;
+    snap->current = restored;
+
+    if (pthread_create(&snap->thread, NULL, snapshot_thread, snap) != 0) {
+        log_error("Failed to start snapshot thread");
+        snapshot_free(snap);
+        return NULL;
+    }
+    snap->thread_started = true;
+    log_debug("Snapshots of %zu bytes to %s every %d ms", snap->file_len, snap->path, snap->interval_ms);
+    return snap;
+}
+
+void snapshot_stop(Snapshotter *snap) {
+    if (!snap) return;
+
+    atomic_store(&snap->stop, true);
+    if (snap->thread_started) {
+        pthread_join(snap->thread, NULL);
+    }
+    if (snapshot_save(snap) >= 0) {
+        log_info("Final snapshot saved to %s", snap->path);
+    }
+    snapshot_free(snap);
+}
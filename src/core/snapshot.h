@@ -0,0 +1,57 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "mapping_lock.h"
+#include "wal.h"
+#include <modbus/modbus.h>
+#include <stdbool.h>
+
+// Granularity of change detection, in bytes of a table
+#define SNAPSHOT_PAGE_BYTES 4096
+
+typedef struct Snapshotter Snapshotter;
+
+/**
+ * Load the tables saved by a previous run into the mapping.
+ * Call before any listener or writer starts. A snapshot taken with other
+ * table starts or sizes is ignored.
+ * @param path Snapshot file
+ * @param mapping Register mapping to fill
+ * @param wal_lsn Receives the last write-ahead log LSN the snapshot includes, 0 if none
+ * @return 1 if restored, 0 if there is no usable snapshot
+ */
+int snapshot_restore(const char *path, modbus_mapping_t *mapping, uint64_t *wal_lsn);
+
+/**
+ * Start a thread saving the mapping to a file every interval.
+ * Each run compares the tables page by page with what was last saved and
+ * copies only the pages that changed; nothing is written while the mapping
+ * is unchanged. The file is written to path.tmp, synced and renamed over
+ * path, so a crash leaves the previous snapshot intact. Each snapshot
+ * records the last logged write it includes and then checkpoints the log.
+ * @param path Snapshot file
+ * @param mapping Register mapping
+ * @param lock Mapping lock shared with every writer
+ * @param wal Write-ahead log of client writes, NULL for none
+ * @param interval_ms Time between snapshots
+ * @param restored true if the file already holds the current mapping
+ * @return Pointer to Snapshotter, or NULL on failure
+ */
+Snapshotter* snapshot_start(const char *path, modbus_mapping_t *mapping, MappingLock *lock, Wal *wal,
+                            int interval_ms, bool restored);
+
+/**
+ * Save the mapping now if it changed since the last snapshot
+ * @param snap Pointer to Snapshotter
+ * @return Pages copied (0 if unchanged), -1 if writing failed
+ */
+int snapshot_save(Snapshotter *snap);
+
+/**
+ * Stop the thread, take a final snapshot and free the snapshotter.
+ * Call once every writer of the mapping has stopped.
+ * @param snap Pointer to Snapshotter (may be NULL)
+ */
+void snapshot_stop(Snapshotter *snap);
+
+#endif // SNAPSHOT_H
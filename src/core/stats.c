@@ -0,0 +1,193 @@
+#include "stats.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t slot_functions[STATS_FUNCTIONS - 1] = {1, 2, 3, 4, 5, 6, 15, 16, 22, 23};
+
+static int function_slot(uint8_t function) {
+    switch (function) {
+    case 1: case 2: case 3: case 4: case 5: case 6:
+        return function - 1;
+    case 15: return 6;
+    case 16: return 7;
+    case 22: return 8;
+    case 23: return 9;
+    default: return STATS_FUNCTIONS - 1;
+    }
+}
+
+int stats_init(Stats *stats) {
+    memset(stats->shards, 0, sizeof(stats->shards));
+    stats->nb_shards = 0;
+    stats->start_us = platform_monotonic_us();
+    return pthread_mutex_init(&stats->lock, NULL) == 0 ? 0 : -1;
+}
+
+void stats_destroy(Stats *stats) {
+    for (int i = 0; i < stats->nb_shards; i++) {
+        free(stats->shards[i]);
+    }
+    stats->nb_shards = 0;
+    pthread_mutex_destroy(&stats->lock);
+}
+
+StatsShard* stats_shard_create(Stats *stats) {
+    if (!stats) {
+        return NULL;
+    }
+    
+    StatsShard *shard = (StatsShard *)calloc(1, sizeof(StatsShard));
+    if (!shard) {
+        log_warn("Failed to allocate stats shard, requests will not be counted");
+        return NULL;
+    }
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        histogram_init(&shard->latency[f]);
+    }
+    
+    pthread_mutex_lock(&stats->lock);
+    if (stats->nb_shards == STATS_MAX_SHARDS) {
+        pthread_mutex_unlock(&stats->lock);
+        log_warn("Out of stats shards (%d), requests will not be counted", STATS_MAX_SHARDS);
+        free(shard);
+        return NULL;
+    }
+    stats->shards[stats->nb_shards++] = shard;
+    pthread_mutex_unlock(&stats->lock);
+    return shard;
+}
+
+static void add_counters(StatsCounters *c, int bytes_in, int bytes_out, bool exception) {
+    c->requests++;
+    c->exceptions += exception ? 1 : 0;
+    c->bytes_in += (uint64_t)bytes_in;
+    c->bytes_out += (uint64_t)bytes_out;
+}
+
+void stats_count(StatsShard *shard, StatsBatch *batch, uint8_t unit, uint8_t function,
+                 int bytes_in, int bytes_out, bool exception) {
+    if (!shard) return;
+    int slot = function_slot(function);
+    add_counters(&shard->units[unit], bytes_in, bytes_out, exception);
+    add_counters(&shard->functions[slot], bytes_in, bytes_out, exception);
+    batch->pending[slot]++;
+}
+
+void stats_complete(StatsShard *shard, StatsBatch *batch, uint64_t latency_ns) {
+    if (!shard) return;
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        if (batch->pending[f] > 0) {
+            histogram_record_count(&shard->latency[f], latency_ns, batch->pending[f]);
+            batch->pending[f] = 0;
+        }
+    }
+}
+
+void stats_record(StatsShard *shard, uint8_t unit, uint8_t function,
+                  int bytes_in, int bytes_out, bool exception, uint64_t latency_ns) {
+    if (!shard) return;
+    int slot = function_slot(function);
+    add_counters(&shard->units[unit], bytes_in, bytes_out, exception);
+    add_counters(&shard->functions[slot], bytes_in, bytes_out, exception);
+    histogram_record(&shard->latency[slot], latency_ns);
+}
+
+static void merge_counters(StatsCounters *dst, const StatsCounters *src) {
+    dst->requests += src->requests;
+    dst->exceptions += src->exceptions;
+    dst->bytes_in += src->bytes_in;
+    dst->bytes_out += src->bytes_out;
+}
+
+static void print_counters(const StatsCounters *c) {
+    printf("\"requests\":%llu,\"exceptions\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu",
+           (unsigned long long)c->requests, (unsigned long long)c->exceptions,
+           (unsigned long long)c->bytes_in, (unsigned long long)c->bytes_out);
+}
+
+int stats_slot_function(int slot) {
+    return slot < STATS_FUNCTIONS - 1 ? slot_functions[slot] : 0;
+}
+
+void stats_snapshot(Stats *stats, StatsShard *total) {
+    memset(total, 0, sizeof(*total));
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        histogram_init(&total->latency[f]);
+    }
+    
+    pthread_mutex_lock(&stats->lock);
+    for (int s = 0; s < stats->nb_shards; s++) {
+        const StatsShard *shard = stats->shards[s];
+        for (int u = 0; u < 256; u++) {
+            merge_counters(&total->units[u], &shard->units[u]);
+        }
+        for (int f = 0; f < STATS_FUNCTIONS; f++) {
+            merge_counters(&total->functions[f], &shard->functions[f]);
+            histogram_merge(&total->latency[f], &shard->latency[f]);
+        }
+        for (int e = 0; e < STATS_EVENTS; e++) {
+            total->events[e] += shard->events[e];
+        }
+    }
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_print(Stats *stats) {
+    StatsShard *total = (StatsShard *)malloc(sizeof(StatsShard));
+    if (!stats || !total) {
+        printf("{\"error\":\"stats_unavailable\"}\n");
+        free(total);
+        return;
+    }
+    stats_snapshot(stats, total);
+    
+    StatsCounters all = {0};
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        merge_counters(&all, &total->functions[f]);
+    }
+    
+    printf("{\"stats\":{\"uptime_s\":%.1f,",
+           (double)(platform_monotonic_us() - stats->start_us) / 1e6);
+    print_counters(&all);
+    printf(",\"crc_errors\":%llu,\"rtu_reconnects\":%llu,\"commands\":%llu",
+           (unsigned long long)total->events[STATS_CRC_ERRORS],
+           (unsigned long long)total->events[STATS_RTU_RECONNECTS],
+           (unsigned long long)total->events[STATS_COMMANDS]);
+    
+    printf(",\"functions\":[");
+    bool first = true;
+    for (int f = 0; f < STATS_FUNCTIONS; f++) {
+        const StatsCounters *c = &total->functions[f];
+        const Histogram *h = &total->latency[f];
+        if (c->requests == 0) continue;
+        if (f < STATS_FUNCTIONS - 1) {
+            printf("%s{\"function\":%d,", first ? "" : ",", stats_slot_function(f));
+        } else {
+            printf("%s{\"function\":\"other\",", first ? "" : ",");
+        }
+        print_counters(c);
+        printf(",\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p99.9\":%.1f,\"max\":%.1f}}",
+               histogram_mean(h) / 1e3,
+               (double)histogram_percentile(h, 50.0) / 1e3,
+               (double)histogram_percentile(h, 90.0) / 1e3,
+               (double)histogram_percentile(h, 99.0) / 1e3,
+               (double)histogram_percentile(h, 99.9) / 1e3,
+               (double)h->max / 1e3);
+        first = false;
+    }
+    
+    printf("],\"units\":[");
+    first = true;
+    for (int u = 0; u < 256; u++) {
+        if (total->units[u].requests == 0) continue;
+        printf("%s{\"unit\":%d,", first ? "" : ",", u);
+        print_counters(&total->units[u]);
+        printf("}");
+        first = false;
+    }
+    printf("]}}\n");
+    free(total);
+}
@@ -0,0 +1,129 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "../utils/histogram.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STATS_MAX_SHARDS 64
+#define STATS_FUNCTIONS 11      // FC 1, 2, 3, 4, 5, 6, 15, 16, 22, 23 and any other
+
+typedef struct {
+    uint64_t requests;
+    uint64_t exceptions;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} StatsCounters;
+
+// Occurrences counted outside the request path
+typedef enum {
+    STATS_CRC_ERRORS,           // RTU and RTU-over-TCP frames failing their CRC
+    STATS_RTU_RECONNECTS,       // Serial port reopened after a failure
+    STATS_COMMANDS,             // JSON commands read from stdin
+    STATS_EVENTS
+} StatsEvent;
+
+// Requests counted but whose responses are not sent yet, per function slot
+typedef struct {
+    uint16_t pending[STATS_FUNCTIONS];
+} StatsBatch;
+
+/*
+ * Counters of one serving thread. Only that thread writes them, with plain
+ * increments; the stats command reads them without synchronisation, so a
+ * snapshot may be a few requests behind.
+ */
+typedef struct {
+    StatsCounters units[256];
+    StatsCounters functions[STATS_FUNCTIONS];
+    Histogram latency[STATS_FUNCTIONS];         // Nanoseconds, receive to send complete
+    uint64_t events[STATS_EVENTS];
+} StatsShard;
+
+typedef struct {
+    pthread_mutex_t lock;                       // Guards shard registration
+    StatsShard *shards[STATS_MAX_SHARDS];
+    int nb_shards;
+    uint64_t start_us;
+} Stats;
+
+/**
+ * Initialize a stats registry
+ * @param stats Pointer to Stats
+ * @return 0 on success, -1 on failure
+ */
+int stats_init(Stats *stats);
+
+/**
+ * Free a stats registry and all its shards
+ * @param stats Pointer to Stats
+ */
+void stats_destroy(Stats *stats);
+
+/**
+ * Add a shard for one serving thread. Shards live until stats_destroy().
+ * @param stats Pointer to Stats, may be NULL
+ * @return New shard, NULL if stats is NULL or out of shards (nothing is counted)
+ */
+StatsShard* stats_shard_create(Stats *stats);
+
+/**
+ * Count a request whose response is still to be sent
+ * @param shard Thread's shard, NULL to skip
+ * @param batch Batch the request's latency will be recorded with
+ * @param unit Unit id of the request
+ * @param function Function code of the request
+ * @param bytes_in Request ADU length
+ * @param bytes_out Response ADU length, 0 if none
+ * @param exception True if answered with an exception
+ */
+void stats_count(StatsShard *shard, StatsBatch *batch, uint8_t unit, uint8_t function,
+                 int bytes_in, int bytes_out, bool exception);
+
+/**
+ * Record the latency of every request of a batch and empty it
+ * @param shard Thread's shard, NULL to skip
+ * @param batch Batch filled by stats_count()
+ * @param latency_ns Time from receiving the requests to sending their responses
+ */
+void stats_complete(StatsShard *shard, StatsBatch *batch, uint64_t latency_ns);
+
+/**
+ * Count and time a single request
+ * @param shard Thread's shard, NULL to skip
+ * @param unit Unit id of the request
+ * @param function Function code of the request
+ * @param bytes_in Request ADU length
+ * @param bytes_out Response ADU length, 0 if none
+ * @param exception True if answered with an exception
+ * @param latency_ns Time from receiving the request to sending its response
+ */
+void stats_record(StatsShard *shard, uint8_t unit, uint8_t function,
+                  int bytes_in, int bytes_out, bool exception, uint64_t latency_ns);
+
+static inline void stats_event(StatsShard *shard, StatsEvent event) {
+    if (shard) shard->events[event]++;
+}
+
+/**
+ * Function code counted in a function slot
+ * @param slot Slot index, 0 to STATS_FUNCTIONS - 1
+ * @return Function code, 0 for the slot of all other codes
+ */
+int stats_slot_function(int slot);
+
+/**
+ * Sum all shards
+ * @param stats Pointer to Stats
+ * @param total Shard receiving the totals (overwritten)
+ */
+void stats_snapshot(Stats *stats, StatsShard *total);
+
+/**
+ * Print the totals of all shards as one JSON line on stdout
+ * @param stats Pointer to Stats, may be NULL
+ */
+void stats_print(Stats *stats);
+
+#endif // STATS_H
@@ -0,0 +1,346 @@
+#include "trace.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAX_RECORDS (1 << 20)
+#define TRACE_DUMP_STREAMS 256
+
+// Synthetic addresses of the dump: clients 192.0.2.(10 + transport), server 192.0.2.1:502
+#define TRACE_SERVER_ADDR 0xC0000201u
+#define TRACE_CLIENT_ADDR 0xC000020Au
+#define TRACE_SERVER_PORT 502
+
+#define ETH_HEADER_LENGTH 14
+#define IPV4_HEADER_LENGTH 20
+#define TCP_HEADER_LENGTH 20
+#define UDP_HEADER_LENGTH 8
+
+#define PUT_U16(p, v) do { (p)[0] = (uint8_t)((v) >> 8); (p)[1] = (uint8_t)(v); } while (0)
+#define PUT_U32(p, v) do { PUT_U16(p, (v) >> 16); PUT_U16((p) + 2, v); } while (0)
+
+// Record copied out of a ring by a dump
+typedef struct {
+    uint64_t time_us;
+    uint64_t order;             // Tie break: ring, then position in the ring
+    uint8_t transport;
+    uint8_t direction;
+    uint16_t len;
+    uint32_t conn;
+    uint8_t adu[TRACE_MAX_ADU];
+} TraceCopy;
+
+// Client side of a synthetic stream: sequence numbers and the MBAP id given to RTU frames
+typedef struct {
+    bool used;
+    uint8_t transport;
+    uint32_t conn;
+    uint32_t seq[2];            // Next sequence number per direction
+    uint16_t transaction;
+} TraceStream;
+
+int trace_init(Trace *trace) {
+    memset(trace->rings, 0, sizeof(trace->rings));
+    trace->nb_rings = 0;
+    trace->ring_records = 0;
+    atomic_init(&trace->enabled, false);
+    atomic_init(&trace->since_us, 0);
+    return pthread_mutex_init(&trace->lock, NULL) == 0 ? 0 : -1;
+}
+
+void trace_configure(Trace *trace, int records, bool enabled) {
+    int n = 0;
+    if (records > 0) {
+        n = 1;
+        while (n < records && n < TRACE_MAX_RECORDS) n <<= 1;
+    }
+    trace->ring_records = n;
+    trace_set_enabled(trace, enabled);
+}
+
+void trace_destroy(Trace *trace) {
+    for (int i = 0; i < trace->nb_rings; i++) {
+        free(trace->rings[i]->records);
+        free(trace->rings[i]);
+    }
+    trace->nb_rings = 0;
+    pthread_mutex_destroy(&trace->lock);
+}
+
+TraceRing* trace_ring_create(Trace *trace) {
+    if (!trace || trace->ring_records == 0) {
+        return NULL;
+    }
+    
+    TraceRing *ring = (TraceRing *)calloc(1, sizeof(TraceRing));
+    TraceRecord *records = (TraceRecord *)calloc((size_t)trace->ring_records, sizeof(TraceRecord));
+    if (!ring || !records) {
+        log_warn("Failed to allocate trace ring, requests will not be traced");
+        free(ring);
+        free(records);
+        return NULL;
+    }
+    ring->trace = trace;
+    ring->mask = (unsigned)trace->ring_records - 1;
+    ring->records = records;
+    atomic_init(&ring->head, 0);
+    
+    pthread_mutex_lock(&trace->lock);
+    if (trace->nb_rings == TRACE_MAX_RINGS) {
+        pthread_mutex_unlock(&trace->lock);
+        log_warn("Out of trace rings (%d), requests will not be traced", TRACE_MAX_RINGS);
+        free(records);
+        free(ring);
+        return NULL;
+    }
+    trace->rings[trace->nb_rings++] = ring;
+    pthread_mutex_unlock(&trace->lock);
+    return ring;
+}
+
+void trace_set_enabled(Trace *trace, bool enabled) {
+    atomic_store_explicit(&trace->enabled, enabled && trace->ring_records > 0, memory_order_relaxed);
+}
+
+void trace_clear(Trace *trace) {
+    // Writers never wait: older records are skipped by the dump instead
+    atomic_store_explicit(&trace->since_us, platform_realtime_us(), memory_order_relaxed);
+}
+
+void trace_record(TraceRing *ring, TraceTransport transport, TraceDirection direction,
+                  uint32_t conn, const uint8_t *adu, int len) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceRecord *record = &ring->records[head & ring->mask];
+    if (len > TRACE_MAX_ADU) len = TRACE_MAX_ADU;
+    if (len < 0) len = 0;
+    
+    atomic_store_explicit(&record->seq, (unsigned)(2 * head + 1), memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    record->transport = (uint8_t)transport;
+    record->direction = (uint8_t)direction;
+    record->len = (uint16_t)len;
+    record->conn = conn;
+    record->time_us = platform_realtime_us();
+    memcpy(record->adu, adu, (size_t)len);
+    atomic_store_explicit(&record->seq, (unsigned)(2 * head + 2), memory_order_release);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Copy the complete records of a ring newer than since_us; returns the count
+static int copy_ring(TraceRing *ring, int ring_index, uint64_t since_us, TraceCopy *out) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t size = (uint64_t)ring->mask + 1;
+    int n = 0;
+    
+    for (uint64_t i = head > size ? head - size : 0; i < head; i++) {
+        TraceRecord *record = &ring->records[i & ring->mask];
+        unsigned seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+        if (seq != (unsigned)(2 * i + 2)) {
+            continue;
+        }
+        TraceCopy *copy = &out[n];
+        copy->time_us = record->time_us;
+        copy->order = ((uint64_t)ring_index << 48) | (i & 0xFFFFFFFFFFFFull);
+        copy->transport = record->transport;
+        copy->direction = record->direction;
+        copy->len = record->len <= TRACE_MAX_ADU ? record->len : TRACE_MAX_ADU;
+        copy->conn = record->conn;
+        memcpy(copy->adu, record->adu, copy->len);
+        
+        // Overwritten while copying: the writer has lapped us
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&record->seq, memory_order_relaxed) != seq || copy->time_us < since_us) {
+            continue;
+        }
+        n++;
+    }
+    return n;
+}
+
+static int compare_copies(const void *a, const void *b) {
+    const TraceCopy *x = (const TraceCopy *)a;
+    const TraceCopy *y = (const TraceCopy *)b;
+    if (x->time_us != y->time_us) return x->time_us < y->time_us ? -1 : 1;
+    if (x->order != y->order) return x->order < y->order ? -1 : 1;
+    return 0;
+}
+
+static TraceStream* find_stream(TraceStream *streams, int *next_free, uint8_t transport, uint32_t conn) {
+    for (int i = 0; i < TRACE_DUMP_STREAMS; i++) {
+        if (streams[i].used && streams[i].transport == transport && streams[i].conn == conn) {
+            return &streams[i];
+        }
+    }
+    
+    // Out of slots: recycle round robin, the old stream just restarts its numbering
+    TraceStream *stream = &streams[*next_free % TRACE_DUMP_STREAMS];
+    (*next_free)++;
+    stream->used = true;
+    stream->transport = transport;
+    stream->conn = conn;
+    stream->seq[0] = 1;
+    stream->seq[1] = 1;
+    stream->transaction = 0;
+    return stream;
+}
+
+static uint16_t ipv4_checksum(const uint8_t *header) {
+    uint32_t sum = 0;
+    for (int i = 0; i < IPV4_HEADER_LENGTH; i += 2) {
+        sum += (uint32_t)((header[i] << 8) | header[i + 1]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/*
+ * Frame one record as Ethernet/IPv4/TCP (or UDP) into pkt.
+ * Returns the packet length, 0 if the record cannot be framed.
+ */
+static int build_packet(const TraceCopy *copy, TraceStream *stream, uint16_t ip_id, uint8_t *pkt) {
+    bool udp = copy->transport == TRACE_UDP;
+    bool request = copy->direction == TRACE_REQUEST;
+    int l4_length = udp ? UDP_HEADER_LENGTH : TCP_HEADER_LENGTH;
+    uint8_t *payload = pkt + ETH_HEADER_LENGTH + IPV4_HEADER_LENGTH + l4_length;
+    int payload_len;
+    
+    if (copy->transport == TRACE_RTU || copy->transport == TRACE_RTU_TCP) {
+        // Unit id and PDU under an MBAP header; the id pairs a response with its request
+        if (copy->len < 4) {
+            return 0;
+        }
+        if (request) {
+            stream->transaction++;
+        }
+        int unit_pdu_len = copy->len - 2;
+        PUT_U16(payload, stream->transaction);
+        PUT_U16(payload + 2, 0);
+        PUT_U16(payload + 4, unit_pdu_len);
+        memcpy(payload + 6, copy->adu, (size_t)unit_pdu_len);
+        payload_len = 6 + unit_pdu_len;
+    } else {
+        memcpy(payload, copy->adu, copy->len);
+        payload_len = copy->len;
+    }
+    
+    uint32_t client_addr = TRACE_CLIENT_ADDR + copy->transport;
+    uint16_t client_port = (uint16_t)(1024 + copy->conn % 64512);
+    if (udp && copy->conn != 0) {
+        client_port = (uint16_t)copy->conn;
+    }
+    
+    uint8_t *eth = pkt;
+    memset(eth, 0, 12);
+    eth[0] = 0x02;
+    eth[5] = request ? 1 : 2;
+    eth[6] = 0x02;
+    eth[11] = request ? 2 : 1;
+    PUT_U16(eth + 12, 0x0800);
+    
+    uint8_t *ip = pkt + ETH_HEADER_LENGTH;
+    ip[0] = 0x45;
+    ip[1] = 0;
+    PUT_U16(ip + 2, IPV4_HEADER_LENGTH + l4_length + payload_len);
+    PUT_U16(ip + 4, ip_id);
+    PUT_U16(ip + 6, 0x4000);        // Don't fragment
+    ip[8] = 64;
+    ip[9] = udp ? 17 : 6;
+    PUT_U16(ip + 10, 0);
+    PUT_U32(ip + 12, request ? client_addr : TRACE_SERVER_ADDR);
+    PUT_U32(ip + 16, request ? TRACE_SERVER_ADDR : client_addr);
+    PUT_U16(ip + 10, ipv4_checksum(ip));
+    
+    // Checksums of the transport headers are left 0 (not verified by Wireshark by default)
+    uint8_t *l4 = ip + IPV4_HEADER_LENGTH;
+    PUT_U16(l4, request ? client_port : TRACE_SERVER_PORT);
+    PUT_U16(l4 + 2, request ? TRACE_SERVER_PORT : client_port);
+    if (udp) {
+        PUT_U16(l4 + 4, UDP_HEADER_LENGTH + payload_len);
+        PUT_U16(l4 + 6, 0);
+    } else {
+        int dir = request ? 0 : 1;
+        PUT_U32(l4 + 4, stream->seq[dir]);
+        PUT_U32(l4 + 8, stream->seq[1 - dir]);
+        stream->seq[dir] += (uint32_t)payload_len;
+        l4[12] = (TCP_HEADER_LENGTH / 4) << 4;
+        l4[13] = 0x18;              // PSH, ACK
+        PUT_U16(l4 + 14, 65535);
+        PUT_U16(l4 + 16, 0);
+        PUT_U16(l4 + 18, 0);
+    }
+    return ETH_HEADER_LENGTH + IPV4_HEADER_LENGTH + l4_length + payload_len;
+}
+
+int trace_dump_pcap(Trace *trace, const char *path) {
+    pthread_mutex_lock(&trace->lock);
+    int nb_rings = trace->nb_rings;
+    pthread_mutex_unlock(&trace->lock);
+    
+    size_t capacity = (size_t)nb_rings * (size_t)trace->ring_records;
+    TraceCopy *copies = (TraceCopy *)malloc(capacity ? capacity * sizeof(TraceCopy) : 1);
+    TraceStream *streams = (TraceStream *)calloc(TRACE_DUMP_STREAMS, sizeof(TraceStream));
+    if (!copies || !streams) {
+        free(copies);
+        free(streams);
+        return -1;
+    }
+    
+    uint64_t since_us = atomic_load_explicit(&trace->since_us, memory_order_relaxed);
+    int n = 0;
+    for (int r = 0; r < nb_rings; r++) {
+        n += copy_ring(trace->rings[r], r, since_us, copies + n);
+    }
+    qsort(copies, (size_t)n, sizeof(TraceCopy), compare_copies);
+    
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        log_warn("Cannot open trace file %s", path);
+        free(copies);
+        free(streams);
+        return -1;
+    }
+    
+    // pcap 2.4, microsecond timestamps in host byte order, Ethernet link type
+    struct {
+        uint32_t magic;
+        uint16_t version_major;
+        uint16_t version_minor;
+        int32_t thiszone;
+        uint32_t sigfigs;
+        uint32_t snaplen;
+        uint32_t network;
+    } header = {0xA1B2C3D4, 2, 4, 0, 0, 65535, 1};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    
+    uint8_t pkt[ETH_HEADER_LENGTH + IPV4_HEADER_LENGTH + TCP_HEADER_LENGTH + TRACE_MAX_ADU + 8];
+    int next_free = 0;
+    int written = 0;
+    for (int i = 0; i < n && ok; i++) {
+        TraceStream *stream = find_stream(streams, &next_free, copies[i].transport, copies[i].conn);
+        int len = build_packet(&copies[i], stream, (uint16_t)i, pkt);
+        if (len == 0) {
+            continue;
+        }
+        uint32_t record[4] = {
+            (uint32_t)(copies[i].time_us / 1000000), (uint32_t)(copies[i].time_us % 1000000),
+            (uint32_t)len, (uint32_t)len
+        };
+        ok = fwrite(record, sizeof(record), 1, f) == 1 && fwrite(pkt, (size_t)len, 1, f) == 1;
+        written++;
+    }
+    
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    free(copies);
+    free(streams);
+    if (!ok) {
+        log_warn("Failed to write trace file %s", path);
+        return -1;
+    }
+    return written;
+}
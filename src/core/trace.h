@@ -0,0 +1,126 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRACE_MAX_RINGS 64
+#define TRACE_MAX_ADU 260       // Largest ADU of any framing (Modbus TCP)
+
+// Framing of a traced ADU, as received or sent on the wire
+typedef enum {
+    TRACE_TCP,                  // MBAP over TCP
+    TRACE_UDP,                  // MBAP over UDP
+    TRACE_RTU,                  // RTU on the serial line
+    TRACE_RTU_TCP               // RTU over raw TCP
+} TraceTransport;
+
+typedef enum {
+    TRACE_REQUEST,
+    TRACE_RESPONSE
+} TraceDirection;
+
+typedef struct {
+    atomic_uint seq;            // 2 * index + 1 while written, 2 * index + 2 once complete
+    uint8_t transport;
+    uint8_t direction;
+    uint16_t len;               // ADU bytes kept (longer ADUs are truncated)
+    uint32_t conn;              // Socket of the connection, peer port for UDP, 0 for RTU
+    uint64_t time_us;           // Wall clock
+    uint8_t adu[TRACE_MAX_ADU];
+} TraceRecord;
+
+/*
+ * Ring of the last ADUs seen by one serving thread. Only that thread
+ * writes; a dump copies records concurrently and drops the ones being
+ * overwritten, as readers of the mapping seqlock do.
+ */
+typedef struct {
+    struct Trace *trace;
+    _Atomic uint64_t head;      // Records written so far
+    unsigned mask;
+    TraceRecord *records;
+} TraceRing;
+
+typedef struct Trace {
+    atomic_bool enabled;
+    _Atomic uint64_t since_us;  // Records older than this were cleared
+    int ring_records;           // Per ring, power of two, 0 = tracing unavailable
+    pthread_mutex_t lock;       // Guards ring registration
+    TraceRing *rings[TRACE_MAX_RINGS];
+    int nb_rings;
+} Trace;
+
+/**
+ * Initialize a trace registry. Tracing is unavailable until trace_configure().
+ * @param trace Pointer to Trace
+ * @return 0 on success, -1 on failure
+ */
+int trace_init(Trace *trace);
+
+/**
+ * Size the rings of a registry, before the first trace_ring_create()
+ * @param trace Pointer to Trace
+ * @param records Records kept per serving thread (rounded up to a power of two), 0 for none
+ * @param enabled Start recording right away
+ */
+void trace_configure(Trace *trace, int records, bool enabled);
+
+/**
+ * Free a trace registry and all its rings
+ * @param trace Pointer to Trace
+ */
+void trace_destroy(Trace *trace);
+
+/**
+ * Add a ring for one serving thread. Rings live until trace_destroy().
+ * @param trace Pointer to Trace, may be NULL
+ * @return New ring, NULL if tracing is unavailable (nothing is recorded)
+ */
+TraceRing* trace_ring_create(Trace *trace);
+
+/**
+ * Turn recording on or off for every ring
+ * @param trace Pointer to Trace
+ * @param enabled true to record
+ */
+void trace_set_enabled(Trace *trace, bool enabled);
+
+/**
+ * Forget every record written so far
+ * @param trace Pointer to Trace
+ */
+void trace_clear(Trace *trace);
+
+// One relaxed load: the only cost on the request path while tracing is off
+static inline bool trace_active(const TraceRing *ring) {
+    return ring && atomic_load_explicit(&ring->trace->enabled, memory_order_relaxed);
+}
+
+/**
+ * Append an ADU to the thread's ring, overwriting the oldest record.
+ * Call only when trace_active() is true.
+ * @param ring Thread's ring
+ * @param transport Framing of the ADU
+ * @param direction Request or response
+ * @param conn Connection id (see TraceRecord)
+ * @param adu ADU as on the wire
+ * @param len ADU length
+ */
+void trace_record(TraceRing *ring, TraceTransport transport, TraceDirection direction,
+                  uint32_t conn, const uint8_t *adu, int len);
+
+/**
+ * Write the records of all rings, oldest first, to a pcap file.
+ * Each ADU becomes a packet of a synthetic client-to-server:502 TCP stream
+ * (UDP datagram for Modbus/UDP) so Wireshark's Modbus/TCP dissector decodes
+ * it; RTU frames are rewrapped in an MBAP header without their CRC.
+ * @param trace Pointer to Trace
+ * @param path Output file
+ * @return Packets written, -1 on failure
+ */
+int trace_dump_pcap(Trace *trace, const char *path);
+
+#endif // TRACE_H
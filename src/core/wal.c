@@ -0,0 +1,441 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // fileno
+#endif
+#include "wal.h"
+#include "modbus_pdu.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define WAL_MAGIC "MBWAL\0\0\1"
+#define WAL_HEADER_LENGTH 40
+#define WAL_RECORD_OVERHEAD 16
+#define WAL_EARLY_COMMIT_BYTES (64 * 1024)     // Commit before the interval is over
+
+#define PUT_U32(p, v) do { (p)[0] = (uint8_t)(v); (p)[1] = (uint8_t)((v) >> 8); \
+                           (p)[2] = (uint8_t)((v) >> 16); (p)[3] = (uint8_t)((v) >> 24); } while (0)
+#define GET_U32(p) ((uint32_t)(p)[0] | (uint32_t)(p)[1] << 8 | (uint32_t)(p)[2] << 16 | (uint32_t)(p)[3] << 24)
+
+/*
+ * File layout, little endian:
+ *   magic[8], then start and size of coils, discrete inputs, holding and
+ *   input registers (8 x u32);
+ *   records: PDU length (u32), LSN (u64), request PDU, CRC-32 of the
+ *   length, LSN and PDU (u32).
+ * LSNs grow by one per record and carry on across files and restarts.
+ */
+
+typedef struct {
+    void (*notify)(void *arg);
+    void *arg;
+} WalSubscriber;
+
+struct Wal {
+    char path[256];
+    char old_path[264];
+    char tmp_path[264];
+    uint8_t header[WAL_HEADER_LENGTH];
+    WalMode mode;
+    int commit_interval_ms;
+
+    pthread_mutex_t lock;       // Guards the queue and the fields up to nb_subscribers
+    pthread_cond_t queued;      // First record queued, queue large, or stop
+    pthread_cond_t committed;   // durable_lsn moved or the log failed
+    uint8_t *queue;             // Records since the last commit
+    size_t queue_len;
+    size_t queue_cap;
+    _Atomic uint64_t last_lsn;  // Written under the mapping write lock as well
+    uint64_t durable_lsn;
+    uint64_t commits;
+    bool failed;
+    bool stop;
+    WalSubscriber *subscribers; // Told about each commit in sync mode
+    int nb_subscribers;
+
+    pthread_mutex_t file_lock;  // Commits and checkpoints never overlap
+    FILE *fp;
+    uint64_t checkpoint_lsn;
+
+    pthread_t thread;
+    bool thread_started;
+};
+
+// Records replayed at startup and kept for the new file
+typedef struct {
+    uint8_t *records;
+    size_t len;
+    size_t cap;
+    uint64_t last_lsn;
+    int applied;
+} WalLoad;
+
+static uint32_t crc32(const uint8_t *buf, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static bool reserve(uint8_t **buf, size_t *cap, size_t needed) {
+    if (needed <= *cap) {
+        return true;
+    }
+    size_t new_cap = *cap ? *cap * 2 : 4096;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+    uint8_t *p = (uint8_t *)realloc(*buf, new_cap);
+    if (!p) {
+        return false;
+    }
+    *buf = p;
+    *cap = new_cap;
+    return true;
+}
+
+static size_t encode_record(uint8_t *out, uint64_t lsn, const uint8_t *pdu, int len) {
+    PUT_U32(out, (uint32_t)len);
+    PUT_U32(out + 4, (uint32_t)lsn);
+    PUT_U32(out + 8, (uint32_t)(lsn >> 32));
+    memcpy(out + 12, pdu, (size_t)len);
+    uint32_t crc = crc32(out, 12 + (size_t)len);
+    PUT_U32(out + 12 + len, crc);
+    return WAL_RECORD_OVERHEAD + (size_t)len;
+}
+
+static void build_header(modbus_mapping_t *m, uint8_t *header) {
+    const int layout[8] = {m->start_bits, m->nb_bits, m->start_input_bits, m->nb_input_bits,
+                           m->start_registers, m->nb_registers, m->start_input_registers, m->nb_input_registers};
+    memcpy(header, WAL_MAGIC, 8);
+    for (int i = 0; i < 8; i++) {
+        PUT_U32(header + 8 + 4 * i, (uint32_t)layout[i]);
+    }
+}
+
+/*
+ * Apply the records of one file above load->last_lsn and keep them.
+ * A crash can leave the last record half written: reading stops there.
+ */
+static void load_file(const Wal *wal, const char *path, modbus_mapping_t *mapping, WalLoad *load) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return;
+    }
+    uint8_t header[WAL_HEADER_LENGTH];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+        memcmp(header, wal->header, WAL_HEADER_LENGTH) != 0) {
+        // Another table layout means another configuration: its writes are meaningless here
+        log_warn("Write-ahead log %s is damaged or does not match the configured tables, ignoring it", path);
+        fclose(fp);
+        return;
+    }
+
+    uint8_t record[WAL_RECORD_OVERHEAD + MODBUS_PDU_MAX_LENGTH];
+    uint8_t rsp[MODBUS_PDU_MAX_LENGTH];
+    for (;;) {
+        size_t n = fread(record, 1, 12, fp);
+        if (n == 0) {
+            break;
+        }
+        uint32_t len = n == 12 ? GET_U32(record) : 0;
+        if (len == 0 || len > MODBUS_PDU_MAX_LENGTH || fread(record + 12, 1, len + 4, fp) != len + 4 ||
+            crc32(record, 12 + len) != GET_U32(record + 12 + len)) {
+            log_warn("Write-ahead log %s ends with a torn record, dropping it", path);
+            break;
+        }
+        uint64_t lsn = GET_U32(record + 4) | (uint64_t)GET_U32(record + 8) << 32;
+        if (lsn <= load->last_lsn) {
+            continue;
+        }
+        modbus_pdu_process(mapping, NULL, NULL, NULL, record + 12, (int)len, rsp);
+        if (reserve(&load->records, &load->cap, load->len + WAL_RECORD_OVERHEAD + len)) {
+            memcpy(load->records + load->len, record, WAL_RECORD_OVERHEAD + len);
+            load->len += WAL_RECORD_OVERHEAD + len;
+        }
+        load->last_lsn = lsn;
+        load->applied++;
+    }
+    fclose(fp);
+}
+
+// Start path afresh with the header and records, through path.tmp so a crash keeps the old file
+static int create_file(Wal *wal, const uint8_t *records, size_t len) {
+    FILE *fp = fopen(wal->tmp_path, "wb");
+    if (!fp) {
+        return -1;
+    }
+    bool ok = fwrite(wal->header, 1, WAL_HEADER_LENGTH, fp) == WAL_HEADER_LENGTH &&
+              (len == 0 || fwrite(records, 1, len, fp) == len) && fflush(fp) == 0 &&
+              platform_sync_fd(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || platform_replace_file(wal->tmp_path, wal->path) != 0) {
+        remove(wal->tmp_path);
+        return -1;
+    }
+    wal->fp = fopen(wal->path, "ab");
+    return wal->fp ? 0 : -1;
+}
+
+static bool commit(Wal *wal, const uint8_t *records, size_t len) {
+    pthread_mutex_lock(&wal->file_lock);
+    bool ok = wal->fp && fwrite(records, 1, len, wal->fp) == len && fflush(wal->fp) == 0 &&
+              platform_sync_fd(fileno(wal->fp)) == 0;
+    pthread_mutex_unlock(&wal->file_lock);
+    return ok;
+}
+
+/*
+ * Group commit: the first record queued opens a window of
+ * commit_interval_ms, then everything queued by then is written and synced
+ * at once and every writer waiting on it is released.
+ */
+static void* commit_thread(void *arg) {
+    Wal *wal = (Wal *)arg;
+    uint8_t *batch = NULL;
+    size_t batch_cap = 0;
+
+    pthread_mutex_lock(&wal->lock);
+    for (;;) {
+        while (wal->queue_len == 0 && !wal->stop) {
+            pthread_cond_wait(&wal->queued, &wal->lock);
+        }
+        if (wal->queue_len == 0) {
+            break;
+        }
+        if (wal->commit_interval_ms > 0 && !wal->stop) {
+            uint64_t deadline_us = platform_realtime_us() + (uint64_t)wal->commit_interval_ms * 1000;
+            struct timespec deadline = {(time_t)(deadline_us / 1000000), (long)(deadline_us % 1000000) * 1000};
+            while (!wal->stop && wal->queue_len < WAL_EARLY_COMMIT_BYTES) {
+                if (pthread_cond_timedwait(&wal->queued, &wal->lock, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+        }
+        
+        // Writers fill the other buffer while this one is on its way to disk
+        uint8_t *records = wal->queue;
+        size_t len = wal->queue_len;
+        size_t cap = wal->queue_cap;
+        uint64_t lsn = atomic_load_explicit(&wal->last_lsn, memory_order_relaxed);
+        wal->queue = batch;
+        wal->queue_cap = batch_cap;
+        wal->queue_len = 0;
+        batch = records;
+        batch_cap = cap;
+        pthread_mutex_unlock(&wal->lock);
+        
+        bool ok = commit(wal, batch, len);
+        
+        pthread_mutex_lock(&wal->lock);
+        if (ok) {
+            wal->durable_lsn = lsn;
+            wal->commits++;
+        } else if (!wal->failed) {
+            // What reached the disk is unknown: stop logging rather than promise durability
+            log_error("Write-ahead log %s failed, writes are no longer logged", wal->path);
+            wal->failed = true;
+            wal->queue_len = 0;
+        }
+        pthread_cond_broadcast(&wal->committed);
+        for (int i = 0; i < wal->nb_subscribers; i++) {
+            wal->subscribers[i].notify(wal->subscribers[i].arg);
+        }
+    }
+    pthread_mutex_unlock(&wal->lock);
+    free(batch);
+    return NULL;
+}
+
+static void wal_free(Wal *wal) {
+    if (wal->fp) {
+        fclose(wal->fp);
+    }
+    free(wal->queue);
+    free(wal->subscribers);
+    pthread_cond_destroy(&wal->queued);
+    pthread_cond_destroy(&wal->committed);
+    pthread_mutex_destroy(&wal->lock);
+    pthread_mutex_destroy(&wal->file_lock);
+    free(wal);
+}
+
+Wal* wal_open(const char *path, modbus_mapping_t *mapping, uint64_t since_lsn, WalMode mode,
+              int commit_interval_ms, int *replayed) {
+    Wal *wal = (Wal *)calloc(1, sizeof(Wal));
+    if (!wal) {
+        return NULL;
+    }
+    snprintf(wal->path, sizeof(wal->path), "%s", path);
+    snprintf(wal->old_path, sizeof(wal->old_path), "%s.old", path);
+    snprintf(wal->tmp_path, sizeof(wal->tmp_path), "%s.tmp", path);
+    wal->mode = mode;
+    wal->commit_interval_ms = commit_interval_ms > 0 ? commit_interval_ms : 0;
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_mutex_init(&wal->file_lock, NULL);
+    pthread_cond_init(&wal->queued, NULL);
+    pthread_cond_init(&wal->committed, NULL);
+    build_header(mapping, wal->header);
+
+    // Oldest records first; both files may hold records the snapshot lacks
+    WalLoad load = {NULL, 0, 0, since_lsn, 0};
+    load_file(wal, wal->old_path, mapping, &load);
+    load_file(wal, wal->path, mapping, &load);
+    int rc = create_file(wal, load.records, load.len);
+    free(load.records);
+    if (rc != 0) {
+        log_error("Failed to create write-ahead log %s", wal->path);
+        wal_free(wal);
+        return NULL;
+    }
+    // Every record it held is in the new file now
+    remove(wal->old_path);
+
+    atomic_init(&wal->last_lsn, load.last_lsn);
+    wal->durable_lsn = load.last_lsn;
+    wal->checkpoint_lsn = since_lsn;
+    if (pthread_create(&wal->thread, NULL, commit_thread, wal) != 0) {
+        log_error("Failed to start write-ahead log thread");
+        wal_free(wal);
+        return NULL;
+    }
+    wal->thread_started = true;
+
+    if (load.applied > 0) {
+        log_info("Replayed %d writes from write-ahead log %s", load.applied, wal->path);
+    }
+    log_debug("Write-ahead log %s, %s mode, commit every %d ms", wal->path,
+              mode == WAL_MODE_SYNC ? "sync" : "async", wal->commit_interval_ms);
+    if (replayed) {
+        *replayed = load.applied;
+    }
+    return wal;
+}
+
+uint64_t wal_append(Wal *wal, const uint8_t *pdu, int len) {
+    if (len < 1 || len > MODBUS_PDU_MAX_LENGTH) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    if (wal->failed || !reserve(&wal->queue, &wal->queue_cap, wal->queue_len + WAL_RECORD_OVERHEAD + (size_t)len)) {
+        pthread_mutex_unlock(&wal->lock);
+        return 0;
+    }
+    uint64_t lsn = atomic_load_explicit(&wal->last_lsn, memory_order_relaxed) + 1;
+    size_t before = wal->queue_len;
+    wal->queue_len += encode_record(wal->queue + before, lsn, pdu, len);
+    atomic_store_explicit(&wal->last_lsn, lsn, memory_order_relaxed);
+    if (before == 0 || (before < WAL_EARLY_COMMIT_BYTES && wal->queue_len >= WAL_EARLY_COMMIT_BYTES)) {
+        pthread_cond_signal(&wal->queued);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return lsn;
+}
+
+uint64_t wal_last_lsn(Wal *wal) {
+    return wal ? atomic_load_explicit(&wal->last_lsn, memory_order_relaxed) : 0;
+}
+
+uint64_t wal_commits(Wal *wal) {
+    if (!wal) return 0;
+
+    pthread_mutex_lock(&wal->lock);
+    uint64_t commits = wal->commits;
+    pthread_mutex_unlock(&wal->lock);
+    return commits;
+}
+
+void wal_wait(Wal *wal, uint64_t lsn) {
+    if (!wal || lsn == 0 || wal->mode != WAL_MODE_SYNC) {
+        return;
+    }
+    pthread_mutex_lock(&wal->lock);
+    while (wal->durable_lsn < lsn && !wal->failed) {
+        pthread_cond_wait(&wal->committed, &wal->lock);
+    }
+    pthread_mutex_unlock(&wal->lock);
+}
+
+bool wal_durable(Wal *wal, uint64_t lsn) {
+    if (!wal || lsn == 0 || wal->mode != WAL_MODE_SYNC) {
+        return true;
+    }
+    pthread_mutex_lock(&wal->lock);
+    bool durable = wal->durable_lsn >= lsn || wal->failed;
+    pthread_mutex_unlock(&wal->lock);
+    return durable;
+}
+
+int wal_subscribe(Wal *wal, void (*notify)(void *arg), void *arg) {
+    if (wal->mode != WAL_MODE_SYNC) {
+        // Nothing is ever held
+        return 0;
+    }
+    pthread_mutex_lock(&wal->lock);
+    WalSubscriber *subscribers = (WalSubscriber *)realloc(wal->subscribers,
+                                                          (size_t)(wal->nb_subscribers + 1) * sizeof(WalSubscriber));
+    if (subscribers) {
+        subscribers[wal->nb_subscribers].notify = notify;
+        subscribers[wal->nb_subscribers].arg = arg;
+        wal->subscribers = subscribers;
+        wal->nb_subscribers++;
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return subscribers ? 0 : -1;
+}
+
+void wal_unsubscribe(Wal *wal, void *arg) {
+    if (!wal) return;
+
+    pthread_mutex_lock(&wal->lock);
+    for (int i = 0; i < wal->nb_subscribers; i++) {
+        if (wal->subscribers[i].arg == arg) {
+            wal->subscribers[i] = wal->subscribers[--wal->nb_subscribers];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&wal->lock);
+}
+
+void wal_checkpoint(Wal *wal, uint64_t lsn) {
+    if (!wal) return;
+
+    pthread_mutex_lock(&wal->file_lock);
+    if (lsn > wal->checkpoint_lsn && wal->fp) {
+        fclose(wal->fp);
+        wal->fp = NULL;
+        if (platform_replace_file(wal->path, wal->old_path) != 0) {
+            // The current file keeps growing until a later checkpoint succeeds
+            log_warn("Failed to rotate write-ahead log %s", wal->path);
+            wal->fp = fopen(wal->path, "ab");
+        } else if (create_file(wal, NULL, 0) != 0) {
+            log_error("Failed to create write-ahead log %s", wal->path);
+        } else {
+            wal->checkpoint_lsn = lsn;
+        }
+    }
+    pthread_mutex_unlock(&wal->file_lock);
+}
+
+void wal_close(Wal *wal) {
+    if (!wal) return;
+
+    if (wal->thread_started) {
+        pthread_mutex_lock(&wal->lock);
+        wal->stop = true;
+        pthread_cond_signal(&wal->queued);
+        pthread_mutex_unlock(&wal->lock);
+        pthread_join(wal->thread, NULL);
+    }
+    wal_free(wal);
+}
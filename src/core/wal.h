@@ -0,0 +1,117 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "../config/config.h"
+#include <modbus/modbus.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Wal Wal;
+
+/**
+ * Replay the write-ahead log onto the mapping and open it for appending.
+ * Records already covered by the restored snapshot (LSN at or below
+ * since_lsn) are skipped. The records still needed are rewritten to a fresh
+ * file, which drops a tail torn by a crash and a previous file the last
+ * snapshot did not cover yet. A log written for other table starts or
+ * sizes is ignored. Call before any listener or writer starts.
+ * @param path Log file (path.old holds the records before the last checkpoint)
+ * @param mapping Register mapping to replay onto
+ * @param since_lsn Last LSN in the restored snapshot, 0 without one
+ * @param mode When writes are answered
+ * @param commit_interval_ms Time records are gathered before one fdatasync, 0 = sync at once
+ * @param replayed Receives the number of records applied (may be NULL)
+ * @return Pointer to Wal, or NULL on failure
+ */
+Wal* wal_open(const char *path, modbus_mapping_t *mapping, uint64_t since_lsn, WalMode mode,
+              int commit_interval_ms, int *replayed);
+
+// Write functions logged: they set values, so replaying them in order rebuilds the tables
+static inline bool wal_logs_function(uint8_t function) {
+    return function == MODBUS_FC_WRITE_SINGLE_COIL || function == MODBUS_FC_WRITE_SINGLE_REGISTER ||
+           function == MODBUS_FC_WRITE_MULTIPLE_COILS || function == MODBUS_FC_WRITE_MULTIPLE_REGISTERS ||
+           function == MODBUS_FC_MASK_WRITE_REGISTER || function == MODBUS_FC_WRITE_AND_READ_REGISTERS;
+}
+
+/**
+ * Queue a write request that was applied to the mapping.
+ * Call under the mapping write lock, so records are in the order the
+ * writes took effect. The record reaches the disk with the next group commit.
+ * @param wal Pointer to Wal
+ * @param pdu Request PDU (function code first)
+ * @param len Request PDU length
+ * @return LSN of the record, 0 if it could not be queued
+ */
+uint64_t wal_append(Wal *wal, const uint8_t *pdu, int len);
+
+/**
+ * LSN of the last record queued. Read inside a mapping read section it
+ * tells which writes a copy of the tables includes.
+ * @param wal Pointer to Wal (may be NULL)
+ * @return LSN, 0 without a log
+ */
+uint64_t wal_last_lsn(Wal *wal);
+
+/**
+ * Hold a response until its write is durable. Returns at once in async
+ * mode, for an LSN of 0, and once the log has failed (reported in the log).
+ * Call outside the mapping write lock.
+ * @param wal Pointer to Wal (may be NULL)
+ * @param lsn LSN returned by wal_append()
+ */
+void wal_wait(Wal *wal, uint64_t lsn);
+
+/**
+ * Non-blocking form of wal_wait(): whether a response holding the write
+ * at lsn may go out now. Always true in async mode, for an LSN of 0, and
+ * once the log has failed.
+ * @param wal Pointer to Wal (may be NULL)
+ * @param lsn LSN returned by wal_append()
+ * @return true once the write is durable
+ */
+bool wal_durable(Wal *wal, uint64_t lsn);
+
+/**
+ * In sync mode, call notify(arg) after every group commit, so a serving
+ * thread can park its responses (see wal_durable()) and send them once
+ * woken rather than block in wal_wait(). notify runs on the commit thread
+ * with the log locked: it must only wake its thread.
+ * @param wal Pointer to Wal
+ * @param notify Function to call
+ * @param arg Argument of notify, also the key for wal_unsubscribe()
+ * @return 0 on success, -1 if out of memory
+ */
+int wal_subscribe(Wal *wal, void (*notify)(void *arg), void *arg);
+
+/**
+ * Stop calling the notify function registered with arg. No call is in
+ * progress once it returns.
+ * @param wal Pointer to Wal (may be NULL)
+ * @param arg Argument given to wal_subscribe()
+ */
+void wal_unsubscribe(Wal *wal, void *arg);
+
+/**
+ * Group commits (one fdatasync each) done so far
+ * @param wal Pointer to Wal (may be NULL)
+ * @return Commit count
+ */
+uint64_t wal_commits(Wal *wal);
+
+/**
+ * Note that a snapshot including every write up to lsn is on disk.
+ * The current file becomes path.old, replacing the previous one: the
+ * snapshot covers all its records, as it was taken after they were queued.
+ * @param wal Pointer to Wal (may be NULL)
+ * @param lsn LSN the snapshot was taken at
+ */
+void wal_checkpoint(Wal *wal, uint64_t lsn);
+
+/**
+ * Sync the queued records, stop the commit thread and close the log.
+ * Call once every writer of the mapping has stopped.
+ * @param wal Pointer to Wal (may be NULL)
+ */
+void wal_close(Wal *wal);
+
+#endif // WAL_H
@@ -0,0 +1,289 @@
+#include "watch.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include "../utils/text_buffer.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GET_U16(p) ((uint16_t)(((p)[0] << 8) | (p)[1]))
+
+// Longest text of one reported entry: a run of its own, "[65535,[65535]],"
+#define ENTRY_TEXT_MAX 16
+
+static const char *const TABLE_NAMES[WATCH_TABLES] = {"coils", "holding"};
+
+/*
+ * One bit per table entry in each bitmap. The main loop owns watched and
+ * the writers only read it; writers set dirty bits and raise pending, the
+ * main loop takes both back at each flush.
+ */
+typedef struct {
+    int start;
+    int size;
+    int nb_words;
+    _Atomic uint64_t *watched;
+    _Atomic uint64_t *dirty;
+    atomic_bool pending;
+    atomic_bool active;         // Something watched: writers skip the bitmaps otherwise
+    int nb_watched;
+} WatchBits;
+
+struct Watch {
+    WatchBits tables[WATCH_TABLES];
+    int interval_ms;
+    uint64_t next_flush_us;
+    
+    // Flush scratch, reused: dirty bits taken, values read, event text
+    uint64_t *bits;
+    uint16_t *values;
+    TextBuffer out;
+};
+
+static int init_bits(WatchBits *t, int start, int size) {
+    t->start = start;
+    t->size = size;
+    t->nb_words = (size + 63) / 64;
+    atomic_init(&t->pending, false);
+    atomic_init(&t->active, false);
+    if (t->nb_words == 0) {
+        return 0;
+    }
+    t->watched = calloc((size_t)t->nb_words, sizeof(*t->watched));
+    t->dirty = calloc((size_t)t->nb_words, sizeof(*t->dirty));
+    return t->watched && t->dirty ? 0 : -1;
+}
+
+Watch* watch_create(const modbus_mapping_t *mapping, int interval_ms) {
+    Watch *watch = (Watch *)calloc(1, sizeof(Watch));
+    if (!watch) {
+        return NULL;
+    }
+    watch->interval_ms = interval_ms;
+    
+    int largest = mapping->nb_bits > mapping->nb_registers ? mapping->nb_bits : mapping->nb_registers;
+    if (init_bits(&watch->tables[WATCH_COILS], mapping->start_bits, mapping->nb_bits) != 0 ||
+        init_bits(&watch->tables[WATCH_HOLDING], mapping->start_registers, mapping->nb_registers) != 0 ||
+        !(watch->bits = calloc((size_t)(largest + 63) / 64 + 1, sizeof(uint64_t))) ||
+        !(watch->values = calloc((size_t)largest + 1, sizeof(uint16_t)))) {
+        log_error("Failed to allocate change watch");
+        watch_destroy(watch);
+        return NULL;
+    }
+    return watch;
+}
+
+void watch_destroy(Watch *watch) {
+    if (!watch) return;
+    
+    for (int t = 0; t < WATCH_TABLES; t++) {
+        free((void *)watch->tables[t].watched);
+        free((void *)watch->tables[t].dirty);
+    }
+    free(watch->bits);
+    free(watch->values);
+    text_buffer_free(&watch->out);
+    free(watch);
+}
+
+int watch_table_from_string(const char *name) {
+    for (int t = 0; t < WATCH_TABLES; t++) {
+        if (strcmp(name, TABLE_NAMES[t]) == 0) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// Bits [bit, bit + n) of a word
+static uint64_t word_mask(int bit, int n) {
+    return (n >= 64 ? ~0ULL : (1ULL << n) - 1) << bit;
+}
+
+int watch_set(Watch *watch, WatchTable table, int address, int count, bool on) {
+    WatchBits *t = &watch->tables[table];
+    int idx = address - t->start;
+    if (count < 1 || idx < 0 || idx > t->size - count) {
+        return -1;
+    }
+    
+    for (int i = idx; i < idx + count; ) {
+        int bit = i % 64;
+        int n = idx + count - i < 64 - bit ? idx + count - i : 64 - bit;
+        uint64_t mask = word_mask(bit, n);
+        uint64_t old = atomic_load_explicit(&t->watched[i / 64], memory_order_relaxed);
+        uint64_t now = on ? old | mask : old & ~mask;
+        t->nb_watched += __builtin_popcountll(now) - __builtin_popcountll(old);
+        atomic_store_explicit(&t->watched[i / 64], now, memory_order_relaxed);
+        i += n;
+    }
+    atomic_store_explicit(&t->active, t->nb_watched > 0, memory_order_relaxed);
+    return 0;
+}
+
+void watch_clear(Watch *watch, WatchTable table) {
+    WatchBits *t = &watch->tables[table];
+    for (int w = 0; w < t->nb_words; w++) {
+        atomic_store_explicit(&t->watched[w], 0, memory_order_relaxed);
+    }
+    t->nb_watched = 0;
+    atomic_store_explicit(&t->active, false, memory_order_relaxed);
+}
+
+int watch_count(Watch *watch, WatchTable table) {
+    return watch->tables[table].nb_watched;
+}
+
+void watch_carry(Watch *to, const Watch *from) {
+    for (int t = 0; t < WATCH_TABLES; t++) {
+        const WatchBits *old = &from->tables[t];
+        for (int w = 0; w < old->nb_words; w++) {
+            for (uint64_t bits = atomic_load_explicit(&old->watched[w], memory_order_relaxed); bits;
+                 bits &= bits - 1) {
+                // Addresses outside the new table are dropped
+                watch_set(to, (WatchTable)t, old->start + w * 64 + __builtin_ctzll(bits), 1, true);
+            }
+        }
+    }
+}
+
+void watch_set_interval(Watch *watch, int interval_ms) {
+    watch->interval_ms = interval_ms;
+}
+
+static void mark(WatchBits *t, int address, int count) {
+    if (!atomic_load_explicit(&t->active, memory_order_relaxed)) {
+        return;
+    }
+    int idx = address - t->start;
+    if (count < 1 || idx < 0 || idx > t->size - count) {
+        return;
+    }
+    
+    bool hit = false;
+    for (int i = idx; i < idx + count; ) {
+        int bit = i % 64;
+        int n = idx + count - i < 64 - bit ? idx + count - i : 64 - bit;
+        uint64_t changed = atomic_load_explicit(&t->watched[i / 64], memory_order_relaxed) & word_mask(bit, n);
+        if (changed) {
+            atomic_fetch_or_explicit(&t->dirty[i / 64], changed, memory_order_relaxed);
+            hit = true;
+        }
+        i += n;
+    }
+    // Publishes the dirty bits: the flush takes pending before the bitmap
+    if (hit) {
+        atomic_store_explicit(&t->pending, true, memory_order_release);
+    }
+}
+
+void watch_note_write(Watch *watch, const uint8_t *req, int req_len) {
+    if (!watch || req_len < 5) return;
+    
+    switch (req[0]) {
+    case MODBUS_FC_WRITE_SINGLE_COIL:
+        mark(&watch->tables[WATCH_COILS], GET_U16(req + 1), 1);
+        break;
+    case MODBUS_FC_WRITE_MULTIPLE_COILS:
+        mark(&watch->tables[WATCH_COILS], GET_U16(req + 1), GET_U16(req + 3));
+        break;
+    case MODBUS_FC_WRITE_SINGLE_REGISTER:
+    case MODBUS_FC_MASK_WRITE_REGISTER:
+        mark(&watch->tables[WATCH_HOLDING], GET_U16(req + 1), 1);
+        break;
+    case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+        mark(&watch->tables[WATCH_HOLDING], GET_U16(req + 1), GET_U16(req + 3));
+        break;
+    case MODBUS_FC_WRITE_AND_READ_REGISTERS:
+        if (req_len >= 9) {
+            mark(&watch->tables[WATCH_HOLDING], GET_U16(req + 5), GET_U16(req + 7));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static int flush_table(Watch *watch, WatchTable table, const modbus_mapping_t *mapping, MappingLock *lock,
+                       FILE *out) {
+    WatchBits *t = &watch->tables[table];
+    if (!atomic_load_explicit(&t->pending, memory_order_relaxed) ||
+        !atomic_exchange_explicit(&t->pending, false, memory_order_acquire)) {
+        return 0;
+    }
+    
+    // Entries no longer watched since they were marked are dropped
+    int nb_changed = 0;
+    for (int w = 0; w < t->nb_words; w++) {
+        uint64_t bits = atomic_load_explicit(&t->dirty[w], memory_order_relaxed) ?
+                        atomic_exchange_explicit(&t->dirty[w], 0, memory_order_relaxed) : 0;
+        watch->bits[w] = bits & atomic_load_explicit(&t->watched[w], memory_order_relaxed);
+        nb_changed += __builtin_popcountll(watch->bits[w]);
+    }
+    if (nb_changed == 0) {
+        return 0;
+    }
+    
+    // Current values, consistent with each other
+    unsigned seq;
+    do {
+        seq = mapping_read_begin(lock);
+        for (int w = 0; w < t->nb_words; w++) {
+            for (uint64_t bits = watch->bits[w]; bits; bits &= bits - 1) {
+                int i = w * 64 + __builtin_ctzll(bits);
+                watch->values[i] = table == WATCH_COILS ? mapping->tab_bits[i] : mapping->tab_registers[i];
+            }
+        }
+    } while (mapping_read_retry(lock, seq));
+    
+    TextBuffer *tb = &watch->out;
+    tb->len = 0;
+    if (text_buffer_reserve(tb, (size_t)nb_changed * ENTRY_TEXT_MAX + 64) != 0) {
+        log_warn("Failed to allocate change event, %d changes dropped", nb_changed);
+        return 0;
+    }
+    text_put_str(tb, "{\"event\":\"changed\",\"table\":\"");
+    text_put_str(tb, TABLE_NAMES[table]);
+    text_put_str(tb, "\",\"changes\":[");
+    int run_end = -1;
+    for (int w = 0; w < t->nb_words; w++) {
+        for (uint64_t bits = watch->bits[w]; bits; bits &= bits - 1) {
+            int i = w * 64 + __builtin_ctzll(bits);
+            if (i == run_end) {
+                text_put_char(tb, ',');
+            } else {
+                if (run_end >= 0) {
+                    text_put_str(tb, "]],");
+                }
+                text_put_char(tb, '[');
+                text_put_uint(tb, (uint64_t)(t->start + i));
+                text_put_str(tb, ",[");
+            }
+            text_put_uint(tb, watch->values[i]);
+            run_end = i + 1;
+        }
+    }
+    text_put_str(tb, "]]]}\n");
+    fwrite(tb->data, 1, tb->len, out);
+    return nb_changed;
+}
+
+int watch_flush(Watch *watch, const modbus_mapping_t *mapping, MappingLock *lock, FILE *out) {
+    if (!watch) return 0;
+    
+    uint64_t now_us = platform_monotonic_us();
+    if (now_us < watch->next_flush_us) {
+        return 0;
+    }
+    
+    int nb_changed = 0;
+    for (int t = 0; t < WATCH_TABLES; t++) {
+        nb_changed += flush_table(watch, (WatchTable)t, mapping, lock, out);
+    }
+    // The interval starts with the first change after a quiet period
+    if (nb_changed > 0) {
+        watch->next_flush_us = now_us + (uint64_t)watch->interval_ms * 1000;
+        fflush(out);
+    }
+    return nb_changed;
+}
@@ -0,0 +1,104 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "mapping_lock.h"
+#include <modbus/modbus.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Tables clients can write, and so the ones that can be watched
+typedef enum {
+    WATCH_COILS,
+    WATCH_HOLDING,
+    WATCH_TABLES
+} WatchTable;
+
+typedef struct Watch Watch;
+
+/**
+ * Create the change watch of a mapping, with nothing watched yet
+ * @param mapping Register mapping (table starts and sizes)
+ * @param interval_ms Time changes are gathered before one event per table
+ * @return Pointer to Watch, or NULL on failure
+ */
+Watch* watch_create(const modbus_mapping_t *mapping, int interval_ms);
+
+/**
+ * Free a change watch
+ * @param watch Pointer to Watch (may be NULL)
+ */
+void watch_destroy(Watch *watch);
+
+/**
+ * Watch in a new watch what an old one watched, for the addresses its
+ * tables still hold. Called by the main loop only.
+ * @param to Pointer to the new Watch
+ * @param from Pointer to the old Watch
+ */
+void watch_carry(Watch *to, const Watch *from);
+
+/**
+ * Change how long changes are gathered. Called by the main loop only.
+ * @param watch Pointer to Watch
+ * @param interval_ms Time changes are gathered before one event per table
+ */
+void watch_set_interval(Watch *watch, int interval_ms);
+
+/**
+ * Parse a table name ("coils" or "holding")
+ * @param name Table name
+ * @return WatchTable, or -1 if unknown
+ */
+int watch_table_from_string(const char *name);
+
+/**
+ * Start or stop watching a range of a table. Called by the main loop only.
+ * @param watch Pointer to Watch
+ * @param table Table
+ * @param address First address
+ * @param count Number of entries
+ * @param on true to watch, false to stop watching
+ * @return 0 on success, -1 if the range is outside the table
+ */
+int watch_set(Watch *watch, WatchTable table, int address, int count, bool on);
+
+/**
+ * Stop watching a whole table
+ * @param watch Pointer to Watch
+ * @param table Table
+ */
+void watch_clear(Watch *watch, WatchTable table);
+
+/**
+ * Entries of a table watched
+ * @param watch Pointer to Watch
+ * @param table Table
+ * @return Number of entries
+ */
+int watch_count(Watch *watch, WatchTable table);
+
+/**
+ * Note a write request that was applied to the mapping. Marks the watched
+ * entries it wrote as changed; costs one load per table when nothing is
+ * watched. Call from any serving thread, after the write took effect.
+ * @param watch Pointer to Watch (may be NULL)
+ * @param req Accepted request PDU (function code first)
+ * @param req_len Request PDU length
+ */
+void watch_note_write(Watch *watch, const uint8_t *req, int req_len);
+
+/**
+ * Print one event per table with changes once the interval has elapsed:
+ * {"event":"changed","table":"holding","changes":[[address,[values...]],...]}
+ * Each run of consecutive changed entries is one address and its current
+ * values. Returns at once when nothing changed. Called by the main loop only.
+ * @param watch Pointer to Watch (may be NULL)
+ * @param mapping Register mapping
+ * @param lock Mapping lock
+ * @param out Stream to print to
+ * @return Number of entries reported
+ */
+int watch_flush(Watch *watch, const modbus_mapping_t *mapping, MappingLock *lock, FILE *out);
+
+#endif // WATCH_H
@@ -1,11 +1,539 @@
 #include "json_command.h"
+#include "table_view.h"
+#include "tag_map.h"
+#include "scale_map.h"
 #include "../utils/logging.h"
 #include "../utils/byte_order.h"
+#include "../utils/scaling.h"
+#include "../utils/text_buffer.h"
+#include "../poller/poller.h"
+#include "../core/watch.h"
 #include "cJSON.h"
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
 
+// What a command handler acts on
+typedef struct {
+    ModbusBackend *backend;
+    ServerState *state;
+    bool *running;
+} CommandContext;
+
+typedef void (*CommandHandler)(cJSON *root, CommandContext *ctx);
+
+// {"cmd":"trace","action":"start|stop|clear|dump","file":"..."}
+static void trace_command(cJSON *root, CommandContext *ctx) {
+    ModbusBackend *backend = ctx->backend;
+    cJSON *action = cJSON_GetObjectItemCaseSensitive(root, "action");
+    Trace *trace = backend ? &backend->trace : NULL;
+    if (!trace || trace->ring_records == 0) {
+        printf("{\"error\":\"trace_unavailable\"}\n");
+        return;
+    }
+    if (!cJSON_IsString(action)) {
+        printf("{\"error\":\"invalid_trace_action\"}\n");
+        return;
+    }
+    
+    if (strcmp(action->valuestring, "start") == 0 || strcmp(action->valuestring, "stop") == 0) {
+        bool enabled = strcmp(action->valuestring, "start") == 0;
+        trace_set_enabled(trace, enabled);
+        printf("{\"status\":\"ok\",\"tracing\":%s}\n", enabled ? "true" : "false");
+    } else if (strcmp(action->valuestring, "clear") == 0) {
+        trace_clear(trace);
+        printf("{\"status\":\"ok\"}\n");
+    } else if (strcmp(action->valuestring, "dump") == 0) {
+        cJSON *file = cJSON_GetObjectItemCaseSensitive(root, "file");
+        if (!cJSON_IsString(file) || file->valuestring[0] == '\0') {
+            printf("{\"error\":\"missing_file\"}\n");
+            return;
+        }
+        int packets = trace_dump_pcap(trace, file->valuestring);
+        if (packets < 0) {
+            printf("{\"error\":\"trace_dump_failed\"}\n");
+        } else {
+            printf("{\"status\":\"ok\",\"packets\":%d}\n", packets);
+        }
+    } else {
+        printf("{\"error\":\"invalid_trace_action\"}\n");
+    }
+}
+
+/*
+ * {"cmd":"subscribe|unsubscribe","table":"coils|holding","ranges":[[address,count],address,...]}
+ * Unsubscribe without ranges drops the whole table. Ranges before a bad
+ * one are applied.
+ */
+static void watch_command(cJSON *root, ModbusBackend *backend, bool on) {
+    cJSON *table_it = cJSON_GetObjectItemCaseSensitive(root, "table");
+    cJSON *ranges = cJSON_GetObjectItemCaseSensitive(root, "ranges");
+    Watch *watch = backend ? backend->watch : NULL;
+    if (!watch) {
+        printf("{\"error\":\"watch_unavailable\"}\n");
+        return;
+    }
+    int table = cJSON_IsString(table_it) ? watch_table_from_string(table_it->valuestring) : -1;
+    if (table < 0) {
+        printf("{\"error\":\"invalid_table\"}\n");
+        return;
+    }
+    
+    if (!on && !ranges) {
+        watch_clear(watch, (WatchTable)table);
+    } else if (!cJSON_IsArray(ranges)) {
+        printf("{\"error\":\"invalid_ranges\"}\n");
+        return;
+    }
+    cJSON *range;
+    cJSON_ArrayForEach(range, ranges) {
+        int address = -1;
+        int count = 1;
+        if (cJSON_IsNumber(range)) {
+            address = range->valueint;
+        } else if (cJSON_IsArray(range) && cJSON_GetArraySize(range) == 2 &&
+                   cJSON_IsNumber(cJSON_GetArrayItem(range, 0)) && cJSON_IsNumber(cJSON_GetArrayItem(range, 1))) {
+            address = cJSON_GetArrayItem(range, 0)->valueint;
+            count = cJSON_GetArrayItem(range, 1)->valueint;
+        }
+        if (watch_set(watch, (WatchTable)table, address, count, on) != 0) {
+            printf("{\"error\":\"invalid_range\",\"address\":%d,\"count\":%d}\n", address, count);
+            return;
+        }
+    }
+    printf("{\"status\":\"ok\",\"table\":\"%s\",\"watched\":%d}\n", table_it->valuestring,
+           watch_count(watch, (WatchTable)table));
+}
+
+// Replies built by read, dump and echoes, and their scratch, kept between commands (main loop only)
+static TextBuffer reply;
+static TextBuffer raw;
+
+/*
+ * Print a reply whose last field is a string the client sent, escaped:
+ * head runs up to the opening quote of that string
+ */
+static void print_echo(const char *head, const char *s) {
+    reply.len = 0;
+    if (text_buffer_reserve(&reply, strlen(head) + strlen(s) * 6 + 4) != 0) {
+        printf("{\"error\":\"out_of_memory\"}\n");
+        return;
+    }
+    text_put_str(&reply, head);
+    text_put_json_string(&reply, s);
+    text_put_str(&reply, "\"}\n");
+    fwrite(reply.data, 1, reply.len, stdout);
+}
+
+// Values converted per encode_registers()/decode_registers() call
+#define VALUE_CHUNK 64
+
+/*
+ * Put decoded register values, the datatype switch taken once per chunk
+ * rather than per value
+ */
+static void put_values(TextBuffer *tb, const uint64_t *values, int n, DataType type) {
+    switch (type) {
+    case DATATYPE_INT16:
+        for (int i = 0; i < n; i++) {
+            text_put_char(tb, ',');
+            text_put_int(tb, (int16_t)values[i]);
+        }
+        break;
+    case DATATYPE_INT32:
+        for (int i = 0; i < n; i++) {
+            text_put_char(tb, ',');
+            text_put_int(tb, (int32_t)values[i]);
+        }
+        break;
+    case DATATYPE_INT64:
+        for (int i = 0; i < n; i++) {
+            text_put_char(tb, ',');
+            text_put_int(tb, (int64_t)values[i]);
+        }
+        break;
+    case DATATYPE_FLOAT:
+        for (int i = 0; i < n; i++) {
+            union { float f; uint32_t u32; } fu;
+            fu.u32 = (uint32_t)values[i];
+            text_put_char(tb, ',');
+            text_put_double(tb, fu.f, 9);
+        }
+        break;
+    case DATATYPE_DOUBLE:
+        for (int i = 0; i < n; i++) {
+            union { double d; uint64_t u64; } du;
+            du.u64 = values[i];
+            text_put_char(tb, ',');
+            text_put_double(tb, du.d, 17);
+        }
+        break;
+    default:
+        for (int i = 0; i < n; i++) {
+            text_put_char(tb, ',');
+            text_put_uint(tb, values[i]);
+        }
+        break;
+    }
+}
+
+/*
+ * {"cmd":"read","table":"coils|discrete|holding|input","address":A,"count":N,
+ *  "datatype":"uint16|int16|uint32|int32|float|uint64|int64|double|string",
+ *  "byte_order":"LE|BE|SWAP|BE_SWAP","raw":false}
+ * or {"cmd":"read","tag":"pump1.flow"}, the tag giving all but the count.
+ * Returns N values decoded as update writes them; bit tables return 0/1.
+ * Registers of a scaled tag or range read back in engineering units unless
+ * "raw" is set. A string reads N registers and returns "value" instead of "values".
+ * The registers are copied on the mapping read side, so the values come from
+ * one instant; they are decoded and formatted from the copy.
+ */
+static void read_command(cJSON *root, CommandContext *ctx) {
+    ModbusBackend *backend = ctx->backend;
+    cJSON *tag_it = cJSON_GetObjectItemCaseSensitive(root, "tag");
+    cJSON *table_it = cJSON_GetObjectItemCaseSensitive(root, "table");
+    cJSON *addr = cJSON_GetObjectItemCaseSensitive(root, "address");
+    cJSON *count_it = cJSON_GetObjectItemCaseSensitive(root, "count");
+    cJSON *datatype_it = cJSON_GetObjectItemCaseSensitive(root, "datatype");
+    cJSON *order_it = cJSON_GetObjectItemCaseSensitive(root, "byte_order");
+    cJSON *raw_it = cJSON_GetObjectItemCaseSensitive(root, "raw");
+    const Tag *tag = NULL;
+    const Scaling *scaling = NULL;
+    const char *datatype = cJSON_IsString(datatype_it) ? datatype_it->valuestring : "uint16";
+    TableView view;
+    DataType type;
+    ByteOrder bo;
+    int address;
+    int count = 1;
+    if (tag_it) {
+        tag = backend && cJSON_IsString(tag_it) ? tag_map_find(backend->tags, tag_it->valuestring) : NULL;
+        if (!tag) {
+            printf("{\"error\":\"unknown_tag\"}\n");
+            return;
+        }
+        view = tag->view;
+        type = tag->type;
+        bo = tag->order;
+        address = view.start + tag->idx;
+        // A whole tag by default: its bits, or the registers of a string
+        if (view.is_bits && type != DATATYPE_BOOL) {
+            count = 16 * datatype_words(type);
+        } else if (type == DATATYPE_STRING && tag->length > 0) {
+            count = tag->length;
+        }
+        scaling = tag->scaled ? &tag->scaling : NULL;
+    } else {
+        if (!backend || !backend->mapping || !cJSON_IsString(table_it) ||
+            !table_view(backend->mapping, table_it->valuestring, &view)) {
+            printf("{\"error\":\"invalid_table\"}\n");
+            return;
+        }
+        type = parse_datatype(datatype);
+        bo = parse_byte_order(cJSON_IsString(order_it) ? order_it->valuestring : "LE");
+        address = cJSON_IsNumber(addr) ? addr->valueint : -1;
+    }
+    int words = view.is_bits || type == DATATYPE_STRING ? 1 : datatype_words(type);
+    if (words == 0) {
+        printf("{\"error\":\"invalid_datatype\"}\n");
+        return;
+    }
+    count = cJSON_IsNumber(count_it) ? count_it->valueint : count;
+    int idx = address - view.start;
+    if ((!tag && !cJSON_IsNumber(addr)) || count < 1 || idx < 0 || count > (view.size - idx) / words) {
+        printf("{\"error\":\"index_out_of_bounds\",\"address\":%d,\"count\":%d}\n", address, count);
+        return;
+    }
+    bool is_string = !view.is_bits && type == DATATYPE_STRING;
+    if (!tag && !view.is_bits && !is_string) {
+        scaling = scale_map_find(backend->scales, view.id, address, count * words);
+    }
+    if (view.is_bits || is_string || cJSON_IsTrue(raw_it)) {
+        scaling = NULL;
+    }
+    
+    // The copy of the registers or bits, then the text of a string
+    size_t copy_size = view.is_bits ? (size_t)count : (size_t)count * words * sizeof(uint16_t);
+    reply.len = 0;
+    raw.len = 0;
+    if (text_buffer_reserve(&reply, (size_t)count * (is_string ? 12 : TEXT_NUMBER_MAX) +
+                                    (tag ? strlen(tag->name) * 6 : 0) + 128) != 0 ||
+        text_buffer_reserve(&raw, copy_size + (is_string ? (size_t)count * 2 + 1 : 0)) != 0) {
+        printf("{\"error\":\"out_of_memory\"}\n");
+        return;
+    }
+    uint16_t *registers = (uint16_t *)(void *)raw.data;
+    unsigned seq;
+    do {
+        seq = mapping_read_begin(&backend->mapping_lock);
+        if (view.is_bits) {
+            memcpy(raw.data, view.bits + idx, copy_size);
+        } else {
+            memcpy(registers, view.registers + idx, copy_size);
+        }
+    } while (mapping_read_retry(&backend->mapping_lock, seq));
+
+    if (tag) {
+        text_put_str(&reply, "{\"status\":\"ok\",\"tag\":\"");
+        text_put_json_string(&reply, tag->name);
+        text_put_char(&reply, '"');
+    } else {
+        text_put_str(&reply, "{\"status\":\"ok\",\"table\":\"");
+        text_put_str(&reply, table_it->valuestring);
+        text_put_str(&reply, "\",\"address\":");
+        text_put_int(&reply, address);
+        if (!view.is_bits) {
+            text_put_str(&reply, ",\"datatype\":\"");
+            text_put_str(&reply, datatype);
+            text_put_char(&reply, '"');
+        }
+    }
+    if (is_string) {
+        char *text = raw.data + copy_size;
+        decode_string(0, text, count, bo, registers);
+        text_put_str(&reply, ",\"value\":\"");
+        text_put_json_string(&reply, text);
+        text_put_str(&reply, "\"}\n");
+        fwrite(reply.data, 1, reply.len, stdout);
+        return;
+    }
+    // Each value is put after a comma: the first one takes the '[' slot
+    text_put_str(&reply, ",\"values\":");
+    size_t open = reply.len;
+    if (view.is_bits) {
+        for (int i = 0; i < count; i++) {
+            text_put_char(&reply, ',');
+            text_put_char(&reply, raw.data[i] ? '1' : '0');
+        }
+    } else {
+        uint64_t values[VALUE_CHUNK];
+        double scaled[VALUE_CHUNK];
+        for (int i = 0; i < count; i += VALUE_CHUNK) {
+            int n = count - i < VALUE_CHUNK ? count - i : VALUE_CHUNK;
+            decode_registers(i * words, values, n, words, bo, registers);
+            if (!scaling) {
+                put_values(&reply, values, n, type);
+                continue;
+            }
+            scaling_decode(scaling, values, n, type, scaled);
+            for (int k = 0; k < n; k++) {
+                text_put_char(&reply, ',');
+                text_put_double(&reply, scaled[k], 15);
+            }
+        }
+    }
+    reply.data[open] = '[';
+    text_put_str(&reply, "]}\n");
+    fwrite(reply.data, 1, reply.len, stdout);
+}
+
+/*
+ * {"cmd":"dump","table":"...","encoding":"base64|binary","address":A,"count":N}
+ * Whole table unless address/count narrow it. Registers are sent big-endian
+ * and bits packed eight per byte, first bit lowest, as on the wire. base64
+ * puts the data in the reply; binary follows the reply line with exactly
+ * "bytes" raw bytes. The table is copied on the mapping read side, then encoded.
+ */
+static void dump_command(cJSON *root, CommandContext *ctx) {
+    ModbusBackend *backend = ctx->backend;
+    cJSON *table_it = cJSON_GetObjectItemCaseSensitive(root, "table");
+    cJSON *encoding_it = cJSON_GetObjectItemCaseSensitive(root, "encoding");
+    cJSON *addr = cJSON_GetObjectItemCaseSensitive(root, "address");
+    cJSON *count_it = cJSON_GetObjectItemCaseSensitive(root, "count");
+    TableView view;
+    if (!backend || !backend->mapping || !cJSON_IsString(table_it) ||
+        !table_view(backend->mapping, table_it->valuestring, &view)) {
+        printf("{\"error\":\"invalid_table\"}\n");
+        return;
+    }
+    const char *encoding = cJSON_IsString(encoding_it) ? encoding_it->valuestring : "base64";
+    bool binary = strcmp(encoding, "binary") == 0;
+    if (!binary && strcmp(encoding, "base64") != 0) {
+        printf("{\"error\":\"invalid_encoding\"}\n");
+        return;
+    }
+    int address = cJSON_IsNumber(addr) ? addr->valueint : view.start;
+    int idx = address - view.start;
+    int count = cJSON_IsNumber(count_it) ? count_it->valueint : view.size - idx;
+    if (idx < 0 || count < 0 || count > view.size - idx) {
+        printf("{\"error\":\"index_out_of_bounds\",\"address\":%d,\"count\":%d}\n", address, count);
+        return;
+    }
+    
+    size_t nb_bytes = view.is_bits ? ((size_t)count + 7) / 8 : (size_t)count * 2;
+    raw.len = 0;
+    reply.len = 0;
+    if (text_buffer_reserve(&raw, nb_bytes) != 0 ||
+        text_buffer_reserve(&reply, (binary ? 0 : (nb_bytes + 2) / 3 * 4) + 192) != 0) {
+        printf("{\"error\":\"out_of_memory\"}\n");
+        return;
+    }
+    uint8_t *bytes = (uint8_t *)raw.data;
+    unsigned seq;
+    do {
+        seq = mapping_read_begin(&backend->mapping_lock);
+        if (!view.is_bits) {
+            for (int i = 0; i < count; i++) {
+                bytes[2 * i] = (uint8_t)(view.registers[idx + i] >> 8);
+                bytes[2 * i + 1] = (uint8_t)view.registers[idx + i];
+            }
+        } else {
+            pack_bits(idx, bytes, count, view.bits);
+        }
+    } while (mapping_read_retry(&backend->mapping_lock, seq));
+    
+    text_put_str(&reply, "{\"status\":\"ok\",\"table\":\"");
+    text_put_str(&reply, table_it->valuestring);
+    text_put_str(&reply, "\",\"address\":");
+    text_put_int(&reply, address);
+    text_put_str(&reply, ",\"count\":");
+    text_put_int(&reply, count);
+    text_put_str(&reply, ",\"encoding\":\"");
+    text_put_str(&reply, encoding);
+    if (binary) {
+        text_put_str(&reply, "\",\"bytes\":");
+        text_put_uint(&reply, nb_bytes);
+        text_put_str(&reply, "}\n");
+    } else {
+        text_put_str(&reply, "\",\"data\":\"");
+        text_put_base64(&reply, bytes, nb_bytes);
+        text_put_str(&reply, "\"}\n");
+    }
+    fwrite(reply.data, 1, reply.len, stdout);
+    if (binary) {
+        fwrite(bytes, 1, nb_bytes, stdout);
+        fflush(stdout);
+    }
+}
+
+static void subscribe_command(cJSON *root, CommandContext *ctx) {
+    watch_command(root, ctx->backend, true);
+}
+
+static void unsubscribe_command(cJSON *root, CommandContext *ctx) {
+    watch_command(root, ctx->backend, false);
+}
+
+static void stop_command(cJSON *root, CommandContext *ctx) {
+    (void)root;
+    *ctx->state = STATE_STOPPED;
+    *ctx->running = false;
+    printf("{\"status\":\"stopping\"}\n");
+}
+
+static void start_command(cJSON *root, CommandContext *ctx) {
+    (void)root;
+    if (*ctx->state == STATE_RUNNING) {
+        printf("{\"error\":\"already_running\"}\n");
+        return;
+    }
+    *ctx->state = STATE_RUNNING;
+    printf("{\"status\":\"starting\"}\n");
+}
+
+static void status_command(cJSON *root, CommandContext *ctx) {
+    (void)root;
+    printf("{\"status\":\"%s\"}\n", *ctx->state == STATE_RUNNING ? "running" : "stopped");
+}
+
+static void poll_status_command(cJSON *root, CommandContext *ctx) {
+    (void)root;
+    poller_print_status(ctx->backend ? ctx->backend->poller : NULL);
+}
+
+static void poll_plan_command(cJSON *root, CommandContext *ctx) {
+    (void)root;
+    poller_print_plan(ctx->backend ? ctx->backend->poller : NULL);
+}
+
+static void stats_command(cJSON *root, CommandContext *ctx) {
+    (void)root;
+    stats_print(ctx->backend ? &ctx->backend->stats : NULL);
+}
+
+static void log_level_command(cJSON *root, CommandContext *ctx) {
+    (void)ctx;
+    cJSON *level = cJSON_GetObjectItemCaseSensitive(root, "level");
+    int value = cJSON_IsString(level) ? log_level_from_string(level->valuestring) : -1;
+    if (value < 0) {
+        printf("{\"error\":\"invalid_log_level\"}\n");
+    } else {
+        log_set_level(value);
+        printf("{\"status\":\"ok\",\"log_level\":\"%s\"}\n", level->valuestring);
+    }
+}
+
+// {"cmd":"reload"}: the main loop rereads the config once outside the mapping lock
+static void reload_command(cJSON *root, CommandContext *ctx) {
+    (void)root;
+    if (!ctx->backend) {
+        printf("{\"error\":\"reload_failed\"}\n");
+        return;
+    }
+    ctx->backend->reload_requested = true;
+}
+
+// {"cmd":"upgrade"}: the main loop hands the server over to a new process
+static void upgrade_command(cJSON *root, CommandContext *ctx) {
+    (void)root;
+    if (!ctx->backend) {
+        printf("{\"error\":\"upgrade_failed\"}\n");
+        return;
+    }
+    ctx->backend->upgrade_requested = true;
+}
+
+/*
+ * Handlers by command name, a perfect hash like the datatype names: the
+ * dispatch is one hash, one compare and an indirect call, however many
+ * commands there are. The table has room for four times the commands, so
+ * new names rarely need other multipliers; two names on one slot do not
+ * compile.
+ */
+#define COMMAND_SLOTS 64u
+#define COMMAND_SLOT(first, last, len) (((unsigned)(first) * 3u + (unsigned)(last) * 11u + (unsigned)(len)) % COMMAND_SLOTS)
+
+#define COMMAND_NAMES(X) \
+    X("stop", 's', 'p', stop_command) \
+    X("start", 's', 't', start_command) \
+    X("status", 's', 's', status_command) \
+    X("poll_status", 'p', 's', poll_status_command) \
+    X("poll_plan", 'p', 'n', poll_plan_command) \
+    X("stats", 's', 's', stats_command) \
+    X("log_level", 'l', 'l', log_level_command) \
+    X("trace", 't', 'e', trace_command) \
+    X("read", 'r', 'd', read_command) \
+    X("dump", 'd', 'p', dump_command) \
+    X("subscribe", 's', 'e', subscribe_command) \
+    X("unsubscribe", 'u', 'e', unsubscribe_command) \
+    X("reload", 'r', 'd', reload_command) \
+    X("upgrade", 'u', 'e', upgrade_command)
+
+#define COMMAND_ENTRY(name, first, last, handler) [COMMAND_SLOT(first, last, sizeof(name) - 1)] = {name, handler},
+#define COMMAND_CASE(name, first, last, handler) case COMMAND_SLOT(first, last, sizeof(name) - 1):
+
+static const struct { const char *name; CommandHandler handler; } COMMANDS[COMMAND_SLOTS] = {
+    COMMAND_NAMES(COMMAND_ENTRY)
+};
+
+static CommandHandler find_command(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0) {
+        return NULL;
+    }
+    unsigned slot = COMMAND_SLOT((unsigned char)name[0], (unsigned char)name[len - 1], len);
+    switch (slot) {
+    COMMAND_NAMES(COMMAND_CASE)
+        return strcmp(COMMANDS[slot].name, name) == 0 ? COMMANDS[slot].handler : NULL;
+    default:
+        return NULL;
+    }
+}
+
+static void tag_command(cJSON *root, ModbusBackend *backend);
+static int update_data(cJSON *root, ModbusBackend *backend);
+
 void json_command_process(
     const char *json_str,
     ModbusBackend *backend,
@@ -19,105 +547,374 @@ void json_command_process(
     }
     
     cJSON *cmd = cJSON_GetObjectItemCaseSensitive(root, "cmd");
+    CommandHandler handler = cJSON_IsString(cmd) ? find_command(cmd->valuestring) : NULL;
+    if (handler) {
+        CommandContext ctx = {backend, state, running};
+        handler(root, &ctx);
+        cJSON_Delete(root);
+        return;
+    }
     
-    if (cJSON_IsString(cmd)) {
-        if (strcmp(cmd->valuestring, "stop") == 0) {
-            *state = STATE_STOPPED;
-            *running = false;
-            printf("{\"status\":\"stopping\"}\n");
-            cJSON_Delete(root);
-            return;
-        }
-        
-        if (strcmp(cmd->valuestring, "start") == 0) {
-            if (*state == STATE_RUNNING) {
-                printf("{\"error\":\"already_running\"}\n");
-                cJSON_Delete(root);
-                return;
+    // Updates by tag name, then by address
+    if (cJSON_GetObjectItemCaseSensitive(root, "tag") || cJSON_GetObjectItemCaseSensitive(root, "tags")) {
+        tag_command(root, backend);
+    } else {
+        update_data(root, backend);
+    }
+    cJSON_Delete(root);
+}
+
+/*
+ * Integer part of a JSON number, saturated to the int64 range so the
+ * conversion is defined for any input
+ */
+static int64_t number_to_int64(double d) {
+    if (d != d) return 0;
+    if (d >= 9223372036854775807.0) return INT64_MAX;
+    if (d <= -9223372036854775808.0) return INT64_MIN;
+    return (int64_t)d;
+}
+
+/*
+ * Bits of a coil or discrete input update: an array sets one bit per
+ * element, a number one bit ("bool") or, with an integer datatype, 16, 32
+ * or 64 bits packed first bit lowest. Returns the bit count, -1 if not understood.
+ */
+static int update_bits(TableView *view, int idx, DataType type, cJSON *val) {
+    uint8_t packed[MODBUS_MAX_WRITE_BITS / 8 + 1];
+    int count;
+    if (cJSON_IsArray(val)) {
+        count = cJSON_GetArraySize(val);
+        if (count < 1 || count > MODBUS_MAX_WRITE_BITS) return -1;
+        memset(packed, 0, (size_t)(count + 7) / 8);
+        int i = 0;
+        cJSON *item;
+        cJSON_ArrayForEach(item, val) {
+            if (cJSON_IsTrue(item) || (cJSON_IsNumber(item) && item->valuedouble != 0)) {
+                packed[i / 8] |= (uint8_t)(1 << (i % 8));
             }
-            *state = STATE_RUNNING;
-            printf("{\"status\":\"starting\"}\n");
-            cJSON_Delete(root);
-            return;
+            i++;
         }
-        
-        if (strcmp(cmd->valuestring, "status") == 0) {
-            printf("{\"status\":\"%s\"}\n", *state == STATE_RUNNING ? "running" : "stopped");
-            cJSON_Delete(root);
-            return;
+    } else if (cJSON_IsNumber(val) || cJSON_IsBool(val)) {
+        uint64_t v = cJSON_IsBool(val) ? (uint64_t)cJSON_IsTrue(val) : (uint64_t)number_to_int64(val->valuedouble);
+        switch (type) {
+        case DATATYPE_BOOL:
+            count = 1;
+            v = v != 0;
+            break;
+        case DATATYPE_UINT16:
+        case DATATYPE_INT16:
+        case DATATYPE_UINT32:
+        case DATATYPE_INT32:
+        case DATATYPE_UINT64:
+        case DATATYPE_INT64:
+            count = 16 * datatype_words(type);
+            break;
+        default:
+            return -1;
         }
+        for (int b = 0; b < (count + 7) / 8; b++) {
+            packed[b] = (uint8_t)(v >> (8 * b));
+        }
+    } else {
+        return -1;
     }
-    
-    // Try to process as data update
-    json_command_update_data(json_str, backend, NULL);
-    cJSON_Delete(root);
+    if (count > view->size - idx) {
+        return 0;
+    }
+    unpack_bits(idx, packed, count, view->bits);
+    return count;
 }
 
-int json_command_update_data(
-    const char *json_str,
-    ModbusBackend *backend,
-    const ModbusConfig *config) {
+/*
+ * A 64-bit integer element: a number, or a decimal string for values
+ * beyond the 2^53 a JSON number holds exactly
+ */
+static bool item_to_u64(const cJSON *item, bool is_signed, uint64_t *out) {
+    if (cJSON_IsNumber(item)) {
+        double d = item->valuedouble;
+        *out = !is_signed && d >= 9223372036854775808.0 ?
+               (d >= 18446744073709551615.0 ? UINT64_MAX : (uint64_t)d) : (uint64_t)number_to_int64(d);
+        return true;
+    }
+    if (!cJSON_IsString(item) || item->valuestring[0] == '\0') {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    *out = is_signed ? (uint64_t)strtoll(item->valuestring, &end, 10) : strtoull(item->valuestring, &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+/*
+ * Convert n JSON values into raw value bits for encode_registers(). The
+ * datatype switch is taken once for the whole run, each case a plain loop.
+ * Returns false on an element of the wrong kind.
+ */
+static bool convert_values(const cJSON *item, int n, DataType type, uint64_t *values) {
+    switch (type) {
+    case DATATYPE_UINT16:
+    case DATATYPE_INT16:
+    case DATATYPE_UINT32:
+    case DATATYPE_INT32:
+        for (int i = 0; i < n; i++, item = item->next) {
+            if (!cJSON_IsNumber(item)) return false;
+            values[i] = (uint64_t)number_to_int64(item->valuedouble);
+        }
+        return true;
+    case DATATYPE_FLOAT:
+        for (int i = 0; i < n; i++, item = item->next) {
+            if (!cJSON_IsNumber(item)) return false;
+            union { float f; uint32_t u32; } fu;
+            fu.f = (float)item->valuedouble;
+            values[i] = fu.u32;
+        }
+        return true;
+    case DATATYPE_DOUBLE:
+        for (int i = 0; i < n; i++, item = item->next) {
+            if (!cJSON_IsNumber(item)) return false;
+            union { double d; uint64_t u64; } du;
+            du.d = item->valuedouble;
+            values[i] = du.u64;
+        }
+        return true;
+    case DATATYPE_UINT64:
+    case DATATYPE_INT64:
+        for (int i = 0; i < n; i++, item = item->next) {
+            if (!item_to_u64(item, type == DATATYPE_INT64, &values[i])) return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Engineering values of an update for scaling_encode(): numbers only.
+ * Returns false on an element of another kind.
+ */
+static bool gather_numbers(const cJSON *item, int n, double *values) {
+    for (int i = 0; i < n; i++, item = item->next) {
+        if (!cJSON_IsNumber(item)) return false;
+        values[i] = item->valuedouble;
+    }
+    return true;
+}
+
+/*
+ * Registers of a holding or input register update, -1 if not understood.
+ * An array writes its values back to back. With a scaling the values are
+ * engineering values, clamped and converted as a batch. The whole value is
+ * converted before any register is written, so a bad element leaves the
+ * table as it was.
+ */
+static int update_registers(TableView *view, int idx, DataType type, ByteOrder bo, cJSON *val, int length,
+                            const Scaling *scaling) {
+    if (type == DATATYPE_STRING) {
+        if (!cJSON_IsString(val)) {
+            return -1;
+        }
+        int count = length > 0 ? length : (int)(strlen(val->valuestring) + 1) / 2;
+        if (count < 1) {
+            return -1;
+        }
+        if (count > view->size - idx) {
+            return 0;
+        }
+        encode_string(idx, val->valuestring, count, bo, view->registers);
+        return count;
+    }
     
-    cJSON *root = cJSON_Parse(json_str);
-    if (!root) {
+    int words = datatype_words(type);
+    if (words == 0) {
         return -1;
     }
+    bool is_array = cJSON_IsArray(val);
+    const cJSON *first = is_array ? val->child : val;
+    int n = is_array ? cJSON_GetArraySize(val) : 1;
+    if (n < 1) {
+        return -1;
+    }
+    if (n > (view->size - idx) / words) {
+        return 0;
+    }
     
+    // A single value needs no scratch; scaled values take a second run of it
+    uint64_t one;
+    double one_value;
+    uint64_t *values = &one;
+    double *eng = &one_value;
+    if (n > 1) {
+        raw.len = 0;
+        if (text_buffer_reserve(&raw, (size_t)n * (sizeof(uint64_t) + sizeof(double))) != 0) {
+            return -1;
+        }
+        values = (uint64_t *)(void *)raw.data;
+        eng = (double *)(void *)(values + n);
+    }
+    if (scaling) {
+        if (!gather_numbers(first, n, eng)) {
+            return -1;
+        }
+        scaling_encode(scaling, eng, n, type, values);
+    } else if (!convert_values(first, n, type, values)) {
+        return -1;
+    }
+    encode_registers(idx, values, n, words, bo, view->registers);
+    return n * words;
+}
+
+/*
+ * Update of one tag, the value in engineering units: numbers for a scaled
+ * register tag go through its scaling. Returns what
+ * update_bits()/update_registers() return.
+ */
+static int update_tag(const Tag *tag, cJSON *val) {
+    TableView view = tag->view;
+    if (view.is_bits) {
+        return update_bits(&view, tag->idx, tag->type, val);
+    }
+    return update_registers(&view, tag->idx, tag->type, tag->order, val, tag->length,
+                            tag->scaled ? &tag->scaling : NULL);
+}
+
+/*
+ * {"tag":"pump1.flow","value":12.3}, or many at once with
+ * {"tags":{"pump1.flow":12.3,"pump1.run":true}}
+ * A batch applies every tag it can and names the ones it could not.
+ */
+static void tag_command(cJSON *root, ModbusBackend *backend) {
+    TagMap *tags = backend ? backend->tags : NULL;
+    cJSON *tag_it = cJSON_GetObjectItemCaseSensitive(root, "tag");
+    if (tag_it) {
+        const Tag *tag = cJSON_IsString(tag_it) ? tag_map_find(tags, tag_it->valuestring) : NULL;
+        cJSON *val = cJSON_GetObjectItemCaseSensitive(root, "value");
+        int count = 0;
+        if (tag && val) {
+            mapping_write_begin(&backend->mapping_lock);
+            count = update_tag(tag, val);
+            mapping_write_end(&backend->mapping_lock);
+        }
+        if (!tag) {
+            printf("{\"error\":\"unknown_tag\"}\n");
+        } else if (count <= 0) {
+            print_echo("{\"error\":\"invalid_value\",\"tag\":\"", tag->name);
+        } else {
+            print_echo("{\"status\":\"updated\",\"tag\":\"", tag->name);
+        }
+        return;
+    }
+    
+    cJSON *batch = cJSON_GetObjectItemCaseSensitive(root, "tags");
+    if (!cJSON_IsObject(batch)) {
+        printf("{\"error\":\"invalid_tags\"}\n");
+        return;
+    }
+    int nb_updated = 0;
+    int nb_failed = 0;
+    reply.len = 0;
+    // One lock for the batch, so readers see all of its tags or none
+    mapping_write_begin(backend ? &backend->mapping_lock : NULL);
+    cJSON *item;
+    cJSON_ArrayForEach(item, batch) {
+        const Tag *tag = tag_map_find(tags, item->string);
+        if (tag && update_tag(tag, item) > 0) {
+            nb_updated++;
+            continue;
+        }
+        // Names of the failed tags, escaped as they came
+        if (text_buffer_reserve(&reply, strlen(item->string) * 6 + 4) != 0) {
+            continue;
+        }
+        text_put_str(&reply, nb_failed++ > 0 ? ",\"" : "\"");
+        text_put_json_string(&reply, item->string);
+        text_put_char(&reply, '"');
+    }
+    mapping_write_end(backend ? &backend->mapping_lock : NULL);
+    if (nb_failed == 0) {
+        printf("{\"status\":\"updated\",\"tags\":%d}\n", nb_updated);
+    } else {
+        printf("{\"error\":\"invalid_tags\",\"updated\":%d,\"failed\":[%.*s]}\n",
+               nb_updated, (int)reply.len, reply.data ? reply.data : "");
+    }
+}
+
+// Data update by address, on an already parsed command
+static int update_data(cJSON *root, ModbusBackend *backend) {
     cJSON *type = cJSON_GetObjectItemCaseSensitive(root, "type");
     cJSON *addr = cJSON_GetObjectItemCaseSensitive(root, "address");
     cJSON *datatype = cJSON_GetObjectItemCaseSensitive(root, "datatype");
     cJSON *order_it = cJSON_GetObjectItemCaseSensitive(root, "byte_order");
     cJSON *val = cJSON_GetObjectItemCaseSensitive(root, "value");
+    cJSON *length = cJSON_GetObjectItemCaseSensitive(root, "length");
+    cJSON *raw_it = cJSON_GetObjectItemCaseSensitive(root, "raw");
     
     if (!cJSON_IsString(type) || !cJSON_IsNumber(addr) || 
         !cJSON_IsString(datatype) || !val) {
-        cJSON_Delete(root);
         return -1;
     }
     
     if (!backend || !backend->mapping) {
-        cJSON_Delete(root);
         return -1;
     }
     
+    TableView view;
+    if (!table_view(backend->mapping, type->valuestring, &view)) {
+        print_echo("{\"error\":\"invalid_type\",\"type\":\"", type->valuestring);
+        return -1;
+    }
+    
+    // Addresses are Modbus addresses: the table may start above 0
     int addr_val = addr->valueint;
-    int idx = addr_val;
+    int idx = addr_val - view.start;
     
-    if (idx < 0 || idx >= backend->mapping->nb_registers) {
+    if (idx < 0 || idx >= view.size) {
         printf("{\"error\":\"index_out_of_bounds\",\"address\":%d}\n", addr_val);
-        cJSON_Delete(root);
         return -1;
     }
     
-    ByteOrder bo = parse_byte_order(order_it ? order_it->valuestring : "LE");
+    ByteOrder bo = parse_byte_order(cJSON_IsString(order_it) ? order_it->valuestring : "LE");
+    DataType dt = parse_datatype(datatype->valuestring);
     
-    // Handle data types
-    if (strcmp(datatype->valuestring, "uint16") == 0 && cJSON_IsNumber(val)) {
-        uint16_t v = (uint16_t)val->valueint;
-        if (bo == ORDER_SWAP) v = (v >> 8) | (v << 8);
-        backend->mapping->tab_registers[idx] = v;
+    // Values in engineering units when a scaled range holds every register written
+    const Scaling *scaling = NULL;
+    int words = view.is_bits ? 0 : datatype_words(dt);
+    if (words > 0 && !cJSON_IsTrue(raw_it)) {
+        int n = cJSON_IsArray(val) ? cJSON_GetArraySize(val) : 1;
+        scaling = scale_map_find(backend->scales, view.id, addr_val, n * words);
     }
-    else if (strcmp(datatype->valuestring, "int16") == 0 && cJSON_IsNumber(val)) {
-        int16_t iv = (int16_t)val->valueint;
-        uint16_t v = *(uint16_t *)&iv;
-        if (bo == ORDER_SWAP) v = (v >> 8) | (v << 8);
-        backend->mapping->tab_registers[idx] = v;
-    }
-    else if ((strcmp(datatype->valuestring, "uint32") == 0 || 
-              strcmp(datatype->valuestring, "int32") == 0) && cJSON_IsNumber(val)) {
-        uint32_t u = strcmp(datatype->valuestring, "int32") == 0 ?
-                     (uint32_t)(int32_t)val->valueint : (uint32_t)val->valueint;
-        uint16_t words[2] = { (uint16_t)(u & 0xFFFF), (uint16_t)(u >> 16) };
-        write_registers(idx, words, 2, bo, backend->mapping->tab_registers);
+    
+    mapping_write_begin(&backend->mapping_lock);
+    int count = view.is_bits ? update_bits(&view, idx, dt, val) :
+                            update_registers(&view, idx, dt, bo, val,
+                                             cJSON_IsNumber(length) ? length->valueint : 0, scaling);
+    mapping_write_end(&backend->mapping_lock);
+    if (count < 0) {
+        print_echo("{\"error\":\"invalid_value\",\"datatype\":\"", datatype->valuestring);
+        return -1;
     }
-    else if (strcmp(datatype->valuestring, "float") == 0 && cJSON_IsNumber(val)) {
-        union { float f; uint32_t u32; } fu;
-        fu.f = (float)val->valuedouble;
-        uint16_t words[2] = { (uint16_t)(fu.u32 & 0xFFFF), (uint16_t)(fu.u32 >> 16) };
-        write_registers(idx, words, 2, bo, backend->mapping->tab_registers);
+    if (count == 0) {
+        printf("{\"error\":\"index_out_of_bounds\",\"address\":%d}\n", addr_val);
+        return -1;
     }
     
-    printf("{\"status\":\"updated\",\"address\":%d,\"datatype\":\"%s\"}\n", addr_val, datatype->valuestring);
-    cJSON_Delete(root);
+    char head[64];
+    snprintf(head, sizeof(head), "{\"status\":\"updated\",\"address\":%d,\"datatype\":\"", addr_val);
+    print_echo(head, datatype->valuestring);
     return 0;
 }
+
+int json_command_update_data(
+    const char *json_str,
+    ModbusBackend *backend,
+    const ModbusConfig *config) {
+    
+    (void)config;
+    cJSON *root = cJSON_Parse(json_str);
+    if (!root) {
+        return -1;
+    }
+    int rc = update_data(root, backend);
+    cJSON_Delete(root);
+    return rc;
+}
@@ -11,7 +11,8 @@ typedef enum {
 } ServerState;
 
 /**
- * Process JSON command from stdin
+ * Process JSON command from stdin. Handlers take the mapping write lock
+ * only while they change or copy the tables, so call outside it.
  * @param json_str JSON string to parse
  * @param backend Pointer to ModbusBackend
  * @param state Pointer to current server state
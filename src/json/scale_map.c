@@ -0,0 +1,104 @@
+#include "scale_map.h"
+#include "../utils/logging.h"
+#include <stdlib.h>
+
+typedef struct {
+    TableId table;
+    int start;
+    int end;                // One past the last register
+    Scaling scaling;
+} ScaleRange;
+
+struct ScaleMap {
+    ScaleRange *ranges;     // Sorted by table, then start; no two overlap
+    int nb_ranges;
+};
+
+bool scaling_from_config(const ScalingConfig *cfg, Scaling *scaling) {
+    int round = parse_round_mode(cfg->round);
+    if (cfg->scale == 0 || cfg->min > cfg->max || round < 0) {
+        return false;
+    }
+    *scaling = (Scaling){cfg->scale, cfg->offset, cfg->min, cfg->max, (RoundMode)round};
+    return true;
+}
+
+static int compare_ranges(const void *a, const void *b) {
+    const ScaleRange *x = (const ScaleRange *)a;
+    const ScaleRange *y = (const ScaleRange *)b;
+    if (x->table != y->table) {
+        return x->table < y->table ? -1 : 1;
+    }
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+ScaleMap* scale_map_create(const ScaleRangeConfig *ranges, int nb_ranges) {
+    ScaleMap *map = (ScaleMap *)calloc(1, sizeof(ScaleMap));
+    if (!map || !(map->ranges = (ScaleRange *)calloc(nb_ranges > 0 ? (size_t)nb_ranges : 1, sizeof(ScaleRange)))) {
+        log_error("Failed to allocate scale map");
+        scale_map_destroy(map);
+        return NULL;
+    }
+    
+    for (int i = 0; i < nb_ranges; i++) {
+        const ScaleRangeConfig *cfg = &ranges[i];
+        ScaleRange *range = &map->ranges[map->nb_ranges];
+        int table = table_from_string(cfg->table);
+        if (table != TABLE_HOLDING && table != TABLE_INPUT) {
+            log_warn("Scaling at address %d: '%s' is not a register table, ignoring it", cfg->address, cfg->table);
+            continue;
+        }
+        if (!scaling_from_config(&cfg->scaling, &range->scaling)) {
+            log_warn("Scaling at address %d: unknown rounding mode '%s', ignoring it", cfg->address,
+                     cfg->scaling.round);
+            continue;
+        }
+        range->table = (TableId)table;
+        range->start = cfg->address;
+        range->end = cfg->address + cfg->count;
+        map->nb_ranges++;
+    }
+    
+    // Of overlapping ranges, the one starting first is kept
+    qsort(map->ranges, (size_t)map->nb_ranges, sizeof(ScaleRange), compare_ranges);
+    int kept = 0;
+    for (int i = 0; i < map->nb_ranges; i++) {
+        ScaleRange *range = &map->ranges[i];
+        if (kept > 0 && map->ranges[kept - 1].table == range->table && map->ranges[kept - 1].end > range->start) {
+            log_warn("Scaling at address %d overlaps another range, ignoring it", range->start);
+            continue;
+        }
+        map->ranges[kept++] = *range;
+    }
+    map->nb_ranges = kept;
+    log_info("Scale map: %d ranges", map->nb_ranges);
+    return map;
+}
+
+void scale_map_destroy(ScaleMap *map) {
+    if (!map) return;
+    
+    free(map->ranges);
+    free(map);
+}
+
+const Scaling* scale_map_find(const ScaleMap *map, TableId table, int address, int count) {
+    if (!map) return NULL;
+    
+    // Last range starting at or before address
+    int lo = 0, hi = map->nb_ranges;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const ScaleRange *r = &map->ranges[mid];
+        if (r->table < table || (r->table == table && r->start <= address)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+    const ScaleRange *range = &map->ranges[lo - 1];
+    return range->table == table && address + count <= range->end ? &range->scaling : NULL;
+}
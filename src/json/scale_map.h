@@ -0,0 +1,46 @@
+#ifndef SCALE_MAP_H
+#define SCALE_MAP_H
+
+#include "table_view.h"
+#include "../config/config.h"
+#include "../utils/scaling.h"
+#include <stdbool.h>
+
+typedef struct ScaleMap ScaleMap;
+
+/**
+ * Check a configured scaling and turn it into a Scaling
+ * @param cfg Configured scaling
+ * @param scaling Filled with the conversion
+ * @return true on success, false on a zero scale, min above max or an unknown rounding mode
+ */
+bool scaling_from_config(const ScalingConfig *cfg, Scaling *scaling);
+
+/**
+ * Index the scaled register ranges of the config. Ranges of a bit table,
+ * with an invalid scaling or overlapping an earlier range are dropped with
+ * a warning.
+ * @param ranges Configured ranges
+ * @param nb_ranges Number of ranges
+ * @return Pointer to ScaleMap, or NULL on allocation failure
+ */
+ScaleMap* scale_map_create(const ScaleRangeConfig *ranges, int nb_ranges);
+
+/**
+ * Free a scale map
+ * @param map Pointer to ScaleMap (may be NULL)
+ */
+void scale_map_destroy(ScaleMap *map);
+
+/**
+ * Scaling of registers [address, address + count) of a table: a binary
+ * search of the ranges, sorted by table and address
+ * @param map Pointer to ScaleMap (may be NULL)
+ * @param table Register table
+ * @param address First register address
+ * @param count Number of registers
+ * @return Scaling of the range holding all of them, or NULL if none does
+ */
+const Scaling* scale_map_find(const ScaleMap *map, TableId table, int address, int count);
+
+#endif // SCALE_MAP_H
@@ -0,0 +1,79 @@
+#include "table_view.h"
+#include <string.h>
+
+/*
+ * Table names, singular and plural forms included, in slots picked by
+ * their first and last character and length (a perfect hash, see
+ * parse_byte_order()); a name is found with one compare, and two names
+ * on one slot do not compile
+ */
+#define TABLE_SLOTS 64u
+#define TABLE_SLOT(first, last, len) (((unsigned)(first) * 3u + (unsigned)(last) * 31u + (unsigned)(len)) % TABLE_SLOTS)
+
+#define TABLE_NAMES(X) \
+    X("coil", 'c', 'l', TABLE_COILS) \
+    X("coils", 'c', 's', TABLE_COILS) \
+    X("coil_input", 'c', 't', TABLE_COILS) \
+    X("coil_inputs", 'c', 's', TABLE_COILS) \
+    X("coil_register", 'c', 'r', TABLE_COILS) \
+    X("coil_registers", 'c', 's', TABLE_COILS) \
+    X("discrete", 'd', 'e', TABLE_DISCRETE) \
+    X("discretes", 'd', 's', TABLE_DISCRETE) \
+    X("discrete_input", 'd', 't', TABLE_DISCRETE) \
+    X("discrete_inputs", 'd', 's', TABLE_DISCRETE) \
+    X("discrete_register", 'd', 'r', TABLE_DISCRETE) \
+    X("discrete_registers", 'd', 's', TABLE_DISCRETE) \
+    X("holding", 'h', 'g', TABLE_HOLDING) \
+    X("holdings", 'h', 's', TABLE_HOLDING) \
+    X("holding_input", 'h', 't', TABLE_HOLDING) \
+    X("holding_inputs", 'h', 's', TABLE_HOLDING) \
+    X("holding_register", 'h', 'r', TABLE_HOLDING) \
+    X("holding_registers", 'h', 's', TABLE_HOLDING) \
+    X("input", 'i', 't', TABLE_INPUT) \
+    X("inputs", 'i', 's', TABLE_INPUT) \
+    X("input_input", 'i', 't', TABLE_INPUT) \
+    X("input_inputs", 'i', 's', TABLE_INPUT) \
+    X("input_register", 'i', 'r', TABLE_INPUT) \
+    X("input_registers", 'i', 's', TABLE_INPUT)
+
+#define TABLE_ENTRY(name, first, last, id) [TABLE_SLOT(first, last, sizeof(name) - 1)] = {name, id},
+#define TABLE_CASE(name, first, last, id) case TABLE_SLOT(first, last, sizeof(name) - 1):
+
+static const struct { const char *name; TableId id; } TABLES[TABLE_SLOTS] = {
+    TABLE_NAMES(TABLE_ENTRY)
+};
+
+int table_from_string(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0) {
+        return -1;
+    }
+    unsigned slot = TABLE_SLOT((unsigned char)name[0], (unsigned char)name[len - 1], len);
+    switch (slot) {
+    TABLE_NAMES(TABLE_CASE)
+        return strcmp(TABLES[slot].name, name) == 0 ? (int)TABLES[slot].id : -1;
+    default:
+        return -1;
+    }
+}
+
+bool table_view(modbus_mapping_t *m, const char *name, TableView *view) {
+    memset(view, 0, sizeof(*view));
+    switch (table_from_string(name)) {
+    case TABLE_COILS:
+        *view = (TableView){true, m->tab_bits, NULL, m->start_bits, m->nb_bits, TABLE_COILS};
+        return true;
+    case TABLE_DISCRETE:
+        *view = (TableView){true, m->tab_input_bits, NULL, m->start_input_bits, m->nb_input_bits, TABLE_DISCRETE};
+        return true;
+    case TABLE_HOLDING:
+        *view = (TableView){false, NULL, m->tab_registers, m->start_registers, m->nb_registers, TABLE_HOLDING};
+        return true;
+    case TABLE_INPUT:
+        *view = (TableView){false, NULL, m->tab_input_registers, m->start_input_registers,
+                            m->nb_input_registers, TABLE_INPUT};
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef TABLE_VIEW_H
+#define TABLE_VIEW_H
+
+#include <modbus/modbus.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Tables named by read, dump, updates and tags
+typedef enum {
+    TABLE_COILS,
+    TABLE_DISCRETE,
+    TABLE_HOLDING,
+    TABLE_INPUT
+} TableId;
+
+// One table of a mapping, addressed from its start address
+typedef struct {
+    bool is_bits;
+    uint8_t *bits;              // Bit tables
+    uint16_t *registers;        // Register tables
+    int start;
+    int size;
+    TableId id;
+} TableView;
+
+/**
+ * Parse a table name, singular and plural forms accepted
+ * ("coil", "discrete_inputs", "holding_registers"...)
+ * @param name Table name
+ * @return TableId, or -1 if unknown
+ */
+int table_from_string(const char *name);
+
+/**
+ * View of a named table of a mapping
+ * @param m Register mapping
+ * @param name Table name, as table_from_string() takes it
+ * @param view Filled with the table
+ * @return true on success, false if the name is unknown
+ */
+bool table_view(modbus_mapping_t *m, const char *name, TableView *view);
+
+#endif // TABLE_VIEW_H
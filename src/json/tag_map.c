@@ -0,0 +1,147 @@
+#include "tag_map.h"
+#include "scale_map.h"
+#include "../utils/logging.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Slot of the open-addressing index; index -1 marks an empty slot
+typedef struct {
+    uint32_t hash;
+    int32_t index;
+} TagSlot;
+
+struct TagMap {
+    Tag *tags;
+    int nb_tags;
+    TagSlot *slots;
+    uint32_t mask;          // Slot count - 1, the count a power of two at least twice nb_tags
+    char *names;            // All tag names, back to back
+};
+
+// FNV-1a
+static uint32_t hash_name(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+static const TagSlot* probe(const TagMap *map, const char *name, uint32_t hash) {
+    for (uint32_t i = hash & map->mask; ; i = (i + 1) & map->mask) {
+        const TagSlot *slot = &map->slots[i];
+        if (slot->index < 0 ||
+            (slot->hash == hash && strcmp(map->tags[slot->index].name, name) == 0)) {
+            return slot;
+        }
+    }
+}
+
+// Resolve one configured tag, false if it cannot be written
+static bool resolve(const TagConfig *cfg, modbus_mapping_t *mapping, Tag *tag) {
+    if (!table_view(mapping, cfg->table, &tag->view)) {
+        log_warn("Tag '%s': unknown table '%s', ignoring it", cfg->name, cfg->table);
+        return false;
+    }
+    tag->type = parse_datatype(cfg->datatype);
+    tag->order = parse_byte_order(cfg->byte_order);
+    tag->idx = cfg->address - tag->view.start;
+    tag->length = cfg->length;
+    if (!scaling_from_config(&cfg->scaling, &tag->scaling)) {
+        log_warn("Tag '%s': unknown rounding mode '%s', ignoring it", cfg->name, cfg->scaling.round);
+        return false;
+    }
+    tag->scaled = tag->scaling.scale != 1.0 || tag->scaling.offset != 0.0 || tag->scaling.min > -DBL_MAX ||
+                  tag->scaling.max < DBL_MAX || tag->scaling.round != ROUND_NEAREST;
+    
+    // Entries the tag takes, to check it fits its table
+    int size;
+    if (tag->view.is_bits) {
+        bool integer = tag->type != DATATYPE_FLOAT && tag->type != DATATYPE_DOUBLE;
+        size = tag->type == DATATYPE_BOOL ? 1 : integer ? 16 * datatype_words(tag->type) : 0;
+    } else {
+        size = tag->type == DATATYPE_STRING ? (tag->length > 0 ? tag->length : 1) : datatype_words(tag->type);
+    }
+    if (size == 0) {
+        log_warn("Tag '%s': datatype '%s' does not fit table '%s', ignoring it",
+                 cfg->name, cfg->datatype, cfg->table);
+        return false;
+    }
+    if (tag->idx < 0 || size > tag->view.size - tag->idx) {
+        log_warn("Tag '%s': address %d is outside table '%s', ignoring it", cfg->name, cfg->address, cfg->table);
+        return false;
+    }
+    return true;
+}
+
+TagMap* tag_map_create(const TagConfig *tags, int nb_tags, modbus_mapping_t *mapping) {
+    TagMap *map = (TagMap *)calloc(1, sizeof(TagMap));
+    if (!map) {
+        log_error("Failed to allocate tag map");
+        return NULL;
+    }
+    
+    uint32_t nb_slots = 16;
+    while (nb_slots < 2 * (uint32_t)nb_tags) {
+        nb_slots *= 2;
+    }
+    size_t names_size = 0;
+    for (int i = 0; i < nb_tags; i++) {
+        names_size += strlen(tags[i].name) + 1;
+    }
+    map->mask = nb_slots - 1;
+    map->tags = (Tag *)calloc(nb_tags > 0 ? (size_t)nb_tags : 1, sizeof(Tag));
+    map->slots = (TagSlot *)malloc(nb_slots * sizeof(TagSlot));
+    map->names = (char *)malloc(names_size + 1);
+    if (!map->tags || !map->slots || !map->names) {
+        log_error("Failed to allocate tag map");
+        tag_map_destroy(map);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < nb_slots; i++) {
+        map->slots[i].index = -1;
+    }
+    
+    char *name = map->names;
+    for (int i = 0; i < nb_tags; i++) {
+        Tag *tag = &map->tags[map->nb_tags];
+        if (!resolve(&tags[i], mapping, tag)) {
+            continue;
+        }
+        uint32_t hash = hash_name(tags[i].name);
+        TagSlot *slot = (TagSlot *)probe(map, tags[i].name, hash);
+        if (slot->index >= 0) {
+            log_warn("Tag '%s' is defined twice, keeping the first", tags[i].name);
+            continue;
+        }
+        size_t len = strlen(tags[i].name) + 1;
+        memcpy(name, tags[i].name, len);
+        tag->name = name;
+        name += len;
+        slot->hash = hash;
+        slot->index = map->nb_tags++;
+    }
+    log_info("Tag map: %d tags", map->nb_tags);
+    return map;
+}
+
+void tag_map_destroy(TagMap *map) {
+    if (!map) return;
+    
+    free(map->tags);
+    free(map->slots);
+    free(map->names);
+    free(map);
+}
+
+const Tag* tag_map_find(const TagMap *map, const char *name) {
+    if (!map) return NULL;
+    
+    const TagSlot *slot = probe(map, name, hash_name(name));
+    return slot->index >= 0 ? &map->tags[slot->index] : NULL;
+}
+
+int tag_map_count(const TagMap *map) {
+    return map ? map->nb_tags : 0;
+}
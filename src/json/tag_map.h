@@ -0,0 +1,58 @@
+#ifndef TAG_MAP_H
+#define TAG_MAP_H
+
+#include "table_view.h"
+#include "../config/config.h"
+#include "../utils/byte_order.h"
+#include "../utils/scaling.h"
+#include <modbus/modbus.h>
+#include <stdbool.h>
+
+// A tag resolved against the mapping: everything an update needs
+typedef struct {
+    const char *name;
+    TableView view;
+    int idx;                // Index of the tag address in the table
+    DataType type;
+    ByteOrder order;
+    int length;             // Registers of a string tag, 0 = as long as the value
+    Scaling scaling;
+    bool scaled;            // Scaling other than the identity
+} Tag;
+
+typedef struct TagMap TagMap;
+
+/**
+ * Resolve the configured tags against a mapping and index them by name.
+ * Tags naming an unknown table, datatype or rounding mode, or outside their
+ * table, are dropped with a warning, as are later duplicates of a name.
+ * @param tags Configured tags
+ * @param nb_tags Number of tags
+ * @param mapping Register mapping (kept for the life of the map)
+ * @return Pointer to TagMap, or NULL on allocation failure
+ */
+TagMap* tag_map_create(const TagConfig *tags, int nb_tags, modbus_mapping_t *mapping);
+
+/**
+ * Free a tag map
+ * @param map Pointer to TagMap (may be NULL)
+ */
+void tag_map_destroy(TagMap *map);
+
+/**
+ * Find a tag: one hash of the name and, on average, a single probe of an
+ * open-addressing table; the name is compared once to confirm the hit
+ * @param map Pointer to TagMap (may be NULL)
+ * @param name Tag name
+ * @return Tag, or NULL if unknown
+ */
+const Tag* tag_map_find(const TagMap *map, const char *name);
+
+/**
+ * Tags in a map
+ * @param map Pointer to TagMap (may be NULL)
+ * @return Number of tags
+ */
+int tag_map_count(const TagMap *map);
+
+#endif // TAG_MAP_H
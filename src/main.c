@@ -1,7 +1,10 @@
+#include "config/config_cache.h"
+#include "core/handoff.h"
 #include "core/server_controller.h"
 #include "utils/logging.h"
 #include "utils/platform.h"
 #include <stdlib.h>
+#include <string.h>
 
 int main(int argc, char *argv[]) {
     // Initialize platform
@@ -10,17 +13,39 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
     
+    // Log records are written by a background thread from here on
+    if (log_init() != 0) {
+        log_warn("Failed to start the log thread, logging synchronously");
+    }
+    
+    // --compile-config [file]: write the binary cache of the config and exit
+    if (argc > 1 && strcmp(argv[1], "--compile-config") == 0) {
+        const char *config_file = (argc > 2) ? argv[2] : "modbus_config.json";
+        char cache_file[512];
+        int rc = config_cache_path(config_file, cache_file, sizeof(cache_file)) == 0 ?
+                 config_cache_compile(config_file, cache_file) : -1;
+        log_shutdown();
+        platform_cleanup();
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
     const char *config_file = (argc > 1) ? argv[1] : "modbus_config.json";
     
     log_info("Starting Modbus JSON Server with config: %s", config_file);
     
+    // Listening sockets passed by systemd socket activation, if any
+    handoff_inherit();
+    
     ServerController *controller = server_controller_create(config_file);
     if (!controller) {
         log_error("Failed to create server controller");
+        log_shutdown();
         platform_cleanup();
         return EXIT_FAILURE;
     }
     
+    controller->argv = argv;
+    
     // Start server automatically
     #ifdef _WIN32
     controller->state = STATE_RUNNING;
@@ -31,6 +56,7 @@ int main(int argc, char *argv[]) {
     int ret = server_controller_run(controller);
     
     server_controller_destroy(controller);
+    log_shutdown();
     platform_cleanup();
     
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -0,0 +1,252 @@
+#include "poll_plan.h"
+#include "../utils/logging.h"
+#include <modbus/modbus.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Frame sizes of FC3/FC4 transactions
+#define RTU_REQUEST_BYTES 8
+#define RTU_RESPONSE_OVERHEAD 5
+#define TCP_REQUEST_BYTES 12
+#define TCP_RESPONSE_OVERHEAD 9
+#define TCP_SEGMENT_OVERHEAD 40     // IPv4 + TCP headers per frame
+
+typedef struct {
+    int period_ms;
+    int function;
+    int address;
+    int index;
+} SortKey;
+
+static int compare_keys(const void *a, const void *b) {
+    const SortKey *x = (const SortKey *)a;
+    const SortKey *y = (const SortKey *)b;
+    if (x->period_ms != y->period_ms) return x->period_ms - y->period_ms;
+    if (x->function != y->function) return x->function - y->function;
+    return x->address - y->address;
+}
+
+static int copy_and_split(PollPlan *plan, const PollDeviceConfig *dev) {
+    plan->nb_blocks = 0;
+    for (int i = 0; i < dev->nb_blocks; i++) {
+        PollBlockConfig b = dev->blocks[i];
+        if (b.period_ms <= 0) {
+            b.period_ms = dev->period_ms;
+        }
+        while (b.count > 0) {
+            if (plan->nb_blocks >= MAX_POLL_BLOCKS) {
+                log_error("Poll device '%s': more than %d blocks after splitting",
+                          dev->name, MAX_POLL_BLOCKS);
+                return -1;
+            }
+            PollBlockConfig *part = &plan->blocks[plan->nb_blocks++];
+            *part = b;
+            if (part->count > MODBUS_MAX_READ_REGISTERS) {
+                part->count = MODBUS_MAX_READ_REGISTERS;
+            }
+            b.address += part->count;
+            b.local_address += part->count;
+            b.count -= part->count;
+        }
+    }
+    return 0;
+}
+
+static void add_transaction(const PollDeviceConfig *dev, int count, int period_ms,
+                            PollPlanCost *cost);
+
+// Bus cost of issuing one read of count registers every period_ms
+static double read_cost(const PollDeviceConfig *dev, int count, int period_ms) {
+    PollPlanCost cost;
+    memset(&cost, 0, sizeof(cost));
+    add_transaction(dev, count, period_ms, &cost);
+    return dev->is_rtu ? cost.bus_utilisation : cost.bytes_per_s;
+}
+
+// Try to fold read s into read f; returns the bus cost saved (<= 0 if not allowed)
+static double merge_gain(const PollDeviceConfig *dev, const PollRead *f, const PollRead *s) {
+    if (f->function != s->function || f->period_ms > s->period_ms) {
+        return 0.0;
+    }
+    
+    int f_end = f->address + f->count;
+    int s_end = s->address + s->count;
+    int lo = f->address < s->address ? f->address : s->address;
+    int hi = f_end > s_end ? f_end : s_end;
+    int gap = s->address >= f_end ? s->address - f_end : f->address - s_end;
+    if (hi - lo > MODBUS_MAX_READ_REGISTERS || gap > dev->max_gap) {
+        return 0.0;
+    }
+    
+    return read_cost(dev, f->count, f->period_ms) + read_cost(dev, s->count, s->period_ms) -
+           read_cost(dev, hi - lo, f->period_ms);
+}
+
+int poll_plan_build(PollPlan *plan, const PollDeviceConfig *dev) {
+    int read_of[MAX_POLL_BLOCKS];
+    bool dead[MAX_POLL_BLOCKS];
+    SortKey sorted[MAX_POLL_BLOCKS];
+    
+    memset(plan, 0, sizeof(*plan));
+    if (copy_and_split(plan, dev) != 0) {
+        return -1;
+    }
+    if (plan->nb_blocks == 0) {
+        return 0;
+    }
+    
+    // Rate-monotonic grouping: period groups, fastest first
+    plan->base_period_ms = plan->blocks[0].period_ms;
+    for (int i = 0; i < plan->nb_blocks; i++) {
+        const PollBlockConfig *b = &plan->blocks[i];
+        if (b->period_ms < plan->base_period_ms) {
+            plan->base_period_ms = b->period_ms;
+        }
+        sorted[i].period_ms = b->period_ms;
+        sorted[i].function = b->function;
+        sorted[i].address = b->address;
+        sorted[i].index = i;
+    }
+    qsort(sorted, plan->nb_blocks, sizeof(SortKey), compare_keys);
+    
+    // Greedy packing inside each period group
+    PollRead *cur = NULL;
+    for (int k = 0; k < plan->nb_blocks; k++) {
+        int i = sorted[k].index;
+        const PollBlockConfig *b = &plan->blocks[i];
+        int end = b->address + b->count;
+        
+        if (cur && cur->period_ms == b->period_ms && cur->function == b->function &&
+            b->address - (cur->address + cur->count) <= dev->max_gap) {
+            int new_end = cur->address + cur->count;
+            if (end > new_end) {
+                new_end = end;
+            }
+            if (new_end - cur->address <= MODBUS_MAX_READ_REGISTERS) {
+                cur->count = new_end - cur->address;
+                read_of[i] = (int)(cur - plan->reads);
+                continue;
+            }
+        }
+        
+        cur = &plan->reads[plan->nb_reads];
+        cur->function = b->function;
+        cur->address = b->address;
+        cur->count = b->count;
+        cur->period_ms = b->period_ms;
+        dead[plan->nb_reads] = false;
+        read_of[i] = plan->nb_reads++;
+    }
+    
+    // Promote slower reads into faster ones whenever that lowers bus load
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int s = plan->nb_reads - 1; s >= 0; s--) {
+            if (dead[s]) continue;
+            int best = -1;
+            double best_gain = 0.0;
+            for (int f = 0; f < plan->nb_reads; f++) {
+                if (f == s || dead[f]) continue;
+                double gain = merge_gain(dev, &plan->reads[f], &plan->reads[s]);
+                if (gain > best_gain) {
+                    best_gain = gain;
+                    best = f;
+                }
+            }
+            if (best < 0) continue;
+            
+            PollRead *f = &plan->reads[best];
+            int lo = f->address < plan->reads[s].address ? f->address : plan->reads[s].address;
+            int f_end = f->address + f->count;
+            int s_end = plan->reads[s].address + plan->reads[s].count;
+            f->count = (f_end > s_end ? f_end : s_end) - lo;
+            f->address = lo;
+            for (int i = 0; i < plan->nb_blocks; i++) {
+                if (read_of[i] == s) read_of[i] = best;
+            }
+            dead[s] = true;
+            merged = true;
+        }
+    }
+    
+    // Compact surviving reads, fastest first
+    int remap[MAX_POLL_BLOCKS];
+    SortKey live[MAX_POLL_BLOCKS];
+    int nb_live = 0;
+    for (int r = 0; r < plan->nb_reads; r++) {
+        if (dead[r]) continue;
+        live[nb_live].period_ms = plan->reads[r].period_ms;
+        live[nb_live].function = plan->reads[r].function;
+        live[nb_live].address = plan->reads[r].address;
+        live[nb_live].index = r;
+        nb_live++;
+    }
+    qsort(live, nb_live, sizeof(SortKey), compare_keys);
+    
+    PollRead reads[MAX_POLL_BLOCKS];
+    for (int n = 0; n < nb_live; n++) {
+        reads[n] = plan->reads[live[n].index];
+        reads[n].nb_blocks = 0;
+        remap[live[n].index] = n;
+    }
+    memcpy(plan->reads, reads, sizeof(PollRead) * nb_live);
+    plan->nb_reads = nb_live;
+    
+    // Group block indexes by read, in address order
+    int fill[MAX_POLL_BLOCKS];
+    for (int k = 0; k < plan->nb_blocks; k++) {
+        plan->reads[remap[read_of[k]]].nb_blocks++;
+    }
+    int offset = 0;
+    for (int r = 0; r < plan->nb_reads; r++) {
+        plan->reads[r].first = offset;
+        fill[r] = offset;
+        offset += plan->reads[r].nb_blocks;
+    }
+    for (int k = 0; k < plan->nb_blocks; k++) {
+        int i = sorted[k].index;
+        plan->order[fill[remap[read_of[i]]]++] = i;
+    }
+    
+    return plan->nb_reads;
+}
+
+static void add_transaction(const PollDeviceConfig *dev, int count, int period_ms,
+                            PollPlanCost *cost) {
+    double rate = 1000.0 / period_ms;
+    int bytes;
+    
+    if (dev->is_rtu) {
+        bytes = RTU_REQUEST_BYTES + RTU_RESPONSE_OVERHEAD + 2 * count;
+        int bits_per_char = 1 + dev->data_bits + (dev->parity == 'N' ? 0 : 1) + dev->stop_bits;
+        double char_s = (double)bits_per_char / dev->baudrate;
+        // 3.5 character silence after each frame, fixed at 1.75 ms above 19200 baud
+        double silence_s = dev->baudrate > 19200 ? 0.00175 : 3.5 * char_s;
+        cost->bus_utilisation += rate * (bytes * char_s + 2 * silence_s);
+    } else {
+        bytes = TCP_REQUEST_BYTES + TCP_RESPONSE_OVERHEAD + 2 * TCP_SEGMENT_OVERHEAD + 2 * count;
+    }
+    
+    cost->transactions_per_s += rate;
+    cost->bytes_per_s += rate * bytes;
+}
+
+void poll_plan_cost(const PollPlan *plan, const PollDeviceConfig *dev, PollPlanCost *cost) {
+    memset(cost, 0, sizeof(*cost));
+    for (int r = 0; r < plan->nb_reads; r++) {
+        add_transaction(dev, plan->reads[r].count, plan->reads[r].period_ms, cost);
+    }
+}
+
+void poll_plan_naive_cost(const PollDeviceConfig *dev, PollPlanCost *cost) {
+    memset(cost, 0, sizeof(*cost));
+    for (int i = 0; i < dev->nb_blocks; i++) {
+        const PollBlockConfig *b = &dev->blocks[i];
+        int period_ms = b->period_ms > 0 ? b->period_ms : dev->period_ms;
+        for (int left = b->count; left > 0; left -= MODBUS_MAX_READ_REGISTERS) {
+            int count = left > MODBUS_MAX_READ_REGISTERS ? MODBUS_MAX_READ_REGISTERS : left;
+            add_transaction(dev, count, period_ms, cost);
+        }
+    }
+}
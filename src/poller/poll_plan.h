@@ -0,0 +1,59 @@
+#ifndef POLL_PLAN_H
+#define POLL_PLAN_H
+
+#include "../config/config.h"
+#include <stdbool.h>
+
+// One FC3/FC4 transaction of the plan
+typedef struct {
+    int function;
+    int address;
+    int count;
+    int period_ms;          // Period the read is issued at
+    int first;              // Offset of its blocks in PollPlan.order
+    int nb_blocks;
+} PollRead;
+
+typedef struct {
+    PollBlockConfig blocks[MAX_POLL_BLOCKS];   // Input blocks, split to fit one read
+    int nb_blocks;
+    int order[MAX_POLL_BLOCKS];                // Block indexes grouped by read
+    PollRead reads[MAX_POLL_BLOCKS];
+    int nb_reads;
+    int base_period_ms;                        // Fastest period of the device
+} PollPlan;
+
+typedef struct {
+    double transactions_per_s;
+    double bytes_per_s;
+    double bus_utilisation;     // Fraction of serial line time (RTU only)
+} PollPlanCost;
+
+/**
+ * Compute the minimal set of reads for one device.
+ * Blocks are grouped by period (rate-monotonic: fastest group first) and
+ * each group is packed greedily into reads of at most 125 registers that
+ * skip at most max_gap unused registers. Slower reads are then folded into
+ * faster or equal-period reads whenever that lowers the estimated bus load.
+ * @param plan Plan to fill
+ * @param dev Device configuration
+ * @return Number of reads, -1 on failure
+ */
+int poll_plan_build(PollPlan *plan, const PollDeviceConfig *dev);
+
+/**
+ * Estimate bus load of a plan
+ * @param plan Plan built by poll_plan_build()
+ * @param dev Device configuration (transport and serial settings)
+ * @param cost Output cost
+ */
+void poll_plan_cost(const PollPlan *plan, const PollDeviceConfig *dev, PollPlanCost *cost);
+
+/**
+ * Estimate bus load of polling every block on its own at its own period
+ * @param dev Device configuration
+ * @param cost Output cost
+ */
+void poll_plan_naive_cost(const PollDeviceConfig *dev, PollPlanCost *cost);
+
+#endif // POLL_PLAN_H
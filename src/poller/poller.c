@@ -0,0 +1,487 @@
+#include "poller.h"
+#include "poll_plan.h"
+#include "../utils/logging.h"
+#include "../utils/platform.h"
+#include "../utils/text_buffer.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+typedef struct {
+    PollDeviceConfig cfg;
+    modbus_t *ctx;
+    int bus_owner;              // Device index owning the context (shared RTU bus)
+    bool connected;
+    uint64_t retry_at_us;
+    uint64_t next_due_us;       // Earliest read deadline
+    
+    PollPlan plan;
+    uint64_t read_due_us[MAX_POLL_BLOCKS];
+    
+    // Latest values, block after block, handed over by poller_apply()
+    uint16_t *staging;
+    int staging_offset[MAX_POLL_BLOCKS];
+    bool block_fresh[MAX_POLL_BLOCKS];
+    
+    // Statistics
+    uint64_t polls_ok;
+    uint64_t polls_failed;
+    uint64_t connects;
+    double last_ms;
+    double avg_ms;
+    double max_ms;
+} PollDevice;
+
+struct Poller {
+    PollDevice devices[MAX_POLL_DEVICES];
+    int nb_devices;
+    
+    pthread_t thread;
+    bool thread_started;
+    atomic_bool stop;
+    
+    // Protects staging buffers, freshness flags and statistics
+    pthread_mutex_t lock;
+    atomic_bool pending;        // Something staged: lets poller_apply() skip the lock
+};
+
+static modbus_t* device_ctx(Poller *poller, PollDevice *dev) {
+    return poller->devices[dev->bus_owner].ctx;
+}
+
+static void device_disconnect(Poller *poller, PollDevice *dev) {
+    PollDevice *owner = &poller->devices[dev->bus_owner];
+    if (owner->ctx && owner->connected) {
+        modbus_close(owner->ctx);
+    }
+    owner->connected = false;
+}
+
+static int device_connect(Poller *poller, PollDevice *dev, uint64_t now) {
+    PollDevice *owner = &poller->devices[dev->bus_owner];
+    if (owner->connected) {
+        return 0;
+    }
+    if (now < owner->retry_at_us) {
+        return -1;
+    }
+    
+    if (modbus_connect(owner->ctx) == -1) {
+        int backoff_ms = owner->cfg.period_ms > 1000 ? owner->cfg.period_ms : 1000;
+        owner->retry_at_us = now + (uint64_t)backoff_ms * 1000ULL;
+        log_debug("Poll device '%s' connect failed: %s", owner->cfg.name, modbus_strerror(errno));
+        return -1;
+    }
+    
+    owner->connected = true;
+    owner->connects++;
+    log_debug("Poll device '%s' connected", owner->cfg.name);
+    return 0;
+}
+
+static void record_result(Poller *poller, PollDevice *dev, bool ok, uint64_t elapsed_us) {
+    pthread_mutex_lock(&poller->lock);
+    if (!ok) {
+        dev->polls_failed++;
+    } else {
+        double elapsed_ms = (double)elapsed_us / 1000.0;
+        dev->polls_ok++;
+        dev->last_ms = elapsed_ms;
+        dev->avg_ms = dev->polls_ok == 1 ? elapsed_ms : dev->avg_ms + (elapsed_ms - dev->avg_ms) / 8.0;
+        if (elapsed_ms > dev->max_ms) {
+            dev->max_ms = elapsed_ms;
+        }
+    }
+    pthread_mutex_unlock(&poller->lock);
+}
+
+// Issue every read of the device whose deadline has passed
+static void poll_device(Poller *poller, PollDevice *dev) {
+    const PollPlan *plan = &dev->plan;
+    uint64_t now = platform_monotonic_us();
+    int due[MAX_POLL_BLOCKS];
+    int nb_due = 0;
+    
+    for (int r = 0; r < plan->nb_reads; r++) {
+        if (dev->read_due_us[r] > now) {
+            continue;
+        }
+        due[nb_due++] = r;
+        
+        // Skip missed periods instead of bursting to catch up
+        uint64_t period_us = (uint64_t)plan->reads[r].period_ms * 1000ULL;
+        dev->read_due_us[r] += period_us;
+        if (dev->read_due_us[r] <= now) {
+            dev->read_due_us[r] = now + period_us;
+        }
+    }
+    if (nb_due == 0) {
+        return;
+    }
+    
+    if (device_connect(poller, dev, now) != 0) {
+        record_result(poller, dev, false, 0);
+        return;
+    }
+    
+    modbus_t *ctx = device_ctx(poller, dev);
+    modbus_set_slave(ctx, dev->cfg.unit_id);
+    
+    uint16_t buf[MODBUS_MAX_READ_REGISTERS];
+    for (int n = 0; n < nb_due; n++) {
+        const PollRead *read = &plan->reads[due[n]];
+        uint64_t start = platform_monotonic_us();
+        int rc;
+        if (read->function == MODBUS_FC_READ_HOLDING_REGISTERS) {
+            rc = modbus_read_registers(ctx, read->address, read->count, buf);
+        } else {
+            rc = modbus_read_input_registers(ctx, read->address, read->count, buf);
+        }
+        
+        if (rc != read->count) {
+            int err = errno;
+            log_debug("Poll device '%s' read %d@%d failed: %s",
+                      dev->cfg.name, read->count, read->address, modbus_strerror(err));
+            record_result(poller, dev, false, 0);
+            // Exceptions and timeouts on a serial bus leave the link usable
+            if (err < MODBUS_ENOBASE && !(dev->cfg.is_rtu && err == ETIMEDOUT)) {
+                device_disconnect(poller, dev);
+                return;
+            }
+            continue;
+        }
+        record_result(poller, dev, true, platform_monotonic_us() - start);
+        
+        pthread_mutex_lock(&poller->lock);
+        for (int k = read->first; k < read->first + read->nb_blocks; k++) {
+            int i = plan->order[k];
+            const PollBlockConfig *b = &plan->blocks[i];
+            memcpy(dev->staging + dev->staging_offset[i], buf + (b->address - read->address),
+                   (size_t)b->count * sizeof(uint16_t));
+            dev->block_fresh[i] = true;
+        }
+        atomic_store_explicit(&poller->pending, true, memory_order_release);
+        pthread_mutex_unlock(&poller->lock);
+    }
+}
+
+static void *poller_thread(void *arg) {
+    Poller *poller = (Poller *)arg;
+    
+    while (!atomic_load_explicit(&poller->stop, memory_order_acquire)) {
+        uint64_t now = platform_monotonic_us();
+        
+        // Earliest deadline first
+        PollDevice *next = &poller->devices[0];
+        for (int i = 1; i < poller->nb_devices; i++) {
+            if (poller->devices[i].next_due_us < next->next_due_us) {
+                next = &poller->devices[i];
+            }
+        }
+        
+        if (next->next_due_us > now) {
+            uint64_t wait_ms = (next->next_due_us - now + 999) / 1000;
+            if (wait_ms > 50) {
+                wait_ms = 50;
+            }
+            platform_msleep(wait_ms);
+            continue;
+        }
+        
+        poll_device(poller, next);
+        
+        next->next_due_us = UINT64_MAX;
+        for (int r = 0; r < next->plan.nb_reads; r++) {
+            if (next->read_due_us[r] < next->next_due_us) {
+                next->next_due_us = next->read_due_us[r];
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+Poller* poller_create(const ModbusConfig *config) {
+    if (config->nb_poll_devices <= 0) {
+        return NULL;
+    }
+    
+    Poller *poller = (Poller *)calloc(1, sizeof(Poller));
+    if (!poller) {
+        log_error("Failed to allocate Poller");
+        return NULL;
+    }
+    pthread_mutex_init(&poller->lock, NULL);
+    atomic_init(&poller->stop, false);
+    atomic_init(&poller->pending, false);
+    
+    for (int d = 0; d < config->nb_poll_devices; d++) {
+        PollDevice *dev = &poller->devices[d];
+        dev->cfg = config->poll_devices[d];
+        dev->bus_owner = d;
+        
+        if (poll_plan_build(&dev->plan, &dev->cfg) < 0) {
+            poller->nb_devices = d;
+            poller_destroy(poller);
+            return NULL;
+        }
+        if (dev->plan.nb_reads == 0) {
+            dev->plan.base_period_ms = dev->cfg.period_ms;
+        }
+        
+        int total = 0;
+        for (int i = 0; i < dev->plan.nb_blocks; i++) {
+            dev->staging_offset[i] = total;
+            total += dev->plan.blocks[i].count;
+        }
+        dev->staging = (uint16_t *)calloc(total > 0 ? total : 1, sizeof(uint16_t));
+        if (!dev->staging) {
+            log_error("Failed to allocate staging buffer for '%s'", dev->cfg.name);
+            poller->nb_devices = d;
+            poller_destroy(poller);
+            return NULL;
+        }
+        
+        // Devices on the same serial line share one master context
+        if (dev->cfg.is_rtu) {
+            for (int o = 0; o < d; o++) {
+                if (poller->devices[o].cfg.is_rtu &&
+                    strcmp(poller->devices[o].cfg.serial_device, dev->cfg.serial_device) == 0) {
+                    dev->bus_owner = o;
+                    break;
+                }
+            }
+        }
+        
+        if (dev->bus_owner == d) {
+            if (dev->cfg.is_rtu) {
+                dev->ctx = modbus_new_rtu(dev->cfg.serial_device, dev->cfg.baudrate,
+                                          dev->cfg.parity, dev->cfg.data_bits, dev->cfg.stop_bits);
+            } else {
+                dev->ctx = modbus_new_tcp(dev->cfg.host, dev->cfg.port);
+            }
+            if (!dev->ctx) {
+                log_error("Failed to create context for poll device '%s'", dev->cfg.name);
+                poller->nb_devices = d + 1;
+                poller_destroy(poller);
+                return NULL;
+            }
+            modbus_set_response_timeout(dev->ctx, dev->cfg.timeout_ms / 1000,
+                                        (dev->cfg.timeout_ms % 1000) * 1000);
+        }
+        
+        log_debug("Poll device '%s': %d blocks in %d reads, base period %d ms",
+                  dev->cfg.name, dev->plan.nb_blocks, dev->plan.nb_reads, dev->plan.base_period_ms);
+    }
+    poller->nb_devices = config->nb_poll_devices;
+    
+    return poller;
+}
+
+int poller_start(Poller *poller) {
+    if (!poller || poller->thread_started) {
+        return -1;
+    }
+    
+    // Spread first deadlines over devices and reads to avoid bursts on the bus
+    uint64_t now = platform_monotonic_us();
+    for (int i = 0; i < poller->nb_devices; i++) {
+        PollDevice *dev = &poller->devices[i];
+        uint64_t device_offset_us = (uint64_t)dev->plan.base_period_ms * 1000ULL * i / poller->nb_devices;
+        dev->next_due_us = dev->plan.nb_reads > 0 ? now + device_offset_us : UINT64_MAX;
+        for (int r = 0; r < dev->plan.nb_reads; r++) {
+            uint64_t period_us = (uint64_t)dev->plan.reads[r].period_ms * 1000ULL;
+            dev->read_due_us[r] = now + device_offset_us + period_us * r / dev->plan.nb_reads;
+        }
+    }
+    
+    atomic_store_explicit(&poller->stop, false, memory_order_release);
+    if (pthread_create(&poller->thread, NULL, poller_thread, poller) != 0) {
+        log_error("Failed to start poller thread");
+        return -1;
+    }
+    poller->thread_started = true;
+    log_info("Poller started with %d devices", poller->nb_devices);
+    return 0;
+}
+
+static uint16_t *target_slot(modbus_mapping_t *mapping, const PollBlockConfig *b) {
+    uint16_t *table;
+    int start, nb;
+    
+    if (b->target == POLL_TARGET_HOLDING_REGISTERS) {
+        table = mapping->tab_registers;
+        start = mapping->start_registers;
+        nb = mapping->nb_registers;
+    } else {
+        table = mapping->tab_input_registers;
+        start = mapping->start_input_registers;
+        nb = mapping->nb_input_registers;
+    }
+    
+    int idx = b->local_address - start;
+    if (!table || idx < 0 || idx + b->count > nb) {
+        return NULL;
+    }
+    return table + idx;
+}
+
+int poller_apply(Poller *poller, modbus_mapping_t *mapping, MappingLock *mapping_lock) {
+    if (!poller || !mapping || !atomic_load_explicit(&poller->pending, memory_order_acquire)) {
+        return 0;
+    }
+    
+    int copied = 0;
+    pthread_mutex_lock(&poller->lock);
+    mapping_write_begin(mapping_lock);
+    for (int d = 0; d < poller->nb_devices; d++) {
+        PollDevice *dev = &poller->devices[d];
+        for (int i = 0; i < dev->plan.nb_blocks; i++) {
+            if (!dev->block_fresh[i]) {
+                continue;
+            }
+            dev->block_fresh[i] = false;
+            
+            const PollBlockConfig *b = &dev->plan.blocks[i];
+            uint16_t *dest = target_slot(mapping, b);
+            if (!dest) {
+                log_debug("Poll device '%s': local address %d (+%d) outside mapping",
+                          dev->cfg.name, b->local_address, b->count);
+                continue;
+            }
+            memcpy(dest, dev->staging + dev->staging_offset[i], (size_t)b->count * sizeof(uint16_t));
+            copied++;
+        }
+    }
+    mapping_write_end(mapping_lock);
+    atomic_store_explicit(&poller->pending, false, memory_order_release);
+    pthread_mutex_unlock(&poller->lock);
+    
+    return copied;
+}
+
+// Longest device name once escaped for a JSON reply
+#define JSON_NAME_MAX (sizeof(((PollDeviceConfig *)0)->name) * 6 + 1)
+
+// Device names come from the config as written: quotes and backslashes are escaped
+static const char* json_name(char *buf, const char *name) {
+    TextBuffer tb = {buf, 0, JSON_NAME_MAX};
+    text_put_json_string(&tb, name);
+    buf[tb.len] = '\0';
+    return buf;
+}
+
+void poller_print_status(Poller *poller) {
+    if (!poller) {
+        printf("{\"poller\":[]}\n");
+        return;
+    }
+    
+    char name[JSON_NAME_MAX];
+    pthread_mutex_lock(&poller->lock);
+    printf("{\"poller\":[");
+    for (int d = 0; d < poller->nb_devices; d++) {
+        const PollDevice *dev = &poller->devices[d];
+        printf("%s{\"name\":\"%s\",\"connected\":%s,\"reads\":%d,\"polls\":%llu,"
+               "\"errors\":%llu,\"connects\":%llu,\"last_ms\":%.2f,\"avg_ms\":%.2f,\"max_ms\":%.2f}",
+               d > 0 ? "," : "",
+               json_name(name, dev->cfg.name),
+               poller->devices[dev->bus_owner].connected ? "true" : "false",
+               dev->plan.nb_reads,
+               (unsigned long long)dev->polls_ok,
+               (unsigned long long)dev->polls_failed,
+               (unsigned long long)poller->devices[dev->bus_owner].connects,
+               dev->last_ms, dev->avg_ms, dev->max_ms);
+    }
+    printf("]}\n");
+    pthread_mutex_unlock(&poller->lock);
+}
+
+int poller_device_stats(Poller *poller, PollDeviceStats *stats, int max_devices) {
+    if (!poller) return 0;
+    
+    pthread_mutex_lock(&poller->lock);
+    int n = poller->nb_devices < max_devices ? poller->nb_devices : max_devices;
+    for (int d = 0; d < n; d++) {
+        const PollDevice *dev = &poller->devices[d];
+        const PollDevice *owner = &poller->devices[dev->bus_owner];
+        snprintf(stats[d].name, sizeof(stats[d].name), "%s", dev->cfg.name);
+        stats[d].connected = owner->connected;
+        stats[d].polls_ok = dev->polls_ok;
+        stats[d].polls_failed = dev->polls_failed;
+        stats[d].connects = owner->connects;
+        stats[d].last_ms = dev->last_ms;
+    }
+    pthread_mutex_unlock(&poller->lock);
+    return n;
+}
+
+static void print_cost(const char *name, const PollPlanCost *cost, bool rtu) {
+    printf("\"%s\":{\"transactions_per_s\":%.2f,\"bytes_per_s\":%.1f",
+           name, cost->transactions_per_s, cost->bytes_per_s);
+    if (rtu) {
+        printf(",\"bus_utilisation\":%.4f", cost->bus_utilisation);
+    }
+    printf("}");
+}
+
+void poller_print_plan(Poller *poller) {
+    if (!poller) {
+        printf("{\"poll_plan\":[]}\n");
+        return;
+    }
+    
+    // Plans are immutable once the poller is created
+    char name[JSON_NAME_MAX];
+    printf("{\"poll_plan\":[");
+    for (int d = 0; d < poller->nb_devices; d++) {
+        const PollDevice *dev = &poller->devices[d];
+        const PollPlan *plan = &dev->plan;
+        PollPlanCost planned, naive;
+        poll_plan_cost(plan, &dev->cfg, &planned);
+        poll_plan_naive_cost(&dev->cfg, &naive);
+        
+        printf("%s{\"device\":\"%s\",\"base_period_ms\":%d,\"max_gap\":%d,\"blocks\":%d,\"reads\":[",
+               d > 0 ? "," : "", json_name(name, dev->cfg.name), plan->base_period_ms, dev->cfg.max_gap, plan->nb_blocks);
+        for (int r = 0; r < plan->nb_reads; r++) {
+            const PollRead *read = &plan->reads[r];
+            printf("%s{\"function\":%d,\"address\":%d,\"count\":%d,\"period_ms\":%d,\"blocks\":%d}",
+                   r > 0 ? "," : "", read->function, read->address, read->count,
+                   read->period_ms, read->nb_blocks);
+        }
+        printf("],");
+        print_cost("planned", &planned, dev->cfg.is_rtu);
+        printf(",");
+        print_cost("naive", &naive, dev->cfg.is_rtu);
+        printf("}");
+    }
+    printf("]}\n");
+}
+
+void poller_destroy(Poller *poller) {
+    if (!poller) return;
+    
+    if (poller->thread_started) {
+        atomic_store_explicit(&poller->stop, true, memory_order_release);
+        pthread_join(poller->thread, NULL);
+        poller->thread_started = false;
+    }
+    
+    for (int d = 0; d < poller->nb_devices; d++) {
+        PollDevice *dev = &poller->devices[d];
+        if (dev->ctx) {
+            if (dev->connected) {
+                modbus_close(dev->ctx);
+            }
+            modbus_free(dev->ctx);
+            dev->ctx = NULL;
+        }
+        free(dev->staging);
+        dev->staging = NULL;
+    }
+    
+    pthread_mutex_destroy(&poller->lock);
+    free(poller);
+}
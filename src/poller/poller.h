@@ -0,0 +1,73 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include "../config/config.h"
+#include "../core/mapping_lock.h"
+#include <modbus/modbus.h>
+
+typedef struct Poller Poller;
+
+// Statistics of one downstream device
+typedef struct {
+    char name[32];
+    bool connected;
+    uint64_t polls_ok;
+    uint64_t polls_failed;
+    uint64_t connects;          // Of the connection it uses (shared on an RTU bus)
+    double last_ms;
+} PollDeviceStats;
+
+/**
+ * Create the downstream poller from the poll_devices section of the config.
+ * The blocks of each device are packed into a read plan (see poll_plan.h).
+ * @param config Pointer to ModbusConfig
+ * @return Pointer to Poller, or NULL if no devices are configured or on failure
+ */
+Poller* poller_create(const ModbusConfig *config);
+
+/**
+ * Start the background polling thread
+ * @param poller Pointer to Poller
+ * @return 0 on success, -1 on failure
+ */
+int poller_start(Poller *poller);
+
+/**
+ * Copy freshly polled values into the local mapping.
+ * Called from the main loop; the mapping lock keeps other readers consistent.
+ * @param poller Pointer to Poller
+ * @param mapping Local register mapping
+ * @param mapping_lock Mapping lock taken for writing while copying (may be NULL)
+ * @return Number of blocks copied
+ */
+int poller_apply(Poller *poller, modbus_mapping_t *mapping, MappingLock *mapping_lock);
+
+/**
+ * Print per-device poll statistics as a JSON line on stdout
+ * @param poller Pointer to Poller (may be NULL)
+ */
+void poller_print_status(Poller *poller);
+
+/**
+ * Copy per-device poll statistics
+ * @param poller Pointer to Poller (may be NULL)
+ * @param stats Array receiving the statistics
+ * @param max_devices Capacity of stats
+ * @return Number of devices copied
+ */
+int poller_device_stats(Poller *poller, PollDeviceStats *stats, int max_devices);
+
+/**
+ * Print the computed read plan of every device, with the estimated bus
+ * load compared to polling each block on its own, as a JSON line on stdout
+ * @param poller Pointer to Poller (may be NULL)
+ */
+void poller_print_plan(Poller *poller);
+
+/**
+ * Stop the polling thread and release all resources
+ * @param poller Pointer to Poller
+ */
+void poller_destroy(Poller *poller);
+
+#endif // POLLER_H
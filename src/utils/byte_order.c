@@ -1,28 +1,243 @@
 #include "byte_order.h"
 #include <string.h>
+#include <strings.h>      // strcasecmp
 #include <ctype.h>
 
+// Eight table entries seen as one little-endian word: entry i is byte i
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LE64(x) __builtin_bswap64(x)
+#else
+#define LE64(x) (x)
+#endif
+
+/*
+ * Perfect hash of the byte order names: first character, last character
+ * and length put each name in a slot of its own. Names are matched
+ * case-insensitively, so slots come from upper-case characters.
+ *
+ * Each name is listed once, in ORDER_NAMES, which lays out the table and
+ * gives the case labels of the lookup switch: two names on one slot are a
+ * duplicate case value, a compile error, rather than one entry silently
+ * replacing the other. The length comes from the name itself.
+ */
+#define ORDER_SLOTS 16u
+#define ORDER_SLOT(first, last, len) (((unsigned)(first) + (unsigned)(last) * 2u + (unsigned)(len)) % ORDER_SLOTS)
+
+#define ORDER_NAMES(X) \
+    X("LE", 'L', 'E', ORDER_LE) \
+    X("CDAB", 'C', 'B', ORDER_LE) \
+    X("BE", 'B', 'E', ORDER_BE) \
+    X("ABCD", 'A', 'D', ORDER_BE) \
+    X("SWAP", 'S', 'P', ORDER_SWAP) \
+    X("DCBA", 'D', 'A', ORDER_SWAP) \
+    X("BE_SWAP", 'B', 'P', ORDER_BE_SWAP) \
+    X("BADC", 'B', 'C', ORDER_BE_SWAP)
+
+#define ORDER_ENTRY(name, first, last, order) [ORDER_SLOT(first, last, sizeof(name) - 1)] = {name, order},
+#define ORDER_CASE(name, first, last, order) case ORDER_SLOT(first, last, sizeof(name) - 1):
+
+static const struct { const char *name; ByteOrder order; } ORDERS[ORDER_SLOTS] = {
+    ORDER_NAMES(ORDER_ENTRY)
+};
+
 ByteOrder parse_byte_order(const char *s) {
-    if (!s || strcasecmp(s, "LE") == 0) return ORDER_LE;
-    if (strcasecmp(s, "BE") == 0) return ORDER_BE;
-    if (strcasecmp(s, "SWAP") == 0) return ORDER_SWAP;
-    return ORDER_LE;
+    size_t len = s ? strlen(s) : 0;
+    if (len == 0) {
+        return ORDER_LE;
+    }
+    unsigned slot = ORDER_SLOT(toupper((unsigned char)s[0]), toupper((unsigned char)s[len - 1]), len);
+    switch (slot) {
+    ORDER_NAMES(ORDER_CASE)
+        return strcasecmp(ORDERS[slot].name, s) == 0 ? ORDERS[slot].order : ORDER_LE;
+    default:
+        return ORDER_LE;
+    }
+}
+
+// Perfect hash of the datatype names, laid out and checked like ORDERS
+#define DATATYPE_SLOTS 16u
+#define DATATYPE_SLOT(first, last, len) (((unsigned)(first) * 4u + (unsigned)(last) * 15u + (unsigned)(len)) % DATATYPE_SLOTS)
+
+#define DATATYPE_NAMES(X) \
+    X("uint16", 'u', '6', DATATYPE_UINT16) \
+    X("int16", 'i', '6', DATATYPE_INT16) \
+    X("uint32", 'u', '2', DATATYPE_UINT32) \
+    X("int32", 'i', '2', DATATYPE_INT32) \
+    X("float", 'f', 't', DATATYPE_FLOAT) \
+    X("uint64", 'u', '4', DATATYPE_UINT64) \
+    X("int64", 'i', '4', DATATYPE_INT64) \
+    X("double", 'd', 'e', DATATYPE_DOUBLE) \
+    X("string", 's', 'g', DATATYPE_STRING) \
+    X("bool", 'b', 'l', DATATYPE_BOOL)
+
+#define DATATYPE_ENTRY(name, first, last, type) [DATATYPE_SLOT(first, last, sizeof(name) - 1)] = {name, type},
+#define DATATYPE_CASE(name, first, last, type) case DATATYPE_SLOT(first, last, sizeof(name) - 1):
+
+static const struct { const char *name; DataType type; } DATATYPES[DATATYPE_SLOTS] = {
+    DATATYPE_NAMES(DATATYPE_ENTRY)
+};
+
+DataType parse_datatype(const char *s) {
+    size_t len = s ? strlen(s) : 0;
+    if (len == 0) {
+        return DATATYPE_INVALID;
+    }
+    unsigned slot = DATATYPE_SLOT((unsigned char)s[0], (unsigned char)s[len - 1], len);
+    switch (slot) {
+    DATATYPE_NAMES(DATATYPE_CASE)
+        return strcmp(DATATYPES[slot].name, s) == 0 ? DATATYPES[slot].type : DATATYPE_INVALID;
+    default:
+        return DATATYPE_INVALID;
+    }
+}
+
+int datatype_words(DataType type) {
+    switch (type) {
+    case DATATYPE_UINT16:
+    case DATATYPE_INT16:
+        return 1;
+    case DATATYPE_UINT32:
+    case DATATYPE_INT32:
+    case DATATYPE_FLOAT:
+        return 2;
+    case DATATYPE_UINT64:
+    case DATATYPE_INT64:
+    case DATATYPE_DOUBLE:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static inline uint16_t swap16(uint16_t w) {
+    return (uint16_t)((w >> 8) | (w << 8));
+}
+
+/*
+ * Called with constant words and flags only, so each combination compiles
+ * to a straight loop with no per-value branching.
+ */
+static inline void encode_loop(const uint64_t *values, int count, int words, int high_first, int swap,
+                               uint16_t *registers) {
+    for(int i = 0; i < count; i++) {
+        uint64_t v = values[i];
+        for(int w = 0; w < words; w++) {
+            uint16_t word = (uint16_t)(v >> (16 * w));
+            registers[i * words + (high_first ? words - 1 - w : w)] = swap ? swap16(word) : word;
+        }
+    }
+}
+
+static inline void decode_loop(uint64_t *values, int count, int words, int high_first, int swap,
+                               const uint16_t *registers) {
+    for(int i = 0; i < count; i++) {
+        uint64_t v = 0;
+        for(int w = 0; w < words; w++) {
+            uint16_t word = registers[i * words + (high_first ? words - 1 - w : w)];
+            v |= (uint64_t)(swap ? swap16(word) : word) << (16 * w);
+        }
+        values[i] = v;
+    }
+}
+
+#define DISPATCH_ORDER(loop, words, values, count, registers) \
+    switch (order) { \
+    case ORDER_BE:      loop(values, count, words, 1, 0, registers); break; \
+    case ORDER_SWAP:    loop(values, count, words, 0, 1, registers); break; \
+    case ORDER_BE_SWAP: loop(values, count, words, 1, 1, registers); break; \
+    default:            loop(values, count, words, 0, 0, registers); break; \
+    }
+
+void encode_registers(int start_idx, const uint64_t *values, int count, int words, ByteOrder order,
+                      uint16_t *registers) {
+    uint16_t *out = registers + start_idx;
+    if (words == 1) {
+        DISPATCH_ORDER(encode_loop, 1, values, count, out)
+    } else if (words == 2) {
+        DISPATCH_ORDER(encode_loop, 2, values, count, out)
+    } else if (words == 4) {
+        DISPATCH_ORDER(encode_loop, 4, values, count, out)
+    }
+}
+
+void decode_registers(int start_idx, uint64_t *values, int count, int words, ByteOrder order,
+                      const uint16_t *registers) {
+    const uint16_t *in = registers + start_idx;
+    if (words == 1) {
+        DISPATCH_ORDER(decode_loop, 1, values, count, in)
+    } else if (words == 2) {
+        DISPATCH_ORDER(decode_loop, 2, values, count, in)
+    } else if (words == 4) {
+        DISPATCH_ORDER(decode_loop, 4, values, count, in)
+    }
 }
 
 void write_registers(int start_idx, uint16_t *words, int count, ByteOrder order, uint16_t *registers) {
     // Swap bytes within words if SWAP
-    if(order == ORDER_SWAP) {
+    if(order == ORDER_SWAP || order == ORDER_BE_SWAP) {
         for(int i = 0; i < count; i++) {
-            words[i] = (words[i] >> 8) | (words[i] << 8);
+            words[i] = swap16(words[i]);
         }
     }
-    // Swap word order if BE (for 2-word data)
-    if(order == ORDER_BE && count == 2) {
-        uint16_t tmp = words[0];
-        words[0] = words[1];
-        words[1] = tmp;
+    // Reverse word order if BE (most significant word first)
+    if(order == ORDER_BE || order == ORDER_BE_SWAP) {
+        for(int i = 0; i < count / 2; i++) {
+            uint16_t tmp = words[i];
+            words[i] = words[count - 1 - i];
+            words[count - 1 - i] = tmp;
+        }
     }
     for(int i = 0; i < count; i++) {
         registers[start_idx + i] = words[i];
     }
 }
+
+void encode_string(int start_idx, const char *s, int nb_registers, ByteOrder order, uint16_t *registers) {
+    int swap = order == ORDER_SWAP || order == ORDER_BE_SWAP;
+    size_t len = strlen(s);
+    for(int i = 0; i < nb_registers; i++) {
+        uint8_t first = (size_t)(2 * i) < len ? (uint8_t)s[2 * i] : 0;
+        uint8_t second = (size_t)(2 * i + 1) < len ? (uint8_t)s[2 * i + 1] : 0;
+        registers[start_idx + i] = swap ? (uint16_t)(first | (second << 8)) : (uint16_t)((first << 8) | second);
+    }
+}
+
+int decode_string(int start_idx, char *s, int nb_registers, ByteOrder order, const uint16_t *registers) {
+    int swap = order == ORDER_SWAP || order == ORDER_BE_SWAP;
+    for(int i = 0; i < nb_registers; i++) {
+        uint16_t word = swap ? swap16(registers[start_idx + i]) : registers[start_idx + i];
+        s[2 * i] = (char)(word >> 8);
+        s[2 * i + 1] = (char)word;
+    }
+    s[2 * nb_registers] = '\0';
+    return (int)strlen(s);
+}
+
+void unpack_bits(int start_idx, const uint8_t *packed, int count, uint8_t *bits) {
+    int i = 0;
+    for(; i + 8 <= count; i += 8) {
+        // Byte k of the product keeps bit k, then each nonzero byte becomes 1
+        uint64_t spread = (packed[i / 8] * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+        uint64_t entries = LE64(((spread + 0x7F7F7F7F7F7F7F7FULL) >> 7) & 0x0101010101010101ULL);
+        memcpy(bits + start_idx + i, &entries, 8);
+    }
+    for(; i < count; i++) {
+        bits[start_idx + i] = (packed[i / 8] >> (i % 8)) & 1;
+    }
+}
+
+void pack_bits(int start_idx, uint8_t *packed, int count, const uint8_t *bits) {
+    int i = 0;
+    for(; i + 8 <= count; i += 8) {
+        // Entry k sits at bit 8k; the multiply gathers them into the top byte
+        uint64_t entries;
+        memcpy(&entries, bits + start_idx + i, 8);
+        packed[i / 8] = (uint8_t)((LE64(entries) * 0x0102040810204080ULL) >> 56);
+    }
+    if(i < count) {
+        packed[i / 8] = 0;
+    }
+    for(; i < count; i++) {
+        packed[i / 8] |= (uint8_t)((bits[start_idx + i] & 1) << (i % 8));
+    }
+}
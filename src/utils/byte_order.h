@@ -3,23 +3,124 @@
 
 #include <stdint.h>
 
-typedef enum { ORDER_LE, ORDER_BE, ORDER_SWAP } ByteOrder;
+/*
+ * Layout of multi-word values in registers, named after the value 0xAABBCCDD
+ * as it appears on the wire: LE = CDAB (low word first), BE = ABCD,
+ * SWAP = DCBA (bytes swapped, low word first), BE_SWAP = BADC.
+ */
+typedef enum { ORDER_LE, ORDER_BE, ORDER_SWAP, ORDER_BE_SWAP } ByteOrder;
+
+typedef enum {
+    DATATYPE_INVALID = -1,
+    DATATYPE_UINT16,
+    DATATYPE_INT16,
+    DATATYPE_UINT32,
+    DATATYPE_INT32,
+    DATATYPE_FLOAT,
+    DATATYPE_UINT64,
+    DATATYPE_INT64,
+    DATATYPE_DOUBLE,
+    DATATYPE_STRING,        // ASCII, two characters per register
+    DATATYPE_BOOL           // Bit tables only
+} DataType;
 
 /**
  * Parse byte order string
- * @param s Byte order string: "LE", "BE", or "SWAP"
+ * @param s Byte order string: "LE", "BE", "SWAP" or "BE_SWAP", or the
+ *          wire names "CDAB", "ABCD", "DCBA" and "BADC"
  * @return ByteOrder enum value
  */
 ByteOrder parse_byte_order(const char *s);
 
+/**
+ * Parse datatype string
+ * @param s Datatype string: "uint16", "int16", "uint32", "int32", "float",
+ *          "uint64", "int64", "double", "string" or "bool"
+ * @return DataType enum value, DATATYPE_INVALID if unknown
+ */
+DataType parse_datatype(const char *s);
+
+/**
+ * Registers taken by one value of a datatype
+ * @param type Datatype
+ * @return 1, 2 or 4; 0 for strings and bools
+ */
+int datatype_words(DataType type);
+
 /**
  * Write multi-word data into registers with correct byte order
  * @param start_idx Starting register index
- * @param words Array of 16-bit words
+ * @param words Array of 16-bit words, least significant first (modified)
  * @param count Number of words
  * @param order Byte order to apply
  * @param registers Target register array (assumed valid)
  */
 void write_registers(int start_idx, uint16_t *words, int count, ByteOrder order, uint16_t *registers);
 
+/**
+ * Encode an array of values into consecutive registers in one pass
+ * @param start_idx Starting register index
+ * @param values Raw bits of each value (an IEEE float or double, or an integer),
+ *               least significant word in bits 0-15
+ * @param count Number of values
+ * @param words Registers per value: 1, 2 or 4
+ * @param order Byte order to apply
+ * @param registers Target register array (assumed valid for count * words)
+ */
+void encode_registers(int start_idx, const uint64_t *values, int count, int words, ByteOrder order,
+                      uint16_t *registers);
+
+/**
+ * Decode consecutive registers into an array of values, undoing encode_registers()
+ * @param start_idx Starting register index
+ * @param values Receives the raw bits of each value
+ * @param count Number of values
+ * @param words Registers per value: 1, 2 or 4
+ * @param order Byte order the values were written with
+ * @param registers Source register array (assumed valid for count * words)
+ */
+void decode_registers(int start_idx, uint64_t *values, int count, int words, ByteOrder order,
+                      const uint16_t *registers);
+
+/**
+ * Pack an ASCII string into registers, first character in the high byte
+ * (low byte with SWAP or BE_SWAP), padded with NULs
+ * @param start_idx Starting register index
+ * @param s String (NUL-terminated, cut to fit)
+ * @param nb_registers Registers to fill
+ * @param order Byte order to apply
+ * @param registers Target register array (assumed valid)
+ */
+void encode_string(int start_idx, const char *s, int nb_registers, ByteOrder order, uint16_t *registers);
+
+/**
+ * Unpack a string packed by encode_string()
+ * @param start_idx Starting register index
+ * @param s Receives the characters, at least 2 * nb_registers + 1 bytes, NUL-terminated
+ * @param nb_registers Registers to read
+ * @param order Byte order the string was written with
+ * @param registers Source register array (assumed valid)
+ * @return String length (up to the first NUL)
+ */
+int decode_string(int start_idx, char *s, int nb_registers, ByteOrder order, const uint16_t *registers);
+
+/**
+ * Unpack bits into a bit table (one byte per bit, as libmodbus keeps them),
+ * eight table entries per step
+ * @param start_idx First bit index
+ * @param packed Bits, eight per byte, first bit lowest (Modbus order)
+ * @param count Number of bits
+ * @param bits Target bit table (assumed valid)
+ */
+void unpack_bits(int start_idx, const uint8_t *packed, int count, uint8_t *bits);
+
+/**
+ * Pack bits of a bit table, eight table entries per step, undoing unpack_bits()
+ * @param start_idx First bit index
+ * @param packed Receives (count + 7) / 8 bytes, unused high bits cleared
+ * @param count Number of bits
+ * @param bits Source bit table (assumed valid, entries 0 or 1)
+ */
+void pack_bits(int start_idx, uint8_t *packed, int count, const uint8_t *bits);
+
 #endif // BYTE_ORDER_H
@@ -0,0 +1,87 @@
+#include "histogram.h"
+#include <string.h>
+
+static int bucket_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_COUNT) {
+        return (int)value;
+    }
+    // Keep the top HISTOGRAM_SUB_BITS bits of the value
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (HISTOGRAM_SUB_BITS - 1);
+    return HISTOGRAM_SUB_COUNT + (shift - 1) * (HISTOGRAM_SUB_COUNT / 2) +
+           (int)((value >> shift) - HISTOGRAM_SUB_COUNT / 2);
+}
+
+// Largest value falling into a bucket
+static uint64_t bucket_highest(int idx) {
+    if (idx < HISTOGRAM_SUB_COUNT) {
+        return (uint64_t)idx;
+    }
+    int shift = (idx - HISTOGRAM_SUB_COUNT) / (HISTOGRAM_SUB_COUNT / 2) + 1;
+    uint64_t sub = (uint64_t)((idx - HISTOGRAM_SUB_COUNT) % (HISTOGRAM_SUB_COUNT / 2) + HISTOGRAM_SUB_COUNT / 2);
+    return ((sub + 1) << shift) - 1;
+}
+
+void histogram_init(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void histogram_record(Histogram *h, uint64_t value) {
+    histogram_record_count(h, value, 1);
+}
+
+void histogram_record_count(Histogram *h, uint64_t value, uint64_t count) {
+    h->counts[bucket_index(value)] += count;
+    h->total += count;
+    h->sum += value * count;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+void histogram_merge(Histogram *dst, const Histogram *src) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t histogram_percentile(const Histogram *h, double percentile) {
+    if (h->total == 0) {
+        return 0;
+    }
+    if (percentile >= 100.0) {
+        return h->max;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->total + 0.5);
+    if (rank < 1) rank = 1;
+    
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_highest(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+uint64_t histogram_count_le(const Histogram *h, uint64_t bound) {
+    if (bound >= h->max) {
+        return h->total;
+    }
+    uint64_t count = 0;
+    int last = bucket_index(bound);
+    for (int i = 0; i <= last; i++) {
+        count += h->counts[i];
+    }
+    return count;
+}
+
+double histogram_mean(const Histogram *h) {
+    return h->total ? (double)h->sum / (double)h->total : 0.0;
+}
@@ -0,0 +1,72 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear buckets: values below 2^HISTOGRAM_SUB_BITS are exact, larger
+// ones are kept to 2^-(HISTOGRAM_SUB_BITS - 1) relative precision (~3%)
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_COUNT + (64 - HISTOGRAM_SUB_BITS) * (HISTOGRAM_SUB_COUNT / 2))
+
+// HDR-style latency histogram, fixed size and allocation free
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+/**
+ * Reset a histogram
+ * @param h Histogram
+ */
+void histogram_init(Histogram *h);
+
+/**
+ * Record one value
+ * @param h Histogram
+ * @param value Value (any unit, e.g. nanoseconds)
+ */
+void histogram_record(Histogram *h, uint64_t value);
+
+/**
+ * Record the same value several times
+ * @param h Histogram
+ * @param value Value
+ * @param count Number of occurrences
+ */
+void histogram_record_count(Histogram *h, uint64_t value, uint64_t count);
+
+/**
+ * Add all values of src to dst
+ * @param dst Destination histogram
+ * @param src Source histogram
+ */
+void histogram_merge(Histogram *dst, const Histogram *src);
+
+/**
+ * Value at a percentile
+ * @param h Histogram
+ * @param percentile Percentile in [0, 100]
+ * @return Highest value equivalent to the percentile's bucket, 0 if empty
+ */
+uint64_t histogram_percentile(const Histogram *h, double percentile);
+
+/**
+ * Number of recorded values up to a bound, for cumulative bucket exports
+ * @param h Histogram
+ * @param bound Upper bound; values sharing its bucket are counted too
+ * @return Count of values <= bound, within the histogram precision
+ */
+uint64_t histogram_count_le(const Histogram *h, uint64_t bound);
+
+/**
+ * Mean of the recorded values
+ * @param h Histogram
+ * @return Mean, 0 if empty
+ */
+double histogram_mean(const Histogram *h);
+
+#endif // HISTOGRAM_H
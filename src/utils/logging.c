@@ -0,0 +1,249 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // gmtime_r
+#endif
+#include "logging.h"
+#include "platform.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_RING_RECORDS 256        // Per thread, power of two
+#define LOG_MESSAGE_LENGTH 232
+#define LOG_MAX_RINGS 64            // Threads beyond that log synchronously
+#define LOG_DRAIN_IDLE_MS 5
+
+typedef struct {
+    uint64_t time_us;
+    int level;
+    unsigned suppressed;
+    char message[LOG_MESSAGE_LENGTH];
+} LogRecord;
+
+/*
+ * Single producer (the owning thread), single consumer (the drain thread).
+ * head and tail are free-running; the ring is full when they differ by
+ * LOG_RING_RECORDS. Rings live until exit.
+ */
+typedef struct {
+    _Alignas(64) atomic_uint head;
+    _Alignas(64) atomic_uint tail;
+    atomic_uint dropped;
+    LogRecord records[LOG_RING_RECORDS];
+} LogRing;
+
+atomic_int log_runtime_level = LOG_LEVEL_INFO;
+
+static LogRing *rings[LOG_MAX_RINGS];
+static atomic_int nb_rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local LogRing *thread_ring;
+static _Thread_local bool thread_ring_failed;
+
+static atomic_bool drain_running;
+static pthread_t drain_thread;
+
+static const char *level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// One line: 2026-01-31T12:00:00.000000Z [LEVEL] message
+static int format_record(char *buf, size_t size, uint64_t time_us, int level, unsigned suppressed,
+                         const char *message) {
+    time_t secs = (time_t)(time_us / 1000000);
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &secs);
+#else
+    gmtime_r(&secs, &tm);
+#endif
+    int n = snprintf(buf, size, "%04d-%02d-%02dT%02d:%02d:%02d.%06uZ [%s] %s",
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                     (unsigned)(time_us % 1000000), level_names[level], message);
+    if (n < 0 || (size_t)n >= size) {
+        n = (int)size - 1;
+    }
+    if (suppressed > 0) {
+        int m = snprintf(buf + n, size - (size_t)n, " (%u similar messages suppressed)", suppressed);
+        n = (m < 0 || (size_t)m >= size - (size_t)n) ? (int)size - 1 : n + m;
+    }
+    if ((size_t)n + 1 >= size) {
+        n = (int)size - 2;
+    }
+    buf[n++] = '\n';
+    buf[n] = '\0';
+    return n;
+}
+
+static LogRing* get_ring(void) {
+    if (thread_ring || thread_ring_failed) {
+        return thread_ring;
+    }
+    
+    LogRing *ring = (LogRing *)calloc(1, sizeof(LogRing));
+    pthread_mutex_lock(&rings_lock);
+    int n = atomic_load_explicit(&nb_rings, memory_order_relaxed);
+    if (ring && n < LOG_MAX_RINGS) {
+        rings[n] = ring;
+        atomic_store_explicit(&nb_rings, n + 1, memory_order_release);
+        thread_ring = ring;
+    } else {
+        free(ring);
+        thread_ring_failed = true;
+    }
+    pthread_mutex_unlock(&rings_lock);
+    return thread_ring;
+}
+
+void log_write(LogSite *site, int level, const char *fmt, ...) {
+    uint64_t now_us = platform_realtime_us();
+    
+    // A new second resets the site's budget and reports what it suppressed
+    unsigned second = (unsigned)(now_us / 1000000);
+    unsigned window = atomic_load_explicit(&site->second, memory_order_relaxed);
+    unsigned suppressed = 0;
+    if (window != second && atomic_compare_exchange_strong(&site->second, &window, second)) {
+        atomic_store_explicit(&site->count, 0, memory_order_relaxed);
+        suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    }
+    if (atomic_fetch_add_explicit(&site->count, 1, memory_order_relaxed) >= LOG_RATE_LIMIT) {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        return;
+    }
+    
+    va_list ap;
+    va_start(ap, fmt);
+    LogRing *ring = atomic_load_explicit(&drain_running, memory_order_acquire) ? get_ring() : NULL;
+    if (!ring) {
+        char message[LOG_MESSAGE_LENGTH];
+        char line[LOG_MESSAGE_LENGTH + 96];
+        vsnprintf(message, sizeof(message), fmt, ap);
+        va_end(ap);
+        int n = format_record(line, sizeof(line), now_us, level, suppressed, message);
+        fwrite(line, 1, (size_t)n, stderr);
+        return;
+    }
+    
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head == LOG_RING_RECORDS) {
+        va_end(ap);
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    LogRecord *record = &ring->records[tail & (LOG_RING_RECORDS - 1)];
+    record->time_us = now_us;
+    record->level = level;
+    record->suppressed = suppressed;
+    vsnprintf(record->message, sizeof(record->message), fmt, ap);
+    va_end(ap);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static void flush_lines(char *buf, size_t *len) {
+    if (*len > 0) {
+        fwrite(buf, 1, *len, stderr);
+        *len = 0;
+    }
+}
+
+// Write out every queued record, oldest first across threads; returns the count
+static int drain(void) {
+    unsigned heads[LOG_MAX_RINGS];
+    unsigned tails[LOG_MAX_RINGS];
+    int n = atomic_load_explicit(&nb_rings, memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        heads[i] = atomic_load_explicit(&rings[i]->head, memory_order_relaxed);
+        tails[i] = atomic_load_explicit(&rings[i]->tail, memory_order_acquire);
+    }
+    
+    char out[16384];
+    size_t len = 0;
+    int count = 0;
+    for (;;) {
+        int oldest = -1;
+        const LogRecord *record = NULL;
+        for (int i = 0; i < n; i++) {
+            if (heads[i] == tails[i]) continue;
+            const LogRecord *r = &rings[i]->records[heads[i] & (LOG_RING_RECORDS - 1)];
+            if (!record || r->time_us < record->time_us) {
+                oldest = i;
+                record = r;
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+        
+        if (sizeof(out) - len < LOG_MESSAGE_LENGTH + 96) {
+            flush_lines(out, &len);
+        }
+        len += (size_t)format_record(out + len, sizeof(out) - len, record->time_us, record->level,
+                                     record->suppressed, record->message);
+        atomic_store_explicit(&rings[oldest]->head, ++heads[oldest], memory_order_release);
+        count++;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        unsigned dropped = atomic_exchange_explicit(&rings[i]->dropped, 0, memory_order_relaxed);
+        if (dropped > 0) {
+            char message[64];
+            snprintf(message, sizeof(message), "%u log records dropped, ring full", dropped);
+            if (sizeof(out) - len < LOG_MESSAGE_LENGTH + 96) {
+                flush_lines(out, &len);
+            }
+            len += (size_t)format_record(out + len, sizeof(out) - len, platform_realtime_us(),
+                                         LOG_LEVEL_WARN, 0, message);
+        }
+    }
+    flush_lines(out, &len);
+    return count;
+}
+
+static void* drain_loop(void *arg) {
+    (void)arg;
+    while (atomic_load_explicit(&drain_running, memory_order_relaxed)) {
+        if (drain() == 0) {
+            platform_msleep(LOG_DRAIN_IDLE_MS);
+        }
+    }
+    return NULL;
+}
+
+int log_init(void) {
+    if (atomic_load(&drain_running)) {
+        return 0;
+    }
+    atomic_store(&drain_running, true);
+    if (pthread_create(&drain_thread, NULL, drain_loop, NULL) != 0) {
+        atomic_store(&drain_running, false);
+        return -1;
+    }
+    return 0;
+}
+
+void log_shutdown(void) {
+    if (!atomic_load(&drain_running)) {
+        return;
+    }
+    atomic_store(&drain_running, false);
+    pthread_join(drain_thread, NULL);
+    drain();
+}
+
+void log_set_level(int level) {
+    if (level < LOG_LEVEL_DEBUG) level = LOG_LEVEL_DEBUG;
+    if (level > LOG_LEVEL_NONE) level = LOG_LEVEL_NONE;
+    atomic_store_explicit(&log_runtime_level, level, memory_order_relaxed);
+}
+
+int log_level_from_string(const char *name) {
+    static const char *names[] = {"debug", "info", "warn", "error", "none"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
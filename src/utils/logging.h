@@ -1,11 +1,103 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+#include <stdatomic.h>
 #include <stdio.h>
 
-#define log_debug(fmt, ...) fprintf(stderr, "[DEBUG] " fmt "\n", ##__VA_ARGS__)
-#define log_info(fmt, ...)  fprintf(stdout, "[INFO] " fmt "\n", ##__VA_ARGS__)
-#define log_error(fmt, ...) fprintf(stderr, "[ERROR] " fmt "\n", ##__VA_ARGS__)
-#define log_warn(fmt, ...)  fprintf(stderr, "[WARN] " fmt "\n", ##__VA_ARGS__)
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE  4
+
+// Lowest level compiled in; calls below it expand to nothing
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Records one call site may emit per second before it is rate limited
+#define LOG_RATE_LIMIT 20
+
+// Rate limit state of one call site
+typedef struct {
+    atomic_uint second;         // Current one-second window
+    atomic_uint count;          // Records emitted in the window
+    atomic_uint suppressed;     // Records dropped since the last one emitted
+} LogSite;
+
+// Lowest level logged at runtime
+extern atomic_int log_runtime_level;
+
+/**
+ * Start the background thread draining the per-thread log rings.
+ * Until then (and after log_shutdown()) records are written synchronously.
+ * @return 0 on success, -1 on failure
+ */
+int log_init(void);
+
+/**
+ * Stop the background thread and write out every pending record
+ */
+void log_shutdown(void);
+
+/**
+ * Set the lowest level logged at runtime (cannot go below LOG_COMPILE_LEVEL)
+ * @param level LOG_LEVEL_DEBUG to LOG_LEVEL_NONE
+ */
+void log_set_level(int level);
+
+/**
+ * Parse a level name
+ * @param name "debug", "info", "warn", "error" or "none"
+ * @return Level, -1 if unknown
+ */
+int log_level_from_string(const char *name);
+
+/**
+ * Queue a record on the calling thread's ring. Use the log_* macros.
+ * @param site Call site, for rate limiting
+ * @param level Record level
+ * @param fmt printf format
+ */
+void log_write(LogSite *site, int level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static inline void __attribute__((format(printf, 1, 2))) log_discard(const char *fmt, ...) {
+    (void)fmt;
+}
+
+#define LOG_AT(level, fmt, ...) do { \
+        if ((level) >= atomic_load_explicit(&log_runtime_level, memory_order_relaxed)) { \
+            static LogSite log_site_; \
+            log_write(&log_site_, (level), fmt, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+// Arguments stay type-checked but no code is generated
+#define LOG_DISABLED(fmt, ...) do { if (0) log_discard(fmt, ##__VA_ARGS__); } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define log_debug(fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define log_debug(fmt, ...) LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define log_info(fmt, ...)  LOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define log_info(fmt, ...)  LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define log_warn(fmt, ...)  LOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define log_warn(fmt, ...)  LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define log_error(fmt, ...) LOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define log_error(fmt, ...) LOG_DISABLED(fmt, ##__VA_ARGS__)
+#endif
 
 #endif // LOGGING_H
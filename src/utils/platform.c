@@ -1,8 +1,12 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L     // clock_gettime, O_CLOEXEC, ftruncate
+#endif
 #include "platform.h"
 #include "logging.h"
 
 #ifdef _WIN32
 #include <stdio.h>
+#include <string.h>
 #include <conio.h>
 
 static WSADATA wsaData;
@@ -36,6 +40,14 @@ int platform_read_stdin(char *buf, size_t size, int timeout_ms) {
     return 0;
 }
 
+int platform_stdin_pending(void) {
+    DWORD avail = 0;
+    if (!PeekNamedPipe(GetStdHandle(STD_INPUT_HANDLE), NULL, 0, NULL, &avail, NULL)) {
+        return -1;
+    }
+    return (int)avail;
+}
+
 int platform_set_nonblocking(int fd) {
     unsigned long mode = 1;
     // For Winsock sockets
@@ -52,9 +64,123 @@ int platform_get_nprocs(void) {
     return (int)sysinfo.dwNumberOfProcessors;
 }
 
+uint64_t platform_monotonic_us(void) {
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000ULL +
+           (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000ULL / (uint64_t)freq.QuadPart;
+}
+
+uint64_t platform_monotonic_ns(void) {
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000ULL +
+           (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000ULL / (uint64_t)freq.QuadPart;
+}
+
+uint64_t platform_realtime_us(void) {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    uint64_t ticks = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (ticks - 116444736000000000ULL) / 10;    // 100 ns ticks since 1601
+}
+
+int platform_sync_fd(int fd) {
+    return _commit(fd) == 0 ? 0 : -1;
+}
+
+int platform_file_stamp(const char *path, uint64_t *size, uint64_t *mtime_ns) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+        return -1;
+    }
+    *size = (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+    *mtime_ns = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime) * 100;
+    return 0;
+}
+
+int platform_replace_file(const char *from, const char *to) {
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1;
+}
+
+int platform_map_file(const char *path, size_t size, PlatformFileMap *map) {
+    memset(map, 0, sizeof(*map));
+    map->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER len;
+    len.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(map->file, len, NULL, FILE_BEGIN) || !SetEndOfFile(map->file)) {
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->view = CreateFileMappingA(map->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+    map->addr = map->view ? MapViewOfFile(map->view, FILE_MAP_ALL_ACCESS, 0, 0, size) : NULL;
+    if (!map->addr) {
+        if (map->view) CloseHandle(map->view);
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->size = size;
+    return 0;
+}
+
+int platform_map_file_readonly(const char *path, PlatformFileMap *map) {
+    memset(map, 0, sizeof(*map));
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER len;
+    if (!GetFileSizeEx(map->file, &len) || len.QuadPart == 0 || (uint64_t)len.QuadPart > SIZE_MAX) {
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->view = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    map->addr = map->view ? MapViewOfFile(map->view, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!map->addr) {
+        if (map->view) CloseHandle(map->view);
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->size = (size_t)len.QuadPart;
+    return 0;
+}
+
+int platform_flush_map(PlatformFileMap *map, size_t offset, size_t len) {
+    if (!FlushViewOfFile((char *)map->addr + offset, len)) {
+        return -1;
+    }
+    return FlushFileBuffers(map->file) ? 0 : -1;
+}
+
+void platform_unmap_file(PlatformFileMap *map) {
+    if (map->addr) {
+        UnmapViewOfFile(map->addr);
+        CloseHandle(map->view);
+        CloseHandle(map->file);
+        map->addr = NULL;
+    }
+}
+
 #else // Linux/Unix
 
 #include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 
 int platform_init(void) {
@@ -89,6 +215,14 @@ int platform_read_stdin(char *buf, size_t size, int timeout_ms) {
     return ret < 0 ? -1 : 0;
 }
 
+int platform_stdin_pending(void) {
+    int avail = 0;
+    if (ioctl(STDIN_FILENO, FIONREAD, &avail) != 0) {
+        return -1;
+    }
+    return avail;
+}
+
 int platform_set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) {
@@ -115,4 +249,135 @@ int platform_get_nprocs(void) {
     return 1;
 }
 
+void platform_msleep(unsigned int ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+uint64_t platform_monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+uint64_t platform_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t platform_realtime_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+int platform_sync_fd(int fd) {
+#ifdef __linux__
+    return fdatasync(fd) == 0 ? 0 : -1;
+#else
+    return fsync(fd) == 0 ? 0 : -1;
+#endif
+}
+
+int platform_file_stamp(const char *path, uint64_t *size, uint64_t *mtime_ns) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    *size = (uint64_t)st.st_size;
+#ifdef __linux__
+    *mtime_ns = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+#else
+    *mtime_ns = (uint64_t)st.st_mtime * 1000000000ULL;
+#endif
+    return 0;
+}
+
+int platform_replace_file(const char *from, const char *to) {
+    if (rename(from, to) != 0) {
+        return -1;
+    }
+    
+    // The new directory entry is only durable once the directory is synced
+    char dir[512];
+    const char *slash = strrchr(to, '/');
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == to) {
+        strcpy(dir, "/");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - to), to);
+    }
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc = fsync(fd);
+    close(fd);
+    return rc == 0 ? 0 : -1;
+}
+
+int platform_map_file(const char *path, size_t size, PlatformFileMap *map) {
+    memset(map, 0, sizeof(*map));
+    map->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (map->fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(map->fd, &st) != 0 || ((size_t)st.st_size != size && ftruncate(map->fd, (off_t)size) != 0)) {
+        close(map->fd);
+        return -1;
+    }
+    // The new length must survive a crash, or the tail of the mapping would be lost
+    if ((size_t)st.st_size != size) {
+        fsync(map->fd);
+    }
+    map->addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+    if (map->addr == MAP_FAILED) {
+        map->addr = NULL;
+        close(map->fd);
+        return -1;
+    }
+    map->size = size;
+    return 0;
+}
+
+int platform_map_file_readonly(const char *path, PlatformFileMap *map) {
+    memset(map, 0, sizeof(*map));
+    map->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (map->fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(map->fd, &st) != 0 || st.st_size == 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        close(map->fd);
+        return -1;
+    }
+    map->addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, map->fd, 0);
+    if (map->addr == MAP_FAILED) {
+        map->addr = NULL;
+        close(map->fd);
+        return -1;
+    }
+    map->size = (size_t)st.st_size;
+    return 0;
+}
+
+int platform_flush_map(PlatformFileMap *map, size_t offset, size_t len) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset - offset % page;
+    return msync((char *)map->addr + start, len + (offset - start), MS_SYNC) == 0 ? 0 : -1;
+}
+
+void platform_unmap_file(PlatformFileMap *map) {
+    if (map->addr) {
+        munmap(map->addr, map->size);
+        close(map->fd);
+        map->addr = NULL;
+    }
+}
+
 #endif
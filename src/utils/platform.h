@@ -2,6 +2,7 @@
 #define PLATFORM_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 #ifdef _WIN32
     #include <windows.h>
@@ -27,6 +28,7 @@
     #include <sys/types.h>
     #include <sys/time.h>
     #include <fcntl.h>
+    #include <time.h>
     
     #define PLATFORM_WINDOWS 0
     #define PLATFORM_LINUX 1
@@ -34,11 +36,22 @@
     typedef int platform_handle_t;
     typedef int platform_socket_t;
     
-    #define platform_msleep(ms) { struct timespec ts; ts.tv_sec = (ms)/1000; ts.tv_nsec = ((ms)%1000)*1000000; nanosleep(&ts, NULL); }
     #define platform_close_fd(fd) close(fd)
     
 #endif
 
+// A mapped file: stores to a read-write mapping reach the file through the page cache
+typedef struct {
+    void *addr;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE view;
+#else
+    int fd;
+#endif
+} PlatformFileMap;
+
 /**
  * Initialize platform-specific features (Windows: Winsock, Linux: nothing)
  * @return 0 on success, -1 on failure
@@ -59,6 +72,12 @@ void platform_cleanup(void);
  */
 int platform_read_stdin(char *buf, size_t size, int timeout_ms);
 
+/**
+ * Bytes written to stdin and not read yet (pipes only)
+ * @return Byte count, -1 if unknown
+ */
+int platform_stdin_pending(void);
+
 /**
  * Set file descriptor to non-blocking mode
  * @param fd File descriptor
@@ -72,4 +91,87 @@ int platform_set_nonblocking(int fd);
  */
 int platform_get_nprocs(void);
 
+#ifndef _WIN32
+/**
+ * Sleep for a number of milliseconds
+ * @param ms Milliseconds to sleep
+ */
+void platform_msleep(unsigned int ms);
+#endif
+
+/**
+ * Get a monotonic timestamp
+ * @return Microseconds since an arbitrary fixed point
+ */
+uint64_t platform_monotonic_us(void);
+
+/**
+ * Get a monotonic timestamp with nanosecond resolution
+ * @return Nanoseconds since an arbitrary fixed point
+ */
+uint64_t platform_monotonic_ns(void);
+
+/**
+ * Get the wall clock time
+ * @return Microseconds since the Unix epoch (UTC)
+ */
+uint64_t platform_realtime_us(void);
+
+/**
+ * Flush a file's data to stable storage
+ * @param fd File descriptor
+ * @return 0 on success, -1 on failure
+ */
+int platform_sync_fd(int fd);
+
+/**
+ * Length and last modification time of a file
+ * @param path File to examine
+ * @param size Filled with the length in bytes
+ * @param mtime_ns Filled with the modification time in ns, from an epoch of the platform
+ * @return 0 on success, -1 on failure
+ */
+int platform_file_stamp(const char *path, uint64_t *size, uint64_t *mtime_ns);
+
+/**
+ * Atomically replace a file by another one and make the rename durable
+ * @param from File to move (already synced)
+ * @param to Path it replaces
+ * @return 0 on success, -1 on failure
+ */
+int platform_replace_file(const char *from, const char *to);
+
+/**
+ * Map a whole file read-write and shared, creating it if needed.
+ * The file is resized to size; bytes it did not have read as zero.
+ * @param path File to map
+ * @param size Length of the file and the mapping
+ * @param map Filled on success
+ * @return 0 on success, -1 on failure
+ */
+int platform_map_file(const char *path, size_t size, PlatformFileMap *map);
+
+/**
+ * Map a whole existing file read-only
+ * @param path File to map
+ * @param map Filled on success
+ * @return 0 on success, -1 on failure (also for an empty file)
+ */
+int platform_map_file_readonly(const char *path, PlatformFileMap *map);
+
+/**
+ * Write the modified pages of a range of a mapping to the file and wait for them
+ * @param map Mapped file
+ * @param offset Start of the range (rounded down to a page)
+ * @param len Length of the range
+ * @return 0 on success, -1 on failure
+ */
+int platform_flush_map(PlatformFileMap *map, size_t offset, size_t len);
+
+/**
+ * Unmap a file and close it. Modified pages still reach the file later.
+ * @param map Mapped file
+ */
+void platform_unmap_file(PlatformFileMap *map);
+
 #endif // PLATFORM_H
@@ -0,0 +1,175 @@
+#include "scaling.h"
+#include <float.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Values converted per pass of each loop below
+#define SCALING_CHUNK 64
+
+// Doubles of this magnitude or more are integers already
+#define TWO_POW_52 4503599627370496.0
+
+int parse_round_mode(const char *s) {
+    static const char *const names[] = {"nearest", "floor", "ceil", "truncate"};
+    for (int i = 0; s && i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(s, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Register values a datatype holds, as doubles its conversion takes
+static void type_range(DataType type, double *lo, double *hi) {
+    switch (type) {
+    case DATATYPE_UINT16:
+        *lo = 0.0;
+        *hi = 65535.0;
+        break;
+    case DATATYPE_INT16:
+        *lo = -32768.0;
+        *hi = 32767.0;
+        break;
+    case DATATYPE_UINT32:
+        *lo = 0.0;
+        *hi = 4294967295.0;
+        break;
+    case DATATYPE_INT32:
+        *lo = -2147483648.0;
+        *hi = 2147483647.0;
+        break;
+    case DATATYPE_UINT64:
+        *lo = 0.0;
+        *hi = 18446744073709549568.0;       // Largest double below 2^64
+        break;
+    case DATATYPE_INT64:
+        *lo = -9223372036854775808.0;
+        *hi = 9223372036854774784.0;        // Largest double below 2^63
+        break;
+    case DATATYPE_FLOAT:
+        *lo = -FLT_MAX;
+        *hi = FLT_MAX;
+        break;
+    default:
+        *lo = -DBL_MAX;
+        *hi = DBL_MAX;
+        break;
+    }
+}
+
+// Integer part, without libm
+static inline double trunc_integral(double v) {
+    return v > -TWO_POW_52 && v < TWO_POW_52 ? (double)(int64_t)v : v;
+}
+
+void scaling_encode(const Scaling *scaling, const double *values, int count, DataType type, uint64_t *raw) {
+    double lo, hi;
+    type_range(type, &lo, &hi);
+    bool integer = type != DATATYPE_FLOAT && type != DATATYPE_DOUBLE;
+    double min = scaling->min, max = scaling->max, offset = scaling->offset, scale = scaling->scale;
+    double v[SCALING_CHUNK];
+    
+    for (int base = 0; base < count; base += SCALING_CHUNK) {
+        int n = count - base < SCALING_CHUNK ? count - base : SCALING_CHUNK;
+        const double *in = values + base;
+        uint64_t *out = raw + base;
+        
+        // Clamp, scale and limit to the datatype; a NaN ends up at min
+        for (int i = 0; i < n; i++) {
+            double x = in[i] > min ? in[i] : min;
+            x = x < max ? x : max;
+            x = (x - offset) / scale;
+            x = x > lo ? x : lo;
+            v[i] = x < hi ? x : hi;
+        }
+        
+        // Within the datatype range, so rounding stays inside it
+        if (integer) {
+            switch (scaling->round) {
+            case ROUND_FLOOR:
+                for (int i = 0; i < n; i++) {
+                    double t = trunc_integral(v[i]);
+                    v[i] = t - (double)(v[i] < t);
+                }
+                break;
+            case ROUND_CEIL:
+                for (int i = 0; i < n; i++) {
+                    double t = trunc_integral(v[i]);
+                    v[i] = t + (double)(v[i] > t);
+                }
+                break;
+            case ROUND_TRUNCATE:
+                for (int i = 0; i < n; i++) {
+                    v[i] = trunc_integral(v[i]);
+                }
+                break;
+            default:
+                for (int i = 0; i < n; i++) {
+                    double t = trunc_integral(v[i]);
+                    double d = v[i] - t;
+                    v[i] = t + (double)(d >= 0.5) - (double)(d <= -0.5);
+                }
+                break;
+            }
+        }
+        
+        switch (type) {
+        case DATATYPE_UINT64:
+            for (int i = 0; i < n; i++) {
+                out[i] = (uint64_t)v[i];
+            }
+            break;
+        case DATATYPE_FLOAT:
+            for (int i = 0; i < n; i++) {
+                union { float f; uint32_t u32; } fu;
+                fu.f = (float)v[i];
+                out[i] = fu.u32;
+            }
+            break;
+        case DATATYPE_DOUBLE:
+            memcpy(out, v, (size_t)n * sizeof(double));
+            break;
+        default:
+            for (int i = 0; i < n; i++) {
+                out[i] = (uint64_t)(int64_t)v[i];
+            }
+            break;
+        }
+    }
+}
+
+void scaling_decode(const Scaling *scaling, const uint64_t *raw, int count, DataType type, double *values) {
+    switch (type) {
+    case DATATYPE_UINT16:
+        for (int i = 0; i < count; i++) values[i] = (double)(uint16_t)raw[i];
+        break;
+    case DATATYPE_INT16:
+        for (int i = 0; i < count; i++) values[i] = (double)(int16_t)raw[i];
+        break;
+    case DATATYPE_UINT32:
+        for (int i = 0; i < count; i++) values[i] = (double)(uint32_t)raw[i];
+        break;
+    case DATATYPE_INT32:
+        for (int i = 0; i < count; i++) values[i] = (double)(int32_t)raw[i];
+        break;
+    case DATATYPE_INT64:
+        for (int i = 0; i < count; i++) values[i] = (double)(int64_t)raw[i];
+        break;
+    case DATATYPE_FLOAT:
+        for (int i = 0; i < count; i++) {
+            union { float f; uint32_t u32; } fu;
+            fu.u32 = (uint32_t)raw[i];
+            values[i] = fu.f;
+        }
+        break;
+    case DATATYPE_DOUBLE:
+        memcpy(values, raw, (size_t)count * sizeof(double));
+        break;
+    default:
+        for (int i = 0; i < count; i++) values[i] = (double)raw[i];
+        break;
+    }
+    
+    double offset = scaling->offset, scale = scaling->scale;
+    for (int i = 0; i < count; i++) {
+        values[i] = values[i] * scale + offset;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef SCALING_H
+#define SCALING_H
+
+#include "byte_order.h"
+#include <stdint.h>
+
+typedef enum {
+    ROUND_NEAREST,          // Half away from zero
+    ROUND_FLOOR,
+    ROUND_CEIL,
+    ROUND_TRUNCATE
+} RoundMode;
+
+/*
+ * Linear conversion between engineering values and register contents:
+ * value = register * scale + offset. Writes clamp the value to [min, max],
+ * then the register value to the range of its datatype, so nothing wraps.
+ */
+typedef struct {
+    double scale;
+    double offset;
+    double min;
+    double max;
+    RoundMode round;
+} Scaling;
+
+/**
+ * Parse a rounding mode: "nearest", "floor", "ceil" or "truncate"
+ * @param s Mode name
+ * @return RoundMode, or -1 if unknown
+ */
+int parse_round_mode(const char *s);
+
+/**
+ * Convert engineering values to raw register value bits for
+ * encode_registers(), in chunks of branch-free loops the compiler
+ * vectorizes. Integer datatypes are rounded with the scaling's mode.
+ * @param scaling Conversion
+ * @param values Engineering values
+ * @param count Number of values
+ * @param type Numeric register datatype (not string or bool)
+ * @param raw Receives the value bits
+ */
+void scaling_encode(const Scaling *scaling, const double *values, int count, DataType type, uint64_t *raw);
+
+/**
+ * Convert raw register value bits, as decode_registers() returns them,
+ * back to engineering values
+ * @param scaling Conversion
+ * @param raw Value bits
+ * @param count Number of values
+ * @param type Numeric register datatype (not string or bool)
+ * @param values Receives the engineering values
+ */
+void scaling_decode(const Scaling *scaling, const uint64_t *raw, int count, DataType type, double *values);
+
+#endif // SCALING_H
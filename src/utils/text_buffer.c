@@ -0,0 +1,101 @@
+#include "text_buffer.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int text_buffer_reserve(TextBuffer *tb, size_t more) {
+    if (tb->len + more <= tb->cap) {
+        return 0;
+    }
+    size_t cap = tb->cap ? tb->cap : 256;
+    while (cap < tb->len + more) {
+        cap *= 2;
+    }
+    char *grown = realloc(tb->data, cap);
+    if (!grown) {
+        return -1;
+    }
+    tb->data = grown;
+    tb->cap = cap;
+    return 0;
+}
+
+void text_buffer_free(TextBuffer *tb) {
+    free(tb->data);
+    tb->data = NULL;
+    tb->len = 0;
+    tb->cap = 0;
+}
+
+void text_put_uint(TextBuffer *tb, uint64_t v) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) {
+        tb->data[tb->len++] = digits[--n];
+    }
+}
+
+void text_put_int(TextBuffer *tb, int64_t v) {
+    if (v < 0) {
+        text_put_char(tb, '-');
+        text_put_uint(tb, (uint64_t)0 - (uint64_t)v);
+    } else {
+        text_put_uint(tb, (uint64_t)v);
+    }
+}
+
+void text_put_double(TextBuffer *tb, double v, int digits) {
+    if (isnan(v) || isinf(v)) {
+        text_put_str(tb, "null");
+    } else if (v > -1e15 && v < 1e15 && v == (double)(int64_t)v) {
+        text_put_int(tb, (int64_t)v);
+    } else {
+        tb->len += (size_t)snprintf(tb->data + tb->len, TEXT_NUMBER_MAX, "%.*g", digits, v);
+    }
+}
+
+void text_put_json_string(TextBuffer *tb, const char *s) {
+    static const char HEX[] = "0123456789abcdef";
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            text_put_char(tb, '\\');
+            text_put_char(tb, (char)c);
+        } else if (c < 0x20) {
+            text_put_str(tb, "\\u00");
+            text_put_char(tb, HEX[c >> 4]);
+            text_put_char(tb, HEX[c & 0xF]);
+        } else {
+            text_put_char(tb, (char)c);
+        }
+    }
+}
+
+void text_put_base64(TextBuffer *tb, const uint8_t *bytes, size_t len) {
+    char *p = tb->data + tb->len;
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t v = ((uint32_t)bytes[i] << 16) | ((uint32_t)bytes[i + 1] << 8) | bytes[i + 2];
+        *p++ = BASE64[v >> 18];
+        *p++ = BASE64[(v >> 12) & 0x3F];
+        *p++ = BASE64[(v >> 6) & 0x3F];
+        *p++ = BASE64[v & 0x3F];
+    }
+    if (i < len) {
+        uint32_t v = (uint32_t)bytes[i] << 16;
+        if (i + 1 < len) {
+            v |= (uint32_t)bytes[i + 1] << 8;
+        }
+        *p++ = BASE64[v >> 18];
+        *p++ = BASE64[(v >> 12) & 0x3F];
+        *p++ = i + 1 < len ? BASE64[(v >> 6) & 0x3F] : '=';
+        *p++ = '=';
+    }
+    tb->len = (size_t)(p - tb->data);
+}
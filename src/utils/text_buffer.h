@@ -0,0 +1,85 @@
+#ifndef TEXT_BUFFER_H
+#define TEXT_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Longest text of one number put by the helpers below
+#define TEXT_NUMBER_MAX 32
+
+/*
+ * Growable buffer for replies built piece by piece. Kept between uses so a
+ * steady stream of replies allocates nothing. The put helpers do not check
+ * room: reserve what a whole reply can take first.
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} TextBuffer;
+
+/**
+ * Make room for more bytes after the current content
+ * @param tb Pointer to TextBuffer (zero-initialised when first used)
+ * @param more Bytes about to be put
+ * @return 0 on success, -1 on allocation failure
+ */
+int text_buffer_reserve(TextBuffer *tb, size_t more);
+
+/**
+ * Release the memory of a buffer
+ * @param tb Pointer to TextBuffer
+ */
+void text_buffer_free(TextBuffer *tb);
+
+static inline void text_put_char(TextBuffer *tb, char c) {
+    tb->data[tb->len++] = c;
+}
+
+static inline void text_put_str(TextBuffer *tb, const char *s) {
+    size_t n = strlen(s);
+    memcpy(tb->data + tb->len, s, n);
+    tb->len += n;
+}
+
+/**
+ * Put an unsigned number in decimal
+ * @param tb Pointer to TextBuffer
+ * @param v Value
+ */
+void text_put_uint(TextBuffer *tb, uint64_t v);
+
+/**
+ * Put a signed number in decimal
+ * @param tb Pointer to TextBuffer
+ * @param v Value
+ */
+void text_put_int(TextBuffer *tb, int64_t v);
+
+/**
+ * Put a number as JSON: integral values as integers, others with the
+ * given significant digits, NaN and infinities as null
+ * @param tb Pointer to TextBuffer
+ * @param v Value
+ * @param digits Significant digits (9 round-trips a float, 17 a double)
+ */
+void text_put_double(TextBuffer *tb, double v, int digits);
+
+/**
+ * Put a string as the inside of a JSON string: quotes, backslashes and
+ * control characters escaped (up to 6 characters per byte)
+ * @param tb Pointer to TextBuffer
+ * @param s String
+ */
+void text_put_json_string(TextBuffer *tb, const char *s);
+
+/**
+ * Put bytes as base64 (4 characters per 3 bytes, padded)
+ * @param tb Pointer to TextBuffer
+ * @param bytes Data
+ * @param len Length of data
+ */
+void text_put_base64(TextBuffer *tb, const uint8_t *bytes, size_t len);
+
+#endif // TEXT_BUFFER_H
@@ -0,0 +1,35 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+/*
+ * Checks shared by the unit tests. Each test is one program: a failed
+ * check is reported with its line and counted, and the test goes on so
+ * one run shows every failure.
+ */
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+/**
+ * Report the outcome of a test
+ * @param name Test name, as printed when every check passed
+ * @return Exit status of the test
+ */
+static inline int check_report(const char *name) {
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,163 @@
+/*
+ * Byte order: every datatype written and read back in each order, the
+ * register layout each order name stands for, strings and packed bits.
+ */
+#include "check.h"
+#include "utils/byte_order.h"
+#include <stdio.h>
+#include <string.h>
+
+static const ByteOrder ORDERS[] = {ORDER_LE, ORDER_BE, ORDER_SWAP, ORDER_BE_SWAP};
+#define NB_ORDERS (int)(sizeof(ORDERS) / sizeof(ORDERS[0]))
+
+static const DataType NUMBER_TYPES[] = {
+    DATATYPE_UINT16, DATATYPE_INT16, DATATYPE_UINT32, DATATYPE_INT32,
+    DATATYPE_FLOAT, DATATYPE_UINT64, DATATYPE_INT64, DATATYPE_DOUBLE,
+};
+
+// Values with every byte distinct, so a swapped byte or word shows
+static uint64_t sample(int i, int words) {
+    uint64_t v = 0x0123456789ABCDEFULL * (uint64_t)(i + 1) ^ 0xF0E1D2C3B4A59687ULL;
+    return words == 4 ? v : v & ((1ULL << (16 * words)) - 1);
+}
+
+static void test_names(void) {
+    CHECK(parse_byte_order("LE") == ORDER_LE && parse_byte_order("CDAB") == ORDER_LE);
+    CHECK(parse_byte_order("BE") == ORDER_BE && parse_byte_order("ABCD") == ORDER_BE);
+    CHECK(parse_byte_order("SWAP") == ORDER_SWAP && parse_byte_order("DCBA") == ORDER_SWAP);
+    CHECK(parse_byte_order("BE_SWAP") == ORDER_BE_SWAP && parse_byte_order("BADC") == ORDER_BE_SWAP);
+    CHECK(parse_byte_order("be_swap") == ORDER_BE_SWAP && parse_byte_order("dcba") == ORDER_SWAP);
+    CHECK(parse_byte_order("") == ORDER_LE && parse_byte_order(NULL) == ORDER_LE);
+    CHECK(parse_byte_order("BEE") == ORDER_LE && parse_byte_order("BA") == ORDER_LE);
+
+    // Every name, so a slot spelled with the wrong characters shows
+    CHECK(parse_datatype("uint16") == DATATYPE_UINT16 && parse_datatype("int16") == DATATYPE_INT16);
+    CHECK(parse_datatype("uint32") == DATATYPE_UINT32 && parse_datatype("int32") == DATATYPE_INT32);
+    CHECK(parse_datatype("uint64") == DATATYPE_UINT64 && parse_datatype("int64") == DATATYPE_INT64);
+    CHECK(parse_datatype("float") == DATATYPE_FLOAT && parse_datatype("double") == DATATYPE_DOUBLE);
+    CHECK(parse_datatype("string") == DATATYPE_STRING && parse_datatype("bool") == DATATYPE_BOOL);
+    CHECK(parse_datatype("uint61") == DATATYPE_INVALID && parse_datatype("") == DATATYPE_INVALID);
+    CHECK(parse_datatype(NULL) == DATATYPE_INVALID);
+
+    CHECK(datatype_words(DATATYPE_INT16) == 1 && datatype_words(DATATYPE_FLOAT) == 2);
+    CHECK(datatype_words(DATATYPE_DOUBLE) == 4 && datatype_words(DATATYPE_STRING) == 0);
+}
+
+// 0xAABBCCDD as each order name spells it on the wire
+static void test_layout(void) {
+    static const struct { ByteOrder order; uint16_t regs[2]; } cases[] = {
+        {ORDER_LE, {0xCCDD, 0xAABB}},
+        {ORDER_BE, {0xAABB, 0xCCDD}},
+        {ORDER_SWAP, {0xDDCC, 0xBBAA}},
+        {ORDER_BE_SWAP, {0xBBAA, 0xDDCC}},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint64_t value = 0xAABBCCDD;
+        uint16_t regs[3] = {0, 0, 0x5555};
+        encode_registers(0, &value, 1, 2, cases[i].order, regs);
+        CHECK(regs[0] == cases[i].regs[0] && regs[1] == cases[i].regs[1]);
+        CHECK(regs[2] == 0x5555);
+
+        // The word-array writer lays values out the same way
+        uint16_t words[2] = {0xCCDD, 0xAABB};
+        uint16_t out[2] = {0, 0};
+        write_registers(0, words, 2, cases[i].order, out);
+        CHECK(out[0] == cases[i].regs[0] && out[1] == cases[i].regs[1]);
+    }
+
+    // Four words: only the word order and the bytes in each word change
+    uint64_t value = 0x1122334455667788ULL;
+    uint16_t regs[4];
+    encode_registers(0, &value, 1, 4, ORDER_BE, regs);
+    CHECK(regs[0] == 0x1122 && regs[1] == 0x3344 && regs[2] == 0x5566 && regs[3] == 0x7788);
+    encode_registers(0, &value, 1, 4, ORDER_SWAP, regs);
+    CHECK(regs[0] == 0x8877 && regs[1] == 0x6655 && regs[2] == 0x4433 && regs[3] == 0x2211);
+}
+
+static void test_round_trip(void) {
+    enum { COUNT = 37, OFFSET = 3 };
+    for (size_t t = 0; t < sizeof(NUMBER_TYPES) / sizeof(NUMBER_TYPES[0]); t++) {
+        int words = datatype_words(NUMBER_TYPES[t]);
+        for (int o = 0; o < NB_ORDERS; o++) {
+            uint64_t in[COUNT];
+            uint64_t out[COUNT];
+            uint16_t regs[OFFSET + COUNT * 4 + 1];
+            for (int i = 0; i < COUNT; i++) {
+                in[i] = sample(i, words);
+            }
+            memset(regs, 0xA5, sizeof(regs));
+            memset(out, 0, sizeof(out));
+            encode_registers(OFFSET, in, COUNT, words, ORDERS[o], regs);
+            decode_registers(OFFSET, out, COUNT, words, ORDERS[o], regs);
+            if (memcmp(in, out, sizeof(in)) != 0) {
+                fprintf(stderr, "round trip differs: datatype %d, order %d\n", (int)NUMBER_TYPES[t], o);
+                failures++;
+            }
+            // Nothing written outside the values
+            CHECK(regs[OFFSET - 1] == 0xA5A5 && regs[OFFSET + COUNT * words] == 0xA5A5);
+        }
+    }
+}
+
+static void test_strings(void) {
+    static const char *strings[] = {"", "A", "AB", "ABC", "pump 1 flow", "0123456789"};
+    for (size_t s = 0; s < sizeof(strings) / sizeof(strings[0]); s++) {
+        for (int o = 0; o < NB_ORDERS; o++) {
+            uint16_t regs[8];
+            char out[2 * 8 + 1];
+            memset(regs, 0xFF, sizeof(regs));
+            encode_string(1, strings[s], 6, ORDERS[o], regs);
+            CHECK(regs[0] == 0xFFFF && regs[7] == 0xFFFF);
+            CHECK(decode_string(1, out, 6, ORDERS[o], regs) == (int)strlen(strings[s]));
+            CHECK(strcmp(out, strings[s]) == 0);
+        }
+    }
+
+    // First character high, or low when swapped; padded with NULs
+    uint16_t regs[3];
+    encode_string(0, "ABC", 3, ORDER_BE, regs);
+    CHECK(regs[0] == 0x4142 && regs[1] == 0x4300 && regs[2] == 0);
+    encode_string(0, "ABC", 3, ORDER_BE_SWAP, regs);
+    CHECK(regs[0] == 0x4241 && regs[1] == 0x0043 && regs[2] == 0);
+
+    // Cut to the registers given
+    char out[2 * 2 + 1];
+    encode_string(0, "ABCDEFG", 2, ORDER_LE, regs);
+    CHECK(decode_string(0, out, 2, ORDER_LE, regs) == 4 && strcmp(out, "ABCD") == 0);
+}
+
+static void test_bits(void) {
+    for (int count = 1; count <= 35; count++) {
+        uint8_t bits[40];
+        uint8_t back[40];
+        uint8_t packed[5];
+        for (int i = 0; i < count; i++) {
+            bits[2 + i] = (uint8_t)((i * 7 + count) % 3 == 0);
+        }
+        memset(packed, 0xFF, sizeof(packed));
+        pack_bits(2, packed, count, bits);
+        if (count % 8 != 0) {
+            CHECK((packed[count / 8] >> (count % 8)) == 0);
+        }
+        memset(back, 0x55, sizeof(back));
+        unpack_bits(1, packed, count, back);
+        CHECK(memcmp(back + 1, bits + 2, (size_t)count) == 0);
+        CHECK(back[0] == 0x55 && back[1 + count] == 0x55);
+    }
+
+    // Modbus order: first bit in the lowest bit of the first byte
+    uint8_t bits[10] = {1, 0, 0, 0, 0, 0, 0, 1, 0, 1};
+    uint8_t packed[2];
+    pack_bits(0, packed, 10, bits);
+    CHECK(packed[0] == 0x81 && packed[1] == 0x02);
+}
+
+int main(void) {
+    test_names();
+    test_layout();
+    test_round_trip();
+    test_strings();
+    test_bits();
+
+    return check_report("byte order");
+}
@@ -0,0 +1,187 @@
+/*
+ * Scaling: rounding of each mode, clamping to the configured and datatype
+ * ranges, NaN input, and reading back what was written.
+ */
+#include "check.h"
+#include "utils/scaling.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// No limits beyond the datatype's
+#define UNBOUNDED -DBL_MAX, DBL_MAX
+
+static const Scaling PLAIN = {1.0, 0.0, UNBOUNDED, ROUND_NEAREST};
+static const Scaling HALF = {0.5, 10.0, UNBOUNDED, ROUND_NEAREST};
+static const Scaling PERCENT = {1.0, 0.0, 0.0, 100.0, ROUND_NEAREST};
+static const Scaling FLOOR = {1.0, 0.0, UNBOUNDED, ROUND_FLOOR};
+static const Scaling CEIL = {1.0, 0.0, UNBOUNDED, ROUND_CEIL};
+static const Scaling TRUNCATE = {1.0, 0.0, UNBOUNDED, ROUND_TRUNCATE};
+
+typedef struct {
+    const Scaling *scaling;
+    DataType type;
+    double value;
+    double expect;          // Register value, before it is cut to the datatype's bits
+} EncodeCase;
+
+static const EncodeCase ENCODE_CASES[] = {
+    // Half away from zero, on both sides
+    {&PLAIN, DATATYPE_INT16, 2.5, 3},
+    {&PLAIN, DATATYPE_INT16, -2.5, -3},
+    {&PLAIN, DATATYPE_INT16, 0.5, 1},
+    {&PLAIN, DATATYPE_INT16, -0.5, -1},
+    {&PLAIN, DATATYPE_INT16, 2.4999999, 2},
+    {&PLAIN, DATATYPE_INT16, -2.4999999, -2},
+    {&PLAIN, DATATYPE_INT32, -1000000.5, -1000001},
+    {&PLAIN, DATATYPE_INT64, 4503599627370495.5, 4503599627370496.0},
+    {&PLAIN, DATATYPE_UINT16, 2.5, 3},
+    {&PLAIN, DATATYPE_UINT16, -0.5, 0},
+
+    // The other modes
+    {&FLOOR, DATATYPE_INT16, 2.5, 2},
+    {&FLOOR, DATATYPE_INT16, -2.5, -3},
+    {&FLOOR, DATATYPE_INT16, -3.0, -3},
+    {&CEIL, DATATYPE_INT16, 2.5, 3},
+    {&CEIL, DATATYPE_INT16, -2.5, -2},
+    {&CEIL, DATATYPE_INT16, 3.0, 3},
+    {&TRUNCATE, DATATYPE_INT16, 2.9, 2},
+    {&TRUNCATE, DATATYPE_INT16, -2.9, -2},
+
+    // Scale and offset apply before rounding: (11.25 - 10) / 0.5 = 2.5
+    {&HALF, DATATYPE_INT16, 11.25, 3},
+    {&HALF, DATATYPE_INT16, 8.75, -3},
+    {&HALF, DATATYPE_FLOAT, 11.25, 2.5},
+
+    // Clamped to the datatype rather than wrapped
+    {&PLAIN, DATATYPE_UINT16, 70000, 65535},
+    {&PLAIN, DATATYPE_UINT16, -1, 0},
+    {&PLAIN, DATATYPE_INT16, 40000, 32767},
+    {&PLAIN, DATATYPE_INT16, -40000, -32768},
+    {&PLAIN, DATATYPE_UINT32, 1e12, 4294967295.0},
+    {&PLAIN, DATATYPE_INT32, -1e12, -2147483648.0},
+    {&PLAIN, DATATYPE_UINT64, 1e30, 18446744073709549568.0},
+    {&PLAIN, DATATYPE_INT64, -1e30, -9223372036854775808.0},
+    {&PLAIN, DATATYPE_FLOAT, 1e40, FLT_MAX},
+    {&PLAIN, DATATYPE_FLOAT, -1e40, -FLT_MAX},
+    {&PLAIN, DATATYPE_INT16, 32767.5, 32767},
+    {&PLAIN, DATATYPE_INT16, -32768.5, -32768},
+
+    // Clamped to the configured range first
+    {&PERCENT, DATATYPE_UINT16, 150, 100},
+    {&PERCENT, DATATYPE_UINT16, -5, 0},
+    {&PERCENT, DATATYPE_DOUBLE, 99.5, 99.5},
+
+    // NaN goes to the minimum, then to the datatype's range
+    {&PERCENT, DATATYPE_UINT16, NAN, 0},
+    {&PERCENT, DATATYPE_DOUBLE, NAN, 0},
+    {&PLAIN, DATATYPE_INT16, NAN, -32768},
+    {&PLAIN, DATATYPE_UINT32, NAN, 0},
+    {&PLAIN, DATATYPE_FLOAT, NAN, -FLT_MAX},
+};
+
+// Value bits as scaling_encode() leaves them for an expected register value
+static uint64_t raw_bits(DataType type, double v) {
+    union { float f; uint32_t u32; } fu;
+    union { double d; uint64_t u64; } du;
+    switch (type) {
+    case DATATYPE_FLOAT:
+        fu.f = (float)v;
+        return fu.u32;
+    case DATATYPE_DOUBLE:
+        du.d = v;
+        return du.u64;
+    case DATATYPE_UINT64:
+        return (uint64_t)v;
+    default:
+        return (uint64_t)(int64_t)v;
+    }
+}
+
+static void test_encode(void) {
+    for (size_t i = 0; i < sizeof(ENCODE_CASES) / sizeof(ENCODE_CASES[0]); i++) {
+        const EncodeCase *c = &ENCODE_CASES[i];
+        uint64_t raw = 0;
+        scaling_encode(c->scaling, &c->value, 1, c->type, &raw);
+        if (raw != raw_bits(c->type, c->expect)) {
+            fprintf(stderr, "encode case %d: %g as datatype %d gave 0x%llx, expected %g\n",
+                    (int)i, c->value, (int)c->type, (unsigned long long)raw, c->expect);
+            failures++;
+        }
+    }
+}
+
+// Register values read back as engineering values, sign extended from the datatype's bits
+static void test_decode(void) {
+    static const struct { const Scaling *scaling; DataType type; uint64_t raw; double expect; } cases[] = {
+        {&PLAIN, DATATYPE_UINT16, 0xFFFF, 65535},
+        {&PLAIN, DATATYPE_INT16, 0xFFFF, -1},
+        {&PLAIN, DATATYPE_INT16, 0xFFFFFFFFFFFF8000ULL, -32768},
+        {&PLAIN, DATATYPE_UINT32, 0xFFFFFFFF, 4294967295.0},
+        {&PLAIN, DATATYPE_INT32, 0x80000000, -2147483648.0},
+        {&PLAIN, DATATYPE_INT64, 0xFFFFFFFFFFFFFFFEULL, -2},
+        {&HALF, DATATYPE_INT16, 0xFFFD, 8.5},
+        {&HALF, DATATYPE_UINT16, 3, 11.5},
+        {&HALF, DATATYPE_FLOAT, 0x40200000, 11.25},         // 2.5f
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        double v = 0;
+        scaling_decode(cases[i].scaling, &cases[i].raw, 1, cases[i].type, &v);
+        if (v != cases[i].expect) {
+            fprintf(stderr, "decode case %d: gave %g, expected %g\n", (int)i, v, cases[i].expect);
+            failures++;
+        }
+    }
+}
+
+// Values on the register grid read back exactly, across several chunks
+static void test_inverse(void) {
+    static const DataType types[] = {
+        DATATYPE_INT16, DATATYPE_INT32, DATATYPE_INT64, DATATYPE_FLOAT, DATATYPE_DOUBLE,
+    };
+    enum { COUNT = 200 };
+    double values[COUNT];
+    double back[COUNT];
+    uint64_t raw[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        values[i] = HALF.offset + (i - COUNT / 2) * HALF.scale;
+    }
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        scaling_encode(&HALF, values, COUNT, types[t], raw);
+        // Only the datatype's bits reach the registers
+        int words = datatype_words(types[t]);
+        for (int i = 0; words < 4 && i < COUNT; i++) {
+            raw[i] &= (1ULL << (16 * words)) - 1;
+        }
+        scaling_decode(&HALF, raw, COUNT, types[t], back);
+        CHECK(memcmp(values, back, sizeof(values)) == 0);
+    }
+
+    // One call over many chunks matches one call per value
+    double mixed[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        mixed[i] = (i % 7 - 3) * 1.25 + (i % 2 ? 0.5 : -0.5);
+    }
+    scaling_encode(&PLAIN, mixed, COUNT, DATATYPE_INT16, raw);
+    for (int i = 0; i < COUNT; i++) {
+        uint64_t one = 0;
+        scaling_encode(&PLAIN, &mixed[i], 1, DATATYPE_INT16, &one);
+        CHECK(raw[i] == one);
+    }
+}
+
+static void test_round_names(void) {
+    CHECK(parse_round_mode("nearest") == ROUND_NEAREST && parse_round_mode("floor") == ROUND_FLOOR);
+    CHECK(parse_round_mode("ceil") == ROUND_CEIL && parse_round_mode("truncate") == ROUND_TRUNCATE);
+    CHECK(parse_round_mode("round") == -1 && parse_round_mode(NULL) == -1);
+}
+
+int main(void) {
+    test_encode();
+    test_decode();
+    test_inverse();
+    test_round_names();
+
+    return check_report("scaling");
+}